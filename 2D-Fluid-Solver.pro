@@ -3,4 +3,10 @@ include(config.pri)
 TEMPLATE = subdirs
 CONFIG  += ordered
 SUBDIRS  = tests \
-           main
+           main \
+           ensemble \
+           slabs \
+           stream \
+           capi \
+           daemon \
+           bench
@@ -0,0 +1,282 @@
+#include <sys/time.h>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "AutoTuner.h"
+#include "FieldMemory.h"
+#include "Grid.h"
+#include "Kernels.h"
+#include "StencilSmoother.h"
+#include "Vector2.h"
+
+// Microbenchmarks for the solver's inner kernels.  Each kernel is timed over
+// a fixed amount of work and reported in nanoseconds per item, so results
+// from different machines and builds can be compared directly.
+
+// Returns the current wall-clock time, in seconds.
+static double wallTime()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+// Returns a pseudo-random float in [0, 1), reproducible across runs.
+static float nextRandom(unsigned &seed)
+{
+  seed = seed * 1664525u + 1013904223u;
+  return (seed >> 8) * (1.0f / 16777216.0f);
+}
+
+// Prints a timing line.  The checksum keeps the compiler from discarding
+// the benchmarked work, and lets two variants be checked for agreement.
+static void report(const char *name, double seconds, double items,
+		   double checksum)
+{
+  printf("%-24s %8.2f ns/item   (checksum %g)\n",
+	 name, 1e9 * seconds / items, checksum);
+}
+
+// Forward Euler update of a particle array with a constant velocity array.
+static void benchVectorMath(unsigned count, unsigned reps)
+{
+  std::vector<Vector2> positions(count), velocities(count);
+  unsigned seed = 1;
+  for (unsigned i = 0; i < count; ++i)
+    velocities[i] = Vector2(nextRandom(seed) - 0.5f, nextRandom(seed) - 0.5f);
+
+  double start = wallTime();
+  for (unsigned r = 0; r < reps; ++r)
+    for (unsigned i = 0; i < count; ++i)
+      positions[i] += velocities[i] * 0.01f;
+  report("vector2 axpy", wallTime() - start, double(count) * reps,
+	 positions[count / 2].x);
+
+  positions.assign(count, Vector2());
+  const unsigned batched = count - count % Vector2x8::SIZE;
+  Vector2x8 p, v;
+  start = wallTime();
+  for (unsigned r = 0; r < reps; ++r) {
+    for (unsigned i = 0; i < batched; i += Vector2x8::SIZE) {
+      p.load(&positions[i]);
+      v.load(&velocities[i]);
+      p += v * 0.01f;
+      p.store(&positions[i]);
+    }
+    for (unsigned i = batched; i < count; ++i)
+      positions[i] += velocities[i] * 0.01f;
+  }
+  report("vector2x8 axpy", wallTime() - start, double(count) * reps,
+	 positions[count / 2].x);
+}
+
+// Samples grid velocity at random particle positions, as moveParticles does.
+static void benchVelocitySampling(unsigned size, unsigned count, unsigned reps)
+{
+  Grid grid(size, size);
+  unsigned seed = 2;
+  for (unsigned i = 0; i < grid.getCellCount(); ++i) {
+    grid[i].vel[Cell::X] = nextRandom(seed) - 0.5f;
+    grid[i].vel[Cell::Y] = nextRandom(seed) - 0.5f;
+  }
+  std::vector<Vector2> positions(count), velocities(count);
+  for (unsigned i = 0; i < count; ++i)
+    positions[i] = Vector2(nextRandom(seed) * size, nextRandom(seed) * size);
+
+  double start = wallTime();
+  for (unsigned r = 0; r < reps; ++r)
+    for (unsigned i = 0; i < count; ++i)
+      velocities[i] = grid.getVelocity(positions[i]);
+  report("sample velocity", wallTime() - start, double(count) * reps,
+	 velocities[count / 2].x);
+
+  velocities.assign(count, Vector2());
+  const unsigned batched = count - count % Vector2x8::SIZE;
+  Vector2x8 p, v;
+  start = wallTime();
+  for (unsigned r = 0; r < reps; ++r) {
+    for (unsigned i = 0; i < batched; i += Vector2x8::SIZE) {
+      p.load(&positions[i]);
+      grid.getVelocity(p, v);
+      v.store(&velocities[i]);
+    }
+    for (unsigned i = batched; i < count; ++i)
+      velocities[i] = grid.getVelocity(positions[i]);
+  }
+  report("sample velocity x8", wallTime() - start, double(count) * reps,
+	 velocities[count / 2].x);
+}
+
+// Times the dispatched kernels once per instruction set this CPU supports.
+static void benchKernels(unsigned size, unsigned count, unsigned reps)
+{
+  Grid grid(size, size);
+  unsigned seed = 3;
+  for (unsigned i = 0; i < grid.getCellCount(); ++i) {
+    grid[i].vel[Cell::X] = nextRandom(seed) - 0.5f;
+    grid[i].vel[Cell::Y] = nextRandom(seed) - 0.5f;
+  }
+  std::vector<Vector2> start(count);
+  std::vector<double> a(count), b(count);
+  for (unsigned i = 0; i < count; ++i) {
+    start[i] = Vector2(nextRandom(seed) * size, nextRandom(seed) * size);
+    a[i] = nextRandom(seed);
+    b[i] = nextRandom(seed);
+  }
+
+  for (unsigned s = 0; s < Kernels::ISA_COUNT; ++s) {
+    const Kernels::Isa isa = static_cast<Kernels::Isa>(s);
+    if (!Kernels::isSupported(isa))
+      continue;
+    const Kernels &kernels = Kernels::get(isa);
+    char name[64];
+
+    std::vector<Vector2> particles(start);
+    double begin = wallTime();
+    for (unsigned r = 0; r < reps; ++r)
+      kernels.advectParticles(grid, &particles[0], count, 1e-4f);
+    snprintf(name, sizeof(name), "advect (%s)", kernels.name);
+    report(name, wallTime() - begin, double(count) * reps,
+	   particles[count / 2].x);
+
+    double sum = 0.0;
+    begin = wallTime();
+    for (unsigned r = 0; r < reps * 10; ++r)
+      sum += kernels.dot(&a[0], &b[0], count);
+    snprintf(name, sizeof(name), "dot (%s)", kernels.name);
+    report(name, wallTime() - begin, double(count) * reps * 10, sum);
+  }
+}
+
+
+// Samples velocity at random positions in a grid far larger than the
+// caches, once with 4 KiB pages and once with huge pages, to show the cost
+// of TLB misses.
+static void benchPageSize(unsigned size, unsigned count, unsigned reps)
+{
+  for (unsigned huge = 0; huge < 2; ++huge) {
+    FieldMemory::setHugePages(huge);
+    Grid grid(size, size);
+    unsigned seed = 4;
+    for (unsigned i = 0; i < grid.getCellCount(); ++i)
+      grid[i].vel[Cell::X] = nextRandom(seed) - 0.5f;
+    std::vector<Vector2> positions(count);
+    for (unsigned i = 0; i < count; ++i)
+      positions[i] = Vector2(nextRandom(seed) * size, nextRandom(seed) * size);
+
+    double sum = 0.0;
+    double start = wallTime();
+    for (unsigned r = 0; r < reps; ++r)
+      for (unsigned i = 0; i < count; ++i)
+	sum += grid.getVelocity(positions[i]).x;
+    report(huge ? "sample large (2M pages)" : "sample large (4K pages)",
+	   wallTime() - start, double(count) * reps, sum);
+  }
+  FieldMemory::setHugePages(true);
+}
+
+
+// Smooths the pressure of a grid far larger than the caches, once a sweep
+// at a time and once with sweeps pipelined through cache-sized blocks, and
+// reports the time per cell per sweep and the blocked schedule's speedup.
+static void benchSmoothers(unsigned size, unsigned sweeps)
+{
+  Grid grid(size, size);
+  for (unsigned y = 0; y < grid.getRowCount() - 1; ++y)
+    for (unsigned x = 0; x < grid.getColCount() - 1; ++x)
+      grid.setCellType(x, y, y < size * 3 / 4 ? Cell::FLUID : Cell::AIR);
+  const unsigned cells = grid.getRowCount() * grid.getColCount();
+  std::vector<double> start(grid.getCellCount());
+  unsigned seed = 5;
+  for (unsigned i = 0; i < start.size(); ++i) {
+    grid.getDivergenceData()[i] = nextRandom(seed) - 0.5;
+    start[i] = nextRandom(seed);
+  }
+
+  const char *methodNames[2] = { "jacobi", "red-black" };
+  const StencilSmoother::Method methods[2] =
+    { StencilSmoother::JACOBI, StencilSmoother::RED_BLACK_SOR };
+  const unsigned depths[3] = { 2, 4, 8 };
+  for (unsigned m = 0; m < 2; ++m) {
+    StencilSmoother smoother(methods[m], 0.8);
+    char name[64];
+
+    // An untimed sweep sizes the naive schedule's second field.
+    smoother.setSchedule(StencilSmoother::NAIVE);
+    smoother.smooth(grid, 1.0f, 1);
+    std::copy(start.begin(), start.end(), grid.getPressureData());
+    double begin = wallTime();
+    smoother.smooth(grid, 1.0f, sweeps);
+    const double naive = wallTime() - begin;
+    snprintf(name, sizeof(name), "%s naive", methodNames[m]);
+    report(name, naive, double(cells) * sweeps, grid.getPressure(1, 1));
+
+    smoother.setSchedule(StencilSmoother::BLOCKED);
+    for (unsigned d = 0; d < 3; ++d) {
+      smoother.setBlockDepth(depths[d]);
+      std::copy(start.begin(), start.end(), grid.getPressureData());
+      begin = wallTime();
+      smoother.smooth(grid, 1.0f, sweeps);
+      const double blocked = wallTime() - begin;
+      snprintf(name, sizeof(name), "%s blocked x%u", methodNames[m],
+	       depths[d]);
+      report(name, blocked, double(cells) * sweeps, grid.getPressure(1, 1));
+      printf("%-24s %8.2fx speedup per sweep\n", "", naive / blocked);
+    }
+  }
+}
+
+
+// Recalibrates the solver settings for a grid size, printing every
+// candidate timed, and records the fastest in this machine's profile.
+static int tune(unsigned width, unsigned height)
+{
+  AutoTuner tuner;
+  const std::string profile = AutoTuner::getDefaultProfilePath();
+  tuner.load(profile);
+  AutoTuner::Settings best = tuner.calibrate(width, height);
+  for (unsigned i = 0; i < tuner.getTrials().size(); ++i) {
+    const AutoTuner::Settings &trial = tuner.getTrials()[i];
+    printf("threads %2u  kernels %-7s  preconditioner %-20s %8.3f ms/frame\n",
+	   trial.threads, Kernels::get(trial.kernels).name,
+	   trial.preconditioner == FluidSolver::DIAGONAL ?
+	   "diagonal" : "incomplete-cholesky", 1e3 * trial.frameSec);
+  }
+  tuner.store(width, height, best);
+  if (!tuner.save(profile)) {
+    fprintf(stderr, "Could not write %s\n", profile.c_str());
+    return 1;
+  }
+  printf("Fastest: %u threads, %s kernels, %s preconditioner; saved to %s\n",
+	 best.threads, Kernels::get(best.kernels).name,
+	 best.preconditioner == FluidSolver::DIAGONAL ?
+	 "diagonal" : "incomplete-cholesky", profile.c_str());
+  return 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+  if (argc == 4 && std::string(argv[1]) == "tune" &&
+      atoi(argv[2]) > 0 && atoi(argv[3]) > 0)
+    return tune(atoi(argv[2]), atoi(argv[3]));
+  if (argc > 2) {
+    fprintf(stderr, "Usage: %s [repetitions]\n"
+	    "       %s tune <width> <height>\n", argv[0], argv[0]);
+    return 1;
+  }
+  unsigned reps = argc == 2 ? atoi(argv[1]) : 20;
+  if (reps == 0)
+    reps = 1;
+
+  printf("Kernels: %s (widest supported: %s)\n", Kernels::get().name,
+	 Kernels::get(Kernels::getWidestSupported()).name);
+
+  benchVectorMath(1 << 16, reps * 10);
+  benchVelocitySampling(256, 1 << 16, reps);
+  benchKernels(256, 1 << 16, reps);
+  benchPageSize(2048, 1 << 16, reps);
+  benchSmoothers(2048, 8 * ((reps + 9) / 10));
+  return 0;
+}
@@ -0,0 +1,182 @@
+#include "FluidSolverC.h"
+#include <cstdio>
+#include <new>
+#include <sstream>
+#include <string>
+#include "FluidSolver.h"
+#include "SceneSpec.h"
+
+// Views of cell types hand out Cell::Type values as FLUID_INT32 elements.
+typedef char CellTypeIsInt32[sizeof(Cell::Type) == 4 ? 1 : -1];
+
+struct fluid_solver {
+  fluid_solver(float width, float height)
+    : solver(width, height)
+  {}
+
+  FluidSolver solver;
+};
+
+namespace {
+
+// Copies a message into a caller's buffer, if there is one.
+void reportError(const std::string &message, char *error, size_t errorSize)
+{
+  if (error && errorSize > 0)
+    snprintf(error, errorSize, "%s", message.c_str());
+}
+
+// Creates a solver for a parsed scene.  No exception may cross into C.
+fluid_solver * createFromScene(const SceneSpec &scene,
+			       char *error, size_t errorSize)
+{
+  try {
+    fluid_solver *solver = new fluid_solver(scene.getWidth(),
+					    scene.getHeight());
+    scene.apply(solver->solver);
+    return solver;
+  }
+  catch (const std::bad_alloc &) {
+    reportError("out of memory", error, errorSize);
+    return NULL;
+  }
+}
+
+// Fills a view of a grid's worth of elements, starting at data, spaced
+// colStride bytes apart.
+void gridView(const Grid &grid, const void *data, fluid_element type,
+	      ptrdiff_t colStride, fluid_view *view)
+{
+  view->data       = data;
+  view->type       = type;
+  view->cols       = grid.getColCount();
+  view->rows       = grid.getRowCount();
+  view->col_stride = colStride;
+  view->row_stride = colStride * grid.getRowStride();
+}
+
+} // namespace
+
+
+fluid_solver * fluid_solver_create(float width, float height)
+{
+  try {
+    return new fluid_solver(width, height);
+  }
+  catch (const std::bad_alloc &) {
+    return NULL;
+  }
+}
+
+
+fluid_solver * fluid_solver_load_scene(const char *path,
+				       char *error, size_t errorSize)
+{
+  SceneSpec scene;
+  if (!scene.parseFile(path)) {
+    reportError(scene.getError(), error, errorSize);
+    return NULL;
+  }
+  return createFromScene(scene, error, errorSize);
+}
+
+
+fluid_solver * fluid_solver_load_scene_text(const char *text,
+					    char *error, size_t errorSize)
+{
+  SceneSpec scene;
+  std::istringstream in(text);
+  if (!scene.parse(in)) {
+    reportError(scene.getError(), error, errorSize);
+    return NULL;
+  }
+  return createFromScene(scene, error, errorSize);
+}
+
+
+void fluid_solver_destroy(fluid_solver *solver)
+{
+  delete solver;
+}
+
+
+int fluid_solver_reset(fluid_solver *solver)
+{
+  try {
+    solver->solver.reset();
+    return 0;
+  }
+  catch (const std::bad_alloc &) {
+    return -1;
+  }
+}
+
+
+int fluid_solver_step(fluid_solver *solver, unsigned frames)
+{
+  try {
+    for (unsigned frame = 0; frame < frames; ++frame) {
+      solver->solver.advanceFrame();
+      solver->solver.consumeFrame();
+    }
+    return 0;
+  }
+  catch (const std::bad_alloc &) {
+    return -1;
+  }
+}
+
+
+float fluid_solver_get_width(const fluid_solver *solver)
+{
+  return solver->solver.getSimulationWidth();
+}
+
+
+float fluid_solver_get_height(const fluid_solver *solver)
+{
+  return solver->solver.getSimulationHeight();
+}
+
+
+size_t fluid_solver_get_particle_count(const fluid_solver *solver)
+{
+  return solver->solver.getParticles().size();
+}
+
+
+int fluid_solver_get_view(const fluid_solver *solver, fluid_field field,
+			  fluid_view *view)
+{
+  const Grid &grid = solver->solver.getGrid();
+  const Cell *cells = grid.getCellData();
+  const ParticleArray &particles = solver->solver.getParticles();
+  switch (field) {
+  case FLUID_FIELD_VELOCITY_X:
+    gridView(grid, &cells->vel[Cell::X], FLUID_FLOAT32, sizeof(Cell), view);
+    return 0;
+  case FLUID_FIELD_VELOCITY_Y:
+    gridView(grid, &cells->vel[Cell::Y], FLUID_FLOAT32, sizeof(Cell), view);
+    return 0;
+  case FLUID_FIELD_PRESSURE:
+    gridView(grid, grid.getPressureData(), FLUID_FLOAT64, sizeof(double),
+	     view);
+    return 0;
+  case FLUID_FIELD_CELL_TYPE:
+    gridView(grid, &cells->cellType, FLUID_INT32, sizeof(Cell), view);
+    return 0;
+  case FLUID_FIELD_PARTICLE_X:
+  case FLUID_FIELD_PARTICLE_Y:
+    // An empty vector has no element to point at.
+    view->data       = particles.empty() ? NULL :
+                       field == FLUID_FIELD_PARTICLE_X ? &particles[0].x
+                                                       : &particles[0].y;
+    view->type       = FLUID_FLOAT32;
+    view->cols       = particles.size();
+    view->rows       = 1;
+    view->col_stride = sizeof(Vector2);
+    view->row_stride = sizeof(Vector2) * particles.size();
+    return 0;
+  }
+  return -1;
+}
@@ -0,0 +1,104 @@
+#ifndef __FLUID_SOLVER_C_H__
+#define __FLUID_SOLVER_C_H__
+
+/* A C interface to the solver, for embedding simulations in host
+ * applications that can't use the C++ FluidSolver class.  A host creates a
+ * solver (directly, or from a scene description; see SceneSpec), steps it a
+ * frame at a time, and reads its fields in place through views: read-only
+ * pointers with the dimensions and byte strides needed to walk them, so no
+ * results are ever copied.
+ *
+ * A view stays valid until the solver is next stepped, reset or destroyed.
+ * No function here is safe to call on one solver from several threads at
+ * once; separate solvers are independent. */
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* An opaque solver instance. */
+typedef struct fluid_solver fluid_solver;
+
+/* The arrays a view can cover.  Grid fields span every cell, including the
+ * grid's extra top row and right column.  Velocities are MAC face values:
+ * a cell's X velocity lies on its left face and its Y velocity on its
+ * bottom face.  Pressure lies at cell centers.  Particle arrays are views
+ * with a single row, one column per particle. */
+typedef enum {
+  FLUID_FIELD_VELOCITY_X = 0,
+  FLUID_FIELD_VELOCITY_Y,
+  FLUID_FIELD_PRESSURE,
+  FLUID_FIELD_CELL_TYPE,
+  FLUID_FIELD_PARTICLE_X,
+  FLUID_FIELD_PARTICLE_Y
+} fluid_field;
+
+/* The type of each element of a view. */
+typedef enum {
+  FLUID_FLOAT32 = 0,
+  FLUID_FLOAT64,
+  FLUID_INT32
+} fluid_element;
+
+/* The values of FLUID_FIELD_CELL_TYPE elements. */
+typedef enum {
+  FLUID_CELL_AIR = 0,
+  FLUID_CELL_FLUID,
+  FLUID_CELL_SOLID
+} fluid_cell_type;
+
+/* A read-only view of one array.  Element (x, y) lies at
+ * (const char *)data + y * row_stride + x * col_stride. */
+typedef struct {
+  const void   *data;        /* The first element, (0, 0). */
+  fluid_element type;        /* The type of every element. */
+  size_t        cols;        /* Elements per row. */
+  size_t        rows;        /* Rows. */
+  ptrdiff_t     col_stride;  /* Bytes between neighboring elements. */
+  ptrdiff_t     row_stride;  /* Bytes between neighboring rows. */
+} fluid_view;
+
+/* Creates a solver of the given size, in world coordinates, with every
+ * setting at its default.  Returns NULL on failure. */
+fluid_solver * fluid_solver_create(float width, float height);
+
+/* Creates a solver from the scene description in a file, or in a string.
+ * Returns NULL on failure, writing a description of the problem into error
+ * (which may be NULL) as a string of at most error_size bytes. */
+fluid_solver * fluid_solver_load_scene(const char *path,
+                                       char *error, size_t error_size);
+fluid_solver * fluid_solver_load_scene_text(const char *text,
+                                            char *error, size_t error_size);
+
+/* Destroys a solver.  NULL is ignored. */
+void fluid_solver_destroy(fluid_solver *solver);
+
+/* Returns the solver to its starting state.  Returns 0 on success, or -1
+ * if memory ran out, after which the solver may only be reset again or
+ * destroyed. */
+int fluid_solver_reset(fluid_solver *solver);
+
+/* Simulates the given number of frames.  Returns 0 on success, or -1 if
+ * memory ran out partway, after which the solver may only be reset or
+ * destroyed. */
+int fluid_solver_step(fluid_solver *solver, unsigned frames);
+
+/* Returns the simulation's size, in world coordinates. */
+float fluid_solver_get_width(const fluid_solver *solver);
+float fluid_solver_get_height(const fluid_solver *solver);
+
+/* Returns the number of marker particles. */
+size_t fluid_solver_get_particle_count(const fluid_solver *solver);
+
+/* Fills a view of one of the solver's arrays.  Returns 0 on success, or -1
+ * if the field is unknown. */
+int fluid_solver_get_view(const fluid_solver *solver, fluid_field field,
+                          fluid_view *view);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FLUID_SOLVER_C_H__ */
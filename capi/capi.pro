@@ -0,0 +1,5 @@
+include(../sources.pri)
+
+TEMPLATE = lib
+TARGET   = fluidsolver
+CONFIG  += shared
@@ -1,3 +1,7 @@
 QT      += core gui opengl
 CONFIG  += warn_on debug_and_release
 CONFIG  -= app_bundle
+
+# Keep the compiler from fusing multiplies into adds.  The kernel sets and
+# the test references must round every operation alike on FMA hardware.
+unix:QMAKE_CXXFLAGS += -ffp-contract=off
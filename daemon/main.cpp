@@ -0,0 +1,46 @@
+#include <signal.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include "JobDaemon.h"
+
+// Set by SIGINT and SIGTERM to stop the daemon.
+static volatile sig_atomic_t stopRequested = 0;
+
+static void requestStop(int)
+{
+  stopRequested = 1;
+}
+
+
+int main(int argc, char *argv[])
+{
+  if (argc < 2 || argc > 3) {
+    fprintf(stderr, "Usage: %s <spool directory> [thread count]\n", argv[0]);
+    return 1;
+  }
+  int threads = argc == 3 ? atoi(argv[2]) : 0;
+
+  JobDaemon daemon(argv[1], threads > 0 ? threads : 0);
+  if (!daemon.start()) {
+    fprintf(stderr, "%s: %s\n", argv[1], daemon.getError().c_str());
+    return 1;
+  }
+  signal(SIGINT, requestStop);
+  signal(SIGTERM, requestStop);
+  printf("Running jobs from %s on %u threads...\n", argv[1],
+	 daemon.getThreadCount());
+
+  // Look for new jobs and holds twice a second.
+  while (!stopRequested) {
+    daemon.poll();
+    usleep(500000);
+  }
+
+  // Running jobs checkpoint, so the next daemon resumes them.
+  daemon.stop();
+  printf("Stopped: %u jobs completed, %u failed, %u suspensions.\n",
+	 daemon.getCompletedCount(), daemon.getFailedCount(),
+	 daemon.getSuspendedCount());
+  return 0;
+}
@@ -0,0 +1,42 @@
+#include <QTime>
+#include <cstdio>
+#include <cstdlib>
+#include "SweepSpec.h"
+#include "EnsembleRunner.h"
+#include "Kernels.h"
+
+
+int main(int argc, char *argv[])
+{
+  if (argc < 2 || argc > 3) {
+    fprintf(stderr, "Usage: %s <sweep file> [thread count]\n", argv[0]);
+    return 1;
+  }
+
+  // Read the sweep description.
+  SweepSpec spec;
+  if (!spec.parseFile(argv[1])) {
+    fprintf(stderr, "%s: %s\n", argv[1], spec.getError().c_str());
+    return 1;
+  }
+  int threads = argc == 3 ? atoi(argv[2]) : 0;
+
+  // Run every variant, reporting overall throughput.
+  EnsembleRunner runner(spec, threads);
+  printf("Running %u simulations on %d threads with %s kernels...\n",
+	 spec.getVariantCount(), runner.getThreadCount(),
+	 Kernels::get().name);
+  QTime timer;
+  timer.start();
+  unsigned failures = runner.run();
+  double seconds = timer.elapsed() / 1000.0;
+  printf("Completed in %.2f s (%.2f simulations/s)\n", seconds,
+	 seconds > 0.0 ? spec.getVariantCount() / seconds : 0.0);
+
+  if (failures) {
+    fprintf(stderr, "%u simulations failed to write their output.\n",
+	    failures);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,341 @@
+#include "AutoTuner.h"
+#include <errno.h>
+#include <omp.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include "FieldMemory.h"
+
+using std::string;
+using std::vector;
+
+namespace {
+
+// The names of the preconditioners in profiles.
+const char *PRECONDITIONER_NAMES[FluidSolver::PRECONDITIONER_COUNT] =
+  { "diagonal", "incomplete-cholesky" };
+
+// Returns the time on a clock that never jumps, in seconds.
+double monotonicTime()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// Returns the name of this machine.
+string hostName()
+{
+  char name[256];
+  if (gethostname(name, sizeof(name)) != 0)
+    return "localhost";
+  name[sizeof(name) - 1] = '\0';
+  return name;
+}
+
+// Looks up a kernel set by name.
+bool toKernels(const string &name, Kernels::Isa &isa)
+{
+  for (unsigned i = 0; i < Kernels::ISA_COUNT; ++i)
+    if (name == Kernels::get(Kernels::Isa(i)).name) {
+      isa = Kernels::Isa(i);
+      return true;
+    }
+  return false;
+}
+
+// Looks up a preconditioner by name.
+bool toPreconditioner(const string &name,
+		      FluidSolver::Preconditioner &preconditioner)
+{
+  for (unsigned i = 0; i < FluidSolver::PRECONDITIONER_COUNT; ++i)
+    if (name == PRECONDITIONER_NAMES[i]) {
+      preconditioner = FluidSolver::Preconditioner(i);
+      return true;
+    }
+  return false;
+}
+
+// Determines whether two candidates are the same combination of settings.
+bool sameSettings(const AutoTuner::Settings &a, const AutoTuner::Settings &b)
+{
+  return a.threads == b.threads && a.kernels == b.kernels &&
+         a.preconditioner == b.preconditioner;
+}
+
+} // namespace
+
+
+AutoTuner::Settings::Settings()
+  : threads(omp_get_max_threads()),
+    kernels(Kernels::get().isa),
+    preconditioner(FluidSolver::DIAGONAL),
+    frameSec(0.0)
+{}
+
+
+AutoTuner::AutoTuner()
+  : _frames(3),
+    _entries(),
+    _trials(),
+    _error()
+{}
+
+
+void AutoTuner::setFrames(unsigned frames)
+{
+  _frames = frames > 0 ? frames : 1;
+}
+
+
+AutoTuner::Settings AutoTuner::calibrate(unsigned width, unsigned height)
+{
+  const Settings saved;
+  _trials.clear();
+  Settings best = measure(width, height, saved);
+
+  // Thread counts double up to the processor count, which is always tried.
+  const unsigned processors = omp_get_num_procs();
+  for (unsigned threads = 1; ; threads *= 2) {
+    Settings candidate = best;
+    candidate.threads = threads < processors ? threads : processors;
+    consider(width, height, candidate, best);
+    if (threads >= processors)
+      break;
+  }
+
+  for (unsigned i = 0; i < FluidSolver::PRECONDITIONER_COUNT; ++i) {
+    Settings candidate = best;
+    candidate.preconditioner = FluidSolver::Preconditioner(i);
+    consider(width, height, candidate, best);
+  }
+
+  // An explicitly requested kernel set is kept.
+  const char *requested = getenv("FLUID_SOLVER_KERNELS");
+  if (!requested || !*requested)
+    for (unsigned i = 0; i < Kernels::ISA_COUNT; ++i)
+      if (Kernels::isSupported(Kernels::Isa(i))) {
+	Settings candidate = best;
+	candidate.kernels = Kernels::Isa(i);
+	consider(width, height, candidate, best);
+      }
+
+  apply(saved);
+  return best;
+}
+
+
+const vector<AutoTuner::Settings> & AutoTuner::getTrials() const
+{
+  return _trials;
+}
+
+
+bool AutoTuner::find(unsigned width, unsigned height,
+		     Settings &settings) const
+{
+  for (unsigned i = 0; i < _entries.size(); ++i)
+    if (_entries[i].width == width && _entries[i].height == height) {
+      settings = _entries[i].settings;
+      return true;
+    }
+  return false;
+}
+
+
+void AutoTuner::store(unsigned width, unsigned height,
+		      const Settings &settings)
+{
+  for (unsigned i = 0; i < _entries.size(); ++i)
+    if (_entries[i].width == width && _entries[i].height == height) {
+      _entries[i].settings = settings;
+      return;
+    }
+  Entry entry;
+  entry.width = width;
+  entry.height = height;
+  entry.settings = settings;
+  _entries.push_back(entry);
+}
+
+
+bool AutoTuner::load(const string &path)
+{
+  std::ifstream in(path.c_str());
+  if (!in) {
+    _error = "cannot open " + path;
+    return false;
+  }
+
+  vector<Entry> entries;
+  string line;
+  unsigned lineNumber = 0;
+  while (std::getline(in, line)) {
+    ++lineNumber;
+
+    // Strip comments, then read the grid size and its settings.
+    string::size_type comment = line.find('#');
+    if (comment != string::npos)
+      line.erase(comment);
+    std::istringstream tokens(line);
+    string key, size;
+    if (!(tokens >> key))
+      continue;
+
+    Entry entry;
+    char sep = 0, extra = 0;
+    bool valid = key == "grid" && (tokens >> size) &&
+      sscanf(size.c_str(), "%u%c%u%c", &entry.width, &sep, &entry.height,
+	     &extra) == 3 && sep == 'x';
+    bool hasThreads = false, hasKernels = false, hasPreconditioner = false;
+    string name, value;
+    while (valid && (tokens >> name)) {
+      if (!(tokens >> value)) {
+	valid = false;
+	break;
+      }
+      std::istringstream number(value);
+      if (name == "threads")
+	valid = hasThreads = (number >> entry.settings.threads) &&
+	  number.eof() && entry.settings.threads > 0;
+      else if (name == "kernels")
+	valid = hasKernels = toKernels(value, entry.settings.kernels) &&
+	  Kernels::isSupported(entry.settings.kernels);
+      else if (name == "preconditioner")
+	valid = hasPreconditioner =
+	  toPreconditioner(value, entry.settings.preconditioner);
+      else if (name == "frame")
+	valid = (number >> entry.settings.frameSec) && number.eof();
+      else
+	valid = false;
+    }
+
+    if (!valid || !hasThreads || !hasKernels || !hasPreconditioner) {
+      std::ostringstream msg;
+      msg << path << ": line " << lineNumber << ": invalid settings";
+      _error = msg.str();
+      return false;
+    }
+    entries.push_back(entry);
+  }
+
+  _entries.swap(entries);
+  _error.clear();
+  return true;
+}
+
+
+bool AutoTuner::save(const string &path) const
+{
+  const string temporary = path + ".part";
+  {
+    std::ofstream out(temporary.c_str());
+    out << "# Solver settings measured fastest on " << hostName() << ".\n";
+    for (unsigned i = 0; i < _entries.size(); ++i) {
+      const Settings &settings = _entries[i].settings;
+      out << "grid " << _entries[i].width << 'x' << _entries[i].height
+	  << " threads " << settings.threads
+	  << " kernels " << Kernels::get(settings.kernels).name
+	  << " preconditioner "
+	  << PRECONDITIONER_NAMES[settings.preconditioner]
+	  << " frame " << settings.frameSec << '\n';
+    }
+    out.flush();
+    if (!out) {
+      unlink(temporary.c_str());
+      return false;
+    }
+  }
+  return rename(temporary.c_str(), path.c_str()) == 0;
+}
+
+
+bool AutoTuner::tune(const string &path, unsigned width, unsigned height,
+		     Settings &settings)
+{
+  if (!load(path))
+    _entries.clear();
+  if (find(width, height, settings))
+    return true;
+
+  settings = calibrate(width, height);
+  store(width, height, settings);
+  return save(path);
+}
+
+
+void AutoTuner::apply(const Settings &settings)
+{
+  // Eigen follows OpenMP's thread count unless told otherwise.  New fields
+  // are first touched by as many threads, so their pages start out on the
+  // nodes of the threads that sweep them.
+  omp_set_num_threads(settings.threads);
+  FieldMemory::setFirstTouchThreads(settings.threads);
+  Kernels::select(settings.kernels);
+}
+
+
+void AutoTuner::apply(const Settings &settings, FluidSolver &solver)
+{
+  apply(settings);
+  solver.setPreconditioner(settings.preconditioner);
+}
+
+
+string AutoTuner::getDefaultProfilePath()
+{
+  const char *profile = getenv("FLUID_SOLVER_PROFILE");
+  if (profile && *profile)
+    return profile;
+
+  const char *home = getenv("HOME");
+  string directory = string(home && *home ? home : ".") + "/.fluid-solver";
+  if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST)
+    directory = ".";
+  return directory + "/" + hostName() + ".profile";
+}
+
+
+const string & AutoTuner::getError() const
+{
+  return _error;
+}
+
+
+AutoTuner::Settings AutoTuner::measure(unsigned width, unsigned height,
+				       Settings settings)
+{
+  // The thread count applies from construction on, since the grid's pages
+  // are first touched by the threads that will work on them.
+  apply(settings);
+  FluidSolver solver(width, height);
+  solver.setPreconditioner(settings.preconditioner);
+
+  // An untimed frame sizes the solver's workspace and warms the caches.
+  solver.advanceFrame();
+  solver.consumeFrame();
+  const double start = monotonicTime();
+  for (unsigned frame = 0; frame < _frames; ++frame) {
+    solver.advanceFrame();
+    solver.consumeFrame();
+  }
+  settings.frameSec = (monotonicTime() - start) / _frames;
+  _trials.push_back(settings);
+  return settings;
+}
+
+
+void AutoTuner::consider(unsigned width, unsigned height,
+			 const Settings &candidate, Settings &best)
+{
+  for (unsigned i = 0; i < _trials.size(); ++i)
+    if (sameSettings(_trials[i], candidate))
+      return;
+  Settings measured = measure(width, height, candidate);
+  if (measured.frameSec < best.frameSec)
+    best = measured;
+}
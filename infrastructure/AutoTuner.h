@@ -0,0 +1,184 @@
+#ifndef __AUTO_TUNER_H__
+#define __AUTO_TUNER_H__
+
+#include <string>
+#include <vector>
+#include "FluidSolver.h"
+#include "Kernels.h"
+
+// Picks the solver settings that run fastest on this machine, by timing a
+// few frames of a dam break at the grid size of interest under each
+// candidate, and caches the choice in a per-machine profile file so later
+// runs start with it at once.
+//
+// The tuned settings are the OpenMP thread count, the kernel instruction
+// set and the preconditioner of the pressure and viscosity solves.  Each is
+// searched in turn with the others held at their best so far, which takes
+// a handful of trials rather than one per combination.  Kernel sets give
+// bit-identical results, so they are only searched for speed; they are
+// left alone when FLUID_SOLVER_KERNELS asks for a particular set.
+//
+// A profile holds one line per grid size:
+//
+//   # Comments start with '#'.
+//   grid 64x64 threads 8 kernels avx2 preconditioner diagonal frame 0.0123
+//
+// where frame is the measured time per frame, in seconds.
+class AutoTuner {
+public:
+  // A combination of solver settings, and how fast it ran.
+  struct Settings {
+    unsigned     threads;         // OpenMP threads.
+    Kernels::Isa kernels;         // Kernel instruction set.
+    FluidSolver::Preconditioner preconditioner; // Pressure/viscosity CG.
+    double       frameSec;        // Measured seconds per frame.
+
+    // Constructs the settings the process currently runs with.
+    Settings();
+  };
+
+  // Constructs a tuner with an empty profile.
+  //
+  // Arguments:
+  //   None
+  AutoTuner();
+
+  // Sets the number of frames timed per candidate.  More frames give
+  // steadier measurements at the cost of a longer calibration.
+  //
+  // Arguments:
+  //   unsigned frames - The frames timed, after one untimed warm-up frame.
+  //
+  // Returns:
+  //   None
+  void setFrames(unsigned frames);
+
+  // Times the candidate settings on a grid of the given size.  The process's
+  // thread count and kernels are restored afterwards.
+  //
+  // Arguments:
+  //   unsigned width - The width of the simulation, in cells.
+  //   unsigned height - The height of the simulation, in cells.
+  //
+  // Returns:
+  //   Settings - The fastest settings measured.
+  Settings calibrate(unsigned width, unsigned height);
+
+  // Returns every candidate timed by the last call to calibrate(), in the
+  // order they were tried.
+  const std::vector<Settings> & getTrials() const;
+
+  // Looks up the settings recorded for a grid size.
+  //
+  // Arguments:
+  //   unsigned width - The width of the simulation, in cells.
+  //   unsigned height - The height of the simulation, in cells.
+  //   Settings &settings - Receives the settings, if there are any.
+  //
+  // Returns:
+  //   bool - True if the profile has settings for the size.
+  bool find(unsigned width, unsigned height, Settings &settings) const;
+
+  // Records the settings for a grid size, replacing any already recorded.
+  //
+  // Arguments:
+  //   unsigned width - The width of the simulation, in cells.
+  //   unsigned height - The height of the simulation, in cells.
+  //   Settings &settings - The settings.
+  //
+  // Returns:
+  //   None
+  void store(unsigned width, unsigned height, const Settings &settings);
+
+  // Replaces the profile with one read from a file.
+  //
+  // Arguments:
+  //   std::string &path - The path of the profile.
+  //
+  // Returns:
+  //   bool - True on success.  On failure, getError() describes the problem
+  //     and the profile is left unchanged.
+  bool load(const std::string &path);
+
+  // Writes the profile to a file, under a temporary name first, so that a
+  // profile shared by concurrent runs is never seen half written.
+  //
+  // Arguments:
+  //   std::string &path - The path of the profile.
+  //
+  // Returns:
+  //   bool - True on success.
+  bool save(const std::string &path) const;
+
+  // Gets the settings for a grid size from a profile file, calibrating and
+  // recording them in the file if it has none.  A missing or unreadable
+  // profile is started afresh.
+  //
+  // Arguments:
+  //   std::string &path - The path of the profile.
+  //   unsigned width - The width of the simulation, in cells.
+  //   unsigned height - The height of the simulation, in cells.
+  //   Settings &settings - Receives the settings.
+  //
+  // Returns:
+  //   bool - False if newly calibrated settings couldn't be saved; the
+  //     settings are still valid.
+  bool tune(const std::string &path, unsigned width, unsigned height,
+	    Settings &settings);
+
+  // Makes the calling thread's solvers run with the settings: sets its
+  // OpenMP thread count and the FieldMemory first-touch thread count, and
+  // selects the kernels for the process.  Solvers created afterwards get
+  // fields placed for that many threads.
+  //
+  // Arguments:
+  //   Settings &settings - The settings.
+  //
+  // Returns:
+  //   None
+  static void apply(const Settings &settings);
+
+  // As above, and sets the preconditioner of a solver.
+  //
+  // Arguments:
+  //   Settings &settings - The settings.
+  //   FluidSolver &solver - The solver.
+  //
+  // Returns:
+  //   None
+  static void apply(const Settings &settings, FluidSolver &solver);
+
+  // Returns the profile of this machine: the FLUID_SOLVER_PROFILE
+  // environment variable if it is set, otherwise
+  // ~/.fluid-solver/<hostname>.profile, so that home directories shared
+  // between node types keep a profile per node.  The directory is created
+  // if it is missing.
+  static std::string getDefaultProfilePath();
+
+  // Returns a description of the last load failure.
+  const std::string & getError() const;
+
+private:
+  // The settings recorded for a grid size.
+  struct Entry {
+    unsigned width;
+    unsigned height;
+    Settings settings;
+  };
+
+  // Times the settings on a freshly reset solver, recording the trial.
+  // Returns the settings with their frame time filled in.
+  Settings measure(unsigned width, unsigned height, Settings settings);
+
+  // Measures a candidate unless it was already tried, keeping it as the
+  // best if it ran faster.
+  void consider(unsigned width, unsigned height, const Settings &candidate,
+		Settings &best);
+
+  unsigned              _frames;  // Frames timed per candidate.
+  std::vector<Entry>    _entries; // The profile, one entry per grid size.
+  std::vector<Settings> _trials;  // Candidates timed by calibrate().
+  std::string           _error;   // Description of the last load failure.
+};
+
+#endif // __AUTO_TUNER_H__
@@ -0,0 +1,234 @@
+#include "EnsembleRunner.h"
+#include <QAtomicInt>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QThread>
+#include <errno.h>
+#include <sys/stat.h>
+#include <cstdio>
+#include <cstring>
+#include <omp.h>
+#include "FluidSolver.h"
+#include "Vector2.h"
+#include "VtkExporter.h"
+
+#ifdef Q_OS_LINUX
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using std::vector;
+
+namespace {
+
+// The cores simulations may be pinned to: those in the process's affinity
+// mask at startup, so that a taskset or cgroup restriction is honored.
+// Each core is claimed by at most one running simulation at a time.
+class CoreSet {
+public:
+  CoreSet()
+  {
+#ifdef Q_OS_LINUX
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+      for (int core = CPU_SETSIZE - 1; core >= 0; --core)
+	if (CPU_ISSET(core, &set))
+	  _free.push_back(core);
+    }
+#endif
+  }
+
+  // Claims a free core, returning -1 if every core is taken.
+  int claim()
+  {
+    QMutexLocker lock(&_mutex);
+    if (_free.empty())
+      return -1;
+    const int core = _free.back();
+    _free.pop_back();
+    return core;
+  }
+
+  // Returns a claimed core to the set.
+  void release(int core)
+  {
+    if (core < 0)
+      return;
+    QMutexLocker lock(&_mutex);
+    _free.push_back(core);
+  }
+
+private:
+  QMutex      _mutex;  // Guards _free.
+  vector<int> _free;   // Cores no simulation is pinned to, lowest last.
+};
+
+// The calling thread's affinity before it was pinned.
+struct Affinity {
+#ifdef Q_OS_LINUX
+  cpu_set_t set;
+#endif
+  bool      saved;
+};
+
+// Pins the calling thread to a single core, saving its previous affinity.
+// Silently does nothing where thread affinity isn't supported, or for a
+// negative core.
+void pinToCore(int core, Affinity &original)
+{
+  original.saved = false;
+#ifdef Q_OS_LINUX
+  if (core < 0 || pthread_getaffinity_np(pthread_self(), sizeof(original.set),
+					 &original.set) != 0)
+    return;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(core, &set);
+  original.saved =
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+  (void)core;
+#endif
+}
+
+// Restores the affinity the calling thread had before pinToCore().
+void unpin(const Affinity &original)
+{
+#ifdef Q_OS_LINUX
+  if (original.saved)
+    pthread_setaffinity_np(pthread_self(), sizeof(original.set),
+			   &original.set);
+#else
+  (void)original;
+#endif
+}
+
+// A single simulation scheduled on the runner's thread pool.
+class SimulationJob : public QRunnable {
+public:
+  SimulationJob(const SweepSpec::Variant &variant, CoreSet *cores,
+		QAtomicInt *failures)
+    : _variant(variant), _cores(cores), _failures(failures) {}
+
+  virtual void run()
+  {
+    // Claim a core no other running simulation holds, whichever worker
+    // this job landed on, and give it back when done.
+    const int core = _cores->claim();
+    Affinity original;
+    pinToCore(core, original);
+    // The runner already fills the cores with simulations, and this one's
+    // core can't host a team of its own: run its parallel regions (the
+    // extrapolation, force and resampling loops, and Eigen's solves) on
+    // this thread alone.
+    omp_set_num_threads(1);
+    if (!EnsembleRunner::runVariant(_variant))
+      _failures->ref();
+    unpin(original);
+    _cores->release(core);
+  }
+
+private:
+  SweepSpec::Variant _variant;
+  CoreSet           *_cores;
+  QAtomicInt        *_failures;
+};
+
+} // namespace
+
+
+EnsembleRunner::EnsembleRunner(const SweepSpec &spec, int threadCount)
+  : _variants(spec.getVariants()),
+    _outputDir(spec.getOutputDirectory()),
+    _pool()
+{
+  if (threadCount <= 0)
+    threadCount = QThread::idealThreadCount();
+  if (threadCount <= 0)
+    threadCount = 1;
+  _pool.setMaxThreadCount(threadCount);
+}
+
+
+EnsembleRunner::~EnsembleRunner()
+{
+  _pool.waitForDone();
+}
+
+
+unsigned EnsembleRunner::run()
+{
+  // Every variant writes into the output directory, so without it all of
+  // them would fail alike.
+  if (mkdir(_outputDir.c_str(), 0755) != 0 && errno != EEXIST) {
+    fprintf(stderr, "%s: %s\n", _outputDir.c_str(), strerror(errno));
+    return _variants.size();
+  }
+
+  // Running simulations claim cores from a shared set, so that they land
+  // on distinct cores however the variants finish.
+  QAtomicInt failures(0);
+  CoreSet cores;
+  for (unsigned i = 0; i < _variants.size(); ++i) {
+    _pool.start(new SimulationJob(_variants[i], &cores, &failures));
+  }
+  _pool.waitForDone();
+
+  return static_cast<int>(failures);
+}
+
+
+int EnsembleRunner::getThreadCount() const
+{
+  return _pool.maxThreadCount();
+}
+
+
+bool EnsembleRunner::runVariant(const SweepSpec::Variant &variant)
+{
+  FILE *out = fopen(variant.output.c_str(), "w");
+  if (!out)
+    return false;
+
+  // Give each output a large private buffer so frames are written with few,
+  // large writes rather than contending on small ones.
+  setvbuf(out, NULL, _IOFBF, 1 << 20);
+  fprintf(out, "# gravity %g resolution %gx%g fill %g frames %u\n",
+	  variant.gravity, variant.width, variant.height,
+	  variant.fill, variant.frames);
+
+  FluidSolver solver(variant.width, variant.height);
+  solver.setGravity(Vector2(0.0f, variant.gravity));
+  solver.setInitialFill(variant.fill);
+  solver.reset();
+
+  // Fields are exported on the exporter's own thread.  Every due frame is
+  // wanted, so the simulation waits if the disk falls behind.
+  VtkExporter exporter;
+  exporter.setDropFrames(false);
+  if (variant.vtkInterval && !exporter.open(variant.vtkOutput,
+					    variant.vtkInterval)) {
+    fclose(out);
+    return false;
+  }
+
+  for (unsigned frame = 0; frame < variant.frames; ++frame) {
+    solver.advanceFrame();
+    solver.consumeFrame();
+    exporter.publish(solver);
+
+    // Stream this frame's particle positions.
+    const ParticleArray &particles = solver.getParticles();
+    fprintf(out, "frame %u %u\n", frame, (unsigned)particles.size());
+    ParticleArray::const_iterator itr = particles.begin();
+    for (; itr != particles.end(); ++itr)
+      fprintf(out, "%g %g\n", itr->x, itr->y);
+  }
+
+  exporter.close();
+  bool ok = !ferror(out) && exporter.getFailedCount() == 0;
+  ok = (fclose(out) == 0) && ok;
+  return ok;
+}
@@ -0,0 +1,75 @@
+#ifndef __ENSEMBLE_RUNNER_H__
+#define __ENSEMBLE_RUNNER_H__
+
+#include <QThreadPool>
+#include <string>
+#include <vector>
+#include "SweepSpec.h"
+
+// Runs every variant of a SweepSpec as an independent FluidSolver instance.
+// Variants are scheduled on a pool of worker threads, one simulation per
+// thread at a time, and each simulation streams its frames into its own
+// output file.  Simulations share no mutable state, so throughput scales
+// with the number of cores given to the runner.  Each simulation runs
+// single-threaded, its OpenMP regions included, since the runner already
+// fills the cores.
+//
+// On Linux each simulation pins its worker thread to a core no other running
+// simulation holds for the duration of the run, so that a simulation's grid
+// stays in one core's cache, then restores the thread's affinity.  Only the
+// cores the process may run on are used; simulations beyond those run
+// unpinned.
+class EnsembleRunner {
+public:
+  // Constructs a runner for the provided sweep.
+  //
+  // Arguments:
+  //   SweepSpec &spec - The sweep to simulate.
+  //   int threadCount - Number of simulations to run concurrently.  A value
+  //                     of 0 uses one thread per available core.
+  EnsembleRunner(const SweepSpec &spec, int threadCount = 0);
+
+  // Destructs the runner, waiting for any outstanding simulations.
+  ~EnsembleRunner();
+
+  // Simulates every variant in the sweep, blocking until all are complete.
+  // Creates the output directory first; if that fails, the reason is
+  // printed and no variant runs.
+  //
+  // Arguments:
+  //   None
+  //
+  // Returns:
+  //   unsigned - The number of variants whose output could not be written.
+  unsigned run();
+
+  // Returns the number of simulations run concurrently.
+  //
+  // Arguments:
+  //   None
+  //
+  // Returns:
+  //   int - The size of the worker thread pool.
+  int getThreadCount() const;
+
+  // Simulates a single variant on the calling thread, streaming each frame's
+  // particle positions into the variant's output file.
+  //
+  // Arguments:
+  //   SweepSpec::Variant &variant - The simulation to run.
+  //
+  // Returns:
+  //   bool - True if the output was written successfully.
+  static bool runVariant(const SweepSpec::Variant &variant);
+
+private:
+  std::vector<SweepSpec::Variant> _variants; // Simulations to run.
+  std::string                     _outputDir; // Receives their output.
+  QThreadPool                     _pool;     // Workers running simulations.
+
+  // Hidden copy constructor and assignment; the pool cannot be copied.
+  EnsembleRunner(const EnsembleRunner &);
+  EnsembleRunner & operator=(const EnsembleRunner &);
+};
+
+#endif // __ENSEMBLE_RUNNER_H__
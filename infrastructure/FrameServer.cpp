@@ -0,0 +1,394 @@
+#include "FrameServer.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include "FluidSolver.h"
+
+using std::string;
+using std::vector;
+
+const unsigned FrameServer::MAX_BUFFERS;
+
+namespace {
+
+// Returns a monotonic time, in seconds.
+double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Makes a descriptor non-blocking.
+bool setNonBlocking(int fd)
+{
+  const int flags = fcntl(fd, F_GETFL, 0);
+  return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+} // namespace
+
+
+FrameServer::FrameServer()
+  : _listenFd(-1),
+    _unixPath(),
+    _port(0),
+    _thread(),
+    _running(false),
+    _stop(0),
+    _downsample(4),
+    _interval(0.0),
+    _frame(0),
+    _clientCount(0),
+    _buffers(),
+    _latest(NULL),
+    _current(NULL),
+    _clients()
+{
+  _wakeFds[0] = _wakeFds[1] = -1;
+}
+
+
+FrameServer::~FrameServer()
+{
+  close();
+  for (unsigned i = 0; i < _buffers.size(); ++i)
+    delete _buffers[i];
+}
+
+
+bool FrameServer::listenUnix(const string &path)
+{
+  struct sockaddr_un address;
+  if (isOpen() || path.size() >= sizeof(address.sun_path))
+    return false;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, path.c_str());
+
+  unlink(path.c_str());
+  const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (!start(fd, &address, sizeof(address)))
+    return false;
+  _unixPath = path;
+  return true;
+}
+
+
+bool FrameServer::listenTcp(unsigned short port)
+{
+  if (isOpen())
+    return false;
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(port);
+
+  const int fd = socket(AF_INET, SOCK_STREAM, 0);
+  const int reuse = 1;
+  if (fd >= 0)
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  if (!start(fd, &address, sizeof(address)))
+    return false;
+
+  socklen_t length = sizeof(address);
+  getsockname(_listenFd, reinterpret_cast<struct sockaddr *>(&address),
+	      &length);
+  _port = ntohs(address.sin_port);
+  return true;
+}
+
+
+bool FrameServer::start(int fd, const void *address, unsigned length)
+{
+  if (fd < 0)
+    return false;
+  if (bind(fd, static_cast<const struct sockaddr *>(address), length) != 0 ||
+      listen(fd, 16) != 0 || !setNonBlocking(fd) || pipe(_wakeFds) != 0) {
+    ::close(fd);
+    return false;
+  }
+  setNonBlocking(_wakeFds[0]);
+  setNonBlocking(_wakeFds[1]);
+  _listenFd = fd;
+
+  _stop = 0;
+  if (pthread_create(&_thread, NULL, serveThread, this) != 0) {
+    ::close(_wakeFds[0]);
+    ::close(_wakeFds[1]);
+    ::close(_listenFd);
+    _wakeFds[0] = _wakeFds[1] = _listenFd = -1;
+    return false;
+  }
+  _running = true;
+  return true;
+}
+
+
+void FrameServer::close()
+{
+  if (!_running)
+    return;
+
+  // Stop the thread, which disconnects the viewers on its way out.
+  __atomic_store_n(&_stop, 1, __ATOMIC_RELEASE);
+  const char wake = 0;
+  if (write(_wakeFds[1], &wake, 1) < 0) {
+    // The pipe is full, so the thread is being woken already.
+  }
+  pthread_join(_thread, NULL);
+  _running = false;
+
+  ::close(_wakeFds[0]);
+  ::close(_wakeFds[1]);
+  ::close(_listenFd);
+  _wakeFds[0] = _wakeFds[1] = _listenFd = -1;
+  if (!_unixPath.empty())
+    unlink(_unixPath.c_str());
+  _unixPath.clear();
+  _port = 0;
+
+  if (_latest)
+    release(_latest);
+  _latest = NULL;
+}
+
+
+bool FrameServer::isOpen() const
+{
+  return _running;
+}
+
+
+unsigned short FrameServer::getPort() const
+{
+  return _port;
+}
+
+
+unsigned FrameServer::getClientCount() const
+{
+  return __atomic_load_n(&_clientCount, __ATOMIC_RELAXED);
+}
+
+
+void FrameServer::setDownsample(unsigned cells)
+{
+  _downsample = cells > 0 ? cells : 1;
+}
+
+
+void FrameServer::setMaxFrameRate(float framesPerSecond)
+{
+  _interval = framesPerSecond > 0.0f ? 1.0 / framesPerSecond : 0.0;
+}
+
+
+bool FrameServer::publish(const FluidSolver &solver)
+{
+  if (!_running || getClientCount() == 0)
+    return false;
+
+  // Find a buffer no one references any more.  The acquire pairs with the
+  // server thread's release, so its sends from the buffer are finished.
+  Buffer *buffer = NULL;
+  for (unsigned i = 0; i < _buffers.size() && !buffer; ++i)
+    if (__atomic_load_n(&_buffers[i]->references, __ATOMIC_ACQUIRE) == 0)
+      buffer = _buffers[i];
+  if (!buffer) {
+    if (_buffers.size() == MAX_BUFFERS)
+      return false;
+    buffer = new Buffer;
+    buffer->references = 0;
+    _buffers.push_back(buffer);
+  }
+
+  // Encode the frame, then swap it in as the latest.  A latest frame the
+  // server thread never took is simply replaced.
+  buffer->snapshot.encode(solver.getGrid(), solver.getParticles(),
+			  _frame++, _downsample);
+  buffer->references = 1;
+  Buffer *previous = __atomic_exchange_n(&_latest, buffer, __ATOMIC_ACQ_REL);
+  if (previous)
+    release(previous);
+
+  const char wake = 0;
+  if (write(_wakeFds[1], &wake, 1) < 0) {
+    // The pipe is full, so the thread will wake anyway.
+  }
+  return true;
+}
+
+
+void * FrameServer::serveThread(void *server)
+{
+  static_cast<FrameServer *>(server)->serve();
+  return NULL;
+}
+
+
+void FrameServer::serve()
+{
+  vector<struct pollfd> fds;
+  while (!__atomic_load_n(&_stop, __ATOMIC_ACQUIRE)) {
+    // Wait for a new frame, a viewer, or sockets ready to write.  When a
+    // viewer is only waiting out its rate limit, wake in time for it.
+    fds.resize(2 + _clients.size());
+    fds[0].fd = _wakeFds[0];
+    fds[1].fd = _listenFd;
+    fds[0].events = fds[1].events = POLLIN;
+    const double start = now();
+    double timeout = -1.0;
+    for (unsigned i = 0; i < _clients.size(); ++i) {
+      const Client &client = _clients[i];
+      fds[2 + i].fd = client.fd;
+      fds[2 + i].events = POLLIN | (client.sending ? POLLOUT : 0);
+      if (!client.sending && _current &&
+	  client.lastFrame != _current->snapshot.getHeader().frame) {
+	const double due = client.lastStart + client.interval - start;
+	if (timeout < 0.0 || due < timeout)
+	  timeout = due > 0.0 ? due : 0.0;
+      }
+    }
+    poll(&fds[0], fds.size(),
+	 timeout < 0.0 ? -1 : int(timeout * 1000.0) + 1);
+
+    if (fds[0].revents & POLLIN) {
+      char drain[64];
+      while (read(_wakeFds[0], drain, sizeof(drain)) > 0) {}
+    }
+
+    // Take the newest frame, if one was published.
+    Buffer *latest = __atomic_exchange_n(&_latest, (Buffer *)NULL,
+					 __ATOMIC_ACQ_REL);
+    if (latest) {
+      if (_current)
+	release(_current);
+      _current = latest;
+    }
+
+    if (fds[1].revents & POLLIN)
+      acceptClients();
+
+    // Serve every viewer, dropping those that disconnected.  Viewers
+    // accepted just now have no poll entry yet; their requests are read
+    // next time around.
+    const double time = now();
+    unsigned polled = fds.size() - 2;
+    for (unsigned i = 0; i < _clients.size(); ) {
+      Client &client = _clients[i];
+      const bool readable = i < polled && (fds[2 + i].revents & POLLIN);
+      if ((readable && !readRequests(client)) || !sendTo(client, time)) {
+	if (client.sending)
+	  release(client.sending);
+	::close(client.fd);
+	_clients.erase(_clients.begin() + i);
+	if (i < polled) {
+	  fds.erase(fds.begin() + 2 + i);
+	  --polled;
+	}
+      }
+      else
+	++i;
+    }
+    __atomic_store_n(&_clientCount, _clients.size(), __ATOMIC_RELAXED);
+  }
+
+  // Disconnect everyone on the way out.
+  for (unsigned i = 0; i < _clients.size(); ++i) {
+    if (_clients[i].sending)
+      release(_clients[i].sending);
+    ::close(_clients[i].fd);
+  }
+  _clients.clear();
+  __atomic_store_n(&_clientCount, 0u, __ATOMIC_RELAXED);
+  if (_current)
+    release(_current);
+  _current = NULL;
+}
+
+
+void FrameServer::acceptClients()
+{
+  for (;;) {
+    const int fd = accept(_listenFd, NULL, NULL);
+    if (fd < 0)
+      return;
+    if (!setNonBlocking(fd)) {
+      ::close(fd);
+      continue;
+    }
+    Client client;
+    client.fd        = fd;
+    client.sending   = NULL;
+    client.offset    = 0;
+    client.lastFrame = _current ? _current->snapshot.getHeader().frame - 1
+                                : ~0u;
+    client.lastStart = 0.0;
+    client.interval  = _interval;
+    _clients.push_back(client);
+  }
+}
+
+
+bool FrameServer::readRequests(Client &client)
+{
+  unsigned char requests[64];
+  for (;;) {
+    const ssize_t count = recv(client.fd, requests, sizeof(requests), 0);
+    if (count == 0)
+      return false;
+    if (count < 0)
+      return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+
+    // The last request wins, but never beats the server's own limit.
+    const unsigned rate = requests[count - 1];
+    client.interval = rate ? std::max(_interval, 1.0 / rate) : _interval;
+  }
+}
+
+
+bool FrameServer::sendTo(Client &client, double time)
+{
+  // Start the newest frame once the viewer has finished its last one and
+  // its rate allows.  Frames published in between are skipped.
+  if (!client.sending && _current &&
+      client.lastFrame != _current->snapshot.getHeader().frame &&
+      time >= client.lastStart + client.interval) {
+    __atomic_add_fetch(&_current->references, 1, __ATOMIC_RELAXED);
+    client.sending = _current;
+    client.offset = 0;
+    client.lastFrame = _current->snapshot.getHeader().frame;
+    client.lastStart = time;
+  }
+  if (!client.sending)
+    return true;
+
+  // Send straight from the shared snapshot, as much as the socket takes.
+  const FrameSnapshot &snapshot = client.sending->snapshot;
+  while (client.offset < snapshot.getSize()) {
+    const ssize_t count = send(client.fd, snapshot.getData() + client.offset,
+			       snapshot.getSize() - client.offset,
+			       MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (count < 0)
+      return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    client.offset += count;
+  }
+  release(client.sending);
+  client.sending = NULL;
+  return true;
+}
+
+
+void FrameServer::release(Buffer *buffer)
+{
+  __atomic_sub_fetch(&buffer->references, 1, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,161 @@
+#ifndef __FRAME_SERVER_H__
+#define __FRAME_SERVER_H__
+
+#include <pthread.h>
+#include <string>
+#include <vector>
+#include "FrameSnapshot.h"
+
+class FluidSolver;
+
+// Streams snapshots of a running simulation (see FrameSnapshot) over a Unix
+// or TCP socket to any number of viewers, so that simulations on farm nodes
+// can be watched without running the GUI there.  Viewers connect, then
+// receive one complete snapshot after another; a viewer may send a single
+// byte at any time to cap its own rate, in frames per second (0 lifts its
+// cap back to the server's).
+//
+// The solver's thread only encodes each frame into a free snapshot buffer
+// and hands it over with an atomic exchange.  A server thread does all the
+// socket work, sending to every viewer straight from the shared buffers
+// without copying.  Viewers that fall behind skip to the newest frame when
+// they finish the one they are on, so a slow viewer never blocks
+// publish(), nor holds back the others.
+class FrameServer {
+public:
+  // Constructs a closed server.
+  //
+  // Arguments:
+  //   None
+  FrameServer();
+
+  // Closes the server, disconnecting every viewer.
+  ~FrameServer();
+
+  // Starts listening on a Unix socket at the given path, replacing any
+  // stale socket left there.
+  //
+  // Arguments:
+  //   std::string &path - The path of the socket.
+  //
+  // Returns:
+  //   bool - True on success.
+  bool listenUnix(const std::string &path);
+
+  // Starts listening on a TCP port on every interface.
+  //
+  // Arguments:
+  //   unsigned short port - The port, or 0 for any free port.
+  //
+  // Returns:
+  //   bool - True on success.
+  bool listenTcp(unsigned short port);
+
+  // Stops listening and disconnects every viewer, removing the Unix socket
+  // if one was created.
+  //
+  // Arguments:
+  //   None
+  //
+  // Returns:
+  //   None
+  void close();
+
+  // Returns whether the server is listening.
+  bool isOpen() const;
+
+  // Returns the TCP port being listened on, or 0 for a Unix socket.
+  unsigned short getPort() const;
+
+  // Returns the number of connected viewers.
+  unsigned getClientCount() const;
+
+  // Sets the number of cells per field block, along each axis, in the
+  // snapshots sent from now on.  Defaults to 4.
+  void setDownsample(unsigned cells);
+
+  // Sets the most frames per second sent to any one viewer.  0, the
+  // default, sends every published frame a viewer can keep up with.  Call
+  // before listening.
+  void setMaxFrameRate(float framesPerSecond);
+
+  // Publishes the solver's current frame to every viewer.  Never blocks on
+  // the viewers: the frame is encoded into a free snapshot buffer and
+  // queued.  Nothing is encoded while no viewer is connected.
+  //
+  // Arguments:
+  //   FluidSolver &solver - The simulation.
+  //
+  // Returns:
+  //   bool - True if the frame was queued, false if it was dropped because
+  //     no viewer is connected or every buffer is still being sent.
+  bool publish(const FluidSolver &solver);
+
+private:
+  // A snapshot buffer with the number of references to it: the latest
+  // frame slot, the server thread's current frame and each viewer sending
+  // it hold one each.  Only the publishing thread reuses a buffer, once
+  // its count has dropped to zero.
+  struct Buffer {
+    FrameSnapshot snapshot;
+    int           references;
+  };
+
+  // A connected viewer.
+  struct Client {
+    int      fd;          // The viewer's socket.
+    Buffer  *sending;     // The snapshot being sent, or NULL.
+    unsigned offset;      // Bytes of it already sent.
+    unsigned lastFrame;   // Sequence number of the last snapshot started.
+    double   lastStart;   // When that snapshot was started, in seconds.
+    double   interval;    // Seconds between frames the viewer asked for.
+  };
+
+  // The most buffers allocated; beyond this, publish() drops frames.
+  static const unsigned MAX_BUFFERS = 16;
+
+  // Binds the listening socket to the address, then starts the thread.
+  bool start(int fd, const void *address, unsigned length);
+
+  // The server thread's loop, and its pthread entry point.
+  void serve();
+  static void * serveThread(void *server);
+
+  // Accepts every pending viewer.
+  void acceptClients();
+
+  // Reads a viewer's rate requests.  Returns false if it disconnected.
+  bool readRequests(Client &client);
+
+  // Starts the next snapshot for a viewer if it is due, and sends as much
+  // as the socket accepts.  Returns false if the viewer is gone.
+  bool sendTo(Client &client, double now);
+
+  // Drops a reference to a buffer.
+  static void release(Buffer *buffer);
+
+  // Not copyable.
+  FrameServer(const FrameServer &);
+  FrameServer & operator=(const FrameServer &);
+
+  int              _listenFd;     // The listening socket, or -1.
+  int              _wakeFds[2];   // Pipe that wakes the server thread.
+  std::string      _unixPath;     // The Unix socket to remove on close.
+  unsigned short   _port;         // The TCP port, or 0.
+  pthread_t        _thread;       // The server thread.
+  bool             _running;      // True while the thread runs.
+  int              _stop;         // Set to make the thread exit.
+  unsigned         _downsample;   // Cells per field block.
+  double           _interval;     // Least seconds between frames per viewer.
+  unsigned         _frame;        // Sequence number of the next frame.
+  unsigned         _clientCount;  // Connected viewers, for publish().
+
+  std::vector<Buffer *> _buffers; // Every buffer; owned by publish().
+  Buffer          *_latest;       // Newest frame not yet taken, or NULL.
+
+  // Owned by the server thread.
+  Buffer          *_current;      // Newest frame taken from _latest.
+  std::vector<Client> _clients;   // Connected viewers.
+};
+
+#endif // __FRAME_SERVER_H__
@@ -0,0 +1,138 @@
+#include "FrameSnapshot.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+const uint32_t FrameSnapshot::MAGIC;
+const uint16_t FrameSnapshot::VERSION;
+
+namespace {
+
+// Quantizes a coordinate in [0, extent] to 16 bits.
+inline uint16_t quantize(float value, float extent)
+{
+  const float scaled = value / extent * 65535.0f + 0.5f;
+  return scaled <= 0.0f ? 0 : scaled >= 65535.0f ? 65535 : uint16_t(scaled);
+}
+
+} // namespace
+
+
+FrameSnapshot::FrameSnapshot()
+  : _data(),
+    _centers()
+{}
+
+
+void FrameSnapshot::encode(const Grid &grid, const ParticleArray &particles,
+			   unsigned frame, unsigned downsample)
+{
+  if (downsample == 0)
+    downsample = 1;
+  const unsigned width  = grid.getWidth();
+  const unsigned height = grid.getHeight();
+  const unsigned cols   = (width  + downsample - 1) / downsample;
+  const unsigned rows   = (height + downsample - 1) / downsample;
+  const unsigned blocks = cols * rows;
+  const unsigned size   = sizeof(Header) + 4 * particles.size() + 3 * blocks;
+  _data.resize(size);
+
+  Header header;
+  header.magic         = MAGIC;
+  header.version       = VERSION;
+  header.downsample    = downsample;
+  header.frame         = frame;
+  header.size          = size;
+  header.width         = width;
+  header.height        = height;
+  header.particleCount = particles.size();
+  header.fieldCols     = cols;
+  header.fieldRows     = rows;
+  header.velocityScale = 0.0f;
+
+  char *data = &_data[0];
+  uint16_t *quantized = reinterpret_cast<uint16_t *>(data + sizeof(Header));
+  for (unsigned i = 0; i < particles.size(); ++i) {
+    quantized[2 * i]     = quantize(particles[i].x, header.width);
+    quantized[2 * i + 1] = quantize(particles[i].y, header.height);
+  }
+
+  // Sample each block's fluid fraction and center velocity.  Velocities are
+  // staged until the largest component, which sets the scale, is known.
+  uint8_t *fluid = reinterpret_cast<uint8_t *>(quantized +
+					       2 * particles.size());
+  int8_t *velocities = reinterpret_cast<int8_t *>(fluid + blocks);
+  std::vector<Vector2> &centers = _centers;
+  centers.resize(blocks);
+  const CellMask &mask = grid.getCellMask();
+  for (unsigned by = 0; by < rows; ++by)
+    for (unsigned bx = 0; bx < cols; ++bx) {
+      const unsigned x0 = bx * downsample;
+      const unsigned y0 = by * downsample;
+      const unsigned x1 = std::min(x0 + downsample, width);
+      const unsigned y1 = std::min(y0 + downsample, height);
+      unsigned count = 0;
+      for (unsigned y = y0; y < y1; ++y)
+	for (unsigned x = x0; x < x1; ++x)
+	  count += mask.isFluid(x, y);
+      const unsigned block = by * cols + bx;
+      fluid[block] = (255 * count + (x1 - x0) * (y1 - y0) / 2) /
+	((x1 - x0) * (y1 - y0));
+      centers[block] = grid.getVelocity(Vector2(0.5f * (x0 + x1),
+						0.5f * (y0 + y1)));
+      header.velocityScale = std::max(header.velocityScale,
+				      std::max(std::fabs(centers[block].x),
+					       std::fabs(centers[block].y)));
+    }
+  if (header.velocityScale == 0.0f)
+    header.velocityScale = 1.0f;
+  const float toByte = 127.0f / header.velocityScale;
+  for (unsigned block = 0; block < blocks; ++block) {
+    const Vector2 &v = centers[block];
+    velocities[2 * block]     = int8_t(floorf(v.x * toByte + 0.5f));
+    velocities[2 * block + 1] = int8_t(floorf(v.y * toByte + 0.5f));
+  }
+
+  memcpy(data, &header, sizeof(Header));
+}
+
+
+const char * FrameSnapshot::getData() const
+{
+  return _data.empty() ? NULL : &_data[0];
+}
+
+
+unsigned FrameSnapshot::getSize() const
+{
+  return _data.size();
+}
+
+
+const FrameSnapshot::Header & FrameSnapshot::getHeader() const
+{
+  return *reinterpret_cast<const Header *>(&_data[0]);
+}
+
+
+const uint16_t * FrameSnapshot::getParticles(const char *data)
+{
+  return reinterpret_cast<const uint16_t *>(data + sizeof(Header));
+}
+
+
+const uint8_t * FrameSnapshot::getFluid(const char *data)
+{
+  const Header *header = reinterpret_cast<const Header *>(data);
+  return reinterpret_cast<const uint8_t *>(getParticles(data) +
+					   2 * header->particleCount);
+}
+
+
+const int8_t * FrameSnapshot::getVelocities(const char *data)
+{
+  const Header *header = reinterpret_cast<const Header *>(data);
+  return reinterpret_cast<const int8_t *>(getFluid(data) +
+					  header->fieldCols *
+					  header->fieldRows);
+}
@@ -0,0 +1,91 @@
+#ifndef __FRAME_SNAPSHOT_H__
+#define __FRAME_SNAPSHOT_H__
+
+#include <stdint.h>
+#include <vector>
+#include "Grid.h"
+
+// A compact, self-contained image of one simulation frame, laid out exactly
+// as it is sent to remote viewers (see FrameServer), so that it can be
+// written to a socket straight from this buffer.  All values are in the
+// host's byte order.  The layout is:
+//
+//   Header
+//   uint16_t particles[2 * particleCount]  x, y pairs, quantized over the
+//                                          width and height: 0 is 0.0 and
+//                                          65535 is the far edge.
+//   uint8_t  fluid[fieldCols * fieldRows]  Fraction of FLUID cells in each
+//                                          block, 255 being all fluid.
+//   int8_t   velocity[2 * fieldCols * fieldRows]  x, y velocity at each
+//                                          block's center, where 127 is
+//                                          velocityScale cells/sec.
+//
+// Fields are downsampled to blocks of getDownsample() x getDownsample()
+// cells, stored row by row from the bottom.
+class FrameSnapshot {
+public:
+  // Leading block of every snapshot.
+  struct Header {
+    uint32_t magic;          // MAGIC.
+    uint16_t version;        // VERSION.
+    uint16_t downsample;     // Cells per field block, along each axis.
+    uint32_t frame;          // Sequence number of the frame.
+    uint32_t size;           // Bytes in the snapshot, header included.
+    float    width;          // Simulation width, in world coordinates.
+    float    height;         // Simulation height, in world coordinates.
+    uint32_t particleCount;  // Number of particles.
+    uint16_t fieldCols;      // Field blocks along X.
+    uint16_t fieldRows;      // Field blocks along Y.
+    float    velocityScale;  // Velocity represented by 127, in cells/sec.
+  };
+
+  // Identifies a snapshot: "FLSN" when read as bytes on little-endian hosts.
+  static const uint32_t MAGIC = 0x4e534c46;
+
+  // The layout version described above.
+  static const uint16_t VERSION = 1;
+
+  // Constructs an empty snapshot.
+  //
+  // Arguments:
+  //   None
+  FrameSnapshot();
+
+  // Encodes a frame into this snapshot, reusing its storage.
+  //
+  // Arguments:
+  //   Grid &grid - The simulation's grid.
+  //   ParticleArray &particles - The simulation's marker particles.
+  //   unsigned frame - Sequence number of the frame.
+  //   unsigned downsample - Cells per field block, along each axis.
+  //
+  // Returns:
+  //   None
+  void encode(const Grid &grid, const ParticleArray &particles,
+	      unsigned frame, unsigned downsample);
+
+  // Returns the encoded bytes, and how many there are.
+  const char * getData() const;
+  unsigned getSize() const;
+
+  // Returns the header of the encoded snapshot.
+  const Header & getHeader() const;
+
+  // Locate the sections of an encoded snapshot, such as one received by a
+  // viewer.  The data must hold a complete snapshot.
+  //
+  // Arguments:
+  //   char *data - The start of the snapshot.
+  //
+  // Returns:
+  //   The start of the section.
+  static const uint16_t * getParticles(const char *data);
+  static const uint8_t * getFluid(const char *data);
+  static const int8_t * getVelocities(const char *data);
+
+private:
+  std::vector<char> _data;        // The encoded snapshot.
+  std::vector<Vector2> _centers;  // Block velocities, before quantizing.
+};
+
+#endif // __FRAME_SNAPSHOT_H__
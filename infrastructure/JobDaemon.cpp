@@ -0,0 +1,474 @@
+#include "JobDaemon.h"
+#include <dirent.h>
+#include <errno.h>
+#include <omp.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include "FluidSolver.h"
+
+using std::string;
+using std::vector;
+
+namespace {
+
+// The subdirectories of the spool directory.
+const char *ACTIVE_DIR = "active";
+const char *DONE_DIR   = "done";
+const char *FAILED_DIR = "failed";
+
+// Creates a directory unless it exists.
+bool makeDirectory(const string &path)
+{
+  return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+}
+
+// Records why a job failed.
+void writeError(const string &path, const string &error)
+{
+  std::ofstream out(path.c_str());
+  out << error << '\n';
+}
+
+// Lists the jobs in a directory by name, without their ".job" extension,
+// in alphabetical order.  Hidden files are skipped, so that jobs can be
+// written under a hidden name and renamed into place once complete.
+vector<string> listJobs(const string &directory)
+{
+  static const string extension = ".job";
+  vector<string> names;
+  DIR *dir = opendir(directory.c_str());
+  if (!dir)
+    return names;
+  while (struct dirent *entry = readdir(dir)) {
+    const string name = entry->d_name;
+    if (name[0] != '.' && name.size() > extension.size() &&
+	name.compare(name.size() - extension.size(), extension.size(),
+		     extension) == 0)
+      names.push_back(name.substr(0, name.size() - extension.size()));
+  }
+  closedir(dir);
+  std::sort(names.begin(), names.end());
+  return names;
+}
+
+} // namespace
+
+
+JobDaemon::JobDaemon(const string &spool, unsigned threadCount)
+  : _spool(spool),
+    _threadCount(threadCount),
+    _checkpointInterval(50),
+    _threads(),
+    _sequence(0),
+    _error(),
+    _stop(false),
+    _jobs(),
+    _completed(0),
+    _failed(0),
+    _suspended(0)
+{
+  if (_threadCount == 0) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    _threadCount = cores > 0 ? cores : 1;
+  }
+  pthread_mutex_init(&_mutex, NULL);
+  pthread_cond_init(&_ready, NULL);
+}
+
+
+JobDaemon::~JobDaemon()
+{
+  stop();
+  for (unsigned i = 0; i < _jobs.size(); ++i)
+    delete _jobs[i];
+  pthread_cond_destroy(&_ready);
+  pthread_mutex_destroy(&_mutex);
+}
+
+
+void JobDaemon::setCheckpointInterval(unsigned frames)
+{
+  _checkpointInterval = frames;
+}
+
+
+bool JobDaemon::start()
+{
+  if (!_threads.empty())
+    return true;
+  if (!makeDirectory(_spool) || !makeDirectory(getPath(ACTIVE_DIR, "", "")) ||
+      !makeDirectory(getPath(DONE_DIR, "", "")) ||
+      !makeDirectory(getPath(FAILED_DIR, "", ""))) {
+    _error = "unable to create the spool directories in " + _spool;
+    return false;
+  }
+
+  // Resume whatever a previous daemon left unfinished.
+  takeJobs(ACTIVE_DIR);
+
+  _stop = false;
+  _completed = _failed = _suspended = 0;
+  for (unsigned i = 0; i < _threadCount; ++i) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, workThread, this) != 0) {
+      stop();
+      _error = "unable to start the workers";
+      return false;
+    }
+    _threads.push_back(thread);
+  }
+  poll();
+  return true;
+}
+
+
+void JobDaemon::poll()
+{
+  takeJobs("");
+
+  pthread_mutex_lock(&_mutex);
+  vector<Job *> ranked;
+  for (unsigned i = 0; i < _jobs.size(); ++i) {
+    Job *job = _jobs[i];
+    const string hold = getPath(ACTIVE_DIR, job->name, ".hold");
+    job->held = access(hold.c_str(), F_OK) == 0;
+    if (job->held)
+      job->suspend = job->running;
+    else
+      ranked.push_back(job);
+  }
+
+  // The best ranked jobs should hold the workers.  A running job ranked
+  // below them has one waiting that outranks it, and no idle worker to run
+  // that one, so it yields.
+  std::sort(ranked.begin(), ranked.end(), outranks);
+  for (unsigned i = _threadCount; i < ranked.size(); ++i)
+    if (ranked[i]->running)
+      ranked[i]->suspend = true;
+  pthread_cond_broadcast(&_ready);
+  pthread_mutex_unlock(&_mutex);
+}
+
+
+void JobDaemon::stop()
+{
+  if (_threads.empty())
+    return;
+
+  pthread_mutex_lock(&_mutex);
+  _stop = true;
+  for (unsigned i = 0; i < _jobs.size(); ++i)
+    _jobs[i]->suspend = _jobs[i]->running;
+  pthread_cond_broadcast(&_ready);
+  pthread_mutex_unlock(&_mutex);
+  for (unsigned i = 0; i < _threads.size(); ++i)
+    pthread_join(_threads[i], NULL);
+  _threads.clear();
+}
+
+
+bool JobDaemon::isIdle() const
+{
+  pthread_mutex_lock(&_mutex);
+  bool idle = true;
+  for (unsigned i = 0; i < _jobs.size(); ++i)
+    idle = idle && _jobs[i]->held && !_jobs[i]->running;
+  pthread_mutex_unlock(&_mutex);
+  return idle;
+}
+
+
+unsigned JobDaemon::getThreadCount() const
+{
+  return _threadCount;
+}
+
+
+unsigned JobDaemon::getCompletedCount() const
+{
+  pthread_mutex_lock(&_mutex);
+  unsigned count = _completed;
+  pthread_mutex_unlock(&_mutex);
+  return count;
+}
+
+
+unsigned JobDaemon::getFailedCount() const
+{
+  pthread_mutex_lock(&_mutex);
+  unsigned count = _failed;
+  pthread_mutex_unlock(&_mutex);
+  return count;
+}
+
+
+unsigned JobDaemon::getSuspendedCount() const
+{
+  pthread_mutex_lock(&_mutex);
+  unsigned count = _suspended;
+  pthread_mutex_unlock(&_mutex);
+  return count;
+}
+
+
+const string & JobDaemon::getError() const
+{
+  return _error;
+}
+
+
+void JobDaemon::work()
+{
+  // Jobs fill the node one per core, so each solver runs single-threaded.
+  omp_set_num_threads(1);
+
+  pthread_mutex_lock(&_mutex);
+  for (;;) {
+    Job *job = NULL;
+    while (!_stop && !(job = nextJob()))
+      pthread_cond_wait(&_ready, &_mutex);
+    if (_stop)
+      break;
+    job->running = true;
+    job->suspend = false;
+    pthread_mutex_unlock(&_mutex);
+
+    string error;
+    const Outcome outcome = runJob(*job, error);
+    if (outcome != SUSPENDED)
+      finishJob(*job, outcome == COMPLETED, error);
+
+    pthread_mutex_lock(&_mutex);
+    job->running = false;
+    if (outcome == SUSPENDED)
+      ++_suspended;
+    else {
+      ++(outcome == COMPLETED ? _completed : _failed);
+      _jobs.erase(std::find(_jobs.begin(), _jobs.end(), job));
+      delete job;
+    }
+    pthread_cond_broadcast(&_ready);
+  }
+  pthread_mutex_unlock(&_mutex);
+}
+
+
+void * JobDaemon::workThread(void *daemon)
+{
+  static_cast<JobDaemon *>(daemon)->work();
+  return NULL;
+}
+
+
+JobDaemon::Job * JobDaemon::nextJob()
+{
+  Job *next = NULL;
+  for (unsigned i = 0; i < _jobs.size(); ++i) {
+    Job *job = _jobs[i];
+    if (!job->running && !job->held && (!next || outranks(job, next)))
+      next = job;
+  }
+  return next;
+}
+
+
+bool JobDaemon::outranks(const Job *a, const Job *b)
+{
+  if (a->spec.getPriority() != b->spec.getPriority())
+    return a->spec.getPriority() > b->spec.getPriority();
+  return a->sequence < b->sequence;
+}
+
+
+JobDaemon::Outcome JobDaemon::runJob(Job &job, string &error)
+{
+  const JobSpec &spec = job.spec;
+  const string &output = spec.getOutput();
+  FluidSolver solver(spec.getWidth(), spec.getHeight());
+  spec.apply(solver);
+
+  // Resume from the checkpoint, dropping any frames written after it, or
+  // start over.  Frames are written with few, large writes.
+  unsigned frame = 0;
+  long outputSize = 0;
+  FILE *out = NULL;
+  if (readCheckpoint(job, solver, frame, outputSize)) {
+    out = fopen(output.c_str(), "r+");
+    if (out) {
+      setvbuf(out, NULL, _IOFBF, 1 << 20);
+      if (ftruncate(fileno(out), outputSize) != 0 ||
+	  fseek(out, 0, SEEK_END) != 0) {
+	fclose(out);
+	out = NULL;
+      }
+    }
+  }
+  else {
+    out = fopen(output.c_str(), "w");
+    if (out) {
+      setvbuf(out, NULL, _IOFBF, 1 << 20);
+      fprintf(out, "# job %s resolution %gx%g frames %u\n", job.name.c_str(),
+	      spec.getWidth(), spec.getHeight(), spec.getFrames());
+    }
+  }
+  if (!out) {
+    error = "unable to write " + output;
+    return FAILED;
+  }
+
+  while (frame < spec.getFrames()) {
+    if (shouldSuspend(job)) {
+      bool ok = fflush(out) == 0 &&
+	writeCheckpoint(job, solver, frame, ftell(out));
+      ok = fclose(out) == 0 && ok;
+      if (!ok) {
+	error = "unable to write a checkpoint";
+	return FAILED;
+      }
+      return SUSPENDED;
+    }
+
+    solver.advanceFrame();
+    solver.consumeFrame();
+
+    // Stream this frame's particle positions.
+    const ParticleArray &particles = solver.getParticles();
+    fprintf(out, "frame %u %u\n", frame, (unsigned)particles.size());
+    ParticleArray::const_iterator itr = particles.begin();
+    for (; itr != particles.end(); ++itr)
+      fprintf(out, "%g %g\n", itr->x, itr->y);
+    ++frame;
+
+    if (_checkpointInterval && frame % _checkpointInterval == 0 &&
+	frame < spec.getFrames() &&
+	(fflush(out) != 0 ||
+	 !writeCheckpoint(job, solver, frame, ftell(out)))) {
+      fclose(out);
+      error = "unable to write a checkpoint";
+      return FAILED;
+    }
+  }
+
+  bool ok = !ferror(out);
+  ok = (fclose(out) == 0) && ok;
+  if (!ok)
+    error = "unable to write " + output;
+  return ok ? COMPLETED : FAILED;
+}
+
+
+bool JobDaemon::shouldSuspend(const Job &job)
+{
+  pthread_mutex_lock(&_mutex);
+  const bool suspend = job.suspend;
+  pthread_mutex_unlock(&_mutex);
+  return suspend;
+}
+
+
+bool JobDaemon::writeCheckpoint(const Job &job, const FluidSolver &solver,
+				unsigned frame, long outputSize) const
+{
+  if (outputSize < 0)
+    return false;
+  const string path = getPath(ACTIVE_DIR, job.name, ".checkpoint");
+  const string temporary = path + ".part";
+  {
+    std::ofstream out(temporary.c_str(), std::ios::binary);
+    const uint32_t frames = frame;
+    const uint64_t size = outputSize;
+    out.write(reinterpret_cast<const char *>(&frames), sizeof(frames));
+    out.write(reinterpret_cast<const char *>(&size), sizeof(size));
+    if (!solver.writeCheckpoint(out) || !out.flush()) {
+      unlink(temporary.c_str());
+      return false;
+    }
+  }
+  return rename(temporary.c_str(), path.c_str()) == 0;
+}
+
+
+bool JobDaemon::readCheckpoint(const Job &job, FluidSolver &solver,
+			       unsigned &frame, long &outputSize) const
+{
+  std::ifstream in(getPath(ACTIVE_DIR, job.name, ".checkpoint").c_str(),
+		   std::ios::binary);
+  uint32_t frames = 0;
+  uint64_t size = 0;
+  if (!in.read(reinterpret_cast<char *>(&frames), sizeof(frames)) ||
+      !in.read(reinterpret_cast<char *>(&size), sizeof(size)) ||
+      !solver.readCheckpoint(in))
+    return false;
+  frame = frames;
+  outputSize = size;
+  return true;
+}
+
+
+void JobDaemon::takeJobs(const string &directory)
+{
+  const vector<string> names = listJobs(getPath(directory, "", ""));
+  for (unsigned i = 0; i < names.size(); ++i) {
+    // A job resubmitted while its namesake is unfinished waits for it.
+    pthread_mutex_lock(&_mutex);
+    bool known = false;
+    for (unsigned j = 0; j < _jobs.size(); ++j)
+      known = known || _jobs[j]->name == names[i];
+    pthread_mutex_unlock(&_mutex);
+    if (known)
+      continue;
+
+    Job *job = new Job;
+    job->name = names[i];
+    job->running = job->held = job->suspend = false;
+    const string path = getPath(directory, names[i], ".job");
+    const string active = getPath(ACTIVE_DIR, names[i], ".job");
+    if (!job->spec.parseFile(path)) {
+      const string error = job->spec.getError();
+      delete job;
+      const string failed = getPath(FAILED_DIR, names[i], ".job");
+      if (rename(path.c_str(), failed.c_str()) == 0)
+	writeError(getPath(FAILED_DIR, names[i], ".error"), error);
+      pthread_mutex_lock(&_mutex);
+      ++_failed;
+      pthread_mutex_unlock(&_mutex);
+      continue;
+    }
+    if (path != active && rename(path.c_str(), active.c_str()) != 0) {
+      delete job;
+      continue;
+    }
+
+    pthread_mutex_lock(&_mutex);
+    job->sequence = _sequence++;
+    _jobs.push_back(job);
+    pthread_mutex_unlock(&_mutex);
+  }
+}
+
+
+void JobDaemon::finishJob(const Job &job, bool completed,
+			  const string &error)
+{
+  const string destination = completed ? DONE_DIR : FAILED_DIR;
+  unlink(getPath(ACTIVE_DIR, job.name, ".checkpoint").c_str());
+  rename(getPath(ACTIVE_DIR, job.name, ".job").c_str(),
+	 getPath(destination, job.name, ".job").c_str());
+  if (!completed)
+    writeError(getPath(FAILED_DIR, job.name, ".error"), error);
+}
+
+
+string JobDaemon::getPath(const string &directory, const string &name,
+			  const char *extension) const
+{
+  string path = _spool + "/";
+  if (!directory.empty())
+    path += directory + "/";
+  return path + name + extension;
+}
@@ -0,0 +1,167 @@
+#ifndef __JOB_DAEMON_H__
+#define __JOB_DAEMON_H__
+
+#include <pthread.h>
+#include <string>
+#include <vector>
+#include "JobSpec.h"
+
+class FluidSolver;
+
+// A long-lived service running simulation jobs dropped into a spool
+// directory, so a render farm node keeps one process busy rather than
+// launching one per shot.  The spool directory holds:
+//
+//   NAME.job              New jobs (see JobSpec), picked up by poll().
+//   active/NAME.job       Jobs taken on, queued, running or suspended.
+//   active/NAME.checkpoint  Where a suspended job stands.
+//   active/NAME.hold      Created by the user to suspend a job until the
+//                         file is removed again.
+//   done/NAME.job         Completed jobs.
+//   failed/NAME.job       Jobs that failed, with the reason in NAME.error.
+//
+// Jobs run on a fixed pool of worker threads, one job per worker at a
+// time, highest priority first and in order of arrival within a priority.
+// Each solver runs single-threaded, so a node is filled by running as many
+// jobs as it has cores.  When a job arrives that outranks a running one
+// and every worker is busy, the lowest ranked running job is preempted:
+// at the end of its current frame it writes a checkpoint and yields its
+// worker, and it later resumes from the checkpoint exactly where it left
+// off.  Jobs also checkpoint every few frames, and when the daemon stops,
+// so that no more than a few frames of work are lost if the node goes
+// down; a restarted daemon resumes every job left in active/.
+class JobDaemon {
+public:
+  // Constructs a stopped daemon.
+  //
+  // Arguments:
+  //   std::string &spool - The spool directory.
+  //   unsigned threadCount - Number of jobs run concurrently.  A value of
+  //                          0 uses one worker per available core.
+  JobDaemon(const std::string &spool, unsigned threadCount = 0);
+
+  // Stops the daemon.
+  ~JobDaemon();
+
+  // Sets how many frames a job runs between checkpoints, or 0 to only
+  // checkpoint jobs that are suspended.  The default is 50.
+  void setCheckpointInterval(unsigned frames);
+
+  // Creates the spool directories, takes on the jobs a previous daemon
+  // left in active/, and starts the workers.
+  //
+  // Arguments:
+  //   None
+  //
+  // Returns:
+  //   bool - True on success.  On failure, getError() describes the problem.
+  bool start();
+
+  // Takes on new jobs from the spool directory, applies holds, and
+  // preempts running jobs that are outranked.  Call it periodically.
+  //
+  // Arguments:
+  //   None
+  //
+  // Returns:
+  //   None
+  void poll();
+
+  // Suspends every running job with a checkpoint and stops the workers.
+  // Jobs stay in active/ for the next start().
+  //
+  // Arguments:
+  //   None
+  //
+  // Returns:
+  //   None
+  void stop();
+
+  // Returns whether every job taken on has finished, apart from held jobs.
+  bool isIdle() const;
+
+  // Returns the number of workers.
+  unsigned getThreadCount() const;
+
+  // Returns the number of jobs completed, failed, and suspended (by
+  // preemption, holds or stop()) since start().
+  unsigned getCompletedCount() const;
+  unsigned getFailedCount() const;
+  unsigned getSuspendedCount() const;
+
+  // Returns a description of the last start() failure.
+  const std::string & getError() const;
+
+private:
+  // A job taken on by the daemon.
+  struct Job {
+    std::string name;      // The job file's name, without ".job".
+    JobSpec     spec;      // The job's description.
+    unsigned    sequence;  // Order of arrival.
+    bool        running;   // True while a worker runs the job.
+    bool        held;      // True while active/NAME.hold exists.
+    bool        suspend;   // Set to make the running job yield.
+  };
+
+  // How a worker's run of a job ended.
+  enum Outcome { COMPLETED, FAILED, SUSPENDED };
+
+  // The workers' loop, and its pthread entry point.
+  void work();
+  static void * workThread(void *daemon);
+
+  // Returns the highest ranked job waiting for a worker, or NULL.  Must be
+  // called with the mutex held.
+  Job * nextJob();
+
+  // Returns whether job a ranks above job b.
+  static bool outranks(const Job *a, const Job *b);
+
+  // Runs a job until it completes, fails or is asked to suspend.
+  Outcome runJob(Job &job, std::string &error);
+
+  // Checks, between frames, whether the running job should yield.
+  bool shouldSuspend(const Job &job);
+
+  // Writes a job's checkpoint, under a temporary name first.
+  bool writeCheckpoint(const Job &job, const FluidSolver &solver,
+		       unsigned frame, long outputSize) const;
+
+  // Reads a job's checkpoint into a solver set up for the job.  Returns
+  // false if there is no usable checkpoint.
+  bool readCheckpoint(const Job &job, FluidSolver &solver, unsigned &frame,
+		      long &outputSize) const;
+
+  // Takes on the jobs in a directory, moving them into active/ unless they
+  // are already there.  Jobs that can't be parsed are failed.
+  void takeJobs(const std::string &directory);
+
+  // Moves a finished job to done/ or failed/, recording why it failed.
+  void finishJob(const Job &job, bool completed, const std::string &error);
+
+  // Returns the path of a file in the spool directory.
+  std::string getPath(const std::string &directory, const std::string &name,
+		      const char *extension) const;
+
+  // Not copyable.
+  JobDaemon(const JobDaemon &);
+  JobDaemon & operator=(const JobDaemon &);
+
+  std::string        _spool;      // The spool directory.
+  unsigned           _threadCount; // Number of workers.
+  unsigned           _checkpointInterval; // Frames between checkpoints.
+  std::vector<pthread_t> _threads; // The workers, while started.
+  unsigned           _sequence;   // Arrival number of the next job.
+  std::string        _error;      // Description of the last failure.
+
+  // Guarded by _mutex.
+  mutable pthread_mutex_t _mutex;
+  pthread_cond_t     _ready;      // Signaled when a job may be runnable.
+  bool               _stop;       // Set to make the workers exit.
+  std::vector<Job *> _jobs;       // Jobs taken on and not yet finished.
+  unsigned           _completed;  // Jobs completed.
+  unsigned           _failed;     // Jobs failed.
+  unsigned           _suspended;  // Runs ended by a suspension.
+};
+
+#endif // __JOB_DAEMON_H__
@@ -0,0 +1,152 @@
+#include "JobSpec.h"
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+using std::string;
+
+
+JobSpec::JobSpec()
+  : _scene(),
+    _width(0.0f),
+    _height(0.0f),
+    _frames(100),
+    _output(),
+    _priority(0),
+    _error()
+{}
+
+
+bool JobSpec::parse(std::istream &in)
+{
+  JobSpec parsed;
+  string line;
+  unsigned lineNumber = 0;
+
+  while (std::getline(in, line)) {
+    ++lineNumber;
+
+    // Strip comments, then split the line into a key and its value.
+    string::size_type comment = line.find('#');
+    if (comment != string::npos)
+      line.erase(comment);
+    std::istringstream tokens(line);
+    string key, value, extra;
+    if (!(tokens >> key))
+      continue;
+    bool valid = (tokens >> value) && !(tokens >> extra);
+
+    std::istringstream number(value);
+    if (key == "scene") {
+      if (valid && !parsed._scene.parseFile(value)) {
+	std::ostringstream msg;
+	msg << "line " << lineNumber << ": " << value << ": "
+	    << parsed._scene.getError();
+	_error = msg.str();
+	return false;
+      }
+    }
+    else if (key == "resolution") {
+      // Accept either "N" (square) or "WxH".
+      float w = 0.0f, h = 0.0f;
+      char sep = 0, more = 0;
+      int count = sscanf(value.c_str(), "%f%c%f%c", &w, &sep, &h, &more);
+      if (count == 1)
+	h = w;
+      else if (count != 3 || sep != 'x')
+	valid = false;
+      valid = valid && w > 0.0f && h > 0.0f;
+      parsed._width  = w;
+      parsed._height = h;
+    }
+    else if (key == "frames") {
+      long frames = -1;
+      valid = valid && (number >> frames) && number.eof() && frames >= 0;
+      parsed._frames = frames;
+    }
+    else if (key == "output")
+      parsed._output = value;
+    else if (key == "priority")
+      valid = valid && (number >> parsed._priority) && number.eof();
+    else {
+      std::ostringstream msg;
+      msg << "line " << lineNumber << ": unknown setting '" << key << "'";
+      _error = msg.str();
+      return false;
+    }
+
+    if (!valid) {
+      std::ostringstream msg;
+      msg << "line " << lineNumber << ": invalid value for '" << key << "'";
+      _error = msg.str();
+      return false;
+    }
+  }
+
+  if (parsed._output.empty()) {
+    _error = "no output given";
+    return false;
+  }
+
+  *this = parsed;
+  return true;
+}
+
+
+bool JobSpec::parseFile(const string &path)
+{
+  std::ifstream in(path.c_str());
+  if (!in) {
+    _error = "unable to open " + path;
+    return false;
+  }
+  return parse(in);
+}
+
+
+const SceneSpec & JobSpec::getScene() const
+{
+  return _scene;
+}
+
+
+float JobSpec::getWidth() const
+{
+  return _width > 0.0f ? _width : _scene.getWidth();
+}
+
+
+float JobSpec::getHeight() const
+{
+  return _height > 0.0f ? _height : _scene.getHeight();
+}
+
+
+unsigned JobSpec::getFrames() const
+{
+  return _frames;
+}
+
+
+const string & JobSpec::getOutput() const
+{
+  return _output;
+}
+
+
+int JobSpec::getPriority() const
+{
+  return _priority;
+}
+
+
+void JobSpec::apply(FluidSolver &solver) const
+{
+  _scene.apply(solver);
+}
+
+
+const string & JobSpec::getError() const
+{
+  return _error;
+}
@@ -0,0 +1,96 @@
+#ifndef __JOB_SPEC_H__
+#define __JOB_SPEC_H__
+
+#include <istream>
+#include <string>
+#include "SceneSpec.h"
+
+// Describes a simulation job run by JobDaemon.
+//
+// A job is read from a plain text description, one setting per line:
+//
+//   # Comments start with '#'.
+//   scene      scenes/dam.scene      # A SceneSpec file; else the default.
+//   resolution 128x64                # Overrides the scene's size.
+//   frames     240                   # Frames to simulate.
+//   output     shots/dam.txt         # File receiving the frames.
+//   priority   5                     # Higher priorities run first.
+//
+// Only output is required.  Relative paths are relative to the daemon's
+// working directory.  The output receives each frame's particle positions
+// in the format of EnsembleRunner's outputs.
+class JobSpec {
+public:
+  // Constructs a job of the default scene, with no output.
+  //
+  // Arguments:
+  //   None
+  JobSpec();
+
+  // Parses a job description, replacing any previously parsed values.  The
+  // scene file, if any, is read as well.
+  //
+  // Arguments:
+  //   std::istream &in - The stream containing the job description.
+  //
+  // Returns:
+  //   bool - True on success.  On failure, getError() describes the problem.
+  bool parse(std::istream &in);
+
+  // Parses the job description stored in the named file.
+  //
+  // Arguments:
+  //   std::string &path - The path of the job description.
+  //
+  // Returns:
+  //   bool - True on success.  On failure, getError() describes the problem.
+  bool parseFile(const std::string &path);
+
+  // Returns the job's scene.
+  const SceneSpec & getScene() const;
+
+  // Returns the size of the simulation, in world coordinates: the
+  // resolution if one was given, else the scene's size.
+  float getWidth() const;
+  float getHeight() const;
+
+  // Returns the number of frames to simulate.
+  unsigned getFrames() const;
+
+  // Returns the path of the file receiving the frames.
+  const std::string & getOutput() const;
+
+  // Returns the job's priority.  Jobs of higher priority run first, and
+  // suspend running jobs of lower priority when every worker is busy.
+  int getPriority() const;
+
+  // Sets up a freshly constructed solver of getWidth() by getHeight() as
+  // the scene describes, then resets it.
+  //
+  // Arguments:
+  //   FluidSolver &solver - The solver to set up.
+  //
+  // Returns:
+  //   None
+  void apply(FluidSolver &solver) const;
+
+  // Returns a description of the last parse failure.
+  //
+  // Arguments:
+  //   None
+  //
+  // Returns:
+  //   std::string - The error message, or an empty string.
+  const std::string & getError() const;
+
+private:
+  SceneSpec   _scene;      // The scene simulated.
+  float       _width;      // Resolution, or 0 for the scene's.
+  float       _height;
+  unsigned    _frames;     // Frames to simulate.
+  std::string _output;     // File receiving the frames.
+  int         _priority;   // Higher runs first.
+  std::string _error;      // Description of the last parse failure.
+};
+
+#endif // __JOB_SPEC_H__
@@ -0,0 +1,240 @@
+#include "SceneSpec.h"
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+using std::string;
+using std::vector;
+
+namespace {
+
+// Converts every value to a number.  Returns false unless there are exactly
+// count values and all of them are numbers.
+bool toFloats(const vector<string> &values, unsigned count, float *numbers)
+{
+  if (values.size() != count)
+    return false;
+  for (unsigned i = 0; i < count; ++i) {
+    std::istringstream number(values[i]);
+    if (!(number >> numbers[i]) || !number.eof())
+      return false;
+  }
+  return true;
+}
+
+// Looks up a side of the domain by name.
+bool toSide(const string &name, FluidSolver::Side &side)
+{
+  static const char *names[FluidSolver::SIDE_COUNT] =
+    { "left", "right", "bottom", "top" };
+  for (unsigned i = 0; i < FluidSolver::SIDE_COUNT; ++i)
+    if (name == names[i]) {
+      side = FluidSolver::Side(i);
+      return true;
+    }
+  return false;
+}
+
+} // namespace
+
+
+SceneSpec::SceneSpec()
+  : _width(32.0f),
+    _height(32.0f),
+    _hasGravity(false),
+    _hasViscosity(false),
+    _hasFill(false),
+    _gravity(),
+    _viscosity(0.0f),
+    _fill(0.0f),
+    _capacity(0),
+    _sources(),
+    _scalars(),
+    _error()
+{
+  _periodic[Cell::X] = _periodic[Cell::Y] = false;
+  for (unsigned i = 0; i < FluidSolver::SIDE_COUNT; ++i)
+    _boundaries[i] = FluidSolver::WALL;
+}
+
+
+bool SceneSpec::parse(std::istream &in)
+{
+  SceneSpec parsed;
+  string line;
+  unsigned lineNumber = 0;
+
+  while (std::getline(in, line)) {
+    ++lineNumber;
+
+    // Strip comments, then split the line into a key and its values.
+    string::size_type comment = line.find('#');
+    if (comment != string::npos)
+      line.erase(comment);
+    std::istringstream tokens(line);
+    string key;
+    if (!(tokens >> key))
+      continue;
+
+    vector<string> values;
+    string value;
+    while (tokens >> value)
+      values.push_back(value);
+    if (values.empty()) {
+      std::ostringstream msg;
+      msg << "line " << lineNumber << ": '" << key << "' has no values";
+      _error = msg.str();
+      return false;
+    }
+
+    bool valid = true;
+    float n[7];
+    if (key == "resolution") {
+      // Accept either "N" (square) or "WxH".
+      float w = 0.0f, h = 0.0f;
+      char sep = 0, extra = 0;
+      int count = sscanf(values[0].c_str(), "%f%c%f%c", &w, &sep, &h, &extra);
+      if (count == 1)
+	h = w;
+      else if (count != 3 || sep != 'x')
+	valid = false;
+      valid = valid && values.size() == 1 && w > 0.0f && h > 0.0f;
+      parsed._width  = w;
+      parsed._height = h;
+    }
+    else if (key == "gravity") {
+      if (toFloats(values, 1, n))
+	parsed._gravity = Vector2(0.0f, n[0]);
+      else if (toFloats(values, 2, n))
+	parsed._gravity = Vector2(n[0], n[1]);
+      else
+	valid = false;
+      parsed._hasGravity = true;
+    }
+    else if (key == "viscosity") {
+      valid = toFloats(values, 1, n) && n[0] >= 0.0f;
+      parsed._viscosity = n[0];
+      parsed._hasViscosity = true;
+    }
+    else if (key == "fill") {
+      valid = toFloats(values, 1, n) && n[0] >= 0.0f && n[0] <= 1.0f;
+      parsed._fill = n[0];
+      parsed._hasFill = true;
+    }
+    else if (key == "capacity") {
+      valid = toFloats(values, 1, n) && n[0] >= 0.0f;
+      parsed._capacity = n[0];
+    }
+    else if (key == "periodic") {
+      valid = values.size() == 1 && (values[0] == "x" || values[0] == "y");
+      parsed._periodic[values[0] == "x" ? Cell::X : Cell::Y] = valid;
+    }
+    else if (key == "boundary") {
+      FluidSolver::Side side = FluidSolver::LEFT;
+      valid = toSide(values[0], side) && values.size() >= 2;
+      if (valid && values[1] == "wall" && values.size() == 2)
+	parsed._boundaries[side] = FluidSolver::WALL;
+      else if (valid && values[1] == "outflow" && values.size() == 2)
+	parsed._boundaries[side] = FluidSolver::OUTFLOW;
+      else if (valid && values[1] == "inflow" &&
+	       toFloats(vector<string>(values.begin() + 2, values.end()),
+			2, n)) {
+	parsed._boundaries[side] = FluidSolver::INFLOW;
+	parsed._inflows[side] = Vector2(n[0], n[1]);
+      }
+      else
+	valid = false;
+    }
+    else if (key == "emitter" || key == "sink") {
+      Source source;
+      source.sink = key == "sink";
+      valid = toFloats(values, source.sink ? 4 : 7, n);
+      source.minCorner = Vector2(n[0], n[1]);
+      source.maxCorner = Vector2(n[2], n[3]);
+      if (valid && !source.sink) {
+	source.velocity = Vector2(n[4], n[5]);
+	source.rate = n[6];
+      }
+      else
+	source.rate = 0.0f;
+      parsed._sources.push_back(source);
+    }
+    else if (key == "scalar") {
+      valid = toFloats(values, 1, n);
+      parsed._scalars.push_back(n[0]);
+    }
+    else {
+      std::ostringstream msg;
+      msg << "line " << lineNumber << ": unknown setting '" << key << "'";
+      _error = msg.str();
+      return false;
+    }
+
+    if (!valid) {
+      std::ostringstream msg;
+      msg << "line " << lineNumber << ": invalid value for '" << key << "'";
+      _error = msg.str();
+      return false;
+    }
+  }
+
+  *this = parsed;
+  return true;
+}
+
+
+bool SceneSpec::parseFile(const string &path)
+{
+  std::ifstream in(path.c_str());
+  if (!in) {
+    _error = "unable to open " + path;
+    return false;
+  }
+  return parse(in);
+}
+
+
+float SceneSpec::getWidth() const
+{
+  return _width;
+}
+
+
+float SceneSpec::getHeight() const
+{
+  return _height;
+}
+
+
+void SceneSpec::apply(FluidSolver &solver) const
+{
+  if (_hasGravity)
+    solver.setGravity(_gravity);
+  if (_hasViscosity)
+    solver.setViscosity(_viscosity);
+  if (_hasFill)
+    solver.setInitialFill(_fill);
+  if (_capacity)
+    solver.setParticleCapacity(_capacity);
+  solver.setPeriodic(Cell::X, _periodic[Cell::X]);
+  solver.setPeriodic(Cell::Y, _periodic[Cell::Y]);
+  for (unsigned i = 0; i < FluidSolver::SIDE_COUNT; ++i)
+    solver.setBoundary(FluidSolver::Side(i), _boundaries[i], _inflows[i]);
+  for (unsigned i = 0; i < _sources.size(); ++i) {
+    const Source &source = _sources[i];
+    if (source.sink)
+      solver.addSink(source.minCorner, source.maxCorner);
+    else
+      solver.addEmitter(source.minCorner, source.maxCorner, source.velocity,
+			source.rate);
+  }
+  for (unsigned i = 0; i < _scalars.size(); ++i)
+    solver.addScalarField(_scalars[i]);
+  solver.reset();
+}
+
+
+const string & SceneSpec::getError() const
+{
+  return _error;
+}
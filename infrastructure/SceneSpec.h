@@ -0,0 +1,106 @@
+#ifndef __SCENE_SPEC_H__
+#define __SCENE_SPEC_H__
+
+#include <istream>
+#include <string>
+#include <vector>
+#include "FluidSolver.h"
+
+// Describes the setup of a single simulation, so that hosts embedding the
+// solver can keep scenes in files rather than in code.
+//
+// A scene is read from a plain text description, one setting per line:
+//
+//   # Comments start with '#'.
+//   resolution 64x32                 # Simulation size, "N" or "WxH".
+//   gravity    0 -9.8                # Acceleration, "Y" or "X Y".
+//   viscosity  0.5                   # Kinematic viscosity, cells^2/sec.
+//   fill       0.25                  # Fraction of each axis filled.
+//   capacity   200000                # Particles storage is reserved for.
+//   periodic   x                     # Makes an axis ("x" or "y") wrap.
+//   boundary   left inflow 4 0       # A side's type, with the velocity of
+//   boundary   right outflow         #   entering fluid for "inflow".
+//   emitter    2 2 4 4  0 5  500     # Corners, velocity and rate.
+//   sink       28 0 32 2             # Corners.
+//   scalar     1.0                   # Adds a scalar field, initial value.
+//
+// Settings that are not given keep the solver's defaults.  Emitters, sinks,
+// periodic axes, boundaries and scalar fields may be repeated.
+class SceneSpec {
+public:
+  // Constructs a scene of the default size, with every solver default.
+  //
+  // Arguments:
+  //   None
+  SceneSpec();
+
+  // Parses a scene description, replacing any previously parsed values.
+  //
+  // Arguments:
+  //   std::istream &in - The stream containing the scene description.
+  //
+  // Returns:
+  //   bool - True on success.  On failure, getError() describes the problem.
+  bool parse(std::istream &in);
+
+  // Parses the scene description stored in the named file.
+  //
+  // Arguments:
+  //   std::string &path - The path of the scene description.
+  //
+  // Returns:
+  //   bool - True on success.  On failure, getError() describes the problem.
+  bool parseFile(const std::string &path);
+
+  // Returns the size of the simulation, in world coordinates.
+  float getWidth() const;
+  float getHeight() const;
+
+  // Sets up a solver as described, then resets it to the scene's starting
+  // state.  The solver should be freshly constructed at getWidth() by
+  // getHeight(): scalar fields and sources are added to any it already has.
+  //
+  // Arguments:
+  //   FluidSolver &solver - The solver to set up.
+  //
+  // Returns:
+  //   None
+  void apply(FluidSolver &solver) const;
+
+  // Returns a description of the last parse failure.
+  //
+  // Arguments:
+  //   None
+  //
+  // Returns:
+  //   std::string - The error message, or an empty string.
+  const std::string & getError() const;
+
+private:
+  // An emitter or sink.
+  struct Source {
+    bool    sink;       // True for a sink, false for an emitter.
+    Vector2 minCorner;  // Lower left corner, world coords.
+    Vector2 maxCorner;  // Upper right corner, world coords.
+    Vector2 velocity;   // Emitter velocity.
+    float   rate;       // Emitter particles per second.
+  };
+
+  float         _width;      // Simulation width, in world coordinates.
+  float         _height;     // Simulation height, in world coordinates.
+  bool          _hasGravity; // Whether the settings below were given.
+  bool          _hasViscosity;
+  bool          _hasFill;
+  Vector2       _gravity;    // Global acceleration, cells/sec^2.
+  float         _viscosity;  // Kinematic viscosity, cells^2/sec.
+  float         _fill;       // Fraction of each axis filled by reset().
+  unsigned      _capacity;   // Reserved particles, or 0 for the default.
+  bool          _periodic[Cell::DIM_COUNT]; // Whether each axis wraps.
+  FluidSolver::BoundaryType _boundaries[FluidSolver::SIDE_COUNT];
+  Vector2       _inflows[FluidSolver::SIDE_COUNT]; // INFLOW velocities.
+  std::vector<Source> _sources;  // Emitters and sinks, in order.
+  std::vector<float>  _scalars;  // Initial value of each scalar field.
+  std::string   _error;      // Description of the last parse failure.
+};
+
+#endif // __SCENE_SPEC_H__
@@ -0,0 +1,268 @@
+#include "SharedFrameRing.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstring>
+#include "FluidSolver.h"
+
+using std::string;
+
+const uint32_t SharedFrameRing::MAGIC;
+const uint32_t SharedFrameRing::VERSION;
+
+namespace {
+
+// Rounds a size up to a whole number of cache lines, so that every array
+// starts on a cache line of its own.
+size_t cacheAlign(size_t size)
+{
+  const size_t line = 64;
+  return (size + line - 1) / line * line;
+}
+
+} // namespace
+
+
+SharedFrameRing::SharedFrameRing()
+  : _name(),
+    _segment(NULL),
+    _size(0),
+    _owner(false)
+{}
+
+
+SharedFrameRing::~SharedFrameRing()
+{
+  detach();
+}
+
+
+bool SharedFrameRing::create(const string &name, const FluidSolver &solver,
+			     unsigned slotCount)
+{
+  detach();
+  if (slotCount < 1)
+    return false;
+
+  // Lay out one slot.
+  const Grid &grid = solver.getGrid();
+  Header layout;
+  memset(&layout, 0, sizeof(layout));
+  layout.magic            = MAGIC;
+  layout.version          = VERSION;
+  layout.slotCount        = slotCount;
+  layout.cols             = grid.getColCount();
+  layout.rows             = grid.getRowCount();
+  layout.scalarCount      = grid.getScalarFieldCount();
+  layout.particleCapacity = solver.getParticleCapacity();
+  const size_t cells = size_t(layout.cols) * layout.rows;
+  size_t offset = cacheAlign(sizeof(SlotHeader));
+  layout.velocityXOffset = offset;
+  offset += cacheAlign(sizeof(float) * cells);
+  layout.velocityYOffset = offset;
+  offset += cacheAlign(sizeof(float) * cells);
+  layout.pressureOffset = offset;
+  offset += cacheAlign(sizeof(float) * cells);
+  layout.cellTypeOffset = offset;
+  offset += cacheAlign(sizeof(uint8_t) * cells);
+  layout.scalarOffset = offset;
+  offset += cacheAlign(sizeof(float) * cells * layout.scalarCount);
+  layout.particleXOffset = offset;
+  offset += cacheAlign(sizeof(float) * layout.particleCapacity);
+  layout.particleYOffset = offset;
+  offset += cacheAlign(sizeof(float) * layout.particleCapacity);
+  layout.slotStride = offset;
+
+  // Create the segment, failing if one of that name already exists.
+  int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd < 0)
+    return false;
+  size_t size = cacheAlign(sizeof(Header)) + slotCount * layout.slotStride;
+  void *segment = MAP_FAILED;
+  if (ftruncate(fd, size) == 0)
+    segment = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (segment == MAP_FAILED) {
+    shm_unlink(name.c_str());
+    return false;
+  }
+
+  _name = name;
+  _segment = segment;
+  _size = size;
+  _owner = true;
+
+  // The fresh segment is zeroed: every slot's sequence is even and empty.
+  memcpy(_segment, &layout, sizeof(layout));
+  return true;
+}
+
+
+bool SharedFrameRing::attach(const string &name)
+{
+  detach();
+
+  int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0)
+    return false;
+  struct stat info;
+  void *segment = MAP_FAILED;
+  if (fstat(fd, &info) == 0 && info.st_size >= (off_t)sizeof(Header))
+    segment = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (segment == MAP_FAILED)
+    return false;
+
+  // Refuse segments that aren't frame rings of this layout.
+  const Header *h = static_cast<const Header *>(segment);
+  if (h->magic != MAGIC || h->version != VERSION ||
+      cacheAlign(sizeof(Header)) + h->slotCount * h->slotStride >
+      (size_t)info.st_size) {
+    munmap(segment, info.st_size);
+    return false;
+  }
+
+  _name = name;
+  _segment = segment;
+  _size = info.st_size;
+  _owner = false;
+  return true;
+}
+
+
+void SharedFrameRing::detach()
+{
+  if (!_segment)
+    return;
+  if (_owner)
+    shm_unlink(_name.c_str());
+  munmap(_segment, _size);
+  _segment = NULL;
+  _size = 0;
+  _owner = false;
+  _name.clear();
+}
+
+
+bool SharedFrameRing::isOpen() const
+{
+  return _segment != NULL;
+}
+
+
+const SharedFrameRing::Header * SharedFrameRing::getHeader() const
+{
+  return static_cast<const Header *>(_segment);
+}
+
+
+bool SharedFrameRing::publish(const FluidSolver &solver)
+{
+  Header *h = static_cast<Header *>(_segment);
+  const Grid &grid = solver.getGrid();
+  const ParticleArray &particles = solver.getParticles();
+  if (!_owner || grid.getColCount() != h->cols ||
+      grid.getRowCount() != h->rows ||
+      grid.getScalarFieldCount() != h->scalarCount ||
+      particles.size() > h->particleCapacity)
+    return false;
+
+  // Mark the slot as being written.  The release fence keeps the frame's
+  // stores from becoming visible before the odd sequence.
+  const uint64_t frame = h->frameCount;
+  SlotHeader *s = slot(frame % h->slotCount);
+  const uint32_t sequence = s->sequence + 1;
+  __atomic_store_n(&s->sequence, sequence, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  s->particleCount = particles.size();
+  s->frame         = frame;
+  s->width         = solver.getSimulationWidth();
+  s->height        = solver.getSimulationHeight();
+
+  // Split the grid into its arrays, a row per iteration.
+  char *base = reinterpret_cast<char *>(s);
+  float *velocityX = reinterpret_cast<float *>(base + h->velocityXOffset);
+  float *velocityY = reinterpret_cast<float *>(base + h->velocityYOffset);
+  float *pressure  = reinterpret_cast<float *>(base + h->pressureOffset);
+  uint8_t *types   = reinterpret_cast<uint8_t *>(base + h->cellTypeOffset);
+  float *scalars   = reinterpret_cast<float *>(base + h->scalarOffset);
+  const int cols = h->cols;
+  const int rows = h->rows;
+  const unsigned scalarCount = h->scalarCount;
+  const size_t cells = size_t(cols) * rows;
+  const unsigned stride = grid.getRowStride();
+  const Cell *cellData = grid.getCellData();
+  const double *pressureData = grid.getPressureData();
+  const CellMask &mask = grid.getCellMask();
+#pragma omp parallel for schedule(static)
+  for (int y = 0; y < rows; ++y)
+    for (int x = 0; x < cols; ++x) {
+      const unsigned i = y * cols + x;
+      const unsigned j = y * stride + x;
+      const Cell &cell = cellData[j];
+      velocityX[i] = cell.vel[Cell::X];
+      velocityY[i] = cell.vel[Cell::Y];
+      pressure[i]  = pressureData[j];
+      types[i]     = mask.get(x, y);
+      for (unsigned field = 0; field < scalarCount; ++field)
+	scalars[field * cells + i] = grid.getScalar(x, y, field);
+    }
+
+  float *particleX = reinterpret_cast<float *>(base + h->particleXOffset);
+  float *particleY = reinterpret_cast<float *>(base + h->particleYOffset);
+  for (unsigned i = 0; i < particles.size(); ++i) {
+    particleX[i] = particles[i].x;
+    particleY[i] = particles[i].y;
+  }
+
+  // Complete the slot, then announce it.
+  __atomic_store_n(&s->sequence, sequence + 1, __ATOMIC_RELEASE);
+  __atomic_store_n(&h->frameCount, frame + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+
+bool SharedFrameRing::acquireLatest(FrameView &view) const
+{
+  const Header *h = getHeader();
+  if (!h)
+    return false;
+  const uint64_t count = __atomic_load_n(&h->frameCount, __ATOMIC_ACQUIRE);
+  if (count == 0)
+    return false;
+  const SlotHeader *s = slot((count - 1) % h->slotCount);
+  view.sequence = __atomic_load_n(&s->sequence, __ATOMIC_ACQUIRE);
+  if (view.sequence & 1)
+    return false;
+
+  const char *base = reinterpret_cast<const char *>(s);
+  view.header    = s;
+  view.velocityX = reinterpret_cast<const float *>(base + h->velocityXOffset);
+  view.velocityY = reinterpret_cast<const float *>(base + h->velocityYOffset);
+  view.pressure  = reinterpret_cast<const float *>(base + h->pressureOffset);
+  view.cellType  = reinterpret_cast<const uint8_t *>(base + h->cellTypeOffset);
+  view.scalars   = reinterpret_cast<const float *>(base + h->scalarOffset);
+  view.particleX = reinterpret_cast<const float *>(base + h->particleXOffset);
+  view.particleY = reinterpret_cast<const float *>(base + h->particleYOffset);
+  return true;
+}
+
+
+bool SharedFrameRing::isValid(const FrameView &view) const
+{
+  // The acquire fence keeps the reader's loads of the frame from moving
+  // past the second look at the sequence.
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return __atomic_load_n(&view.header->sequence, __ATOMIC_RELAXED) ==
+    view.sequence;
+}
+
+
+SharedFrameRing::SlotHeader * SharedFrameRing::slot(unsigned index) const
+{
+  char *first = static_cast<char *>(_segment) + cacheAlign(sizeof(Header));
+  return reinterpret_cast<SlotHeader *>(first +
+					index * getHeader()->slotStride);
+}
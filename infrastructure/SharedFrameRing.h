@@ -0,0 +1,178 @@
+#ifndef __SHARED_FRAME_RING_H__
+#define __SHARED_FRAME_RING_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+class FluidSolver;
+
+// Publishes completed frames into a ring of slots in a POSIX shared-memory
+// segment, so that tools on the same machine (compositors, analysis) can
+// map the ring and read frames in place, with no serialization or copies.
+//
+// The segment starts with a Header, followed by getSlotCount() slots of
+// Header::slotStride bytes.  Each slot starts with a SlotHeader and holds
+// the frame as separate arrays, each starting on a cache line at the
+// offsets given in the Header:
+//
+//   float   velocityX[rows * cols]   MAC face velocities, indexed as the
+//   float   velocityY[rows * cols]   grid is: y * cols + x, including the
+//   float   pressure[rows * cols]    grid's extra row and column.
+//   uint8_t cellType[rows * cols]    Cell::Type of every cell.
+//   float   scalars[scalarCount][rows * cols]  Scalar fields, one array each.
+//   float   particleX[particleCapacity]  Particle positions; the first
+//   float   particleY[particleCapacity]  SlotHeader::particleCount are used.
+//
+// Slots are guarded seqlock-style: the writer makes a slot's sequence odd
+// before rewriting it and even again once done.  A reader notes an even
+// sequence, reads the slot in place, then checks the sequence is unchanged;
+// if not, the writer lapped it and the reader should start over.  The
+// writer never waits for readers, so any number of them may come and go.
+class SharedFrameRing {
+public:
+  // Data at the start of the segment.  Written once by create(), apart from
+  // frameCount.
+  struct Header {
+    uint32_t magic;             // MAGIC.
+    uint32_t version;           // VERSION.
+    uint32_t slotCount;         // Number of slots in the ring.
+    uint32_t cols;              // Grid columns, including the extra one.
+    uint32_t rows;              // Grid rows, including the extra one.
+    uint32_t scalarCount;       // Number of scalar fields.
+    uint32_t particleCapacity;  // Most particles a slot holds.
+    uint32_t reserved;
+    uint64_t slotStride;        // Bytes between consecutive slots.
+    uint64_t velocityXOffset;   // Offsets of each array within a slot.
+    uint64_t velocityYOffset;
+    uint64_t pressureOffset;
+    uint64_t cellTypeOffset;
+    uint64_t scalarOffset;
+    uint64_t particleXOffset;
+    uint64_t particleYOffset;
+    uint64_t frameCount;        // Frames published so far.  Frame n lives in
+                                // slot n % slotCount.
+  };
+
+  // Data at the start of each slot.
+  struct SlotHeader {
+    uint32_t sequence;          // Odd while the slot is being written.
+    uint32_t particleCount;     // Particles in this frame.
+    uint64_t frame;             // Number of the frame in this slot.
+    float    width;             // Simulation width, in world coordinates.
+    float    height;            // Simulation height, in world coordinates.
+  };
+
+  // A frame being read in place.  The pointers remain valid while the ring
+  // is attached, but their contents only while isValid() holds.
+  struct FrameView {
+    const SlotHeader *header;
+    const float      *velocityX;
+    const float      *velocityY;
+    const float      *pressure;
+    const uint8_t    *cellType;
+    const float      *scalars;    // scalarCount arrays of rows * cols.
+    const float      *particleX;
+    const float      *particleY;
+    uint32_t          sequence;   // The slot's sequence when acquired.
+  };
+
+  // Identifies a frame ring segment.
+  static const uint32_t MAGIC = 0x474e5246;
+
+  // The layout version described above.
+  static const uint32_t VERSION = 1;
+
+  // Constructs a closed ring.
+  //
+  // Arguments:
+  //   None
+  SharedFrameRing();
+
+  // Unmaps the segment, and unlinks its name if this instance created it.
+  ~SharedFrameRing();
+
+  // Creates and maps a new named segment, sized for frames of one solver.
+  //
+  // Arguments:
+  //   std::string &name - The segment name, e.g. "/fluid-frames".
+  //   FluidSolver &solver - The solver whose frames will be published; its
+  //     grid size, scalar fields and particle capacity size the slots.
+  //   unsigned slotCount - The number of frames kept in the ring.
+  //
+  // Returns:
+  //   bool - True on success.
+  bool create(const std::string &name, const FluidSolver &solver,
+	      unsigned slotCount = 4);
+
+  // Maps an existing segment created by another process, read-only.
+  //
+  // Arguments:
+  //   std::string &name - The segment name passed to create().
+  //
+  // Returns:
+  //   bool - True on success.
+  bool attach(const std::string &name);
+
+  // Unmaps the segment, unlinking its name if this instance created it.
+  //
+  // Arguments:
+  //   None
+  //
+  // Returns:
+  //   None
+  void detach();
+
+  // Returns whether a segment is currently mapped.
+  bool isOpen() const;
+
+  // Returns the segment's header, or NULL if none is mapped.
+  const Header * getHeader() const;
+
+  // Writes the solver's current frame into the next slot.  Must only be
+  // called by the instance that created the ring.  Never waits on readers.
+  //
+  // Arguments:
+  //   FluidSolver &solver - The simulation.
+  //
+  // Returns:
+  //   bool - False if the frame doesn't fit the slots: the grid was
+  //     resampled, a scalar field was added, or the particles outgrew the
+  //     capacity the ring was created with.
+  bool publish(const FluidSolver &solver);
+
+  // Starts reading the most recently published frame in place.
+  //
+  // Arguments:
+  //   FrameView &view - Receives the frame.
+  //
+  // Returns:
+  //   bool - False if no frame has been published yet, or the newest one
+  //     is being overwritten; try again.
+  bool acquireLatest(FrameView &view) const;
+
+  // Determines whether a frame acquired earlier is still intact, i.e.
+  // everything read from it since acquireLatest() is consistent.
+  //
+  // Arguments:
+  //   FrameView &view - The frame.
+  //
+  // Returns:
+  //   bool - True if the writer hasn't touched the slot since.
+  bool isValid(const FrameView &view) const;
+
+private:
+  // Returns a slot's header.
+  SlotHeader * slot(unsigned index) const;
+
+  // Hidden copy constructor and assignment; mappings are not shared.
+  SharedFrameRing(const SharedFrameRing &);
+  SharedFrameRing & operator=(const SharedFrameRing &);
+
+  std::string _name;     // The name of the mapped segment.
+  void       *_segment;  // The mapped segment, or NULL.
+  size_t      _size;     // The size of the mapped segment, in bytes.
+  bool        _owner;    // True if this instance created the segment.
+};
+
+#endif // __SHARED_FRAME_RING_H__
@@ -0,0 +1,322 @@
+#include "SharedMemoryTransport.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+
+using std::string;
+using std::vector;
+
+// Data shared by all slabs, at the start of the segment.
+struct SharedMemoryTransport::Header {
+  pthread_barrier_t barrier;        // Synchronizes all slabs.
+  unsigned          slabCount;      // Number of cooperating slabs.
+  unsigned          haloCapacity;   // Halo values per direction.
+  unsigned          particleCapacity; // Particles per direction per round.
+  size_t            mailboxStride;  // Bytes between consecutive mailboxes.
+};
+
+// Per-slab data, written only by its owning slab.  The halo and particle
+// buffers follow each mailbox in the segment.
+struct SharedMemoryTransport::Mailbox {
+  double   reduceValue;             // This slab's allReduce() contribution.
+  unsigned particleCount[2];        // Particles sent down [0] and up [1].
+};
+
+namespace {
+
+// Rounds a size up to a whole number of cache lines, so that mailboxes
+// written by different processes never share a cache line.
+size_t cacheAlign(size_t size)
+{
+  const size_t line = 64;
+  return (size + line - 1) / line * line;
+}
+
+} // namespace
+
+
+SharedMemoryTransport::SharedMemoryTransport()
+  : _name(),
+    _segment(NULL),
+    _size(0),
+    _owner(false)
+{}
+
+
+SharedMemoryTransport::~SharedMemoryTransport()
+{
+  detach();
+}
+
+
+size_t SharedMemoryTransport::segmentSize(unsigned slabCount,
+					  unsigned haloCapacity,
+					  unsigned particleCapacity)
+{
+  size_t stride = cacheAlign(sizeof(Mailbox)) +
+    2 * cacheAlign(sizeof(double) * haloCapacity) +
+    2 * cacheAlign(sizeof(float) * 2 * particleCapacity);
+  return cacheAlign(sizeof(Header)) + slabCount * stride;
+}
+
+
+bool SharedMemoryTransport::create(const string &name, unsigned slabCount,
+				   unsigned haloCapacity,
+				   unsigned particleCapacity)
+{
+  detach();
+  if (slabCount < 1 || particleCapacity < 1)
+    return false;
+
+  // Create the segment, failing if one of that name already exists.
+  int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0)
+    return false;
+  size_t size = segmentSize(slabCount, haloCapacity, particleCapacity);
+  void *segment = MAP_FAILED;
+  if (ftruncate(fd, size) == 0)
+    segment = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (segment == MAP_FAILED) {
+    shm_unlink(name.c_str());
+    return false;
+  }
+
+  _name = name;
+  _segment = segment;
+  _size = size;
+  _owner = true;
+
+  // Initialize the header and the process-shared barrier.
+  memset(_segment, 0, _size);
+  Header *h = header();
+  h->slabCount = slabCount;
+  h->haloCapacity = haloCapacity;
+  h->particleCapacity = particleCapacity;
+  h->mailboxStride = (size - cacheAlign(sizeof(Header))) / slabCount;
+  pthread_barrierattr_t attr;
+  pthread_barrierattr_init(&attr);
+  pthread_barrierattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+  pthread_barrier_init(&h->barrier, &attr, slabCount);
+  pthread_barrierattr_destroy(&attr);
+
+  return true;
+}
+
+
+bool SharedMemoryTransport::attach(const string &name)
+{
+  detach();
+
+  int fd = shm_open(name.c_str(), O_RDWR, 0600);
+  if (fd < 0)
+    return false;
+  struct stat info;
+  void *segment = MAP_FAILED;
+  if (fstat(fd, &info) == 0 && info.st_size >= (off_t)sizeof(Header))
+    segment = mmap(NULL, info.st_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		   fd, 0);
+  close(fd);
+  if (segment == MAP_FAILED)
+    return false;
+
+  _name = name;
+  _segment = segment;
+  _size = info.st_size;
+  _owner = false;
+  return true;
+}
+
+
+void SharedMemoryTransport::detach()
+{
+  if (!_segment)
+    return;
+  if (_owner) {
+    pthread_barrier_destroy(&header()->barrier);
+    shm_unlink(_name.c_str());
+  }
+  munmap(_segment, _size);
+  _segment = NULL;
+  _size = 0;
+  _owner = false;
+  _name.clear();
+}
+
+
+bool SharedMemoryTransport::isOpen() const
+{
+  return _segment != NULL;
+}
+
+
+unsigned SharedMemoryTransport::getSlabCount() const
+{
+  return _segment ? header()->slabCount : 0;
+}
+
+
+unsigned SharedMemoryTransport::getHaloCapacity() const
+{
+  return _segment ? header()->haloCapacity : 0;
+}
+
+
+void SharedMemoryTransport::barrier()
+{
+  pthread_barrier_wait(&header()->barrier);
+}
+
+
+void SharedMemoryTransport::exchangeHalo(unsigned slab,
+					 const double *sendDown,
+					 const double *sendUp,
+					 double *recvBelow, double *recvAbove,
+					 unsigned count)
+{
+  const unsigned slabCount = header()->slabCount;
+  count = std::min(count, header()->haloCapacity);
+
+  // Publish this slab's boundary values.
+  if (sendDown && slab > 0)
+    memcpy(haloBuffer(slab, false), sendDown, sizeof(double) * count);
+  if (sendUp && slab + 1 < slabCount)
+    memcpy(haloBuffer(slab, true), sendUp, sizeof(double) * count);
+  barrier();
+
+  // Read the neighbors' values, then wait until every slab has done the same
+  // before any mailbox may be overwritten.
+  if (recvBelow && slab > 0)
+    memcpy(recvBelow, haloBuffer(slab - 1, true), sizeof(double) * count);
+  if (recvAbove && slab + 1 < slabCount)
+    memcpy(recvAbove, haloBuffer(slab + 1, false), sizeof(double) * count);
+  barrier();
+}
+
+
+double SharedMemoryTransport::allReduce(unsigned slab, double value,
+					ReduceOp op)
+{
+  const unsigned slabCount = header()->slabCount;
+  mailbox(slab)->reduceValue = value;
+  barrier();
+
+  double result = mailbox(0)->reduceValue;
+  for (unsigned i = 1; i < slabCount; ++i) {
+    double other = mailbox(i)->reduceValue;
+    switch (op) {
+    case SUM:
+      result += other;
+      break;
+    case MAX:
+      result = std::max(result, other);
+      break;
+    default:
+      break;
+    }
+  }
+  barrier();
+
+  return result;
+}
+
+
+void SharedMemoryTransport::migrateParticles(unsigned slab,
+					     vector<Vector2> &down,
+					     vector<Vector2> &up,
+					     vector<Vector2> &incoming)
+{
+  const unsigned slabCount = header()->slabCount;
+  const unsigned capacity = header()->particleCapacity;
+  vector<Vector2> *outgoing[2] = { &down, &up };
+  size_t sent[2] = { 0, 0 };
+
+  // Nothing lies past the first or last slab, so particles sent that way
+  // stay with the caller rather than being lost.
+  if (slab == 0) {
+    incoming.insert(incoming.end(), down.begin(), down.end());
+    down.clear();
+  }
+  if (slab + 1 == slabCount) {
+    incoming.insert(incoming.end(), up.begin(), up.end());
+    up.clear();
+  }
+
+  for (;;) {
+    // Post up to one mailbox's worth of particles in each direction.
+    Mailbox *mine = mailbox(slab);
+    for (unsigned dir = 0; dir < 2; ++dir) {
+      unsigned count = std::min<size_t>(capacity,
+					outgoing[dir]->size() - sent[dir]);
+      float *buffer = particleBuffer(slab, dir == 1);
+      for (unsigned i = 0; i < count; ++i) {
+	const Vector2 &p = (*outgoing[dir])[sent[dir] + i];
+	buffer[2*i]   = p.x;
+	buffer[2*i+1] = p.y;
+      }
+      mine->particleCount[dir] = count;
+      sent[dir] += count;
+    }
+    barrier();
+
+    // Collect particles sent up from below and down from above.
+    if (slab > 0) {
+      const float *buffer = particleBuffer(slab - 1, true);
+      unsigned count = mailbox(slab - 1)->particleCount[1];
+      for (unsigned i = 0; i < count; ++i)
+	incoming.push_back(Vector2(buffer[2*i], buffer[2*i+1]));
+    }
+    if (slab + 1 < slabCount) {
+      const float *buffer = particleBuffer(slab + 1, false);
+      unsigned count = mailbox(slab + 1)->particleCount[0];
+      for (unsigned i = 0; i < count; ++i)
+	incoming.push_back(Vector2(buffer[2*i], buffer[2*i+1]));
+    }
+
+    // Stop once no slab has particles left to send.  The reduction also
+    // guarantees all mailboxes have been read before the next round.
+    double pending = (down.size() - sent[0]) + (up.size() - sent[1]);
+    if (allReduce(slab, pending, SUM) == 0.0)
+      break;
+  }
+
+  down.clear();
+  up.clear();
+}
+
+
+SharedMemoryTransport::Header * SharedMemoryTransport::header() const
+{
+  return static_cast<Header *>(_segment);
+}
+
+
+SharedMemoryTransport::Mailbox *
+SharedMemoryTransport::mailbox(unsigned slab) const
+{
+  char *base = static_cast<char *>(_segment) + cacheAlign(sizeof(Header));
+  return reinterpret_cast<Mailbox *>(base + slab * header()->mailboxStride);
+}
+
+
+double * SharedMemoryTransport::haloBuffer(unsigned slab, bool up) const
+{
+  char *base = reinterpret_cast<char *>(mailbox(slab)) +
+    cacheAlign(sizeof(Mailbox));
+  size_t haloBytes = cacheAlign(sizeof(double) * header()->haloCapacity);
+  return reinterpret_cast<double *>(base + (up ? haloBytes : 0));
+}
+
+
+float * SharedMemoryTransport::particleBuffer(unsigned slab, bool up) const
+{
+  char *base = reinterpret_cast<char *>(haloBuffer(slab, false)) +
+    2 * cacheAlign(sizeof(double) * header()->haloCapacity);
+  size_t particleBytes =
+    cacheAlign(sizeof(float) * 2 * header()->particleCapacity);
+  return reinterpret_cast<float *>(base + (up ? particleBytes : 0));
+}
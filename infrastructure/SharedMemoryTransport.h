@@ -0,0 +1,167 @@
+#ifndef __SHARED_MEMORY_TRANSPORT_H__
+#define __SHARED_MEMORY_TRANSPORT_H__
+
+#include <string>
+#include <vector>
+#include "Vector2.h"
+
+// Communication between cooperating slab solvers (see SlabSolver), each
+// usually running in its own process.  All communication happens through a
+// single POSIX shared-memory segment, which stands in for a network
+// transport: every slab has a pair of halo mailboxes (one per neighbor), a
+// pair of particle mailboxes, and a slot for collective reductions, and all
+// slabs synchronize on a process-shared barrier.
+//
+// Every operation other than create/attach/detach is collective: all slabs
+// must call it, in the same order, with consistent arguments.
+//
+// Typical use is to create() the transport in a parent process and fork()
+// one child per slab; the mapping is inherited.  Unrelated processes may
+// attach() by name instead.
+class SharedMemoryTransport {
+public:
+  // Reduction operators supported by allReduce().
+  enum ReduceOp {
+    SUM = 0,
+    MAX,
+    REDUCE_OP_COUNT
+  };
+
+  // Constructs a closed transport.
+  //
+  // Arguments:
+  //   None
+  SharedMemoryTransport();
+
+  // Unmaps the segment, and unlinks its name if this instance created it.
+  ~SharedMemoryTransport();
+
+  // Creates and maps a new named shared-memory segment.
+  //
+  // Arguments:
+  //   std::string &name - The segment name, e.g. "/fluid-slabs".
+  //   unsigned slabCount - The number of cooperating slabs.
+  //   unsigned haloCapacity - Max values exchanged with each neighbor.
+  //   unsigned particleCapacity - Max particles sent to a neighbor per round.
+  //
+  // Returns:
+  //   bool - True on success.
+  bool create(const std::string &name, unsigned slabCount,
+	      unsigned haloCapacity, unsigned particleCapacity);
+
+  // Maps an existing named segment created by another process.
+  //
+  // Arguments:
+  //   std::string &name - The segment name passed to create().
+  //
+  // Returns:
+  //   bool - True on success.
+  bool attach(const std::string &name);
+
+  // Unmaps the segment, unlinking its name if this instance created it.
+  //
+  // Arguments:
+  //   None
+  //
+  // Returns:
+  //   None
+  void detach();
+
+  // Returns whether a segment is currently mapped.
+  bool isOpen() const;
+
+  // Returns the number of cooperating slabs.
+  unsigned getSlabCount() const;
+
+  // Returns the maximum number of values exchangeHalo() can send per side.
+  unsigned getHaloCapacity() const;
+
+  // Blocks until every slab has reached the barrier.
+  //
+  // Arguments:
+  //   None
+  //
+  // Returns:
+  //   None
+  void barrier();
+
+  // Sends values to the neighboring slabs, and receives theirs.  Slab s
+  // receives slab s-1's "up" values into recvBelow and slab s+1's "down"
+  // values into recvAbove.  Buffers facing a missing neighbor are ignored.
+  //
+  // Arguments:
+  //   unsigned slab - The calling slab.
+  //   double *sendDown - Values sent to slab-1.
+  //   double *sendUp - Values sent to slab+1.
+  //   double *recvBelow - Receives values sent up by slab-1.
+  //   double *recvAbove - Receives values sent down by slab+1.
+  //   unsigned count - The number of values per buffer.
+  //
+  // Returns:
+  //   None
+  void exchangeHalo(unsigned slab,
+		    const double *sendDown, const double *sendUp,
+		    double *recvBelow, double *recvAbove, unsigned count);
+
+  // Combines one value from every slab.  All slabs receive the same result,
+  // since every slab reduces the values in the same order.
+  //
+  // Arguments:
+  //   unsigned slab - The calling slab.
+  //   double value - This slab's contribution.
+  //   ReduceOp op - The reduction to apply.
+  //
+  // Returns:
+  //   double - The reduced value.
+  double allReduce(unsigned slab, double value, ReduceOp op);
+
+  // Moves particles to the neighboring slabs.  Particles may be sent in
+  // several rounds if they exceed the mailbox capacity.  The outgoing lists
+  // are emptied, and received particles are appended to incoming.  The
+  // first slab's downward and the last slab's upward particles have no
+  // neighbor to go to, and are appended to the caller's own incoming.
+  //
+  // Arguments:
+  //   unsigned slab - The calling slab.
+  //   vector<Vector2> &down - Particles leaving toward slab-1.
+  //   vector<Vector2> &up - Particles leaving toward slab+1.
+  //   vector<Vector2> &incoming - Receives particles from both neighbors.
+  //
+  // Returns:
+  //   None
+  void migrateParticles(unsigned slab,
+			std::vector<Vector2> &down,
+			std::vector<Vector2> &up,
+			std::vector<Vector2> &incoming);
+
+private:
+  struct Header;
+  struct Mailbox;
+
+  std::string _name;     // The name of the mapped segment.
+  void       *_segment;  // The mapped segment, or NULL.
+  size_t      _size;     // The size of the mapped segment, in bytes.
+  bool        _owner;    // True if this instance created the segment.
+
+  // Returns the header at the start of the segment.
+  Header * header() const;
+
+  // Returns the mailbox owned by a slab.
+  Mailbox * mailbox(unsigned slab) const;
+
+  // Returns the halo values a slab sends in one direction.
+  double * haloBuffer(unsigned slab, bool up) const;
+
+  // Returns the particles a slab sends in one direction.
+  float * particleBuffer(unsigned slab, bool up) const;
+
+  // Computes the segment size for the given capacities.
+  static size_t segmentSize(unsigned slabCount, unsigned haloCapacity,
+			    unsigned particleCapacity);
+
+  // Hidden copy constructor and assignment; mappings are not shared.
+  SharedMemoryTransport(const SharedMemoryTransport &);
+  SharedMemoryTransport & operator=(const SharedMemoryTransport &);
+};
+
+#endif // __SHARED_MEMORY_TRANSPORT_H__
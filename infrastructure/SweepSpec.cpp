@@ -0,0 +1,175 @@
+#include "SweepSpec.h"
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+using std::string;
+using std::vector;
+
+SweepSpec::SweepSpec()
+  : _gravity(1, -9.8f),
+    _widths(1, 8.0f),
+    _heights(1, 8.0f),
+    _fill(1, 0.5f),
+    _frames(30),
+    _outputDir("."),
+    _vtkInterval(0),
+    _error()
+{}
+
+
+bool SweepSpec::parse(std::istream &in)
+{
+  SweepSpec parsed;
+  string line;
+  unsigned lineNumber = 0;
+
+  while (std::getline(in, line)) {
+    ++lineNumber;
+
+    // Strip comments, then split the line into a key and its values.
+    string::size_type comment = line.find('#');
+    if (comment != string::npos)
+      line.erase(comment);
+    std::istringstream tokens(line);
+    string key;
+    if (!(tokens >> key))
+      continue;
+
+    vector<string> values;
+    string value;
+    while (tokens >> value)
+      values.push_back(value);
+    if (values.empty()) {
+      std::ostringstream msg;
+      msg << "line " << lineNumber << ": '" << key << "' has no values";
+      _error = msg.str();
+      return false;
+    }
+
+    bool valid = true;
+    if (key == "gravity" || key == "fill") {
+      vector<float> &list = (key == "gravity") ? parsed._gravity : parsed._fill;
+      list.clear();
+      for (unsigned i = 0; i < values.size() && valid; ++i) {
+	std::istringstream number(values[i]);
+	float f;
+	valid = (number >> f) && number.eof();
+	list.push_back(f);
+      }
+    }
+    else if (key == "resolution") {
+      parsed._widths.clear();
+      parsed._heights.clear();
+      for (unsigned i = 0; i < values.size() && valid; ++i) {
+	// Accept either "N" (square) or "WxH".
+	float w = 0.0f, h = 0.0f;
+	char sep = 0, extra = 0;
+	int count = sscanf(values[i].c_str(), "%f%c%f%c", &w, &sep, &h, &extra);
+	if (count == 1)
+	  h = w;
+	else if (count != 3 || sep != 'x')
+	  valid = false;
+	valid = valid && w > 0.0f && h > 0.0f;
+	parsed._widths.push_back(w);
+	parsed._heights.push_back(h);
+      }
+    }
+    else if (key == "frames") {
+      std::istringstream number(values[0]);
+      int frames = 0;
+      valid = values.size() == 1 && (number >> frames) && number.eof() &&
+	frames > 0;
+      parsed._frames = frames;
+    }
+    else if (key == "vtk") {
+      std::istringstream number(values[0]);
+      int interval = 0;
+      valid = values.size() == 1 && (number >> interval) && number.eof() &&
+	interval >= 0;
+      parsed._vtkInterval = interval;
+    }
+    else if (key == "output") {
+      valid = values.size() == 1;
+      parsed._outputDir = values[0];
+    }
+    else {
+      std::ostringstream msg;
+      msg << "line " << lineNumber << ": unknown parameter '" << key << "'";
+      _error = msg.str();
+      return false;
+    }
+
+    if (!valid) {
+      std::ostringstream msg;
+      msg << "line " << lineNumber << ": invalid value for '" << key << "'";
+      _error = msg.str();
+      return false;
+    }
+  }
+
+  *this = parsed;
+  return true;
+}
+
+
+bool SweepSpec::parseFile(const string &path)
+{
+  std::ifstream in(path.c_str());
+  if (!in) {
+    _error = "unable to open " + path;
+    return false;
+  }
+  return parse(in);
+}
+
+
+vector<SweepSpec::Variant> SweepSpec::getVariants() const
+{
+  vector<Variant> variants;
+  variants.reserve(getVariantCount());
+
+  for (unsigned g = 0; g < _gravity.size(); ++g)
+    for (unsigned r = 0; r < _widths.size(); ++r)
+      for (unsigned f = 0; f < _fill.size(); ++f) {
+	Variant v;
+	v.index   = variants.size();
+	v.gravity = _gravity[g];
+	v.width   = _widths[r];
+	v.height  = _heights[r];
+	v.fill    = _fill[f];
+	v.frames  = _frames;
+
+	// Name each output after its parameters so results are self-describing.
+	char name[128];
+	snprintf(name, sizeof(name), "/variant%04u_g%g_%gx%g_f%g.txt",
+		 v.index, v.gravity, v.width, v.height, v.fill);
+	v.output = _outputDir + name;
+
+	// VTK files go in a directory named after the output, if at all.
+	v.vtkInterval = _vtkInterval;
+	v.vtkOutput = v.output.substr(0, v.output.size() - 4) + "_vtk";
+
+	variants.push_back(v);
+      }
+
+  return variants;
+}
+
+
+unsigned SweepSpec::getVariantCount() const
+{
+  return _gravity.size() * _widths.size() * _fill.size();
+}
+
+
+const string & SweepSpec::getOutputDirectory() const
+{
+  return _outputDir;
+}
+
+
+const string & SweepSpec::getError() const
+{
+  return _error;
+}
@@ -0,0 +1,109 @@
+#ifndef __SWEEP_SPEC_H__
+#define __SWEEP_SPEC_H__
+
+#include <istream>
+#include <string>
+#include <vector>
+
+// Describes a parameter sweep over many independent simulations.  Each
+// parameter is given as a list of values, and the sweep consists of every
+// combination (the cartesian product) of those values.
+//
+// A sweep is read from a plain text description, one parameter per line:
+//
+//   # Comments start with '#'.
+//   gravity    -9.8 -4.9 -1.0       # Vertical acceleration, cells/sec^2.
+//   resolution 16 32x16             # Simulation size, "N" or "WxH".
+//   fill       0.25 0.5             # Fraction of each axis filled at start.
+//   frames     120                  # Frames to simulate per variant.
+//   output     sweep_results        # Directory receiving one file/variant.
+//   vtk        10                   # Also export every 10th frame as VTK.
+//
+// Parameters that are not given keep a single default value.
+class SweepSpec {
+public:
+  // A single simulation within the sweep.
+  struct Variant {
+    unsigned    index;    // Position of this variant within the sweep.
+    float       gravity;  // Vertical acceleration, in cells/sec^2.
+    float       width;    // Simulation width, in world coordinates.
+    float       height;   // Simulation height, in world coordinates.
+    float       fill;     // Fraction of each axis filled with fluid.
+    unsigned    frames;   // Number of frames to simulate.
+    std::string output;   // Path of the file this variant streams into.
+    unsigned    vtkInterval; // Frames between VTK exports, or 0 for none.
+    std::string vtkOutput;   // Directory receiving the VTK files.
+  };
+
+  // Constructs a sweep containing a single variant with default values.
+  //
+  // Arguments:
+  //   None
+  SweepSpec();
+
+  // Parses a sweep description, replacing any previously parsed values.
+  //
+  // Arguments:
+  //   std::istream &in - The stream containing the sweep description.
+  //
+  // Returns:
+  //   bool - True on success.  On failure, getError() describes the problem.
+  bool parse(std::istream &in);
+
+  // Parses the sweep description stored in the named file.
+  //
+  // Arguments:
+  //   std::string &path - The path of the sweep description.
+  //
+  // Returns:
+  //   bool - True on success.  On failure, getError() describes the problem.
+  bool parseFile(const std::string &path);
+
+  // Expands the sweep into the list of individual simulations it describes.
+  //
+  // Arguments:
+  //   None
+  //
+  // Returns:
+  //   std::vector<Variant> - One entry per combination of parameter values.
+  std::vector<Variant> getVariants() const;
+
+  // Returns the number of variants in the sweep.
+  //
+  // Arguments:
+  //   None
+  //
+  // Returns:
+  //   unsigned - The number of combinations of parameter values.
+  unsigned getVariantCount() const;
+
+  // Returns the directory receiving the variants' output files.
+  //
+  // Arguments:
+  //   None
+  //
+  // Returns:
+  //   std::string - The output directory.
+  const std::string & getOutputDirectory() const;
+
+  // Returns a description of the last parse failure.
+  //
+  // Arguments:
+  //   None
+  //
+  // Returns:
+  //   std::string - The error message, or an empty string.
+  const std::string & getError() const;
+
+private:
+  std::vector<float> _gravity;    // Swept vertical accelerations.
+  std::vector<float> _widths;     // Swept widths, paired with _heights.
+  std::vector<float> _heights;    // Swept heights, paired with _widths.
+  std::vector<float> _fill;       // Swept initial fill fractions.
+  unsigned           _frames;     // Frames simulated by every variant.
+  std::string        _outputDir;  // Directory receiving variant results.
+  unsigned           _vtkInterval; // Frames between VTK exports, or 0.
+  std::string        _error;      // Description of the last parse failure.
+};
+
+#endif // __SWEEP_SPEC_H__
@@ -0,0 +1,403 @@
+#include "VtkExporter.h"
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <cstdio>
+#include <sstream>
+#include "FluidSolver.h"
+
+using std::string;
+using std::vector;
+
+const unsigned VtkExporter::MAX_FRAMES;
+
+namespace {
+
+// Returns the VTK name of the host's byte order.
+const char * byteOrder()
+{
+  const uint16_t one = 1;
+  return *reinterpret_cast<const char *>(&one) ? "LittleEndian"
+                                               : "BigEndian";
+}
+
+// Appends bytes to a file being laid out.
+void append(vector<char> &file, const void *data, size_t size)
+{
+  const char *bytes = static_cast<const char *>(data);
+  file.insert(file.end(), bytes, bytes + size);
+}
+
+void append(vector<char> &file, const string &text)
+{
+  append(file, text.data(), text.size());
+}
+
+// Appends one array of appended data: its size in bytes, then its bytes.
+void appendArray(vector<char> &file, const void *data, uint32_t size)
+{
+  append(file, &size, sizeof(size));
+  append(file, data, size);
+}
+
+// Formats a frame's file name.
+string framePath(const string &directory, const char *prefix,
+		 unsigned frame, const char *extension)
+{
+  char name[64];
+  snprintf(name, sizeof(name), "/%s_%06u.%s", prefix, frame, extension);
+  return directory + name;
+}
+
+} // namespace
+
+
+VtkExporter::VtkExporter()
+  : _directory(),
+    _interval(1),
+    _frame(0),
+    _thread(),
+    _running(false),
+    _drop(true),
+    _stop(false),
+    _queue(),
+    _free(),
+    _allocated(0),
+    _written(0),
+    _dropped(0),
+    _failed(0),
+    _file(),
+    _scratch()
+{
+  pthread_mutex_init(&_mutex, NULL);
+  pthread_cond_init(&_queued, NULL);
+  pthread_cond_init(&_freed, NULL);
+}
+
+
+VtkExporter::~VtkExporter()
+{
+  close();
+  for (unsigned i = 0; i < _free.size(); ++i)
+    delete _free[i];
+  pthread_cond_destroy(&_queued);
+  pthread_cond_destroy(&_freed);
+  pthread_mutex_destroy(&_mutex);
+}
+
+
+bool VtkExporter::open(const string &directory, unsigned interval)
+{
+  if (_running)
+    return false;
+  if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST)
+    return false;
+
+  _directory = directory;
+  _interval = interval > 0 ? interval : 1;
+  _frame = 0;
+  _stop = false;
+  if (pthread_create(&_thread, NULL, writeThread, this) != 0)
+    return false;
+  _running = true;
+  return true;
+}
+
+
+void VtkExporter::close()
+{
+  if (!_running)
+    return;
+
+  // The thread drains the queue before it exits.
+  pthread_mutex_lock(&_mutex);
+  _stop = true;
+  pthread_cond_signal(&_queued);
+  pthread_mutex_unlock(&_mutex);
+  pthread_join(_thread, NULL);
+  _running = false;
+}
+
+
+bool VtkExporter::isOpen() const
+{
+  return _running;
+}
+
+
+void VtkExporter::setDropFrames(bool drop)
+{
+  _drop = drop;
+}
+
+
+bool VtkExporter::publish(const FluidSolver &solver)
+{
+  if (!_running)
+    return false;
+  const unsigned number = _frame++;
+  if (number % _interval != 0)
+    return true;
+
+  // Take a free buffer, or allocate another while under the limit.
+  Frame *frame = NULL;
+  bool allocate = false;
+  pthread_mutex_lock(&_mutex);
+  while (!_drop && _free.empty() && _allocated == MAX_FRAMES)
+    pthread_cond_wait(&_freed, &_mutex);
+  if (!_free.empty()) {
+    frame = _free.back();
+    _free.pop_back();
+  }
+  else if (_allocated < MAX_FRAMES) {
+    ++_allocated;
+    allocate = true;
+  }
+  else
+    ++_dropped;
+  pthread_mutex_unlock(&_mutex);
+  if (allocate)
+    frame = new Frame;
+  if (!frame)
+    return false;
+
+  // Copy the arrays without the row padding; the background thread derives
+  // the rest.
+  const Grid &grid = solver.getGrid();
+  const unsigned cols = grid.getColCount();
+  const unsigned stride = grid.getRowStride();
+  const unsigned cells = cols * grid.getRowCount();
+  const Cell *cell = grid.getCellData();
+  const double *pressure = grid.getPressureData();
+  frame->number = number;
+  frame->cols = grid.getColCount();
+  frame->rows = grid.getRowCount();
+  frame->velocityX.resize(cells);
+  frame->velocityY.resize(cells);
+  frame->pressure.resize(cells);
+  frame->cellType.resize(cells);
+  for (unsigned i = 0; i < cells; ++i) {
+    const unsigned j = i / cols * stride + i % cols;
+    frame->velocityX[i] = cell[j].vel[Cell::X];
+    frame->velocityY[i] = cell[j].vel[Cell::Y];
+    frame->pressure[i]  = pressure[j];
+    frame->cellType[i]  = cell[j].cellType;
+  }
+  const ParticleArray &particles = solver.getParticles();
+  frame->particles.resize(2 * particles.size());
+  for (unsigned i = 0; i < particles.size(); ++i) {
+    frame->particles[2 * i]     = particles[i].x;
+    frame->particles[2 * i + 1] = particles[i].y;
+  }
+
+  pthread_mutex_lock(&_mutex);
+  _queue.push_back(frame);
+  pthread_cond_signal(&_queued);
+  pthread_mutex_unlock(&_mutex);
+  return true;
+}
+
+
+unsigned VtkExporter::getWrittenCount() const
+{
+  pthread_mutex_lock(&_mutex);
+  const unsigned count = _written;
+  pthread_mutex_unlock(&_mutex);
+  return count;
+}
+
+
+unsigned VtkExporter::getDroppedCount() const
+{
+  pthread_mutex_lock(&_mutex);
+  const unsigned count = _dropped;
+  pthread_mutex_unlock(&_mutex);
+  return count;
+}
+
+
+unsigned VtkExporter::getFailedCount() const
+{
+  pthread_mutex_lock(&_mutex);
+  const unsigned count = _failed;
+  pthread_mutex_unlock(&_mutex);
+  return count;
+}
+
+
+string VtkExporter::getFieldsPath(unsigned frame) const
+{
+  return framePath(_directory, "fields", frame, "vti");
+}
+
+
+string VtkExporter::getParticlesPath(unsigned frame) const
+{
+  return framePath(_directory, "particles", frame, "vtp");
+}
+
+
+void * VtkExporter::writeThread(void *exporter)
+{
+  static_cast<VtkExporter *>(exporter)->write();
+  return NULL;
+}
+
+
+void VtkExporter::write()
+{
+  for (;;) {
+    pthread_mutex_lock(&_mutex);
+    while (_queue.empty() && !_stop)
+      pthread_cond_wait(&_queued, &_mutex);
+    if (_queue.empty()) {
+      pthread_mutex_unlock(&_mutex);
+      return;
+    }
+    Frame *frame = _queue.front();
+    _queue.pop_front();
+    pthread_mutex_unlock(&_mutex);
+
+    const bool ok = writeFields(*frame) && writeParticles(*frame);
+
+    pthread_mutex_lock(&_mutex);
+    if (ok)
+      ++_written;
+    else
+      ++_failed;
+    _free.push_back(frame);
+    pthread_cond_signal(&_freed);
+    pthread_mutex_unlock(&_mutex);
+  }
+}
+
+
+bool VtkExporter::writeFields(const Frame &frame)
+{
+  // Derive the exported fields for the simulation's cells, leaving out the
+  // grid's extra row and column.  Velocity is averaged from the faces to
+  // the cell centers.
+  const unsigned cols = frame.cols;
+  const unsigned width = cols - 1;
+  const unsigned height = frame.rows - 1;
+  const unsigned cells = width * height;
+  _scratch.resize(5 * cells);
+  float *velocity   = &_scratch[0];
+  float *pressure   = velocity + 3 * cells;
+  float *divergence = pressure + cells;
+  vector<uint8_t> cellType(cells);
+  for (unsigned y = 0, c = 0; y < height; ++y)
+    for (unsigned x = 0; x < width; ++x, ++c) {
+      const unsigned i = y * cols + x;
+      const float u0 = frame.velocityX[i], u1 = frame.velocityX[i + 1];
+      const float v0 = frame.velocityY[i], v1 = frame.velocityY[i + cols];
+      velocity[3 * c]     = 0.5f * (u0 + u1);
+      velocity[3 * c + 1] = 0.5f * (v0 + v1);
+      velocity[3 * c + 2] = 0.0f;
+      pressure[c]   = frame.pressure[i];
+      divergence[c] = (u1 - u0) + (v1 - v0);
+      cellType[c]   = frame.cellType[i];
+    }
+
+  // Lay the file out: the XML header, then the arrays appended raw.
+  const uint32_t velocityBytes = 3 * cells * sizeof(float);
+  const uint32_t scalarBytes = cells * sizeof(float);
+  const uint32_t typeBytes = cells * sizeof(uint8_t);
+  std::ostringstream header;
+  header << "<?xml version=\"1.0\"?>\n"
+	 << "<VTKFile type=\"ImageData\" version=\"1.0\" byte_order=\""
+	 << byteOrder() << "\" header_type=\"UInt32\">\n"
+	 << "  <ImageData WholeExtent=\"0 " << width << " 0 " << height
+	 << " 0 0\" Origin=\"0 0 0\" Spacing=\"1 1 1\">\n"
+	 << "    <Piece Extent=\"0 " << width << " 0 " << height
+	 << " 0 0\">\n"
+	 << "      <CellData Scalars=\"pressure\" Vectors=\"velocity\">\n"
+	 << "        <DataArray type=\"Float32\" Name=\"velocity\" "
+	 << "NumberOfComponents=\"3\" format=\"appended\" offset=\"0\"/>\n"
+	 << "        <DataArray type=\"Float32\" Name=\"pressure\" "
+	 << "format=\"appended\" offset=\"" << 4 + velocityBytes << "\"/>\n"
+	 << "        <DataArray type=\"Float32\" Name=\"divergence\" "
+	 << "format=\"appended\" offset=\""
+	 << 8 + velocityBytes + scalarBytes << "\"/>\n"
+	 << "        <DataArray type=\"UInt8\" Name=\"cellType\" "
+	 << "format=\"appended\" offset=\""
+	 << 12 + velocityBytes + 2 * scalarBytes << "\"/>\n"
+	 << "      </CellData>\n"
+	 << "    </Piece>\n"
+	 << "  </ImageData>\n"
+	 << "  <AppendedData encoding=\"raw\">\n   _";
+  _file.clear();
+  append(_file, header.str());
+  appendArray(_file, velocity, velocityBytes);
+  appendArray(_file, pressure, scalarBytes);
+  appendArray(_file, divergence, scalarBytes);
+  appendArray(_file, cells ? &cellType[0] : NULL, typeBytes);
+  append(_file, string("\n  </AppendedData>\n</VTKFile>\n"));
+  return writeFile(getFieldsPath(frame.number));
+}
+
+
+bool VtkExporter::writeParticles(const Frame &frame)
+{
+  // The particles are points, joined into a single poly-vertex cell.
+  const unsigned count = frame.particles.size() / 2;
+  _scratch.resize(3 * count);
+  for (unsigned i = 0; i < count; ++i) {
+    _scratch[3 * i]     = frame.particles[2 * i];
+    _scratch[3 * i + 1] = frame.particles[2 * i + 1];
+    _scratch[3 * i + 2] = 0.0f;
+  }
+  vector<int32_t> connectivity(count);
+  for (unsigned i = 0; i < count; ++i)
+    connectivity[i] = i;
+  const int32_t offsets = count;
+
+  const uint32_t pointBytes = 3 * count * sizeof(float);
+  const uint32_t connectivityBytes = count * sizeof(int32_t);
+  const unsigned cellCount = count ? 1 : 0;
+  std::ostringstream header;
+  header << "<?xml version=\"1.0\"?>\n"
+	 << "<VTKFile type=\"PolyData\" version=\"1.0\" byte_order=\""
+	 << byteOrder() << "\" header_type=\"UInt32\">\n"
+	 << "  <PolyData>\n"
+	 << "    <Piece NumberOfPoints=\"" << count << "\" NumberOfVerts=\""
+	 << cellCount << "\" NumberOfLines=\"0\" NumberOfStrips=\"0\" "
+	 << "NumberOfPolys=\"0\">\n"
+	 << "      <Points>\n"
+	 << "        <DataArray type=\"Float32\" NumberOfComponents=\"3\" "
+	 << "format=\"appended\" offset=\"0\"/>\n"
+	 << "      </Points>\n"
+	 << "      <Verts>\n"
+	 << "        <DataArray type=\"Int32\" Name=\"connectivity\" "
+	 << "format=\"appended\" offset=\"" << 4 + pointBytes << "\"/>\n"
+	 << "        <DataArray type=\"Int32\" Name=\"offsets\" "
+	 << "format=\"appended\" offset=\""
+	 << 8 + pointBytes + connectivityBytes << "\"/>\n"
+	 << "      </Verts>\n"
+	 << "    </Piece>\n"
+	 << "  </PolyData>\n"
+	 << "  <AppendedData encoding=\"raw\">\n   _";
+  _file.clear();
+  append(_file, header.str());
+  appendArray(_file, count ? &_scratch[0] : NULL, pointBytes);
+  appendArray(_file, count ? &connectivity[0] : NULL, connectivityBytes);
+  appendArray(_file, &offsets, cellCount * sizeof(int32_t));
+  append(_file, string("\n  </AppendedData>\n</VTKFile>\n"));
+  return writeFile(getParticlesPath(frame.number));
+}
+
+
+bool VtkExporter::writeFile(const string &path)
+{
+  const string partial = path + ".part";
+  FILE *out = fopen(partial.c_str(), "wb");
+  if (!out)
+    return false;
+  bool ok = fwrite(&_file[0], 1, _file.size(), out) == _file.size();
+  ok = (fclose(out) == 0) && ok;
+  if (ok)
+    ok = rename(partial.c_str(), path.c_str()) == 0;
+  else
+    remove(partial.c_str());
+  return ok;
+}
@@ -0,0 +1,144 @@
+#ifndef __VTK_EXPORTER_H__
+#define __VTK_EXPORTER_H__
+
+#include <pthread.h>
+#include <stdint.h>
+#include <deque>
+#include <string>
+#include <vector>
+
+class FluidSolver;
+
+// Exports simulation frames for analysis tools such as ParaView, as VTK XML
+// files in a directory:
+//
+//   fields_NNNNNN.vti     ImageData with one cell per simulation cell, and
+//                         the cell data velocity (at cell centers), pressure,
+//                         divergence and cellType (Cell::Type).
+//   particles_NNNNNN.vtp  PolyData holding the marker particles as points.
+//
+// where NNNNNN is the frame number.  Arrays are stored as raw binary
+// appended data, in the host's byte order.
+//
+// The solver's thread only copies the grid's arrays and the particles into
+// a free frame buffer and queues it.  A background thread derives the
+// exported fields, lays each file out in memory and writes it with a single
+// large write, so export never adds file I/O to the frame time.  A file
+// appears under its final name only once it is complete.
+class VtkExporter {
+public:
+  // Constructs a closed exporter.
+  //
+  // Arguments:
+  //   None
+  VtkExporter();
+
+  // Closes the exporter, writing every queued frame first.
+  ~VtkExporter();
+
+  // Starts exporting into a directory, which is created if it is missing.
+  //
+  // Arguments:
+  //   std::string &directory - The directory receiving the files.
+  //   unsigned interval - Export every interval'th frame published,
+  //     starting with the first.
+  //
+  // Returns:
+  //   bool - True on success.
+  bool open(const std::string &directory, unsigned interval = 1);
+
+  // Writes every queued frame, then stops the background thread.
+  //
+  // Arguments:
+  //   None
+  //
+  // Returns:
+  //   None
+  void close();
+
+  // Returns whether the exporter is open.
+  bool isOpen() const;
+
+  // Sets whether publish() drops frames when every frame buffer is still
+  // queued (the default), or waits for one to be written.  Batch runs that
+  // need every frame wait; interactive ones drop.
+  void setDropFrames(bool drop);
+
+  // Counts a frame of the simulation, queuing it for export if it is due.
+  // Never waits on the disk unless setDropFrames(false) was called: when
+  // every frame buffer is still queued, the frame is dropped instead.
+  //
+  // Arguments:
+  //   FluidSolver &solver - The simulation.
+  //
+  // Returns:
+  //   bool - False if the exporter is closed, or the frame was due but
+  //     dropped.
+  bool publish(const FluidSolver &solver);
+
+  // Returns the number of frames written, dropped by publish(), or that
+  // failed to be written, so far.
+  unsigned getWrittenCount() const;
+  unsigned getDroppedCount() const;
+  unsigned getFailedCount() const;
+
+  // Returns the path of a frame's fields or particles file.
+  std::string getFieldsPath(unsigned frame) const;
+  std::string getParticlesPath(unsigned frame) const;
+
+private:
+  // A frame copied from the solver, as the grid stores it.
+  struct Frame {
+    unsigned             number;      // The frame's number.
+    unsigned             cols;        // Grid columns, extra one included.
+    unsigned             rows;        // Grid rows, extra one included.
+    std::vector<float>   velocityX;   // Face velocities, cols * rows.
+    std::vector<float>   velocityY;
+    std::vector<float>   pressure;    // Cell pressures, cols * rows.
+    std::vector<uint8_t> cellType;    // Cell types, cols * rows.
+    std::vector<float>   particles;   // Particle x, y pairs.
+  };
+
+  // The most frame buffers allocated; beyond this, publish() drops frames.
+  static const unsigned MAX_FRAMES = 8;
+
+  // The background thread's loop, and its pthread entry point.
+  void write();
+  static void * writeThread(void *exporter);
+
+  // Writes one frame's files.  Returns false on failure.
+  bool writeFields(const Frame &frame);
+  bool writeParticles(const Frame &frame);
+
+  // Writes the file laid out in _file, under a temporary name first.
+  bool writeFile(const std::string &path);
+
+  // Not copyable.
+  VtkExporter(const VtkExporter &);
+  VtkExporter & operator=(const VtkExporter &);
+
+  std::string        _directory;  // The directory receiving the files.
+  unsigned           _interval;   // Frames between exported frames.
+  unsigned           _frame;      // Number of the next frame published.
+  pthread_t          _thread;     // The background thread.
+  bool               _running;    // True while the thread runs.
+  bool               _drop;       // Drop frames rather than wait.
+
+  // Guarded by _mutex.
+  mutable pthread_mutex_t _mutex;
+  pthread_cond_t     _queued;     // Signaled when a frame is queued.
+  pthread_cond_t     _freed;      // Signaled when a frame is written.
+  bool               _stop;       // Set to make the thread exit.
+  std::deque<Frame *> _queue;     // Frames awaiting export, oldest first.
+  std::vector<Frame *> _free;     // Frame buffers ready for reuse.
+  unsigned           _allocated;  // Frame buffers allocated.
+  unsigned           _written;    // Frames written.
+  unsigned           _dropped;    // Frames dropped by publish().
+  unsigned           _failed;     // Frames that couldn't be written.
+
+  // Owned by the background thread.
+  std::vector<char>  _file;       // The file being laid out.
+  std::vector<float> _scratch;    // Fields derived for export.
+};
+
+#endif // __VTK_EXPORTER_H__
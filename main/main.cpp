@@ -2,25 +2,41 @@
 #include <QTimer>
 #include <vector>
 #include <algorithm>
+#include <cstdio>
 #include "MainWindow.h"
 #include "FluidSolver.h"
+#include "AutoTuner.h"
+#include "SignalRelay.h"
 
 using namespace std;
 
 
-// TODO - YUCK - This global variable is a temporary hack!!!
-FluidSolver *solver = NULL;
-
 int main(int argc, char *argv[])
 {
   // Create the Qt application.
   QApplication app(argc, argv);
 
+  // Run with the settings measured fastest on this machine, calibrating
+  // them the first time this grid size runs here.  They apply before the
+  // solver exists, so its fields are first touched by its OpenMP threads.
+  AutoTuner tuner;
+  AutoTuner::Settings settings;
+  const std::string profile = AutoTuner::getDefaultProfilePath();
+  if (!tuner.tune(profile, 8, 8, settings))
+    fprintf(stderr, "Could not save solver settings to %s\n",
+	    profile.c_str());
+  AutoTuner::apply(settings);
+
   // Instantiate the Fluid Solver using the initial velocity field.
-  solver = new FluidSolver(8.0f, 8.0f);
+  FluidSolver *solver = new FluidSolver(8.0f, 8.0f);
+  solver->setPreconditioner(settings.preconditioner);
+
+  // Let the UI's reset requests reach this particular solver.
+  QObject::connect(SignalRelay::getInstance(), SIGNAL(resetSimulation()),
+		   solver, SLOT(reset()));
   
   // Create and realize UI widgets.
-  MainWindow window;
+  MainWindow window(solver);
   window.resize(window.sizeHint());
   window.show();
 
@@ -1,9 +1,6 @@
 #include "CompatibilityRenderer.h"
 #include <cstdio>
 
-// TODO - YUCK - This global variable is a temporary hack!!!
-#include "FluidSolver.h"
-extern FluidSolver *solver;
 using std::vector;
 
 QGLFormat CompatibilityRenderer::getFormat()
@@ -36,15 +33,16 @@ void CompatibilityRenderer::initialize()
 }
 
 
-void CompatibilityRenderer::resize(int pixWidth, int pixHeight)
+void CompatibilityRenderer::resize(int pixWidth, int pixHeight,
+                                   float simWidth, float simHeight)
 {
   // Define a viewport based on widget size.
   glViewport(0, 0, pixWidth, pixHeight);
 
   // For the purpose of fitting the grid within the rendering area, take into
   // account a margin of 1 cell around the grid.
-  unsigned rawWidth  = solver->getSimulationWidth();
-  unsigned rawHeight = solver->getSimulationHeight();
+  unsigned rawWidth  = simWidth;
+  unsigned rawHeight = simHeight;
   unsigned paddedWidth  = rawWidth + 2;
   unsigned paddedHeight = rawHeight + 2;
 
@@ -82,7 +80,7 @@ void CompatibilityRenderer::resize(int pixWidth, int pixHeight)
 
 
 void CompatibilityRenderer::drawGrid(const Grid &grid, 
-                                     const vector<Vector2> &particles)
+                                     const ParticleArray &particles)
 {
   // Get grid dimensions.
   float height = grid.getRowCount();
@@ -111,29 +109,33 @@ void CompatibilityRenderer::drawGrid(const Grid &grid,
   }
   glEnd();
 
-  // Color the cells gray if they currently contain liquid.
+  // Tint the simulation area, then outline the liquid.  The outline's
+  // segments are already in one contiguous array, so they are drawn with a
+  // single call.
   glPushAttrib(GL_DEPTH_BUFFER_BIT);
   glDepthMask(GL_FALSE);
-  for (unsigned y = 0; y < height; ++y) {
-    for (unsigned x = 0; x < width; ++x) {
-      if (grid(x, y).cellType == Cell::SOLID)
-	continue;
-      if (grid(x, y).cellType == Cell::FLUID)
-	glColor4f(0.65f, 0.65f, 1.0f, 0.1f);
-      if (grid(x, y).cellType == Cell::AIR)
-	glColor4f(1.0f, 1.0f, 1.0f, 0.1f);
-      glBegin(GL_TRIANGLES);
-      glVertex2f(x, y);
-      glVertex2f(x+1, y);
-      glVertex2f(x+1, y+1);
-      glVertex2f(x+1, y+1);
-      glVertex2f(x, y+1);
-      glVertex2f(x, y);
-      glEnd();
-    }
-  }
+  glColor4f(1.0f, 1.0f, 1.0f, 0.1f);
+  glBegin(GL_TRIANGLES);
+  glVertex2f(0, 0);
+  glVertex2f(grid.getWidth(), 0);
+  glVertex2f(grid.getWidth(), grid.getHeight());
+  glVertex2f(grid.getWidth(), grid.getHeight());
+  glVertex2f(0, grid.getHeight());
+  glVertex2f(0, 0);
+  glEnd();
   glPopAttrib();
 
+  _surface.sampleParticles(grid, particles);
+  _surface.extract();
+  const vector<Vector2> &outline = _surface.getVertices();
+  if (!outline.empty()) {
+    glColor4f(0.65f, 0.65f, 1.0f, 1.0f);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(2, GL_FLOAT, sizeof(Vector2), &outline[0]);
+    glDrawArrays(GL_LINES, 0, outline.size());
+    glDisableClientState(GL_VERTEX_ARRAY);
+  }
+
   // Draw the MAC velocity vectors.
   glColor4f(0.5f, 0.0f, 0.0f, 1.0f);
   for (unsigned y = 0; y < height; ++y) {
@@ -166,7 +168,7 @@ void CompatibilityRenderer::drawGrid(const Grid &grid,
 
   glColor4f(0.0f, 0.6f, 0.8f, 1.0f);
   glBegin(GL_POINTS);
-  vector<Vector2>::const_iterator itr = particles.begin();
+  ParticleArray::const_iterator itr = particles.begin();
   for(; itr != particles.end(); ++itr)
   {
     glVertex2f(itr->x, itr->y);
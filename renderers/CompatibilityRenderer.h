@@ -5,6 +5,7 @@
 #include <vector>
 #include "IFluidRenderer.h"
 #include "Grid.h"
+#include "SurfaceExtractor.h"
 
 
 class CompatibilityRenderer : public IFluidRenderer
@@ -47,25 +48,31 @@ public:
   // Arguments:
   //   int pixWidth - The new width of the widget, in pixels.
   //   int pixHeight - The new height of the widget, in pixels.
+  //   float simWidth - The width of the drawn simulation, in world coordinates.
+  //   float simHeight - The height of the drawn simulation, in world coords.
   //
   // Returns:
   //   None
-  virtual void resize(int pixWidth, int pixHeight);
+  virtual void resize(int pixWidth, int pixHeight,
+                      float simWidth, float simHeight);
 
-  // Renders the fluid simulation grid, the contents of each cell
-  // (liquid, solid, or gas), and velocity vectors at the center of each
-  // cell.  This also renders the particles representing the fluid.
+  // Renders the fluid simulation grid, the outline of the liquid, and
+  // velocity vectors at the center of each cell.  This also renders the
+  // particles representing the fluid.
   //
   // Should typically be called from the FluidSolver class.
   //
   // Arguments:
   //   Grid &grid - The grid object containing all simulation cell data.
-  //   vector<Vector2> &particles- The particles visually representing the fluid.
+  //   ParticleArray &particles- The particles visually representing the fluid.
   //
   // Returns:
   //   None
   virtual void drawGrid(const Grid &grid, 
-                        const std::vector<Vector2> &particles);
+                        const ParticleArray &particles);
+
+private:
+  SurfaceExtractor _surface;  // Outlines the liquid each frame.
 };
 
 #endif // __COMPATIBILITY_RENDERER_H__
@@ -41,21 +41,24 @@ public:
   // Arguments:
   //   int pixWidth - The new width of the widget, in pixels.
   //   int pixHeight - The new height of the widget, in pixels.
+  //   float simWidth - The width of the drawn simulation, in world coordinates.
+  //   float simHeight - The height of the drawn simulation, in world coords.
   //
   // Returns:
   //   None
-  virtual void resize(int pixWidth, int pixHeight) = 0;
+  virtual void resize(int pixWidth, int pixHeight,
+                      float simWidth, float simHeight) = 0;
 
   // Renders the fluid simulation grid.
   //
   // Arguments:
   //   Grid &grid - The grid object containing all simulation cell data.
-  //   vector<Vector2> &particles - The particles visually representing fluid.
+  //   ParticleArray &particles - The particles visually representing fluid.
   //
   // Returns:
   //   None
   virtual void drawGrid(const Grid &grid, 
-                        const std::vector<Vector2> &particles) = 0;
+                        const ParticleArray &particles) = 0;
 };
 
 #endif // __FLUID_RENDERER_H__
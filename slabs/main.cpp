@@ -0,0 +1,178 @@
+#include <omp.h>
+#include <sched.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "Kernels.h"
+#include "SlabSolver.h"
+#include "SharedMemoryTransport.h"
+
+// Returns the current wall-clock time, in seconds.
+static double wallTime()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+// Returns the CPUs this process may run on, in order.
+static std::vector<int> allowedCpus()
+{
+  std::vector<int> cpus;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) == 0)
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+      if (CPU_ISSET(cpu, &set))
+	cpus.push_back(cpu);
+  return cpus;
+}
+
+
+// Pins the calling process to one CPU.  Returns false if it couldn't be.
+static bool pinToCpu(int cpu)
+{
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+
+// Simulates one slab in a child process.  Slab 0 reports timings, and
+// writes the elapsed time to the parent through the given pipe.
+static int runSlab(SharedMemoryTransport &transport, float width,
+		   float height, unsigned slab, unsigned frames, int report)
+{
+  SlabSolver solver(width, height, &transport, slab);
+  transport.barrier();
+
+  double start = wallTime();
+  unsigned iterations = 0;
+  for (unsigned frame = 0; frame < frames; ++frame) {
+    solver.advanceFrame();
+    iterations += solver.getLastIterationCount();
+  }
+  transport.barrier();
+  double elapsed = wallTime() - start;
+
+  unsigned particles = solver.getGlobalParticleCount();
+  if (slab == 0) {
+    printf("%u slabs: %.3f s total, %.2f ms/frame, %u particles, "
+	   "%u CG iterations at frame ends, %s kernels\n",
+	   transport.getSlabCount(), elapsed, 1000.0 * elapsed / frames,
+	   particles, iterations, Kernels::get().name);
+    if (write(report, &elapsed, sizeof(elapsed)) != sizeof(elapsed))
+      return 1;
+  }
+
+  // Children leave via _exit(), which doesn't flush stdio.
+  fflush(stdout);
+  return 0;
+}
+
+
+// Runs the simulation split into slabCount processes.  Returns the elapsed
+// time, or a negative value on failure.
+static double runDecomposed(float width, float height, unsigned slabCount,
+			    unsigned frames)
+{
+  // Create the shared segment, then fork one process per slab.
+  std::ostringstream name;
+  name << "/fluid-slabs-" << getpid() << "-" << slabCount;
+  SharedMemoryTransport transport;
+  if (!transport.create(name.str(), slabCount,
+			SlabSolver::getHaloCapacity(width), 4096)) {
+    perror("shm_open");
+    return -1.0;
+  }
+  int report[2];
+  if (pipe(report) != 0) {
+    perror("pipe");
+    return -1.0;
+  }
+
+  // Each slab gets its own CPU, so its solver's pages are first touched,
+  // and stay, on that CPU's node.  With more slabs than CPUs they share.
+  const std::vector<int> cpus = allowedCpus();
+
+  fflush(stdout);
+  int failures = 0;
+  unsigned started = 0;
+  for (; started < slabCount; ++started) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      close(report[0]);
+      if (!cpus.empty() && !pinToCpu(cpus[started % cpus.size()]))
+	perror("sched_setaffinity");
+      // One slab per core, so the solver runs single-threaded.
+      omp_set_num_threads(1);
+      _exit(runSlab(transport, width, height, started, frames, report[1]));
+    }
+    if (pid < 0) {
+      perror("fork");
+      ++failures;
+      break;
+    }
+  }
+  close(report[1]);
+
+  // A slab that failed to start leaves the others waiting at a barrier.
+  double elapsed = -1.0;
+  if (failures == 0 &&
+      read(report[0], &elapsed, sizeof(elapsed)) != sizeof(elapsed))
+    elapsed = -1.0;
+  close(report[0]);
+  for (unsigned slab = 0; slab < started; ++slab) {
+    int status = 0;
+    if (wait(&status) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+      ++failures;
+  }
+  return failures ? -1.0 : elapsed;
+}
+
+
+int main(int argc, char *argv[])
+{
+  if (argc != 5) {
+    fprintf(stderr, "Usage: %s <width> <height> <max processes> <frames>\n",
+	    argv[0]);
+    return 1;
+  }
+  float width = atof(argv[1]);
+  float height = atof(argv[2]);
+  unsigned frames = atoi(argv[4]);
+
+  // Limit the process count to what the grid can be split into.
+  unsigned maxSlabs =
+    SlabSolver::decompose(height, atoi(argv[3])).getSlabCount();
+
+  // Measure scaling over doubling process counts, up to the maximum.
+  std::vector<unsigned> counts;
+  for (unsigned count = 1; count < maxSlabs; count *= 2)
+    counts.push_back(count);
+  counts.push_back(maxSlabs);
+  std::vector<double> times;
+  for (unsigned i = 0; i < counts.size(); ++i) {
+    double elapsed = runDecomposed(width, height, counts[i], frames);
+    if (elapsed < 0.0) {
+      fprintf(stderr, "%u slabs: run failed\n", counts[i]);
+      return 1;
+    }
+    times.push_back(elapsed);
+  }
+
+  printf("\nscaling for %gx%g, %u frames:\n", width, height, frames);
+  printf("  slabs  ms/frame  speedup  efficiency\n");
+  for (unsigned i = 0; i < counts.size(); ++i) {
+    const double speedup = times[0] / times[i];
+    printf("  %5u  %8.2f  %7.2f  %9.0f%%\n", counts[i],
+	   1000.0 * times[i] / frames, speedup, 100.0 * speedup / counts[i]);
+  }
+  return 0;
+}
@@ -0,0 +1,6 @@
+include(../sources.pri)
+
+TEMPLATE = app
+TARGET   = fluid-slabs
+
+SOURCES += main.cpp
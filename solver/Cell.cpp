@@ -1,8 +1,7 @@
 #include "Cell.h"
 
 Cell::Cell()
-  : pressure(0.0f),
-    cellType(AIR),
+  : cellType(AIR),
     allNeighbors(false)
 {
   // Initialize arrays.
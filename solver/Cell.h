@@ -30,8 +30,7 @@ struct Cell {
   };
 
 
-  // Public data members.
-  float pressure;             // Pressure, as sampled at the center of this cell
+  // Public data members.  Pressure is kept by Grid, in one contiguous array.
   float vel[DIM_COUNT];       // Velocity component, as sampled at the faces.
   float stagedVel[DIM_COUNT]; // Temp vel. component, as sampled at faces.
   Type  cellType;             // Contents type of this cell.
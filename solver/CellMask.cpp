@@ -0,0 +1,35 @@
+#include "CellMask.h"
+#include <algorithm>
+
+CellMask::CellMask(unsigned colCount, unsigned rowCount)
+  : _colCount(colCount),
+    _rowCount(rowCount),
+    _wordsPerRow((colCount + CELLS_PER_WORD - 1) / CELLS_PER_WORD),
+    _tileColCount((colCount + TILE_SIZE - 1) / TILE_SIZE),
+    _tileRowCount((rowCount + TILE_SIZE - 1) / TILE_SIZE)
+{
+  // AIR is zero, so zeroed storage is an all-AIR mask.
+  _types.resize(_wordsPerRow * _rowCount);
+  _rows.resize((_rowCount + 31) / 32);
+  _tiles.resize((_tileColCount * _tileRowCount + 31) / 32);
+}
+
+
+void CellMask::clear()
+{
+  std::fill(_types.begin(), _types.end(), 0u);
+  std::fill(_rows.begin(), _rows.end(), 0u);
+  std::fill(_tiles.begin(), _tiles.end(), 0u);
+}
+
+
+void CellMask::clearFluid()
+{
+  // FLUID (01) becomes AIR (00) by clearing each cell's low bit; SOLID (10)
+  // has no low bit set, and is unaffected.
+  std::vector<uint32_t>::iterator itr = _types.begin();
+  for (; itr != _types.end(); ++itr)
+    *itr &= ~FLUID_BITS;
+  std::fill(_rows.begin(), _rows.end(), 0u);
+  std::fill(_tiles.begin(), _tiles.end(), 0u);
+}
@@ -0,0 +1,164 @@
+#ifndef __CELL_MASK_H__
+#define __CELL_MASK_H__
+
+#include <stdint.h>
+#include <vector>
+#include "Cell.h"
+
+// A compact copy of every cell's type.  Types are packed two bits per cell,
+// sixteen cells per 32-bit word, so a pass can classify a row of cells
+// without touching the Cell structs themselves.  Alongside the packed types,
+// one bit per row and one bit per TILE_SIZE x TILE_SIZE tile record whether
+// that row or tile may contain FLUID, letting passes skip empty regions with
+// a single test.
+//
+// The row and tile bits are conservative: they are set whenever a cell is
+// set to FLUID, and only cleared by clear() and clearFluid().  A set bit
+// means "may contain fluid"; a clear bit means "contains no fluid".
+class CellMask {
+  unsigned _colCount;     // The number of cells per row.
+  unsigned _rowCount;     // The number of rows.
+  unsigned _wordsPerRow;  // Packed words per row of cells.
+  unsigned _tileColCount; // The number of tiles per row of tiles.
+  unsigned _tileRowCount; // The number of rows of tiles.
+  std::vector<uint32_t> _types; // Packed cell types, row-major.
+  std::vector<uint32_t> _rows;  // One "may contain fluid" bit per row.
+  std::vector<uint32_t> _tiles; // One "may contain fluid" bit per tile.
+
+public:
+  // The width and height of a tile, in cells.
+  static const unsigned TILE_SIZE = 8;
+
+  // The number of cells packed into each word of getRow().
+  static const unsigned CELLS_PER_WORD = 16;
+
+  // Selects the low bit of every cell's type in a packed word.  As FLUID is
+  // the only type with its low bit set, word & FLUID_BITS has a bit set
+  // exactly for the FLUID cells.
+  static const uint32_t FLUID_BITS = 0x55555555u;
+
+  // Constructs a mask of colCount by rowCount AIR cells.
+  //
+  // Arguments:
+  //   unsigned colCount - The number of cells per row.
+  //   unsigned rowCount - The number of rows.
+  CellMask(unsigned colCount = 0, unsigned rowCount = 0);
+
+  // Sets every cell to AIR.
+  //
+  // Arguments:
+  //   None
+  //
+  // Returns:
+  //   None
+  void clear();
+
+  // Sets every FLUID cell to AIR, leaving SOLID cells unchanged.
+  //
+  // Arguments:
+  //   None
+  //
+  // Returns:
+  //   None
+  void clearFluid();
+
+  // Gets or sets the type of one cell.
+  inline Cell::Type get(unsigned x, unsigned y) const;
+  inline void set(unsigned x, unsigned y, Cell::Type type);
+
+  // Determines whether one cell is FLUID.
+  inline bool isFluid(unsigned x, unsigned y) const;
+
+  // Determines whether a row, or the tile at tile coordinates (tx, ty),
+  // may contain FLUID cells.
+  inline bool rowHasFluid(unsigned y) const;
+  inline bool tileHasFluid(unsigned tx, unsigned ty) const;
+
+  // Gets the packed types of a row, getWordsPerRow() words long.  Cell x of
+  // the row is bits 2 * (x % 16) and up of word x / 16.
+  inline const uint32_t * getRow(unsigned y) const;
+
+  // Gets the dimensions of the mask.
+  inline unsigned getColCount() const;
+  inline unsigned getRowCount() const;
+  inline unsigned getWordsPerRow() const;
+  inline unsigned getTileColCount() const;
+  inline unsigned getTileRowCount() const;
+};
+
+
+Cell::Type CellMask::get(unsigned x, unsigned y) const
+{
+  const uint32_t word = _types[y * _wordsPerRow + x / CELLS_PER_WORD];
+  return static_cast<Cell::Type>((word >> (2 * (x % CELLS_PER_WORD))) & 3u);
+}
+
+
+void CellMask::set(unsigned x, unsigned y, Cell::Type type)
+{
+  const unsigned shift = 2 * (x % CELLS_PER_WORD);
+  uint32_t &word = _types[y * _wordsPerRow + x / CELLS_PER_WORD];
+  word = (word & ~(3u << shift)) | (static_cast<uint32_t>(type) << shift);
+  if (type == Cell::FLUID) {
+    _rows[y / 32] |= 1u << (y % 32);
+    const unsigned tile = (y / TILE_SIZE) * _tileColCount + x / TILE_SIZE;
+    _tiles[tile / 32] |= 1u << (tile % 32);
+  }
+}
+
+
+bool CellMask::isFluid(unsigned x, unsigned y) const
+{
+  return get(x, y) == Cell::FLUID;
+}
+
+
+bool CellMask::rowHasFluid(unsigned y) const
+{
+  return (_rows[y / 32] >> (y % 32)) & 1u;
+}
+
+
+bool CellMask::tileHasFluid(unsigned tx, unsigned ty) const
+{
+  const unsigned tile = ty * _tileColCount + tx;
+  return (_tiles[tile / 32] >> (tile % 32)) & 1u;
+}
+
+
+const uint32_t * CellMask::getRow(unsigned y) const
+{
+  return &_types[y * _wordsPerRow];
+}
+
+
+unsigned CellMask::getColCount() const
+{
+  return _colCount;
+}
+
+
+unsigned CellMask::getRowCount() const
+{
+  return _rowCount;
+}
+
+
+unsigned CellMask::getWordsPerRow() const
+{
+  return _wordsPerRow;
+}
+
+
+unsigned CellMask::getTileColCount() const
+{
+  return _tileColCount;
+}
+
+
+unsigned CellMask::getTileRowCount() const
+{
+  return _tileRowCount;
+}
+
+#endif // __CELL_MASK_H__
@@ -0,0 +1,88 @@
+#include "CommandQueue.h"
+
+SolverCommand::SolverCommand(Type type)
+  : type(type),
+    position(),
+    value(),
+    radius(0.0f),
+    scalar(0.0f)
+{}
+
+
+SolverCommand SolverCommand::force(Vector2 position, Vector2 velocity,
+				   float radius)
+{
+  SolverCommand command(ADD_FORCE);
+  command.position = position;
+  command.value = velocity;
+  command.radius = radius;
+  return command;
+}
+
+
+CommandQueue::CommandQueue(unsigned capacity)
+  : _slots(),
+    _mask(0),
+    _tail(0),
+    _head(0)
+{
+  unsigned size = 2;
+  while (size < capacity)
+    size *= 2;
+  _slots.resize(size);
+  _mask = size - 1;
+
+  // Every slot starts out free for the producer of its own position.
+  for (unsigned i = 0; i < size; ++i)
+    _slots[i].sequence = i;
+}
+
+
+bool CommandQueue::push(const SolverCommand &command)
+{
+  // Claim the next position whose slot the consumer has released.  The
+  // difference is taken as signed so that positions may wrap around.
+  unsigned position = __atomic_load_n(&_tail, __ATOMIC_RELAXED);
+  Slot *slot;
+  for (;;) {
+    slot = &_slots[position & _mask];
+    const unsigned sequence =
+      __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+    const int difference = int(sequence - position);
+    if (difference == 0) {
+      if (__atomic_compare_exchange_n(&_tail, &position, position + 1, true,
+				      __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+	break;
+      // On failure, position now holds the current tail; retry with it.
+    }
+    else if (difference < 0)
+      return false;   // The slot still holds an unread command: full.
+    else
+      position = __atomic_load_n(&_tail, __ATOMIC_RELAXED);
+  }
+
+  // Fill the slot, then publish it to the consumer.
+  slot->command = command;
+  __atomic_store_n(&slot->sequence, position + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+
+bool CommandQueue::pop(SolverCommand &command)
+{
+  Slot &slot = _slots[_head & _mask];
+  if (__atomic_load_n(&slot.sequence, __ATOMIC_ACQUIRE) != _head + 1)
+    return false;
+
+  // Read the command, then hand the slot to the producer one lap ahead.
+  command = slot.command;
+  __atomic_store_n(&slot.sequence, _head + _mask + 1, __ATOMIC_RELEASE);
+  ++_head;
+  return true;
+}
+
+
+unsigned CommandQueue::getCapacity() const
+{
+  return _slots.size();
+}
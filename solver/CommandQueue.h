@@ -0,0 +1,118 @@
+#ifndef __COMMAND_QUEUE_H__
+#define __COMMAND_QUEUE_H__
+
+#include <vector>
+#include "Vector2.h"
+#include "FieldMemory.h"
+
+// A request for a running solver, sent from another thread (typically the
+// UI) through its CommandQueue.  The meaning of the fields depends on the
+// type.
+struct SolverCommand {
+  // Enumerated type to determine what the command does.
+  enum Type {
+    ADD_FORCE = 0,  // Push the fluid near position by value (cells/sec).
+    SET_GRAVITY,    // Set the gravity to value.
+    SET_VISCOSITY,  // Set the kinematic viscosity to scalar.
+    PAUSE,          // Stop advancing frames.
+    RESUME,         // Advance frames again.
+    STEP,           // While paused, advance a single frame.
+    RESET,          // Restart the simulation, as reset() does.
+    TYPE_COUNT
+  };
+
+  // Public data members.
+  Type     type;      // What the command does.
+  Vector2  position;  // Center of a force, world coords.
+  Vector2  value;     // Velocity change of a force, or the new gravity.
+  float    radius;    // Radius of a force, in cells.
+  float    scalar;    // The new viscosity.
+
+
+  // Constructs a command of the given type with every field zeroed.
+  //
+  // Arguments:
+  //   Type type - What the command does.
+  SolverCommand(Type type = RESET);
+
+  // Constructs an ADD_FORCE command.  The force changes the velocity of
+  // every face within radius of position, by value weighted with a smooth
+  // falloff that reaches zero at the radius.
+  //
+  // Arguments:
+  //   Vector2 position - Center of the force, world coords.
+  //   Vector2 velocity - Velocity change at the center, in cells/sec.
+  //   float radius - Radius of the force, in cells.
+  //
+  // Returns:
+  //   SolverCommand - The command.
+  static SolverCommand force(Vector2 position, Vector2 velocity,
+			     float radius);
+};
+
+
+// A bounded, lock-free queue of SolverCommands with any number of producers
+// and a single consumer.  Producers on any thread push() without blocking
+// or taking a lock: each claims a slot with one compare-and-swap on the
+// tail and publishes it by storing the slot's sequence number.  The
+// consumer (the solver's thread) pops without any atomic read-modify-write,
+// so draining an empty queue costs one load.
+//
+// Each slot's sequence number says whose turn it is: a slot at position n
+// is free for the producer of position n when its sequence is n, and holds
+// a command for the consumer when it is n + 1.  Popping the command hands
+// the slot to the producer of position n + capacity.
+class CommandQueue {
+public:
+  // Constructs an empty queue.
+  //
+  // Arguments:
+  //   unsigned capacity - The maximum number of queued commands.  Rounded
+  //     up to a power of two.
+  CommandQueue(unsigned capacity = 1024);
+
+  // Queues a command.  Safe to call from any number of threads at once.
+  // Never blocks: when the queue is full, the command is dropped.
+  //
+  // Arguments:
+  //   SolverCommand &command - The command.
+  //
+  // Returns:
+  //   bool - True if the command was queued, false if the queue was full.
+  bool push(const SolverCommand &command);
+
+  // Removes the oldest command.  Must only be called by the consumer.
+  //
+  // Arguments:
+  //   SolverCommand &command - Receives the command.
+  //
+  // Returns:
+  //   bool - True if a command was removed, false if the queue was empty.
+  bool pop(SolverCommand &command);
+
+  // Returns the maximum number of queued commands.
+  unsigned getCapacity() const;
+
+private:
+  // A slot of the ring, with the sequence number that says whose turn it is.
+  struct Slot {
+    unsigned      sequence;
+    SolverCommand command;
+  };
+
+  // Not copyable.
+  CommandQueue(const CommandQueue &);
+  CommandQueue & operator=(const CommandQueue &);
+
+  // The producers' and the consumer's positions sit on cache lines of their
+  // own, so that pushes don't invalidate the consumer's line and vice versa.
+  std::vector<Slot> _slots;   // The ring.
+  unsigned          _mask;    // Capacity - 1, to wrap positions.
+  char _pad0[FieldMemory::ALIGNMENT];
+  unsigned          _tail;    // The next position to push, shared.
+  char _pad1[FieldMemory::ALIGNMENT];
+  unsigned          _head;    // The next position to pop, consumer only.
+  char _pad2[FieldMemory::ALIGNMENT];
+};
+
+#endif // __COMMAND_QUEUE_H__
@@ -0,0 +1,115 @@
+#include "FieldMemory.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace {
+
+unsigned firstTouchThreads = 1;
+bool hugePages = true;
+
+// Rounds bytes up to a multiple of the huge page size.
+size_t mappedSize(size_t bytes)
+{
+  return (bytes + FieldMemory::HUGE_PAGE_SIZE - 1) &
+    ~(FieldMemory::HUGE_PAGE_SIZE - 1);
+}
+
+// Zeroes a block in contiguous chunks, one per thread, so that each chunk's
+// pages are placed on the node of the thread that will process it.  The
+// chunks are whole pages of the given size: a huge page is placed by
+// whichever thread touches it first, so it can't be split between threads.
+void firstTouch(void *block, size_t bytes, size_t pageSize)
+{
+  char *memory = static_cast<char *>(block);
+#ifdef _OPENMP
+  const long pages = (bytes + pageSize - 1) / pageSize;
+  if (firstTouchThreads > 1 && pages > 1) {
+#pragma omp parallel for schedule(static) num_threads(firstTouchThreads)
+    for (long page = 0; page < pages; ++page) {
+      const size_t offset = page * pageSize;
+      memset(memory + offset, 0, std::min(pageSize, bytes - offset));
+    }
+    return;
+  }
+#endif
+  memset(memory, 0, bytes);
+}
+
+}
+
+
+void * FieldMemory::allocate(size_t bytes)
+{
+  if (bytes == 0)
+    bytes = 1;
+
+#ifdef __linux__
+  // Map large blocks directly, over-allocating so the block can start on a
+  // huge page boundary, then trim the excess.
+  if (bytes >= HUGE_PAGE_SIZE) {
+    const size_t size = mappedSize(bytes);
+    void *mapping = mmap(NULL, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED)
+      return NULL;
+    char *start = static_cast<char *>(mapping);
+    char *aligned = reinterpret_cast<char *>(
+      (reinterpret_cast<uintptr_t>(start) + HUGE_PAGE_SIZE - 1) &
+      ~uintptr_t(HUGE_PAGE_SIZE - 1));
+    if (aligned > start)
+      munmap(start, aligned - start);
+    if (aligned + size < start + size + HUGE_PAGE_SIZE)
+      munmap(aligned + size, start + size + HUGE_PAGE_SIZE - aligned - size);
+
+    // With huge pages, each thread must touch whole ones, since a huge page
+    // is placed as a unit.
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+#ifdef MADV_HUGEPAGE
+    if (hugePages && madvise(aligned, size, MADV_HUGEPAGE) == 0)
+      pageSize = HUGE_PAGE_SIZE;
+#endif
+    firstTouch(aligned, size, pageSize);
+    return aligned;
+  }
+#endif
+
+  void *block = NULL;
+  if (posix_memalign(&block, ALIGNMENT, bytes) != 0)
+    return NULL;
+  return block;
+}
+
+
+void FieldMemory::release(void *block, size_t bytes)
+{
+  if (!block)
+    return;
+#ifdef __linux__
+  if (bytes >= HUGE_PAGE_SIZE) {
+    munmap(block, mappedSize(bytes));
+    return;
+  }
+#endif
+  free(block);
+}
+
+
+void FieldMemory::setFirstTouchThreads(unsigned threads)
+{
+  firstTouchThreads = threads ? threads : 1;
+}
+
+
+void FieldMemory::setHugePages(bool enabled)
+{
+  hugePages = enabled;
+}
@@ -0,0 +1,129 @@
+#ifndef __FIELD_MEMORY_H__
+#define __FIELD_MEMORY_H__
+
+#include <cstddef>
+#include <new>
+#include <vector>
+#include "Vector2.h"
+
+// Allocation for the solver's large arrays: grid cells, scalar fields and
+// particles.  Every block is aligned to a cache line, so rows and SIMD
+// batches never straddle one needlessly.  Blocks of at least HUGE_PAGE_SIZE
+// are mapped directly, aligned to a huge page and advised to use
+// transparent huge pages, which cuts TLB misses on large grids.
+//
+// Memory is placed on the NUMA node of the thread that first touches it.
+// By default, allocate() touches new blocks from the calling thread, so a
+// solver built on a pinned thread or process (the fluid-ensemble workers,
+// the fluid-slabs processes) keeps its fields local.  With
+// setFirstTouchThreads(n), which AutoTuner::apply() and fluid-stream call
+// with their OpenMP thread count, mapped blocks are instead touched by n
+// OpenMP threads in contiguous chunks of whole pages.  That matches the
+// partition of the solver's row loops that run "omp parallel for
+// schedule(static)" over the grid: velocity and scalar advection and
+// applied forces.  Other passes, such as the pressure solve, are serial
+// and read every node's memory.  With huge pages the chunks are whole huge
+// pages, so a block spanning fewer huge pages than there are threads is
+// split more coarsely.
+class FieldMemory {
+public:
+  // The alignment of every block, in bytes.
+  static const size_t ALIGNMENT = 64;
+
+  // The size of a transparent huge page, in bytes.
+  static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+  // Allocates an aligned block.  Mapped blocks, those of at least
+  // HUGE_PAGE_SIZE, come back zeroed by the first touch; smaller ones are
+  // left uninitialized, since the containers construct their elements.
+  //
+  // Arguments:
+  //   size_t bytes - The size of the block.
+  //
+  // Returns:
+  //   void * - The block, or NULL if it couldn't be allocated.
+  static void * allocate(size_t bytes);
+
+  // Releases a block from allocate().
+  //
+  // Arguments:
+  //   void *block - The block.
+  //   size_t bytes - The size the block was allocated with.
+  //
+  // Returns:
+  //   None
+  static void release(void *block, size_t bytes);
+
+  // Sets how many threads first-touch each new large block.  1, the
+  // default, touches from the calling thread.  Call during startup, before
+  // solvers are created on other threads.
+  //
+  // Arguments:
+  //   unsigned threads - The number of OpenMP threads to touch with.
+  //
+  // Returns:
+  //   None
+  static void setFirstTouchThreads(unsigned threads);
+
+  // Enables or disables huge pages for blocks allocated from now on.
+  // Enabled by default.  Call during startup, like setFirstTouchThreads().
+  //
+  // Arguments:
+  //   bool enabled - Whether large blocks request huge pages.
+  //
+  // Returns:
+  //   None
+  static void setHugePages(bool enabled);
+};
+
+
+// An STL allocator drawing from FieldMemory.
+template <class T>
+class FieldAllocator {
+public:
+  typedef T value_type;
+  typedef T * pointer;
+  typedef const T * const_pointer;
+  typedef T & reference;
+  typedef const T & const_reference;
+  typedef size_t size_type;
+  typedef ptrdiff_t difference_type;
+
+  template <class U>
+  struct rebind {
+    typedef FieldAllocator<U> other;
+  };
+
+  FieldAllocator() {}
+  template <class U>
+  FieldAllocator(const FieldAllocator<U> &) {}
+
+  pointer address(reference value) const { return &value; }
+  const_pointer address(const_reference value) const { return &value; }
+  size_type max_size() const { return size_t(-1) / sizeof(T); }
+
+  pointer allocate(size_type count, const void * = 0)
+  {
+    void *block = FieldMemory::allocate(count * sizeof(T));
+    if (!block)
+      throw std::bad_alloc();
+    return static_cast<pointer>(block);
+  }
+
+  void deallocate(pointer block, size_type count)
+  {
+    FieldMemory::release(block, count * sizeof(T));
+  }
+
+  void construct(pointer p, const T &value) { new (p) T(value); }
+  void destroy(pointer p) { p->~T(); }
+
+  bool operator==(const FieldAllocator &) const { return true; }
+  bool operator!=(const FieldAllocator &) const { return false; }
+};
+
+
+// The particle storage of a solver.
+typedef std::vector<Vector2, FieldAllocator<Vector2> > ParticleArray;
+
+#endif // __FIELD_MEMORY_H__
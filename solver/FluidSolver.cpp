@@ -1,5 +1,9 @@
 // DEBUG
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
 #include <iostream>
+#include <stdint.h>
 #include <vector>
 #include <eigen3/Eigen/Dense>
 #include <eigen3/Eigen/Sparse>
@@ -7,12 +11,13 @@
 #include "FluidSolver.h"
 #include "IFluidRenderer.h"
 #include "Grid.h"
+#include "Kernels.h"
 #include "Cell.h"
 #include "Vector2.h"
-#include "SignalRelay.h"
 
 
 using std::vector;
+using Eigen::Map;
 using Eigen::VectorXd;
 using Eigen::VectorXi;
 using Eigen::SparseMatrix;
@@ -20,28 +25,81 @@ using Eigen::Triplet;
 using Eigen::RowMajor;
 using Eigen::ConjugateGradient;
 using Eigen::Success;
-typedef Triplet<double> Tripletd;
+
+namespace {
+
+// How many seconds of emission the default particle capacity holds.
+const float DEFAULT_EMISSION_SEC = 1.0f;
+
+// Determines whether a value is neither infinite nor NaN.
+inline bool isFinite(float value)
+{
+  return value == value && std::fabs(value) <= FLT_MAX;
+}
+
+// Leads every checkpoint: "FLCK" when read as bytes on little-endian hosts.
+const uint32_t CHECKPOINT_MAGIC = 0x4b434c46;
+const uint32_t CHECKPOINT_VERSION = 1;
+
+// Writes or reads one plain value of a checkpoint.
+template <typename T>
+void writeValue(std::ostream &out, const T &value)
+{
+  out.write(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+template <typename T>
+bool readValue(std::istream &in, T &value)
+{
+  return bool(in.read(reinterpret_cast<char *>(&value), sizeof(value)));
+}
+
+} // namespace
+
 
 FluidSolver::FluidSolver(float width, float height)
   : _width(width),
     _height(height),
     _grid(_width, _height),
     _frameReady(false),
-    _particles()
+    _particles(),
+    _gravity(0.0f, -9.8f),
+    _initialFill(0.5f),
+    _scalarDefaults(),
+    _viscosity(0.0f),
+    _sources(),
+    _particleCapacity(0),
+    _requestedCapacity(0),
+    _extrapolator(3),
+    _inflows(SIDE_COUNT, FluidSource(FluidSource::EMITTER, Vector2(),
+				     Vector2())),
+    _commands(),
+    _forces(),
+    _paused(false),
+    _pendingSteps(0),
+    _preconditioner(DIAGONAL)
 {
+  // A full queue's worth of forces never reallocates.
+  _forces.reserve(_commands.getCapacity());
+
+  // Both axes start out closed, with walls on every side.
+  _periodic[Cell::X] = false;
+  _periodic[Cell::Y] = false;
+  for (unsigned side = 0; side < SIDE_COUNT; ++side) {
+    _boundaries[side] = WALL;
+    _inflows[side].seed += side;
+  }
+
   // Provide default values to the grid.
+  // Note: the solver does not connect itself to any global signal source.
+  // Whoever owns this instance decides which signals (if any) drive it, so
+  // that any number of independent solvers may coexist in one process.
   reset();
-
-  // Connect ourselves to the 'resetSimulation' signal.
-  QObject::connect(SignalRelay::getInstance(), SIGNAL(resetSimulation()),
-		   this, SLOT(reset()));
 }
 
 
 FluidSolver::~FluidSolver()
 {
-  // Disconnect from receiving any signals.
-  SignalRelay::getInstance()->disconnect(this);
 }
 
 
@@ -52,18 +110,32 @@ void FluidSolver::reset()
   // Change this as needed during devlopment to quickly test stuff out, and
   // remove before final release!
 
-  // Delete existing particles
+  // Delete existing particles, and reserve the particle storage once so
+  // that emitters reuse its free slots instead of reallocating while the
+  // simulation runs.  Storage reserved for a different capacity is
+  // replaced, since reserve() never shrinks it.
+  const unsigned startX = _width  * (1.0f - _initialFill);
+  const unsigned startY = _height * (1.0f - _initialFill);
+  _particleCapacity = _requestedCapacity;
+  if (_particleCapacity == 0)
+    _particleCapacity = getDefaultParticleCapacity(startX, startY);
   _particles.clear();
+  if (_particles.capacity() != _particleCapacity)
+    ParticleArray().swap(_particles);
+  _particles.reserve(_particleCapacity);
   
   // Initialize a velocity field for testing.
   // Note: values in this velocity field are arbitrarily chosen and may be
   //  divergent within a cell.
   // Note: sin() is used to clamp output values to [-1, 1].
   Grid grid(_width, _height);
-  for (unsigned y = _height / 2; y < _height; ++y) 
-    for (unsigned x = _width / 2; x < _width; ++x) {
-      grid(x,y).cellType = Cell::FLUID;
-      grid(x,y).pressure = 0.0f;
+  grid.setPeriodic(Cell::X, _periodic[Cell::X]);
+  grid.setPeriodic(Cell::Y, _periodic[Cell::Y]);
+  for (unsigned i = 0; i < _scalarDefaults.size(); ++i)
+    grid.addScalarField(_scalarDefaults[i]);
+  for (unsigned y = startY; y < _height; ++y) 
+    for (unsigned x = startX; x < _width; ++x) {
+      grid.setCellType(x, y, Cell::FLUID);
 
       // Initialize marker particle positions.
       for (unsigned i = 0; i < 4; i++)
@@ -71,16 +143,227 @@ void FluidSolver::reset()
 	  _particles.push_back(Vector2(x + 0.20f * (i + 1), y + 0.20f * (j + 1)));
   }
 
+  if (_particleCapacity < _particles.size())
+    _particleCapacity = _particles.size();
+
+  // Restart every source's emission.
+  for (unsigned i = 0; i < _sources.size(); ++i)
+    _sources[i].pending = 0.0f;
+  for (unsigned side = 0; side < SIDE_COUNT; ++side)
+    _inflows[side].pending = 0.0f;
+
   // Set values accordingly.
   _grid = grid;
   _frameReady = false;
 }
 
+unsigned FluidSolver::getDefaultParticleCapacity(unsigned startX,
+						 unsigned startY) const
+{
+  // The fluid reset() seeds, at 4 x 4 particles per cell.
+  unsigned capacity = 0;
+  if (startX < _width && startY < _height)
+    capacity = 16 * (unsigned(_width) - startX) * (unsigned(_height) - startY);
+
+  // Plus DEFAULT_EMISSION_SEC of every emitter's output, INFLOW sides
+  // included.
+  float emitted = 0.0f;
+  for (unsigned i = 0; i < _sources.size(); ++i)
+    if (_sources[i].type == FluidSource::EMITTER)
+      emitted += _sources[i].rate;
+  for (unsigned side = 0; side < SIDE_COUNT; ++side) {
+    const unsigned dim = side < BOTTOM ? Cell::X : Cell::Y;
+    if (_boundaries[side] == INFLOW && !_periodic[dim])
+      emitted += _inflows[side].rate;
+  }
+  return capacity + unsigned(ceilf(emitted * DEFAULT_EMISSION_SEC));
+}
+
+void FluidSolver::resample(float width, float height)
+{
+  const float scaleX = width  / _width;
+  const float scaleY = height / _height;
+
+  Grid grid(width, height);
+  grid.setPeriodic(Cell::X, _periodic[Cell::X]);
+  grid.setPeriodic(Cell::Y, _periodic[Cell::Y]);
+  grid.resample(_grid, scaleX, scaleY);
+  grid.wrapBorders();
+  _grid = grid;
+
+  // When the resolution grows, split each particle into an even lattice
+  // of copies so upsampled cells stay as densely marked.  reset() seeds
+  // particles a quarter cell apart, so the copies spread over a quarter of
+  // a source cell, which keeps them inside the cells their original
+  // covers.
+  const unsigned splitX = scaleX > 1.0f ? unsigned(scaleX + 0.5f) : 1;
+  const unsigned splitY = scaleY > 1.0f ? unsigned(scaleY + 0.5f) : 1;
+  const unsigned split = splitX * splitY;
+  const int count = _particles.size();
+  ParticleArray particles(count * split);
+#pragma omp parallel for schedule(static)
+  for (int i = 0; i < count; ++i) {
+    const Vector2 center(_particles[i].x * scaleX, _particles[i].y * scaleY);
+    for (unsigned k = 0; k < splitX; ++k)
+      for (unsigned l = 0; l < splitY; ++l) {
+	Vector2 offset(0.25f * scaleX * ((k + 0.5f) / splitX - 0.5f),
+		       0.25f * scaleY * ((l + 0.5f) / splitY - 0.5f));
+	particles[i * split + k * splitY + l] = center + offset;
+      }
+  }
+  _particleCapacity = std::max<unsigned>(_particleCapacity * split,
+					 particles.size());
+  _particles.swap(particles);
+  _particles.reserve(_particleCapacity);
+
+  // Quantities measured in cells scale with the resolution.
+  _gravity = Vector2(_gravity.x * scaleX, _gravity.y * scaleY);
+  _viscosity *= scaleX * scaleY;
+  for (unsigned i = 0; i < _sources.size(); ++i) {
+    FluidSource &source = _sources[i];
+    source.minCorner = Vector2(source.minCorner.x * scaleX,
+			       source.minCorner.y * scaleY);
+    source.maxCorner = Vector2(source.maxCorner.x * scaleX,
+			       source.maxCorner.y * scaleY);
+    source.velocity = Vector2(source.velocity.x * scaleX,
+			      source.velocity.y * scaleY);
+    source.rate *= scaleX * scaleY;
+  }
+
+  _width = width;
+  _height = height;
+  for (unsigned side = 0; side < SIDE_COUNT; ++side) {
+    const Vector2 &velocity = _inflows[side].velocity;
+    setBoundary(Side(side), _boundaries[side],
+		Vector2(velocity.x * scaleX, velocity.y * scaleY));
+  }
+
+  // Mark fluid from the particles, as at the end of every timestep.
+  markCells();
+}
+
+
+bool FluidSolver::writeCheckpoint(std::ostream &out) const
+{
+  const unsigned cols = _grid.getColCount();
+  const unsigned rows = _grid.getRowCount();
+  const unsigned fields = _grid.getScalarFieldCount();
+  writeValue(out, CHECKPOINT_MAGIC);
+  writeValue(out, CHECKPOINT_VERSION);
+  writeValue(out, uint32_t(cols));
+  writeValue(out, uint32_t(rows));
+  writeValue(out, uint32_t(fields));
+  writeValue(out, uint32_t(_sources.size()));
+  writeValue(out, uint32_t(_particles.size()));
+
+  // Rows are written without the grid's padding.
+  const unsigned stride = _grid.getRowStride();
+  for (unsigned y = 0; y < rows; ++y) {
+    const Cell *cell = _grid.getCellData() + y * stride;
+    for (unsigned x = 0; x < cols; ++x, ++cell) {
+      writeValue(out, cell->vel[Cell::X]);
+      writeValue(out, cell->vel[Cell::Y]);
+      writeValue(out, int32_t(cell->cellType));
+    }
+  }
+  for (unsigned y = 0; y < rows; ++y)
+    out.write(reinterpret_cast<const char *>(_grid.getPressureData() +
+					     y * stride),
+	      cols * sizeof(double));
+  for (unsigned y = 0; y < rows; ++y)
+    for (unsigned x = 0; x < cols; ++x)
+      for (unsigned field = 0; field < fields; ++field)
+	writeValue(out, _grid.getScalar(x, y, field));
+  if (!_particles.empty())
+    out.write(reinterpret_cast<const char *>(&_particles[0]),
+	      _particles.size() * sizeof(Vector2));
+
+  for (unsigned i = 0; i < _sources.size(); ++i) {
+    writeValue(out, _sources[i].pending);
+    writeValue(out, uint32_t(_sources[i].seed));
+  }
+  for (unsigned side = 0; side < SIDE_COUNT; ++side) {
+    writeValue(out, _inflows[side].pending);
+    writeValue(out, uint32_t(_inflows[side].seed));
+  }
+  return bool(out);
+}
+
+
+bool FluidSolver::readCheckpoint(std::istream &in)
+{
+  uint32_t magic = 0, version = 0, cols = 0, rows = 0, fields = 0;
+  uint32_t sources = 0, particleCount = 0;
+  if (!readValue(in, magic) || !readValue(in, version) ||
+      !readValue(in, cols) || !readValue(in, rows) ||
+      !readValue(in, fields) || !readValue(in, sources) ||
+      !readValue(in, particleCount))
+    return false;
+  if (magic != CHECKPOINT_MAGIC || version != CHECKPOINT_VERSION ||
+      cols != _grid.getColCount() || rows != _grid.getRowCount() ||
+      fields != _grid.getScalarFieldCount() || sources != _sources.size())
+    return false;
+
+  // Read into copies, so that a truncated checkpoint changes nothing.
+  Grid grid(_grid);
+  for (unsigned y = 0; y < rows; ++y)
+    for (unsigned x = 0; x < cols; ++x) {
+      Cell &cell = grid(x, y);
+      int32_t type = 0;
+      if (!readValue(in, cell.vel[Cell::X]) ||
+	  !readValue(in, cell.vel[Cell::Y]) || !readValue(in, type))
+	return false;
+      grid.setCellType(x, y, Cell::Type(type));
+    }
+  for (unsigned y = 0; y < rows; ++y)
+    if (!in.read(reinterpret_cast<char *>(grid.getPressureData() +
+					  y * grid.getRowStride()),
+		 cols * sizeof(double)))
+      return false;
+  for (unsigned y = 0; y < rows; ++y)
+    for (unsigned x = 0; x < cols; ++x)
+      for (unsigned field = 0; field < fields; ++field) {
+	float value = 0.0f;
+	if (!readValue(in, value))
+	  return false;
+	grid.setScalar(x, y, field, value);
+      }
+  vector<Vector2> particles(particleCount);
+  if (particleCount > 0 &&
+      !in.read(reinterpret_cast<char *>(&particles[0]),
+	       particleCount * sizeof(Vector2)))
+    return false;
+
+  vector<float> pending(sources + SIDE_COUNT);
+  vector<uint32_t> seeds(sources + SIDE_COUNT);
+  for (unsigned i = 0; i < pending.size(); ++i)
+    if (!readValue(in, pending[i]) || !readValue(in, seeds[i]))
+      return false;
+
+  _grid = grid;
+  if (_particleCapacity < particleCount)
+    _particleCapacity = particleCount;
+  _particles.reserve(_particleCapacity);
+  _particles.assign(particles.begin(), particles.end());
+  for (unsigned i = 0; i < sources; ++i) {
+    _sources[i].pending = pending[i];
+    _sources[i].seed = seeds[i];
+  }
+  for (unsigned side = 0; side < SIDE_COUNT; ++side) {
+    _inflows[side].pending = pending[sources + side];
+    _inflows[side].seed = seeds[sources + side];
+  }
+  _frameReady = false;
+  return true;
+}
+
+
 void FluidSolver::advanceFrame()
 {
   float frameTimeSec = 1.0f/30.0f; // TODO Target 30 Hz framerate for now.
   float CFLCoefficient = 2.0f;     // TODO CFL coefficient set to 2 for now.
 
+  bool stepping = false;           // True once a STEP has been spent.
   while (!_frameReady) {
     // If enough simulation time has elapsed to draw the next frame, break.
     if (frameTimeSec <= 0.0f) {
@@ -88,6 +371,18 @@ void FluidSolver::advanceFrame()
       break;
     }
 
+    // Commands from other threads take effect between timesteps.  While
+    // paused, a frame is only calculated when a STEP requests one.
+    applyCommands();
+    if (_paused && !stepping) {
+      if (_pendingSteps == 0) {
+	_forces.clear();
+	return;
+      }
+      --_pendingSteps;
+      stepping = true;
+    }
+
     // Calculate an appropriate timestep based on the estimated max velocity
     // and the CFL coefficient.
     float simTimeStepSec = CFLCoefficient / _grid.getMaxVelocity().magnitude();
@@ -108,39 +403,85 @@ void FluidSolver::advanceFrame()
 
 void FluidSolver::advanceTimeStep(float timeStepSec)
 {
-  Vector2 gravity(0.0f, -9.8f);  // Gravity: -0.098 cells/sec^2
-
+  // Along periodic axes, the extra row or column is refreshed from the
+  // first before every stage that samples across the wrap.
+  _grid.wrapBorders();
+  advectScalars(timeStepSec);
   advectVelocity(timeStepSec);
-  applyGlobalVelocity(gravity * timeStepSec);
+  applyGlobalVelocity(_gravity * timeStepSec);
+  applyForces();
+  applyEmitters(timeStepSec);
   boundaryCollide();
+  viscositySolve(timeStepSec);
+  _grid.wrapBorders();
   pressureSolve(timeStepSec);
+  _extrapolator.extrapolate(_grid);
   boundaryCollide();
+  _grid.wrapBorders();
   moveParticles(timeStepSec);
+  applySinks();
   markCells();
 }
 
 
 void FluidSolver::advectVelocity(float timeStepSec)
 {
-  for(float x = 0; x < _grid.getWidth(); x += 1.0f)
-    for( float y = 0.5; y < _grid.getHeight(); y += 1.0f) {
-      Cell &cell = _grid(floor(x), floor(y));
-      Vector2 position(x, y); 
-      position = particleTrace(position, timeStepSec);
+  // Every face is traced from the current velocities into its own staged
+  // slot, so rows are independent.  The static schedule gives each thread
+  // the same block of rows that FieldMemory placed on its node.
+  const int width  = _grid.getWidth();
+  const int height = _grid.getHeight();
+#pragma omp parallel for schedule(static)
+  for (int y = 0; y < height; ++y)
+    for (int x = 0; x < width; ++x) {
+      Cell &cell = _grid(x, y);
+      Vector2 position = particleTrace(Vector2(x, y + 0.5f), timeStepSec);
       cell.stagedVel[Cell::X] = _grid.getVelocity(position).x;
-    }
-  for(float y = 0; y < _grid.getHeight(); y += 1.0f)
-    for(float x = 0.5; x < _grid.getWidth(); x+= 1.0f) {
-      Cell &cell = _grid(floor(x), floor(y));
-      Vector2 position(x, y);
-      position = particleTrace(position, timeStepSec);
+      position = particleTrace(Vector2(x + 0.5f, y), timeStepSec);
       cell.stagedVel[Cell::Y] = _grid.getVelocity(position).y;
     }
-  for(unsigned i = 0; i < _grid.getRowCount() * _grid.getColCount(); i++) {
+  for(unsigned i = 0; i < _grid.getCellCount(); i++) {
     _grid[i].commitStagedVel();
   }
 }
 
+
+void FluidSolver::advectScalars(float timeStepSec)
+{
+  const unsigned fields = _grid.getScalarFieldCount();
+  if (fields == 0)
+    return;
+
+  // Only cells inside the domain are traced.  A trace that leaves it can
+  // come back non-finite from particleTrace(); such cells keep their value.
+  const int width  = _grid.getWidth();
+  const int height = _grid.getHeight();
+#pragma omp parallel for schedule(static)
+  for (int y = 0; y < height; ++y)
+    for (int x = 0; x < width; ++x) {
+      const Vector2 center(x + 0.5f, y + 0.5f);
+      Vector2 position = particleTrace(center, timeStepSec);
+      if (!isFinite(position.x) || !isFinite(position.y))
+	position = center;
+      _grid.sampleScalars(position, _grid.getStagedScalars(x, y));
+    }
+
+  // The extra column and row repeat the last ones, or the first ones along
+  // a periodic axis, so that the whole staged buffer is valid when it is
+  // exchanged with the current one.
+  const int fromX = _periodic[Cell::X] ? 0 : width - 1;
+  const int fromY = _periodic[Cell::Y] ? 0 : height - 1;
+  for (int y = 0; y < height; ++y) {
+    const float *from = _grid.getStagedScalars(fromX, y);
+    std::copy(from, from + fields, _grid.getStagedScalars(width, y));
+  }
+  for (int x = 0; x <= width; ++x) {
+    const float *from = _grid.getStagedScalars(x, fromY);
+    std::copy(from, from + fields, _grid.getStagedScalars(x, height));
+  }
+  _grid.commitStagedScalars();
+}
+
 // This function only enforces boundary condtitions at the grid borders,
 // not on the free surface
 Vector2 FluidSolver::particleTrace(Vector2 position, float timeStepSec)
@@ -153,6 +494,12 @@ Vector2 FluidSolver::particleTrace(Vector2 position, float timeStepSec)
   float dist;
   float interceptX = 0.0f;
   float interceptY = 0.0f; 
+
+  // Periodic axes have no walls; the trace wraps around instead.
+  if (_grid.isPeriodic(Cell::X))
+    toPosition.x = Grid::wrapCoordinate(toPosition.x, width);
+  if (_grid.isPeriodic(Cell::Y))
+    toPosition.y = Grid::wrapCoordinate(toPosition.y, height);
   bool intersectX = toPosition.x < 0 || toPosition.x > _grid.getWidth(); 
   bool intersectY = toPosition.y < 0 || toPosition.y > _grid.getHeight(); 
 
@@ -176,14 +523,25 @@ Vector2 FluidSolver::particleTrace(Vector2 position, float timeStepSec)
 
 void FluidSolver::applyGlobalVelocity(Vector2 velocity)
 {
-  // Apply the provided velocity to all cells in the simulation.
-  for (unsigned y = 0; y < _grid.getHeight(); ++y) 
-    for (unsigned x = 0; x < _grid.getWidth(); ++x) {
-      Cell &cell = _grid(x,y);
-      if (cell.cellType == Cell::FLUID) {
-	cell.vel[Cell::X] += velocity.x;
-	cell.vel[Cell::Y] += velocity.y;
-      }
+  // Apply the provided velocity to all FLUID cells in the simulation,
+  // skipping the tiles that hold no fluid.
+  const CellMask &mask = _grid.getCellMask();
+  const unsigned width  = _grid.getWidth();
+  const unsigned height = _grid.getHeight();
+  for (unsigned ty = 0; ty < mask.getTileRowCount(); ++ty)
+    for (unsigned tx = 0; tx < mask.getTileColCount(); ++tx) {
+      if (!mask.tileHasFluid(tx, ty))
+	continue;
+      const unsigned endY = std::min((ty + 1) * CellMask::TILE_SIZE, height);
+      const unsigned endX = std::min((tx + 1) * CellMask::TILE_SIZE, width);
+      for (unsigned y = ty * CellMask::TILE_SIZE; y < endY; ++y)
+	for (unsigned x = tx * CellMask::TILE_SIZE; x < endX; ++x) {
+	  if (mask.isFluid(x, y)) {
+	    Cell &cell = _grid(x,y);
+	    cell.vel[Cell::X] += velocity.x;
+	    cell.vel[Cell::Y] += velocity.y;
+	  }
+	}
     }
 }
 
@@ -201,43 +559,52 @@ void FluidSolver::pressureSolve(float timeStepSec)
   // * Solve the Ap = b using the conjugate gradient algorithm.
   // * Compute the new velocities according to the updated pressure.
 
-  // Calculate the dimensionality of our vectors/matrix.
+  // Calculate the dimensionality of our vectors/matrix.  The system spans
+  // every cell, including the grid's extra top row and right column, so
+  // that b and p can be the grid's own divergence and pressure arrays,
+  // which share the grid's indexing.  The extra cells and each row's
+  // padding are pinned with identity rows.
+  const unsigned cols   = _grid.getRowStride();
   const unsigned width  = _grid.getColCount() - 1;
   const unsigned height = _grid.getRowCount() - 1;
-  int dim = width * height;
+  int dim = _grid.getCellCount();
 
-  // Calculate the negative divergence throughout the simulation.
-  VectorXd b(dim);
+  // Calculate the negative divergence throughout the simulation, a row at
+  // a time.  Only FLUID cells' entries are used; the rest are zeroed.
+  const CellMask &mask = _grid.getCellMask();
+  Map<VectorXd> b(_grid.getDivergenceData(), dim);
+  const Kernels &kernels = Kernels::get();
   for (unsigned y = 0; y < height; ++y)
-    for (unsigned x = 0; x < width; ++x) {
-      unsigned index = y * width + x;
-      b(index) = -_grid.getVelocityDivergence(x, y);
-    }
+    kernels.divergence(&_grid(0, y), &_grid(0, y + 1), &b(y * cols), width);
 
   // Update the negative divergence to account for solid boundaries.
+  // Periodic axes and OUTFLOW sides have none, and INFLOW faces already
+  // hold the inflow's velocity, so only WALL sides need the correction.
   // TODO assumes that the only solids are at the boundaries, which have 0 vel.
+  const bool periodicX = _periodic[Cell::X];
+  const bool periodicY = _periodic[Cell::Y];
   // Bottom row.
-  for (unsigned x = 0; x < width; ++x) {
+  for (unsigned x = 0; x < width && isWall(BOTTOM); ++x) {
     unsigned y = 0;
-    unsigned index = y * width + x;
+    unsigned index = y * cols + x;
     b(index) -= _grid(x,y).vel[Cell::Y];
   }
   // Top row.
-  for (unsigned x = 0; x < width; ++x) {
+  for (unsigned x = 0; x < width && isWall(TOP); ++x) {
     unsigned y = height - 1;
-    unsigned index = y * width + x;
+    unsigned index = y * cols + x;
     b(index) += _grid(x,y+1).vel[Cell::Y];
   }
   // Left column.
-  for (unsigned y = 0; y < height; ++y) {
+  for (unsigned y = 0; y < height && isWall(LEFT); ++y) {
     unsigned x = 0;
-    unsigned index = y * width + x;
+    unsigned index = y * cols + x;
     b(index) -= _grid(x,y).vel[Cell::X];
   }
   // Right column.
-  for (unsigned y = 0; y < height; ++y) {
+  for (unsigned y = 0; y < height && isWall(RIGHT); ++y) {
     unsigned x = width - 1;
-    unsigned index = y * width + x;
+    unsigned index = y * cols + x;
     b(index) += _grid(x+1,y).vel[Cell::X];
   }
 
@@ -263,50 +630,85 @@ void FluidSolver::pressureSolve(float timeStepSec)
   //  std::cout << "Post-compat Divergence: " << std::endl << b << std::endl;
   */
 
-  // Set the entries of A. 
-  std::vector< Tripletd > vals;
-  SparseMatrix<double,RowMajor> A(dim, dim);
-  for (unsigned y = 0; y < height; ++y)
+  // Set the entries of A.  Both off-diagonal entries of each coupling are
+  // stored, so that the solver may use the full (symmetric) matrix.
+  std::vector< Tripletd > &vals = _solverTriplets;
+  vals.clear();
+  // An OUTFLOW side acts as AIR beyond the domain.  The right and top
+  // sides get that from the extra column and row, which boundaryCollide
+  // marks AIR; the left and bottom ones have no cells of their own.
+  const bool openLeft   = !periodicX && _boundaries[LEFT] == OUTFLOW;
+  const bool openBottom = !periodicY && _boundaries[BOTTOM] == OUTFLOW;
+  for (unsigned y = 0; y < height; ++y) {
+    // Where neither this row nor the one above holds fluid, every cell in
+    // the row is pinned with an identity row.
+    if (!mask.rowHasFluid(y) && !mask.rowHasFluid(y + 1)) {
+      for (unsigned i = y * cols; i < y * cols + width; ++i) {
+	vals.push_back( Tripletd(i,i,1.0) );
+	b(i) = 0.0;
+      }
+      continue;
+    }
+
     for (unsigned x = 0; x < width; ++x) {
-      Cell &cell = _grid(x,y);
-      unsigned i = y * width + x;  // this cell's col/row in A.
+      unsigned i = y * cols + x;   // this cell's col/row in A.
       unsigned j;                  // neighbor cell's col/row in A
+      const Cell::Type right = mask.get(x + 1, y);
+      const Cell::Type up    = mask.get(x, y + 1);
+      // Along a periodic axis, the last cell's neighbor is the first one;
+      // the extra row or column only mirrors its type.
+      const unsigned rightIndex =
+	periodicX && x + 1 == width ? y * cols : y * cols + x + 1;
+      const unsigned upIndex =
+	periodicY && y + 1 == height ? x : (y + 1) * cols + x;
 
-      switch (cell.cellType) {
+      switch (mask.get(x, y)) {
       case (Cell::SOLID):
-	// If this cell is a SOLID, leave the entire row as 0's.
+	// If this cell is a SOLID, its pressure is unused; pin it to zero
+	// with an identity row so that A stays nonsingular.
+	vals.push_back( Tripletd(i,i,1.0) );
+	b(i) = 0.0;
 	break;
 
       case (Cell::AIR):
+	// AIR cells have zero pressure; pin them with an identity row.
+	vals.push_back( Tripletd(i,i,1.0) );
+	b(i) = 0.0;
 	// If this cell is AIR, increment neighboring fluid diagonals' coeff.
-	if (cell.neighbors[Cell::POS_X]->cellType == Cell::FLUID) {
-	  j = y * width + x + 1;                        // rt neighbor's idx
+	if (right == Cell::FLUID) {
+	  j = rightIndex;                               // rt neighbor's idx
 	  vals.push_back( Tripletd(j,j,timeStepSec) );  // rt neighbor's diag
 	}
-	if (cell.neighbors[Cell::POS_Y]->cellType == Cell::FLUID) {
-	  j = (y + 1) * width + x;                      // up neighbor's idx
+	if (up == Cell::FLUID) {
+	  j = upIndex;                                  // up neighbor's idx
 	  vals.push_back( Tripletd(j,j,timeStepSec) );  // up neighbor's diag
 	}
 	break;
 
       case (Cell::FLUID):
 	// Cell is fluid. Determine coefficients of self and neighbors.
-	if (cell.neighbors[Cell::POS_X]->cellType == Cell::FLUID) {
-	  j = y * width + x + 1;                        // rt neighbor's idx
+	if (x == 0 && openLeft)
+	  vals.push_back( Tripletd(i,i,timeStepSec) );
+	if (y == 0 && openBottom)
+	  vals.push_back( Tripletd(i,i,timeStepSec) );
+	if (right == Cell::FLUID) {
+	  j = rightIndex;                               // rt neighbor's idx
 	  vals.push_back( Tripletd(i,i,timeStepSec) );  // my diagonal coeff
 	  vals.push_back( Tripletd(i,j,-timeStepSec) ); // rt neighbor's coeff
+	  vals.push_back( Tripletd(j,i,-timeStepSec) ); // rt neighbor's coeff
 	  vals.push_back( Tripletd(j,j,timeStepSec) );  // rt neighbor's diag
 	}
-	else if (cell.neighbors[Cell::POS_X]->cellType == Cell::AIR) {
+	else if (right == Cell::AIR) {
 	  vals.push_back( Tripletd(i,i,timeStepSec) );
 	}
-	if (cell.neighbors[Cell::POS_Y]->cellType == Cell::FLUID) {
-	  j = (y + 1) * width + x;                      // up neighbor's idx
+	if (up == Cell::FLUID) {
+	  j = upIndex;                                  // up neighbor's idx
 	  vals.push_back( Tripletd(i,i,timeStepSec) );  // my diagonal coeff
 	  vals.push_back( Tripletd(i,j,-timeStepSec) ); // up neighbor's coeff
+	  vals.push_back( Tripletd(j,i,-timeStepSec) ); // up neighbor's coeff
 	  vals.push_back( Tripletd(j,j,timeStepSec) );  // up neighbor's diag
 	}
-	else if (cell.neighbors[Cell::POS_Y]->cellType == Cell::AIR) {
+	else if (up == Cell::AIR) {
 	  vals.push_back( Tripletd(i,i,timeStepSec) );
 	}
 	break;
@@ -315,54 +717,169 @@ void FluidSolver::pressureSolve(float timeStepSec)
 	break;
       }
     }
-  A.setFromTriplets(vals.begin(), vals.end());
-
-  // Solve for the new pressure values, p.
-  VectorXd p(dim);
-  ConjugateGradient< SparseMatrix<double,RowMajor> > cg;
-  cg.compute(A);
-  p = cg.solve(b);
-  if (cg.info() == Success)
-    std::cout << "SUCCESS: Convergence!" << std::endl;
-  else 
-    std::cout << "FAILED: No Convergence..." << std::endl;
-  //  std::cout << "#iterations:     " << cg.iterations() << std::endl;
-  //  std::cout << "estimated error: " << cg.error()      << std::endl;  
-  //  std::cout << "A: " << std::endl << A << std::endl;
-  //  std::cout << "Pressure: " << std::endl << p << std::endl;
-  //  std::cout << "Divergence: " << std::endl << b << std::endl;
-  //  std::cout << "Ap: " << std::endl << A*p << std::endl;
+  }
 
-  // Set new pressure values.
-  for (unsigned y = 0; y < height; ++y)
-    for (unsigned x = 0; x < width; ++x) {
-      unsigned index = y * width + x;
-      _grid(x, y).pressure = p(index);
+  // Pin the extra top row, the right column and the padding beyond it.
+  for (unsigned y = 0; y <= height; ++y)
+    for (unsigned i = y * cols + width; i < (y + 1) * cols; ++i) {
+      vals.push_back( Tripletd(i,i,1.0) );
+      b(i) = 0.0;
     }
+  for (unsigned x = 0; x < width; ++x) {
+    unsigned i = height * cols + x;
+    vals.push_back( Tripletd(i,i,1.0) );
+    b(i) = 0.0;
+  }
+
+  // Solve for the new pressure values, p, directly into the grid.
+  Map<VectorXd> p(_grid.getPressureData(), dim);
+  if (!solveLinearSystem(dim, b.data(), p.data()))
+    std::cerr << "FAILED: No Convergence..." << std::endl;
+  //  std::cout << "A: " << std::endl << _solverMatrix << std::endl;
+  //  std::cout << "Pressure: " << std::endl << p << std::endl;
+  //  std::cout << "Divergence: " << std::endl << b << std::endl;
+  //  std::cout << "Ap: " << std::endl << _solverMatrix*p << std::endl;
 
   // Modify velocity field based on updated pressure scalar field.
-  for (unsigned y = 0; y < height; ++y)
+  for (unsigned y = 0; y < height; ++y) {
+    if (!mask.rowHasFluid(y))
+      continue;
     for (unsigned x = 0; x < width; ++x) {
-      Cell &cell = _grid(x,y);
-      float pressureVel = timeStepSec * cell.pressure;
-      if (cell.cellType == Cell::FLUID) {
-	// Update all neighboring velocities touched by this pressure.
+      if (mask.isFluid(x, y)) {
+	Cell &cell = _grid(x,y);
+	float pressureVel = timeStepSec * p(y * cols + x);
+	// Update all neighboring velocities touched by this pressure.  Along
+	// a periodic axis the last cell's far face is the first cell's
+	// near face.
+	Cell *right = periodicX && x + 1 == width
+	  ? &_grid(0, y) : cell.neighbors[Cell::POS_X];
+	Cell *up = periodicY && y + 1 == height
+	  ? &_grid(x, 0) : cell.neighbors[Cell::POS_Y];
 	cell.vel[Cell::X] -= pressureVel;
 	cell.vel[Cell::Y] -= pressureVel;
-	if (cell.neighbors[Cell::POS_X])
-	  cell.neighbors[Cell::POS_X]->vel[Cell::X] += pressureVel;
-	if (cell.neighbors[Cell::POS_Y])
-	  cell.neighbors[Cell::POS_Y]->vel[Cell::Y] += pressureVel;
+	if (right)
+	  right->vel[Cell::X] += pressureVel;
+	if (up)
+	  up->vel[Cell::Y] += pressureVel;
       }
     }
+  }
 
+#ifdef FLUID_SOLVER_VERBOSE
   // Calculate the negative divergence throughout the simulation.
   for (unsigned y = 0; y < height; ++y)
     for (unsigned x = 0; x < width; ++x) {
-      unsigned index = y * width + x;
+      unsigned index = y * cols + x;
       b(index) = -_grid.getVelocityDivergence(x, y);
     }
   std::cout << "New Divergence: " << std::endl << b << std::endl;
+#endif
+}
+
+
+bool FluidSolver::solveLinearSystem(int dim, const double *rhs, double *result)
+{
+  // Assemble the matrix from the staged triplets, reusing the matrix's
+  // storage, then solve with the preconditioned conjugate gradient method.
+  // The vectors are mapped in place; nothing is copied in or out.
+  _solverMatrix.resize(dim, dim);
+  _solverMatrix.setFromTriplets(_solverTriplets.begin(),
+				_solverTriplets.end());
+  Map<VectorXd> x(result, dim);
+  if (_preconditioner == INCOMPLETE_CHOLESKY) {
+    _icSolver.compute(_solverMatrix);
+    x = _icSolver.solve(Map<const VectorXd>(rhs, dim));
+    return _icSolver.info() == Success;
+  }
+  _solver.compute(_solverMatrix);
+  x = _solver.solve(Map<const VectorXd>(rhs, dim));
+  return _solver.info() == Success;
+}
+
+
+void FluidSolver::viscositySolve(float timeStepSec)
+{
+  if (_viscosity <= 0.0f)
+    return;
+  solveViscosity(Cell::X, timeStepSec);
+  solveViscosity(Cell::Y, timeStepSec);
+}
+
+
+void FluidSolver::solveViscosity(Cell::Dimension dim, float timeStepSec)
+{
+  // Backward Euler diffusion of one velocity component:
+  //   (I - dt * viscosity * Laplacian) u_new = u_old
+  // Unknowns are the faces bordering at least one FLUID cell.  Faces on the
+  // simulation walls are held at zero (no-slip), and faces away from the
+  // fluid are left out, acting as a zero-gradient condition.
+  const int cols = _grid.getColCount();
+  const int rows = _grid.getRowCount();
+  const int width = cols - 1;
+  const int height = rows - 1;
+  const int offX = (dim == Cell::X) ? 1 : 0;  // Offset to the face's
+  const int offY = (dim == Cell::Y) ? 1 : 0;  // other adjacent cell.
+
+  // Number the unknown faces.  Face (x, y) lies between cells (x, y) and
+  // (x - offX, y - offY); wall faces (x or y equal to 0 or the extent along
+  // the component's axis) are never unknowns.
+  const CellMask &mask = _grid.getCellMask();
+  vector<int> &index = _solverIndex;
+  index.assign(rows * cols, -1);
+  int dimCount = 0;
+  for (int y = offY; y < height; ++y) {
+    if (!mask.rowHasFluid(y) && !mask.rowHasFluid(y - offY))
+      continue;
+    for (int x = offX; x < width; ++x) {
+      if (mask.isFluid(x, y) || mask.isFluid(x - offX, y - offY))
+	index[y * cols + x] = dimCount++;
+    }
+  }
+  if (dimCount == 0)
+    return;
+
+  const double coeff = double(timeStepSec) * _viscosity;
+  const int dx[4] = { 1, -1, 0, 0 };
+  const int dy[4] = { 0, 0, 1, -1 };
+  vector<Tripletd> &vals = _solverTriplets;
+  vals.clear();
+  _solverRhs.resize(dimCount);
+  _solverResult.resize(dimCount);
+  for (int y = offY; y < height; ++y)
+    for (int x = offX; x < width; ++x) {
+      int i = index[y * cols + x];
+      if (i < 0)
+	continue;
+      double diag = 1.0;
+      for (unsigned n = 0; n < 4; ++n) {
+	int nx = x + dx[n];
+	int ny = y + dy[n];
+	bool wall = nx < offX || nx >= width || ny < offY || ny >= height;
+	if (wall) {
+	  diag += coeff;                  // Zero-velocity neighbor.
+	  continue;
+	}
+	int j = index[ny * cols + nx];
+	if (j >= 0) {
+	  diag += coeff;
+	  vals.push_back( Tripletd(i, j, -coeff) );
+	}
+      }
+      vals.push_back( Tripletd(i, i, diag) );
+      _solverRhs(i) = _grid(x, y).vel[dim];
+    }
+
+  if (!solveLinearSystem(dimCount, _solverRhs.data(), _solverResult.data())) {
+    std::cerr << "FAILED: Viscosity did not converge..." << std::endl;
+    return;
+  }
+
+  for (int y = offY; y < height; ++y)
+    for (int x = offX; x < width; ++x) {
+      int i = index[y * cols + x];
+      if (i >= 0)
+	_grid(x, y).vel[dim] = _solverResult(i);
+    }
 }
 
 
@@ -370,26 +887,242 @@ void FluidSolver::boundaryCollide()
 {
   // Set all boundary velocities to zero in the MAC grid.
   // This prevents fluid from entering or exiting through the walls of the
-  // simulation.
+  // simulation.  INFLOW sides hold their inflow's normal velocity instead,
+  // and OUTFLOW sides are left alone, with the extra row or column beyond
+  // them marked AIR so the pressure solve treats them as a free surface.
   const unsigned rows = _grid.getRowCount();
   const unsigned cols = _grid.getColCount();
 
+  // Periodic axes have no walls to enforce.
+
   // Bottom row. Set velocity Y component to 0.
   // Top row. Set velocity X and Y components to 0. Set to SOLID.
-  for (unsigned col = 0; col < cols; ++col) {
-    _grid(col, 0).vel[Cell::Y] = 0.0f;
-    _grid(col, rows-1).vel[Cell::X] = 0.0f;
-    _grid(col, rows-1).vel[Cell::Y] = 0.0f;
-    _grid(col, rows-1).cellType = Cell::SOLID;
+  if (!_periodic[Cell::Y]) {
+    const float bottom = _boundaries[BOTTOM] == INFLOW
+      ? _inflows[BOTTOM].velocity.y : 0.0f;
+    const float top = _boundaries[TOP] == INFLOW
+      ? _inflows[TOP].velocity.y : 0.0f;
+    for (unsigned col = 0; col < cols; ++col) {
+      if (_boundaries[BOTTOM] != OUTFLOW)
+	_grid(col, 0).vel[Cell::Y] = bottom;
+      if (_boundaries[TOP] != OUTFLOW) {
+	_grid(col, rows-1).vel[Cell::X] = 0.0f;
+	_grid(col, rows-1).vel[Cell::Y] = top;
+	_grid.setCellType(col, rows-1, Cell::SOLID);
+      }
+      else
+	_grid.setCellType(col, rows-1, Cell::AIR);
+    }
   }
 
   // Left column. Set velocity X component to 0.
   // Right column. Set velocity X and Y components to 0. Set to SOLID.
-  for (unsigned row = 0; row < rows; ++row) {
-    _grid(0, row).vel[Cell::X] = 0.0f;
-    _grid(cols-1, row).vel[Cell::X] = 0.0f;
-    _grid(cols-1, row).vel[Cell::Y] = 0.0f;
-    _grid(cols-1, row).cellType = Cell::SOLID;
+  if (!_periodic[Cell::X]) {
+    const float left = _boundaries[LEFT] == INFLOW
+      ? _inflows[LEFT].velocity.x : 0.0f;
+    const float right = _boundaries[RIGHT] == INFLOW
+      ? _inflows[RIGHT].velocity.x : 0.0f;
+    for (unsigned row = 0; row < rows; ++row) {
+      if (_boundaries[LEFT] != OUTFLOW)
+	_grid(0, row).vel[Cell::X] = left;
+      if (_boundaries[RIGHT] != OUTFLOW) {
+	_grid(cols-1, row).vel[Cell::X] = right;
+	_grid(cols-1, row).vel[Cell::Y] = 0.0f;
+	_grid.setCellType(cols-1, row, Cell::SOLID);
+      }
+      else
+	_grid.setCellType(cols-1, row, Cell::AIR);
+    }
+  }
+}
+
+
+void FluidSolver::applyCommands()
+{
+  SolverCommand command;
+  while (_commands.pop(command)) {
+    switch (command.type) {
+    case (SolverCommand::ADD_FORCE):
+      if (command.radius > 0.0f)
+	_forces.push_back(command);
+      break;
+    case (SolverCommand::SET_GRAVITY):
+      setGravity(command.value);
+      break;
+    case (SolverCommand::SET_VISCOSITY):
+      setViscosity(command.scalar);
+      break;
+    case (SolverCommand::PAUSE):
+      _paused = true;
+      break;
+    case (SolverCommand::RESUME):
+      _paused = false;
+      _pendingSteps = 0;
+      break;
+    case (SolverCommand::STEP):
+      ++_pendingSteps;
+      break;
+    case (SolverCommand::RESET):
+      // Forces aimed at the old simulation are dropped with it.
+      _forces.clear();
+      reset();
+      break;
+    default:
+      break;
+    }
+  }
+}
+
+
+void FluidSolver::applyForces()
+{
+  if (_forces.empty())
+    return;
+
+  // Bound the faces reached by any force, then visit each of them once,
+  // summing the contributions of every force that reaches it.
+  float minX = _forces[0].position.x - _forces[0].radius;
+  float maxX = _forces[0].position.x + _forces[0].radius;
+  float minY = _forces[0].position.y - _forces[0].radius;
+  float maxY = _forces[0].position.y + _forces[0].radius;
+  for (unsigned i = 1; i < _forces.size(); ++i) {
+    const SolverCommand &force = _forces[i];
+    minX = std::min(minX, force.position.x - force.radius);
+    maxX = std::max(maxX, force.position.x + force.radius);
+    minY = std::min(minY, force.position.y - force.radius);
+    maxY = std::max(maxY, force.position.y + force.radius);
+  }
+  const int cols = _grid.getColCount();
+  const int rows = _grid.getRowCount();
+  const int x0 = std::max(0, int(std::floor(minX)));
+  const int x1 = std::min(cols - 1, int(std::ceil(maxX)));
+  const int y0 = std::max(0, int(std::floor(minY)));
+  const int y1 = std::min(rows - 1, int(std::ceil(maxY)));
+  const unsigned count = _forces.size();
+  const SolverCommand *forces = &_forces[0];
+
+#pragma omp parallel for schedule(static)
+  for (int y = y0; y <= y1; ++y)
+    for (int x = x0; x <= x1; ++x) {
+      // The X face sits at (x, y + 0.5), the Y face at (x + 0.5, y).  Each
+      // force falls off smoothly to zero at its radius.
+      float du = 0.0f, dv = 0.0f;
+      for (unsigned i = 0; i < count; ++i) {
+	const SolverCommand &force = forces[i];
+	const float r2 = force.radius * force.radius;
+	float dx = x - force.position.x;
+	float dy = y + 0.5f - force.position.y;
+	float w = 1.0f - (dx * dx + dy * dy) / r2;
+	if (w > 0.0f)
+	  du += w * w * force.value.x;
+	dx += 0.5f;
+	dy -= 0.5f;
+	w = 1.0f - (dx * dx + dy * dy) / r2;
+	if (w > 0.0f)
+	  dv += w * w * force.value.y;
+      }
+      Cell &cell = _grid(x, y);
+      cell.vel[Cell::X] += du;
+      cell.vel[Cell::Y] += dv;
+    }
+
+  _forces.clear();
+}
+
+
+void FluidSolver::applyEmitters(float timeStepSec)
+{
+  vector<FluidSource>::iterator src = _sources.begin();
+  for (; src != _sources.end(); ++src)
+    if (src->type == FluidSource::EMITTER)
+      applyEmitter(*src, timeStepSec);
+
+  // Each INFLOW side is an emitter covering the cells along it.
+  for (unsigned side = 0; side < SIDE_COUNT; ++side) {
+    const unsigned dim = side < BOTTOM ? Cell::X : Cell::Y;
+    if (_boundaries[side] == INFLOW && !_periodic[dim])
+      applyEmitter(_inflows[side], timeStepSec);
+  }
+}
+
+
+void FluidSolver::applyEmitter(FluidSource &source, float timeStepSec)
+{
+  // Emitters impose their velocity on every face of the cells whose
+  // centers lie in the region, and fill those cells with fluid.  Along a
+  // periodic axis, the last cell's far face is the first cell's near face;
+  // the extra row or column only mirrors the first, so it's left alone.
+  const unsigned width  = _grid.getWidth();
+  const unsigned height = _grid.getHeight();
+  const bool periodicX = _periodic[Cell::X];
+  const bool periodicY = _periodic[Cell::Y];
+  for (unsigned y = 0; y < height; ++y)
+    for (unsigned x = 0; x < width; ++x) {
+      if (!source.contains(Vector2(x + 0.5f, y + 0.5f)))
+	continue;
+      _grid.setCellType(x, y, Cell::FLUID);
+      Cell &cell = _grid(x, y);
+      cell.vel[Cell::X] = source.velocity.x;
+      cell.vel[Cell::Y] = source.velocity.y;
+      Cell &right = periodicX && x + 1 == width ? _grid(0, y)
+	                                        : *cell.neighbors[Cell::POS_X];
+      Cell &up = periodicY && y + 1 == height ? _grid(x, 0)
+	                                      : *cell.neighbors[Cell::POS_Y];
+      right.vel[Cell::X] = source.velocity.x;
+      up.vel[Cell::Y] = source.velocity.y;
+    }
+
+  // Spawn this timestep's share of particles into the free slots.  The
+  // limit is the requested capacity, not whatever the storage happens to
+  // hold, so emission doesn't depend on the allocator's growth.
+  source.pending += source.rate * timeStepSec;
+  while (source.pending >= 1.0f && _particles.size() < _particleCapacity) {
+    _particles.push_back(source.randomPosition());
+    source.pending -= 1.0f;
+  }
+  if (source.pending > 1.0f)
+    source.pending = 1.0f;
+}
+
+
+void FluidSolver::applySinks()
+{
+  vector<FluidSource>::const_iterator src = _sources.begin();
+  for (; src != _sources.end(); ++src) {
+    if (src->type != FluidSource::SINK)
+      continue;
+
+    // Remove particles by moving the last particle into the freed slot.
+    // The storage's capacity is untouched, and the freed slots at the end
+    // are reused by the next emitted particles.
+    for (unsigned i = 0; i < _particles.size(); ) {
+      if (src->contains(_particles[i])) {
+	_particles[i] = _particles.back();
+	_particles.pop_back();
+      }
+      else
+	++i;
+    }
+  }
+
+  // Remove the particles that left through an OUTFLOW side.
+  const bool open[SIDE_COUNT] = {
+    !_periodic[Cell::X] && _boundaries[LEFT]   == OUTFLOW,
+    !_periodic[Cell::X] && _boundaries[RIGHT]  == OUTFLOW,
+    !_periodic[Cell::Y] && _boundaries[BOTTOM] == OUTFLOW,
+    !_periodic[Cell::Y] && _boundaries[TOP]    == OUTFLOW
+  };
+  if (!open[LEFT] && !open[RIGHT] && !open[BOTTOM] && !open[TOP])
+    return;
+  for (unsigned i = 0; i < _particles.size(); ) {
+    const Vector2 &p = _particles[i];
+    if ((open[LEFT] && p.x < 0.0f) || (open[RIGHT] && p.x >= _width) ||
+	(open[BOTTOM] && p.y < 0.0f) || (open[TOP] && p.y >= _height)) {
+      _particles[i] = _particles.back();
+      _particles.pop_back();
+    }
+    else
+      ++i;
   }
 }
 
@@ -397,27 +1130,48 @@ void FluidSolver::boundaryCollide()
 void FluidSolver::moveParticles(float timeStepSec)
 {
   // Advect velocity using simple forward Euler.
-  vector<Vector2>::iterator itr = _particles.begin();
-  for (; itr != _particles.end(); ++itr) {
-    *itr += _grid.getVelocity(*itr) * timeStepSec;
+  if (!_particles.empty())
+    Kernels::get().advectParticles(_grid, &_particles[0], _particles.size(),
+				   timeStepSec);
+
+  // Particles leaving across a periodic axis re-enter on the other side.
+  if (_periodic[Cell::X] || _periodic[Cell::Y]) {
+    ParticleArray::iterator itr = _particles.begin();
+    for (; itr != _particles.end(); ++itr) {
+      if (_periodic[Cell::X])
+	itr->x = Grid::wrapCoordinate(itr->x, _width);
+      if (_periodic[Cell::Y])
+	itr->y = Grid::wrapCoordinate(itr->y, _height);
+    }
   }
 }
 
 
 void FluidSolver::markCells()
 {
-  // Sweep over all FLUID cells, resetting them to AIR.
-  unsigned cellCount = _grid.getRowCount() * _grid.getColCount();
-  for (unsigned i = 0; i < cellCount; ++i)
-    if (_grid[i].cellType == Cell::FLUID)
-      _grid[i].cellType = Cell::AIR;
+  // Sweep over all FLUID cells, resetting them to AIR.  Only the rows
+  // that held fluid need visiting.
+  CellMask &mask = _grid.getCellMask();
+  const unsigned rows = _grid.getRowCount();
+  const unsigned cols = _grid.getColCount();
+  for (unsigned y = 0; y < rows; ++y) {
+    if (!mask.rowHasFluid(y))
+      continue;
+    for (unsigned x = 0; x < cols; ++x)
+      if (mask.isFluid(x, y))
+	_grid(x, y).cellType = Cell::AIR;
+  }
+  mask.clearFluid();
   
   // Iterate over all marker particles, setting their resident cells to FLUID.
-  vector<Vector2>::iterator itr = _particles.begin();
+  // Most cells hold several particles, so test the packed mask first and
+  // only touch each cell once.
+  ParticleArray::iterator itr = _particles.begin();
   for (; itr != _particles.end(); ++itr) {
     if (itr->x >= 0.0f && itr->x < _width &&
-	itr->y >= 0.0f && itr->y < _height)
-      _grid(itr->x, itr->y).cellType = Cell::FLUID;
+	itr->y >= 0.0f && itr->y < _height &&
+	!mask.isFluid(itr->x, itr->y))
+      _grid.setCellType(itr->x, itr->y, Cell::FLUID);
   }
 }
 
@@ -445,3 +1199,182 @@ float FluidSolver::getSimulationHeight() const
 {
   return _height;
 }
+
+
+const Grid & FluidSolver::getGrid() const
+{
+  return _grid;
+}
+
+
+const ParticleArray & FluidSolver::getParticles() const
+{
+  return _particles;
+}
+
+
+void FluidSolver::setGravity(Vector2 gravity)
+{
+  _gravity = gravity;
+}
+
+
+void FluidSolver::setInitialFill(float fraction)
+{
+  if (fraction < 0.0f)
+    fraction = 0.0f;
+  if (fraction > 1.0f)
+    fraction = 1.0f;
+  _initialFill = fraction;
+}
+
+
+void FluidSolver::consumeFrame()
+{
+  _frameReady = false;
+}
+
+
+unsigned FluidSolver::addScalarField(float initialValue)
+{
+  _scalarDefaults.push_back(initialValue);
+  return _grid.addScalarField(initialValue);
+}
+
+
+void FluidSolver::setViscosity(float viscosity)
+{
+  _viscosity = viscosity < 0.0f ? 0.0f : viscosity;
+}
+
+
+void FluidSolver::setPreconditioner(Preconditioner preconditioner)
+{
+  _preconditioner = preconditioner;
+}
+
+
+FluidSolver::Preconditioner FluidSolver::getPreconditioner() const
+{
+  return _preconditioner;
+}
+
+
+void FluidSolver::setPeriodic(Cell::Dimension dim, bool periodic)
+{
+  _periodic[dim] = periodic;
+  _grid.setPeriodic(dim, periodic);
+}
+
+
+bool FluidSolver::isPeriodic(Cell::Dimension dim) const
+{
+  return _periodic[dim];
+}
+
+
+void FluidSolver::setBoundary(Side side, BoundaryType type, Vector2 velocity)
+{
+  _boundaries[side] = type;
+
+  // Place the side's inflow emitter over the cells along it.  Particles
+  // are spawned at the rate the normal velocity carries cells of fluid
+  // through the side, at the 16 particles per cell reset() seeds.
+  FluidSource &inflow = _inflows[side];
+  const float w = _width, h = _height;
+  switch (side) {
+  case LEFT:
+    inflow.minCorner = Vector2(0.0f, 0.0f);
+    inflow.maxCorner = Vector2(1.0f, h);
+    break;
+  case RIGHT:
+    inflow.minCorner = Vector2(w - 1.0f, 0.0f);
+    inflow.maxCorner = Vector2(w, h);
+    break;
+  case BOTTOM:
+    inflow.minCorner = Vector2(0.0f, 0.0f);
+    inflow.maxCorner = Vector2(w, 1.0f);
+    break;
+  default:
+    inflow.minCorner = Vector2(0.0f, h - 1.0f);
+    inflow.maxCorner = Vector2(w, h);
+    break;
+  }
+  inflow.velocity = velocity;
+  const bool alongX = side == LEFT || side == RIGHT;
+  inflow.rate = 16.0f * (alongX ? std::fabs(velocity.x) * h
+			        : std::fabs(velocity.y) * w);
+}
+
+
+FluidSolver::BoundaryType FluidSolver::getBoundary(Side side) const
+{
+  return _boundaries[side];
+}
+
+
+bool FluidSolver::isWall(Side side) const
+{
+  const unsigned dim = side < BOTTOM ? Cell::X : Cell::Y;
+  return !_periodic[dim] && _boundaries[side] == WALL;
+}
+
+
+CommandQueue & FluidSolver::getCommandQueue()
+{
+  return _commands;
+}
+
+
+bool FluidSolver::isPaused() const
+{
+  return _paused;
+}
+
+
+void FluidSolver::setExtrapolationBand(unsigned cells)
+{
+  _extrapolator.setBandWidth(cells);
+}
+
+
+void FluidSolver::addEmitter(Vector2 minCorner, Vector2 maxCorner,
+			     Vector2 velocity, float rate)
+{
+  FluidSource emitter(FluidSource::EMITTER, minCorner, maxCorner);
+  emitter.velocity = velocity;
+  emitter.rate = rate;
+  emitter.seed += _sources.size();
+  _sources.push_back(emitter);
+}
+
+
+void FluidSolver::addSink(Vector2 minCorner, Vector2 maxCorner)
+{
+  _sources.push_back(FluidSource(FluidSource::SINK, minCorner, maxCorner));
+}
+
+
+void FluidSolver::clearSources()
+{
+  _sources.clear();
+}
+
+
+void FluidSolver::setParticleCapacity(unsigned capacity)
+{
+  _requestedCapacity = capacity;
+}
+
+
+unsigned FluidSolver::getParticleCapacity() const
+{
+  return _particleCapacity;
+}
+
+
+void FluidSolver::setScalar(unsigned x, unsigned y, unsigned field,
+			    float value)
+{
+  _grid.setScalar(x, y, field, value);
+}
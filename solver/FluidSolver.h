@@ -3,21 +3,82 @@
 
 #include "Grid.h"
 #include "Vector2.h"
+#include "FluidSource.h"
+#include "CommandQueue.h"
+#include "VelocityExtrapolator.h"
 #include "IFluidRenderer.h"
+#include <iosfwd>
 #include <vector>
+#include <eigen3/Eigen/Sparse>
+#include <eigen3/Eigen/IterativeLinearSolvers>
+
+typedef Eigen::Triplet<double> Tripletd;
+typedef Eigen::SparseMatrix<double, Eigen::RowMajor> SparseMatrixd;
 
 
 class FluidSolver : public QObject
 {
   Q_OBJECT
 
+public:
+  // The sides of the simulation domain.
+  enum Side { LEFT = 0, RIGHT, BOTTOM, TOP, SIDE_COUNT };
+
+  // How a side of the domain treats the fluid.
+  enum BoundaryType {
+    WALL = 0,   // A solid wall; nothing crosses it.  The default.
+    OUTFLOW,    // Open, at zero pressure; fluid leaves freely.
+    INFLOW      // Fluid enters at a prescribed velocity.
+  };
+
+  // How the conjugate gradient solves of pressure and viscosity are
+  // preconditioned.
+  enum Preconditioner {
+    DIAGONAL = 0,         // Jacobi scaling; cheap to set up.  The default.
+    INCOMPLETE_CHOLESKY,  // Fewer iterations, but costlier to set up.
+    PRECONDITIONER_COUNT
+  };
+
 private:
-  const float     _width;       // The width of the simulation.
-  const float     _height;      // The height of the simulation.
+  float           _width;       // The width of the simulation.
+  float           _height;      // The height of the simulation.
   Grid            _grid;        // The 2D MAC Grid.
   Vector2 _maxVelocity; // The maximum velocity seen last timestep.
   bool            _frameReady;  // True if frame's calculations are complete.
-  std::vector<Vector2> _particles;
+  ParticleArray _particles;
+  Vector2         _gravity;     // Global acceleration applied each timestep.
+  float           _initialFill; // Fraction of each axis filled by reset().
+  std::vector<float> _scalarDefaults; // Initial value of each scalar field.
+  float           _viscosity;   // Kinematic viscosity, in cells^2/sec.
+  std::vector<FluidSource> _sources; // Emitters and sinks.
+  unsigned        _particleCapacity; // Storage reserved for particles.
+  unsigned        _requestedCapacity; // setParticleCapacity(), or 0.
+  VelocityExtrapolator _extrapolator; // Extends fluid velocity into air.
+  bool            _periodic[2]; // Whether each axis wraps around.
+  BoundaryType    _boundaries[SIDE_COUNT]; // How each side treats fluid.
+  std::vector<FluidSource> _inflows; // The emitter behind each side.
+  CommandQueue    _commands;    // Requests from other threads.
+  std::vector<SolverCommand> _forces; // Forces to splat next timestep.
+  bool            _paused;      // True if frames only advance by STEP.
+  unsigned        _pendingSteps; // Frames requested by STEP while paused.
+
+  // Linear solver workspace, shared by the pressure and viscosity solves so
+  // that their storage is allocated once and reused every timestep.  Using
+  // both triangles of the row-major matrix lets Eigen multithread the
+  // matrix-vector products inside the conjugate gradient solver.  The
+  // pressure solve works in place on the grid's divergence and pressure
+  // arrays; the vectors here serve the viscosity solve.
+  std::vector<Tripletd> _solverTriplets; // Matrix entries being assembled.
+  SparseMatrixd   _solverMatrix;  // The assembled system matrix.
+  Eigen::VectorXd _solverRhs;     // Viscosity right hand side.
+  Eigen::VectorXd _solverResult;  // Viscosity solution.
+  std::vector<int> _solverIndex;  // Maps grid cells/faces to unknowns.
+  Preconditioner  _preconditioner; // Selects one of the solvers below.
+  Eigen::ConjugateGradient<SparseMatrixd, Eigen::Lower | Eigen::Upper>
+                  _solver;        // Diagonally preconditioned CG solver.
+  Eigen::ConjugateGradient<SparseMatrixd, Eigen::Lower | Eigen::Upper,
+			   Eigen::IncompleteCholesky<double> >
+                  _icSolver;      // Incomplete Cholesky preconditioned CG.
 
 public:
   // Constructs a 2D fluid simulation of the specified size.
@@ -58,10 +119,285 @@ public:
   //   float - The height of the simulation.
   float getSimulationHeight() const;
 
+  // Returns a read-only reference to the solver's MAC grid.
+  //
+  // Arguments:
+  //   None
+  //
+  // Returns:
+  //   const Grid & - The grid owned by this solver instance.
+  const Grid & getGrid() const;
+
+  // Returns a read-only reference to the solver's marker particles.
+  //
+  // Arguments:
+  //   None
+  //
+  // Returns:
+  //   const ParticleArray & - The particles owned by this solver.
+  const ParticleArray & getParticles() const;
+
+  // Sets the global acceleration (e.g. gravity) applied to all fluid cells
+  // every timestep.  Defaults to (0.0f, -9.8f).
+  //
+  // Arguments:
+  //   Vector2 gravity - The acceleration, in cells/sec^2.
+  //
+  // Returns:
+  //   None
+  void setGravity(Vector2 gravity);
+
+  // Sets the fraction of the simulation, per axis, that reset() fills with
+  // fluid.  The fluid block is anchored at the top right of the simulation.
+  // Defaults to 0.5f.  Takes effect on the next call to reset().
+  //
+  // Arguments:
+  //   float fraction - The filled fraction of each axis, in [0.0f, 1.0f].
+  //
+  // Returns:
+  //   None
+  void setInitialFill(float fraction);
+
+  // Marks the most recently calculated frame as consumed without drawing it,
+  // so that the next call to advanceFrame() calculates a new frame.  This is
+  // used by headless drivers that never call draw().
+  //
+  // Arguments:
+  //   None
+  //
+  // Returns:
+  //   None
+  void consumeFrame();
+
+  // Sets the fluid's kinematic viscosity.  Viscosity is applied implicitly,
+  // so that high viscosities don't shorten the CFL-limited timestep.  A
+  // viscosity of 0.0f (the default) skips the viscosity solve entirely.
+  //
+  // Arguments:
+  //   float viscosity - The kinematic viscosity, in cells^2/sec.
+  //
+  // Returns:
+  //   None
+  void setViscosity(float viscosity);
+
+  // Sets the preconditioner of the pressure and viscosity solves.  Which
+  // one is faster depends on the grid size and the machine; see AutoTuner.
+  //
+  // Arguments:
+  //   Preconditioner preconditioner - The preconditioner to use.
+  //
+  // Returns:
+  //   None
+  void setPreconditioner(Preconditioner preconditioner);
+
+  // Returns the preconditioner of the pressure and viscosity solves.
+  //
+  // Arguments:
+  //   None
+  //
+  // Returns:
+  //   Preconditioner - The preconditioner in use.
+  Preconditioner getPreconditioner() const;
+
+  // Makes an axis periodic, or closes it with walls again (the default).
+  // Fluid leaving across a periodic axis re-enters on the opposite side:
+  // sampling, advection, particle moves and the pressure solve all wrap
+  // around, so a small domain simulates one tile of a repeating pattern.
+  // The setting persists across reset() and resample().  The viscosity
+  // solve still treats every edge as a wall.
+  //
+  // Arguments:
+  //   Cell::Dimension dim - The axis.
+  //   bool periodic - Whether the axis wraps around.
+  //
+  // Returns:
+  //   None
+  void setPeriodic(Cell::Dimension dim, bool periodic);
+
+  // Determines whether an axis wraps around.
+  //
+  // Arguments:
+  //   Cell::Dimension dim - The axis.
+  //
+  // Returns:
+  //   bool - Whether the axis is periodic.
+  bool isPeriodic(Cell::Dimension dim) const;
+
+  // Sets how one side of the domain treats the fluid.  An OUTFLOW side is
+  // held at zero pressure, and particles crossing it are removed, so the
+  // domain can be cropped to the region of interest.  An INFLOW side acts
+  // as an emitter covering the row or column of cells along it: its faces
+  // hold the given velocity, and particles are spawned at the rate that
+  // velocity carries through the side.  Sides of a periodic axis ignore
+  // this setting.
+  //
+  // Arguments:
+  //   Side side - The side of the domain.
+  //   BoundaryType type - How the side treats the fluid.
+  //   Vector2 velocity - The velocity of entering fluid, for INFLOW.
+  //
+  // Returns:
+  //   None
+  void setBoundary(Side side, BoundaryType type,
+		   Vector2 velocity = Vector2());
+
+  // Gets how one side of the domain treats the fluid.
+  //
+  // Arguments:
+  //   Side side - The side of the domain.
+  //
+  // Returns:
+  //   BoundaryType - How the side treats the fluid.
+  BoundaryType getBoundary(Side side) const;
+
+  // Sets how many cells beyond the fluid the velocity is extrapolated into
+  // after each pressure solve.  Backtraces and particle moves near the
+  // surface sample those faces, so the band should cover the CFL
+  // coefficient's worth of cells plus one; the default is 3.  A band of 0
+  // leaves air velocities as they are.
+  //
+  // Arguments:
+  //   unsigned cells - The width of the band, in cells.
+  //
+  // Returns:
+  //   None
+  void setExtrapolationBand(unsigned cells);
+
+  // Adds an emitter that fills a rectangular region with fluid moving at a
+  // fixed velocity, spawning marker particles at the given rate.  Sources
+  // persist across calls to reset().
+  //
+  // Arguments:
+  //   Vector2 minCorner - Lower left corner of the region, world coords.
+  //   Vector2 maxCorner - Upper right corner of the region, world coords.
+  //   Vector2 velocity - The velocity of fluid leaving the emitter.
+  //   float rate - The number of particles spawned per second.
+  //
+  // Returns:
+  //   None
+  void addEmitter(Vector2 minCorner, Vector2 maxCorner, Vector2 velocity,
+		  float rate);
+
+  // Adds a sink that removes all fluid entering a rectangular region.
+  // Sources persist across calls to reset().
+  //
+  // Arguments:
+  //   Vector2 minCorner - Lower left corner of the region, world coords.
+  //   Vector2 maxCorner - Upper right corner of the region, world coords.
+  //
+  // Returns:
+  //   None
+  void addSink(Vector2 minCorner, Vector2 maxCorner);
+
+  // Removes all emitters and sinks.
+  //
+  // Arguments:
+  //   None
+  //
+  // Returns:
+  //   None
+  void clearSources();
+
+  // Sets the number of particles storage is reserved for.  The storage is
+  // allocated once by reset(), and particles removed by sinks free slots
+  // that emitters reuse, so steady-state emission never allocates.  Once
+  // the storage is full, emitters pause until sinks free some slots.
+  // Takes effect on the next call to reset().  0, the default, reserves
+  // room for the particles reset() seeds plus one second of every
+  // emitter's output.
+  //
+  // Arguments:
+  //   unsigned capacity - The maximum number of marker particles.
+  //
+  // Returns:
+  //   None
+  void setParticleCapacity(unsigned capacity);
+
+  // Returns the number of particles storage is reserved for.
+  //
+  // Arguments:
+  //   None
+  //
+  // Returns:
+  //   unsigned - The maximum number of marker particles.
+  unsigned getParticleCapacity() const;
+
+  // Adds a cell-centered scalar field, such as smoke density or temperature,
+  // that is carried along by the fluid's velocity.  The field keeps its
+  // index across calls to reset(), which restores the initial value.
+  //
+  // Arguments:
+  //   float initialValue - The field's value in every cell after reset().
+  //
+  // Returns:
+  //   unsigned - The index of the new field.
+  unsigned addScalarField(float initialValue);
+
+  // Sets the value of a scalar field within a single cell.
+  //
+  // Arguments:
+  //   unsigned x - The integer x coordinate of the cell within the grid.
+  //   unsigned y - The integer y coordinate of the cell within the grid.
+  //   unsigned field - The index returned by addScalarField().
+  //   float value - The new value of the field in this cell.
+  //
+  // Returns:
+  //   None
+  void setScalar(unsigned x, unsigned y, unsigned field, float value);
+
+  // Returns the queue through which other threads (typically the UI) send
+  // this solver forces, parameter changes and pause/step requests.  Pushing
+  // is lock-free and safe from any number of threads; the solver drains the
+  // queue itself before every timestep, so commands take effect at the next
+  // substep boundary.  Forces that arrive together are applied in a single
+  // pass over the grid.
+  //
+  // Arguments:
+  //   None
+  //
+  // Returns:
+  //   CommandQueue & - The solver's command queue.
+  CommandQueue & getCommandQueue();
+
+  // Returns whether a PAUSE command has stopped the simulation.
+  //
+  // Arguments:
+  //   None
+  //
+  // Returns:
+  //   bool - True if frames only advance by STEP commands.
+  bool isPaused() const;
+
+  // Writes the evolving state of the simulation as a binary checkpoint:
+  // velocities, cell types, pressures, scalar fields, particles, and where
+  // each source's emission stands.  The setup (size, gravity, boundaries,
+  // sources and scalar fields) is not written.  Values are in the host's
+  // byte order.
+  //
+  // Arguments:
+  //   std::ostream &out - The stream receiving the checkpoint.
+  //
+  // Returns:
+  //   bool - True on success.
+  bool writeCheckpoint(std::ostream &out) const;
+
+  // Restores the state written by writeCheckpoint(), so the simulation
+  // continues exactly as the checkpointed one would have.  The solver must
+  // be set up like the one that wrote the checkpoint; a checkpoint whose
+  // grid, scalar fields or sources don't match is rejected.
+  //
+  // Arguments:
+  //   std::istream &in - The stream holding the checkpoint.
+  //
+  // Returns:
+  //   bool - True on success.  On failure, the solver is unchanged.
+  bool readCheckpoint(std::istream &in);
+
 public slots:
   // Advances the simulation by a single frame if necessary.  If a frame has
   // already been calculated but not yet drawn (by calling the draw() method
-  // of this class), this method immediately returns.
+  // of this class), or the simulation is paused with no STEP pending, this
+  // method immediately returns.
   // Calculating a single frame involves determining an appropriate timestep
   // based on the CFL condition, and potentially advancing the simulation
   // multiple times based on that timestep until the simulation over the
@@ -85,6 +421,22 @@ public slots:
   //   None
   void reset();
 
+  // Continues the simulation at a new resolution.  The world is stretched
+  // onto the new grid: velocities, cell types and scalar fields are
+  // resampled, particle positions are scaled, and when the resolution grows
+  // each particle is split so that cells keep the same particle density.
+  // Gravity, viscosity and sources are rescaled into the new grid's units,
+  // so the resampled simulation carries on where it left off.  Later calls
+  // to reset() start over at the new resolution.
+  //
+  // Arguments:
+  //   float width - The new width of the simulation, in world coordinates.
+  //   float height - The new height of the simulation, in world coordinates.
+  //
+  // Returns:
+  //   None
+  void resample(float width, float height);
+
 protected:
   // Advances the simulation by a specific amount of time.
   //
@@ -104,6 +456,18 @@ protected:
   // Returns:
   //   None
   void advectVelocity(float timeStepSec);
+
+  // Advects every cell-centered scalar field through the velocity field.
+  // Each cell center inside the domain is traced backwards once, and all
+  // fields are sampled together at the traced position.  The extra row and
+  // column are filled from their neighbors inside.
+  //
+  // Arguments:
+  //   float timeStepSec - The amount of time to advect over.
+  //
+  // Returns:
+  //   None
+  void advectScalars(float timeStepSec);
   
   // Computes the backwards particle trace while enforcing boundary conditions
   //
@@ -135,9 +499,62 @@ protected:
   // Returns:
   //   None
   void pressureSolve(float timeStepSec);
+
+  // Diffuses the velocity field according to the fluid's viscosity, using
+  // an implicit (backward Euler) step that is stable for any timestep.
+  //
+  // Arguments:
+  //   float timeStepSec - The amount of time to simulate.
+  //
+  // Returns:
+  //   None
+  void viscositySolve(float timeStepSec);
+
+  // Applies the commands queued by other threads.  Forces are collected to
+  // be applied by applyForces(); everything else takes effect immediately.
+  //
+  // Arguments:
+  //   None
+  //
+  // Returns:
+  //   None
+  void applyCommands();
+
+  // Applies the collected forces in a single pass over the faces they
+  // reach, then forgets them.  Each face is visited once however many
+  // forces overlap it.
+  //
+  // Arguments:
+  //   None
+  //
+  // Returns:
+  //   None
+  void applyForces();
+
+  // Applies all emitters: each sets the velocity of the faces in its region,
+  // marks those cells as FLUID and spawns its share of particles.
+  //
+  // Arguments:
+  //   float timeStepSec - The amount of time to simulate.
+  //
+  // Returns:
+  //   None
+  void applyEmitters(float timeStepSec);
+
+  // Applies all sinks, removing the particles inside their regions, and
+  // removes the particles that left through an OUTFLOW side.
+  //
+  // Arguments:
+  //   None
+  //
+  // Returns:
+  //   None
+  void applySinks();
   
   // Modifies velocity values to prevent the fluid from flowing out of the
-  // simulation boundaries.
+  // simulation boundaries.  WALL sides have their normal velocity zeroed,
+  // INFLOW sides hold their inflow velocity, and OUTFLOW and periodic sides
+  // are left free.
   //
   // TODO:
   //   Does this cover the case where fluid cells travel into air?
@@ -149,6 +566,38 @@ protected:
   //   None
   void boundaryCollide();
 
+  // Computes the particle capacity reset() reserves when none was set: the
+  // particles it seeds plus one second of emission.
+  //
+  // Arguments:
+  //   unsigned startX - The first column reset() fills with fluid.
+  //   unsigned startY - The first row reset() fills with fluid.
+  //
+  // Returns:
+  //   unsigned - The number of particles to reserve storage for.
+  unsigned getDefaultParticleCapacity(unsigned startX, unsigned startY) const;
+
+  // Applies one emitter: sets the velocity of the faces in its region,
+  // marks those cells as FLUID and spawns its share of particles.
+  //
+  // Arguments:
+  //   FluidSource &source - The emitter.
+  //   float timeStepSec - The amount of time to simulate.
+  //
+  // Returns:
+  //   None
+  void applyEmitter(FluidSource &source, float timeStepSec);
+
+  // Determines whether a side is a solid wall: a WALL side of an axis that
+  // isn't periodic.
+  //
+  // Arguments:
+  //   Side side - The side of the domain.
+  //
+  // Returns:
+  //   bool - Whether the side is a wall.
+  bool isWall(Side side) const;
+
   // Moves particles through the velocity field for the specified duration.
   //
   // Arguments:
@@ -168,6 +617,27 @@ protected:
   void markCells();
 
 private:
+  // Solves the system staged in _solverTriplets.
+  //
+  // Arguments:
+  //   int dim - The number of unknowns.
+  //   const double *rhs - The dim values of the right hand side.
+  //   double *result - Receives the dim values of the solution.
+  //
+  // Returns:
+  //   bool - True if the solver converged.
+  bool solveLinearSystem(int dim, const double *rhs, double *result);
+
+  // Implicitly diffuses one component of the velocity field.
+  //
+  // Arguments:
+  //   Cell::Dimension dim - The velocity component to diffuse.
+  //   float timeStepSec - The amount of time to simulate.
+  //
+  // Returns:
+  //   None
+  void solveViscosity(Cell::Dimension dim, float timeStepSec);
+
   // Hidden default constructor.
   FluidSolver();
 };
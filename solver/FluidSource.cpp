@@ -0,0 +1,30 @@
+#include "FluidSource.h"
+
+FluidSource::FluidSource(Type type, Vector2 minCorner, Vector2 maxCorner)
+  : type(type),
+    minCorner(minCorner),
+    maxCorner(maxCorner),
+    velocity(),
+    rate(0.0f),
+    pending(0.0f),
+    seed(12345u)
+{}
+
+
+bool FluidSource::contains(Vector2 position) const
+{
+  return position.x >= minCorner.x && position.x < maxCorner.x &&
+         position.y >= minCorner.y && position.y < maxCorner.y;
+}
+
+
+Vector2 FluidSource::randomPosition()
+{
+  // A small linear congruential generator is plenty for placing particles.
+  seed = seed * 1664525u + 1013904223u;
+  float u = (seed >> 8) * (1.0f / 16777216.0f);
+  seed = seed * 1664525u + 1013904223u;
+  float v = (seed >> 8) * (1.0f / 16777216.0f);
+  return Vector2(minCorner.x + u * (maxCorner.x - minCorner.x),
+		 minCorner.y + v * (maxCorner.y - minCorner.y));
+}
@@ -0,0 +1,57 @@
+#ifndef __FLUID_SOURCE_H__
+#define __FLUID_SOURCE_H__
+
+#include "Vector2.h"
+
+// A rectangular region that continuously adds fluid to, or removes fluid
+// from, the simulation.  EMITTERs (faucets, inflows) hold the velocity of
+// every face inside the region and spawn marker particles at a fixed rate.
+// SINKs (drains) remove every marker particle that enters the region.
+struct FluidSource {
+  // Enumerated type to determine the behavior of the source.
+  enum Type {
+    EMITTER = 0,
+    SINK,
+    TYPE_COUNT
+  };
+
+  // Public data members.
+  Type     type;        // Whether fluid is added or removed.
+  Vector2  minCorner;   // Lower left corner of the region, world coords.
+  Vector2  maxCorner;   // Upper right corner of the region, world coords.
+  Vector2  velocity;    // Velocity imposed inside an emitter's region.
+  float    rate;        // Particles spawned per second by an emitter.
+  float    pending;     // Fractional particles carried between timesteps.
+  unsigned seed;        // State of this source's particle placement RNG.
+
+
+  // Constructs a source covering the given region.
+  //
+  // Arguments:
+  //   Type type - Whether this source is an EMITTER or a SINK.
+  //   Vector2 minCorner - Lower left corner of the region, world coords.
+  //   Vector2 maxCorner - Upper right corner of the region, world coords.
+  FluidSource(Type type, Vector2 minCorner, Vector2 maxCorner);
+
+  // Returns true if the position lies within this source's region.
+  //
+  // Arguments:
+  //   Vector2 position - The position to test, in world coordinates.
+  //
+  // Returns:
+  //   bool - True if the position is inside the region.
+  bool contains(Vector2 position) const;
+
+  // Returns a pseudo-random position inside this source's region.  Each
+  // source has its own generator, so solvers on different threads never
+  // share random state.
+  //
+  // Arguments:
+  //   None
+  //
+  // Returns:
+  //   Vector2 - A position inside the region.
+  Vector2 randomPosition();
+};
+
+#endif //__FLUID_SOURCE_H__
@@ -1,6 +1,7 @@
 #include "Grid.h"
 #include "Cell.h"
 #include "Vector2.h"
+#include <algorithm>
 #include <vector>
 #include <cstddef>
 
@@ -11,15 +12,32 @@ Grid::Grid(float width, float height)
   // Note the extra top/right border cell to track velocity at edges of sim.
   _colCount = width  < _minSize ? _minSize : ceil(width)  + 1;
   _rowCount = height < _minSize ? _minSize : ceil(height) + 1;
-  _cells.resize(_rowCount * _colCount);
+  _rowStride = (_colCount + ROW_ALIGNMENT - 1) / ROW_ALIGNMENT *
+    ROW_ALIGNMENT;
+  _cells.resize(getCellCount());
+  _pressure.resize(getCellCount());
+  _divergence.resize(getCellCount());
+  _scalarCount = 0;
+  _cellMask = CellMask(_colCount, _rowCount);
+  _periodic[Cell::X] = false;
+  _periodic[Cell::Y] = false;
   setCellLinkage();
 }
 
 
 Grid::Grid(const Grid &grid)
   : _rowCount(grid._rowCount),
-    _colCount(grid._colCount)
+    _colCount(grid._colCount),
+    _rowStride(grid._rowStride),
+    _scalarCount(grid._scalarCount),
+    _scalars(grid._scalars),
+    _stagedScalars(grid._stagedScalars),
+    _pressure(grid._pressure),
+    _divergence(grid._divergence),
+    _cellMask(grid._cellMask)
 {
+  _periodic[Cell::X] = grid._periodic[Cell::X];
+  _periodic[Cell::Y] = grid._periodic[Cell::Y];
   _cells = grid._cells;
   setCellLinkage();
 }
@@ -30,7 +48,16 @@ Grid & Grid::operator=(const Grid &grid)
   if (this != &grid) {
     _rowCount = grid._rowCount;
     _colCount = grid._colCount;
+    _rowStride = grid._rowStride;
     _cells = grid._cells;
+    _scalarCount = grid._scalarCount;
+    _scalars = grid._scalars;
+    _stagedScalars = grid._stagedScalars;
+    _pressure = grid._pressure;
+    _divergence = grid._divergence;
+    _cellMask = grid._cellMask;
+    _periodic[Cell::X] = grid._periodic[Cell::X];
+    _periodic[Cell::Y] = grid._periodic[Cell::Y];
     setCellLinkage();
   }
   return *this;
@@ -40,7 +67,7 @@ Grid & Grid::operator=(const Grid &grid)
 Grid::~Grid()
 {
   // Tear down linkage between cells.
-  vector<Cell>::iterator itr = _cells.begin();
+  CellArray::iterator itr = _cells.begin();
   for( ; itr != _cells.end(); ++itr) {
     for (unsigned i = 0; i < Cell::NEIGHBOR_COUNT; ++i) {
       itr->neighbors[i] = NULL;
@@ -145,10 +172,10 @@ float Grid::bilerpVel(Vector2 position, Cell::Dimension dim) const
   // Ensure that incoming x and y values are not greater than the
   // max grid width. Do this prior to the "shifting" step below,
   // since a clamped value will need to be adjusted for X or Y
-  // MAC grid sampling.
-  if (position.x > getWidth())
+  // MAC grid sampling.  Periodic axes are wrapped after the shift instead.
+  if (position.x > getWidth() && !_periodic[Cell::X])
     position.x = getWidth();
-  if (position.y > getHeight())
+  if (position.y > getHeight() && !_periodic[Cell::Y])
     position.y = getHeight();
 
   // In a MAC Grid, the X and Y velocities are offset from the centerpoint
@@ -173,10 +200,16 @@ float Grid::bilerpVel(Vector2 position, Cell::Dimension dim) const
 
   // Ensure the resulting X and Y value are not less than the minimal
   // grid index.  Do this after the "shifting" step above, since the
-  // shifted result may be less than 0.0.
-  if (position.x < 0.0f)
+  // shifted result may be less than 0.0.  A periodic axis instead wraps
+  // into [0, size); its last cell's neighbor is then the extra row or
+  // column, which mirrors the first.
+  if (_periodic[Cell::X])
+    position.x = wrapCoordinate(position.x, getWidth());
+  else if (position.x < 0.0f)
     position.zeroX();
-  if (position.y < 0.0f)
+  if (_periodic[Cell::Y])
+    position.y = wrapCoordinate(position.y, getHeight());
+  else if (position.y < 0.0f)
     position.zeroY();
 
   // Determine the base and fractional cell index for interpolation.
@@ -186,8 +219,9 @@ float Grid::bilerpVel(Vector2 position, Cell::Dimension dim) const
   j = floor(position.y);
   position -= Vector2(i,j);
 
-  // Get the base cell.
-  Cell cell = (*this)(i,j);
+  // Get the base cell.  Read it in place; copying a Cell here would
+  // dominate the cost of the interpolation.
+  const Cell &cell = _cells[j * _rowStride + i];
 
   float thisVel, rightVel, topVel, topRightVel;
   // If all neighbors are present, get the velocity value from each.
@@ -211,3 +245,166 @@ float Grid::bilerpVel(Vector2 position, Cell::Dimension dim) const
   // Perform the bilinear interpolation.
   return bilerp(position, thisVel, rightVel, topVel, topRightVel);
 }
+
+
+void Grid::updateCellMask()
+{
+  _cellMask.clear();
+  for (unsigned y = 0; y < _rowCount; ++y)
+    for (unsigned x = 0; x < _colCount; ++x) {
+      Cell::Type type = _cells[y * _rowStride + x].cellType;
+      if (type != Cell::AIR)
+	_cellMask.set(x, y, type);
+    }
+}
+
+
+void Grid::setPeriodic(Cell::Dimension dim, bool periodic)
+{
+  _periodic[dim] = periodic;
+  wrapBorders();
+}
+
+
+void Grid::wrapBorders()
+{
+  const unsigned width  = _colCount - 1;
+  const unsigned height = _rowCount - 1;
+  if (_periodic[Cell::X])
+    for (unsigned y = 0; y < _rowCount; ++y)
+      copyCell(0, y, width, y);
+  if (_periodic[Cell::Y])
+    for (unsigned x = 0; x < _colCount; ++x)
+      copyCell(x, 0, x, height);
+}
+
+
+void Grid::copyCell(unsigned fromX, unsigned fromY, unsigned toX,
+		    unsigned toY)
+{
+  const unsigned from = fromY * _rowStride + fromX;
+  const unsigned to   = toY * _rowStride + toX;
+  _cells[to].vel[Cell::X] = _cells[from].vel[Cell::X];
+  _cells[to].vel[Cell::Y] = _cells[from].vel[Cell::Y];
+  setCellType(toX, toY, _cells[from].cellType);
+  if (_scalarCount > 0)
+    std::copy(&_scalars[from * _scalarCount],
+	      &_scalars[from * _scalarCount] + _scalarCount,
+	      &_scalars[to * _scalarCount]);
+  _pressure[to] = _pressure[from];
+}
+
+
+void Grid::resample(const Grid &source, float scaleX, float scaleY)
+{
+  _scalarCount = source._scalarCount;
+  _scalars.assign(getCellCount() * _scalarCount, 0.0f);
+  _stagedScalars.assign(_scalars.size(), 0.0f);
+  std::fill(_pressure.begin(), _pressure.end(), 0.0);
+
+  const float invX = 1.0f / scaleX;
+  const float invY = 1.0f / scaleY;
+  const unsigned sourceMaxX = source._colCount - 1;
+  const unsigned sourceMaxY = source._rowCount - 1;
+  const int rowCount = _rowCount;
+#pragma omp parallel for schedule(static)
+  for (int y = 0; y < rowCount; ++y)
+    for (unsigned x = 0; x < _colCount; ++x) {
+      Cell &cell = _cells[y * _rowStride + x];
+
+      // Each face samples the source at its own position, mapped back into
+      // the source's coordinates.  Velocities are in cells per second, so
+      // they scale with the resolution.
+      Vector2 xFace(x * invX, (y + 0.5f) * invY);
+      Vector2 yFace((x + 0.5f) * invX, y * invY);
+      cell.vel[Cell::X] = source.bilerpVel(xFace, Cell::X) * scaleX;
+      cell.vel[Cell::Y] = source.bilerpVel(yFace, Cell::Y) * scaleY;
+
+      // Types and scalars are taken at the cell center.
+      Vector2 center((x + 0.5f) * invX, (y + 0.5f) * invY);
+      const unsigned i = std::min<unsigned>(center.x, sourceMaxX);
+      const unsigned j = std::min<unsigned>(center.y, sourceMaxY);
+      cell.cellType = source._cells[j * source._rowStride + i].cellType;
+      source.sampleScalars(center, &_scalars[(y * _rowStride + x) *
+					     _scalarCount]);
+    }
+
+  // The mask's row and tile bits are shared between rows, so it is rebuilt
+  // once the cells are done.
+  updateCellMask();
+}
+
+
+unsigned Grid::addScalarField(float value)
+{
+  // Re-interleave the existing fields with the new one.
+  const unsigned cellCount = getCellCount();
+  const unsigned newCount = _scalarCount + 1;
+  ScalarArray scalars(cellCount * newCount);
+  for (unsigned i = 0; i < cellCount; ++i) {
+    for (unsigned f = 0; f < _scalarCount; ++f)
+      scalars[i * newCount + f] = _scalars[i * _scalarCount + f];
+    scalars[i * newCount + _scalarCount] = value;
+  }
+  _scalars.swap(scalars);
+  _stagedScalars = _scalars;
+  return _scalarCount++;
+}
+
+
+void Grid::sampleScalars(Vector2 position, float *values) const
+{
+  if (_scalarCount == 0)
+    return;
+
+  // Scalars are sampled at cell centers, offset by half a cell from the
+  // cell's origin.  Clamp to the span of cell centers, keeping one cell
+  // on the positive side of the base cell for interpolation.  The lower
+  // clamps are written to catch NaN too, so it can't reach the weights.
+  position -= Vector2(0.5f, 0.5f);
+  const float maxX = _colCount - 1;
+  const float maxY = _rowCount - 1;
+  if (_periodic[Cell::X])
+    position.x = wrapCoordinate(position.x, maxX);
+  if (_periodic[Cell::Y])
+    position.y = wrapCoordinate(position.y, maxY);
+  if (!(position.x >= 0.0f))
+    position.zeroX();
+  if (!(position.y >= 0.0f))
+    position.zeroY();
+  if (position.x > maxX)
+    position.x = maxX;
+  if (position.y > maxY)
+    position.y = maxY;
+
+  unsigned i = floor(position.x);
+  unsigned j = floor(position.y);
+  if (i > _colCount - 2)
+    i = _colCount - 2;
+  if (j > _rowCount - 2)
+    j = _rowCount - 2;
+  position -= Vector2(i, j);
+
+  // Compute the bilinear weights once for every field.
+  const float w00 = (1-position.x) * (1-position.y);
+  const float w10 = position.x     * (1-position.y);
+  const float w01 = (1-position.x) * position.y;
+  const float w11 = position.x     * position.y;
+
+  // The four corner cells' fields are each contiguous, so every field is
+  // read with unit stride from the same four cache lines.
+  const unsigned n = _scalarCount;
+  const float *origin = &_scalars[(j * _rowStride + i) * n];
+  const float *posX   = origin + n;
+  const float *posY   = origin + _rowStride * n;
+  const float *posXY  = posY + n;
+  for (unsigned f = 0; f < n; ++f)
+    values[f] = w00 * origin[f] + w10 * posX[f] +
+                w01 * posY[f]   + w11 * posXY[f];
+}
+
+
+void Grid::commitStagedScalars()
+{
+  _scalars.swap(_stagedScalars);
+}
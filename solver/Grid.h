@@ -1,18 +1,44 @@
 #ifndef __GRID_H__
 #define __GRID_H__
 
+#include <cmath>
 #include <vector>
 #include "Cell.h"
+#include "CellMask.h"
+#include "FieldMemory.h"
 #include "Vector2.h"
 
 
+// Cells and their per-cell fields are stored row by row, each row padded
+// to a whole number of ROW_ALIGNMENT cells.  A row of cells, pressures or
+// divergences then starts on a cache line, given the 64 byte aligned
+// blocks of FieldMemory, and rows processed by different threads never
+// share one.  Padding cells lie outside the simulation: they have no
+// neighbors, aren't in the cell mask, and nothing but whole-array passes
+// touches them.
 class Grid {
+  typedef std::vector<Cell, FieldAllocator<Cell> > CellArray;
+  typedef std::vector<float, FieldAllocator<float> > ScalarArray;
+  typedef std::vector<double, FieldAllocator<double> > DoubleArray;
+
   unsigned _rowCount;  // The number of rows in the sim.
   unsigned _colCount;  // The number of columns in the sim.
-  std::vector<Cell> _cells;  // STL Vector of all managed cells.
+  unsigned _rowStride; // The number of cells from one row to the next.
+  CellArray _cells;    // STL Vector of all managed cells.
+  unsigned _scalarCount;       // The number of cell-centered scalar fields.
+  ScalarArray _scalars;        // Scalar values, interleaved per cell.
+  ScalarArray _stagedScalars;  // Temp scalar values, same layout.
+  DoubleArray _pressure;       // Pressure at each cell's center.
+  DoubleArray _divergence;     // Pressure solve right-hand side.
+  CellMask _cellMask;        // Packed copy of every cell's type.
+  bool _periodic[2];         // Whether each axis wraps around.
   const static unsigned _minSize = 2; // Minimum size of grid in any dim.
 
 public:
+  // The number of cells each row is padded to a multiple of.  A Cell is 48
+  // bytes and a double 8, so 8 of either fill whole 64 byte lines.
+  static const unsigned ROW_ALIGNMENT = 8;
+
   // Constructs an instance of Grid of size width by height. Width and height
   // are to be provided in world coordinates.  The Grid class produces a MAC
   // grid of size that rounds up to the nearest integer in each dimension.
@@ -63,10 +89,11 @@ public:
   inline Cell operator()(unsigned x, unsigned y) const;
 
   // Returns a reference to the specified cell, as specified by an index
-  // into a contiguous array of Cell objects in row-major order.
+  // into a contiguous array of Cell objects in row-major order.  Cell
+  // (x, y) has index y * getRowStride() + x.
   // 
   // Arguments:
-  //   unsigned index - The index into the row-major
+  //   unsigned index - The index into the row-major, padded array.
   //
   // Returns:
   //   Cell& - A reference to the specified cell.
@@ -76,7 +103,7 @@ public:
   // into a contiguous array of Cell objects in row-major order.
   // 
   // Arguments:
-  //   unsigned index - The index into the row-major
+  //   unsigned index - The index into the row-major, padded array.
   //
   // Returns:
   //   Cell - A copy of the specified cell.
@@ -93,6 +120,19 @@ public:
   //   Vector2 - The interpolated velocity at this point.
   Vector2 getVelocity(Vector2 position) const;
 
+  // Gets the velocity at each of a batch of locations within the grid.  The
+  // result for each lane matches getVelocity(), but the index and weight
+  // arithmetic runs across all lanes at once.
+  //
+  // Arguments:
+  //   const Vector2xN<N> &positions - The positions to sample velocity at
+  //   Vector2xN<N> &velocities - Receives the interpolated velocities.
+  // Returns:
+  //   None
+  template <unsigned N>
+  void getVelocity(const Vector2xN<N> &positions,
+		   Vector2xN<N> &velocities) const;
+
   // Calculates the pressure gradient across this cell. 
   // 
   // Arguments:
@@ -170,13 +210,261 @@ public:
   //   unsigned - The number of cols in the grid.
   inline unsigned getColCount() const;
 
+  // Gets the distance between rows in the cell, pressure, divergence and
+  // scalar arrays, in cells: getColCount() rounded up to a multiple of
+  // ROW_ALIGNMENT.
+  //
+  // Arguments:
+  //   None
+  //
+  // Returns:
+  //   unsigned - The row stride of the grid's arrays.
+  inline unsigned getRowStride() const;
+
+  // Gets the number of cells in the grid's arrays, padding included:
+  // getRowCount() * getRowStride().  Passes over every cell may run over
+  // all of them.
+  //
+  // Arguments:
+  //   None
+  //
+  // Returns:
+  //   unsigned - The length of the cell, pressure and divergence arrays.
+  inline unsigned getCellCount() const;
+
+  // Adds a cell-centered scalar field (e.g. smoke density or temperature),
+  // initialized to the provided value in every cell.  The values of all
+  // scalar fields are stored interleaved per cell, so that every field can
+  // be sampled at once with sampleScalars().
+  //
+  // Arguments:
+  //   float value - The initial value of the field in every cell.
+  //
+  // Returns:
+  //   unsigned - The index of the new field.
+  unsigned addScalarField(float value);
+
+  // Gets the number of cell-centered scalar fields.
+  //
+  // Arguments:
+  //   None
+  //
+  // Returns:
+  //   unsigned - The number of scalar fields.
+  inline unsigned getScalarFieldCount() const;
+
+  // Gets the value of a scalar field at the center of a cell.
+  //
+  // Arguments:
+  //   unsigned x - The integer x coordinate of this cell within the grid.
+  //   unsigned y - The integer y coordinate of this cell within the grid.
+  //   unsigned field - The index of the scalar field.
+  //
+  // Returns:
+  //   float - The value of the field in this cell.
+  inline float getScalar(unsigned x, unsigned y, unsigned field) const;
+
+  // Sets the value of a scalar field at the center of a cell.
+  //
+  // Arguments:
+  //   unsigned x - The integer x coordinate of this cell within the grid.
+  //   unsigned y - The integer y coordinate of this cell within the grid.
+  //   unsigned field - The index of the scalar field.
+  //   float value - The new value of the field in this cell.
+  //
+  // Returns:
+  //   None
+  inline void setScalar(unsigned x, unsigned y, unsigned field, float value);
+
+  // Bilinearly interpolates every scalar field at a location within the grid.
+  // The interpolation weights are computed once and shared by all fields.
+  // Positions outside the grid are clamped to the nearest cell center, and
+  // NaN coordinates to the first.
+  //
+  // Arguments:
+  //   Vector2 position - The position to sample the fields at.
+  //   float *values - Receives getScalarFieldCount() interpolated values.
+  //
+  // Returns:
+  //   None
+  void sampleScalars(Vector2 position, float *values) const;
+
+  // Returns the staged values of every scalar field for a cell, to be
+  // realized by commitStagedScalars().
+  //
+  // Arguments:
+  //   unsigned x - The integer x coordinate of this cell within the grid.
+  //   unsigned y - The integer y coordinate of this cell within the grid.
+  //
+  // Returns:
+  //   float * - The cell's getScalarFieldCount() staged values.
+  inline float * getStagedScalars(unsigned x, unsigned y);
+
+  // Gets or sets the pressure, as sampled at the center of a cell.
+  inline double getPressure(unsigned x, unsigned y) const;
+  inline void setPressure(unsigned x, unsigned y, double pressure);
+
+  // Gets the pressure of every cell as one contiguous array, indexed like
+  // operator[].  A pressure solve may use it directly as its solution.
+  //
+  // Arguments:
+  //   None
+  //
+  // Returns:
+  //   double * - getCellCount() pressure values.
+  inline double * getPressureData();
+  inline const double * getPressureData() const;
+
+  // Gets every cell as one contiguous array, indexed like operator[], so
+  // that the cells can be read in place rather than copied one by one.
+  //
+  // Arguments:
+  //   None
+  //
+  // Returns:
+  //   Cell * - getCellCount() cells.
+  inline const Cell * getCellData() const;
+
+  // Gets the right-hand side of the pressure solve, the negative velocity
+  // divergence of each cell adjusted for the walls, laid out like
+  // getPressureData().  The grid only stores it; the solver fills it.
+  //
+  // Arguments:
+  //   None
+  //
+  // Returns:
+  //   double * - getCellCount() values.
+  inline double * getDivergenceData();
+  inline const double * getDivergenceData() const;
+
+  // Sets the type of a cell, keeping the cell mask current.  Writing a
+  // Cell's cellType directly leaves the mask stale until updateCellMask().
+  //
+  // Arguments:
+  //   unsigned x - The integer x coordinate of this cell within the grid.
+  //   unsigned y - The integer y coordinate of this cell within the grid.
+  //   Cell::Type type - The cell's new type.
+  //
+  // Returns:
+  //   None
+  inline void setCellType(unsigned x, unsigned y, Cell::Type type);
+
+  // Gets the packed cell types and fluid bitmaps of this grid.
+  //
+  // Arguments:
+  //   None
+  //
+  // Returns:
+  //   const CellMask & - The cell mask.
+  inline const CellMask & getCellMask() const;
+
+  // Gets the cell mask for in-place updates.  Changes made through it must
+  // be mirrored in the cells' cellType.
+  //
+  // Arguments:
+  //   None
+  //
+  // Returns:
+  //   CellMask & - The cell mask.
+  inline CellMask & getCellMask();
+
+  // Rebuilds the cell mask from every cell's cellType.
+  //
+  // Arguments:
+  //   None
+  //
+  // Returns:
+  //   None
+  void updateCellMask();
+
+  // Makes an axis periodic, so that the grid wraps around along it, or
+  // closes it again.  Along a periodic axis the extra top row or right
+  // column is a copy of the first one, kept current by wrapBorders(), and
+  // sampling wraps positions around instead of clamping them.  Grids are
+  // closed along both axes by default.
+  //
+  // Arguments:
+  //   Cell::Dimension dim - The axis.
+  //   bool periodic - Whether the axis wraps around.
+  //
+  // Returns:
+  //   None
+  void setPeriodic(Cell::Dimension dim, bool periodic);
+
+  // Determines whether an axis wraps around.
+  //
+  // Arguments:
+  //   Cell::Dimension dim - The axis.
+  //
+  // Returns:
+  //   bool - Whether the axis is periodic.
+  inline bool isPeriodic(Cell::Dimension dim) const;
+
+  // Copies the first column into the extra right column along a periodic X
+  // axis, and the first row into the extra top row along a periodic Y
+  // axis: velocities, cell types, scalars and pressure.  Call after
+  // changing the first row or column and before sampling across the wrap.
+  //
+  // Arguments:
+  //   None
+  //
+  // Returns:
+  //   None
+  void wrapBorders();
+
+  // Wraps a coordinate into [0, size).
+  //
+  // Arguments:
+  //   float value - The coordinate.
+  //   float size - The length of the periodic axis.
+  //
+  // Returns:
+  //   float - The equivalent coordinate in [0, size).
+  static inline float wrapCoordinate(float value, float size);
+
+  // Fills this grid by resampling another grid of a different resolution,
+  // whose world coordinates map onto this grid's scaled by (scaleX,
+  // scaleY).  Face velocities are interpolated bilinearly and scaled into
+  // this grid's units; cell types come from the nearest source cell and
+  // scalar fields are interpolated at cell centers.  Pressure is cleared.
+  // Rows are resampled in parallel.
+  //
+  // Arguments:
+  //   const Grid &source - The grid to resample.
+  //   float scaleX - This grid's size over the source's, along X.
+  //   float scaleY - This grid's size over the source's, along Y.
+  //
+  // Returns:
+  //   None
+  void resample(const Grid &source, float scaleX, float scaleY);
+
+  // Realizes the staged scalar values of all cells as their current values.
+  // Every cell's staged values must have been written since the last commit,
+  // as the staged and current buffers are exchanged rather than copied.
+  // Padding cells are the exception; nothing reads their values.
+  //
+  // Arguments:
+  //   None
+  //
+  // Returns:
+  //   None
+  void commitStagedScalars();
+
 private:
   // Creates linkage between neighboring cells.
   void setCellLinkage();
 
+  // Copies one cell's velocities, type, scalars and pressure to another.
+  void copyCell(unsigned fromX, unsigned fromY, unsigned toX, unsigned toY);
+
   // Calculates a velocity component at the given world location in the MAC grid.
   float bilerpVel(Vector2 position, Cell::Dimension dim) const;
 
+  // Calculates a velocity component at each of a batch of world locations.
+  template <unsigned N>
+  void bilerpVel(const Vector2xN<N> &positions, Cell::Dimension dim,
+		 float *result) const;
+
   // Utility function to perform bilinear interpolation between four values.
   // 
   // Arguments:
@@ -195,14 +483,14 @@ private:
 
 Cell& Grid::operator()(unsigned x, unsigned y)
 {
-  unsigned index = y * _colCount + x;
+  unsigned index = y * _rowStride + x;
   return _cells[index];
 }
  
  
 Cell Grid::operator()(unsigned x, unsigned y) const
 {
-  unsigned index = y * _colCount + x;
+  unsigned index = y * _rowStride + x;
   return _cells[index];
 }
 
@@ -219,6 +507,39 @@ Cell Grid::operator[](unsigned index) const
 }
 
 
+bool Grid::isPeriodic(Cell::Dimension dim) const
+{
+  return _periodic[dim];
+}
+
+
+float Grid::wrapCoordinate(float value, float size)
+{
+  value -= size * floorf(value / size);
+  // Rounding can land a tiny negative value exactly on size.
+  return value < size ? value : 0.0f;
+}
+
+
+void Grid::setCellType(unsigned x, unsigned y, Cell::Type type)
+{
+  _cells[y * _rowStride + x].cellType = type;
+  _cellMask.set(x, y, type);
+}
+
+
+const CellMask & Grid::getCellMask() const
+{
+  return _cellMask;
+}
+
+
+CellMask & Grid::getCellMask()
+{
+  return _cellMask;
+}
+
+
 float Grid::getHeight() const
 {
   return static_cast<float>(_rowCount - 1);
@@ -243,6 +564,84 @@ unsigned Grid::getColCount() const
 }
 
 
+unsigned Grid::getRowStride() const
+{
+  return _rowStride;
+}
+
+
+unsigned Grid::getCellCount() const
+{
+  return _rowCount * _rowStride;
+}
+
+
+unsigned Grid::getScalarFieldCount() const
+{
+  return _scalarCount;
+}
+
+
+float Grid::getScalar(unsigned x, unsigned y, unsigned field) const
+{
+  return _scalars[(y * _rowStride + x) * _scalarCount + field];
+}
+
+
+void Grid::setScalar(unsigned x, unsigned y, unsigned field, float value)
+{
+  _scalars[(y * _rowStride + x) * _scalarCount + field] = value;
+}
+
+
+float * Grid::getStagedScalars(unsigned x, unsigned y)
+{
+  return &_stagedScalars[(y * _rowStride + x) * _scalarCount];
+}
+
+
+double Grid::getPressure(unsigned x, unsigned y) const
+{
+  return _pressure[y * _rowStride + x];
+}
+
+
+void Grid::setPressure(unsigned x, unsigned y, double pressure)
+{
+  _pressure[y * _rowStride + x] = pressure;
+}
+
+
+double * Grid::getPressureData()
+{
+  return &_pressure[0];
+}
+
+
+const double * Grid::getPressureData() const
+{
+  return &_pressure[0];
+}
+
+
+const Cell * Grid::getCellData() const
+{
+  return &_cells[0];
+}
+
+
+double * Grid::getDivergenceData()
+{
+  return &_divergence[0];
+}
+
+
+const double * Grid::getDivergenceData() const
+{
+  return &_divergence[0];
+}
+
+
 float Grid::bilerp(Vector2 pos,
 		   float originVal, float posXVal,
 		   float posYVal, float posXYVal) const 
@@ -254,4 +653,84 @@ float Grid::bilerp(Vector2 pos,
 }
 
 
+template <unsigned N>
+void Grid::getVelocity(const Vector2xN<N> &positions,
+		       Vector2xN<N> &velocities) const
+{
+  bilerpVel(positions, Cell::X, velocities.x);
+  bilerpVel(positions, Cell::Y, velocities.y);
+}
+
+
+template <unsigned N>
+void Grid::bilerpVel(const Vector2xN<N> &positions, Cell::Dimension dim,
+		     float *result) const
+{
+  // This follows the scalar bilerpVel() step for step, split into three
+  // passes so that only the cell lookups are done one lane at a time.
+  const float width = getWidth();
+  const float height = getHeight();
+  const float shiftX = dim == Cell::Y ? 0.5f : 0.0f;
+  const float shiftY = dim == Cell::X ? 0.5f : 0.0f;
+
+  // Clamp, shift for the MAC component offset, and split each position
+  // into a cell index and a fractional offset.
+  float fracX[N], fracY[N];
+  unsigned index[N];
+  // Periodic axes wrap instead of clamping.
+  const bool wrapX = _periodic[Cell::X];
+  const bool wrapY = _periodic[Cell::Y];
+  for (unsigned l = 0; l < N; ++l) {
+    float x, y;
+    if (wrapX)
+      x = wrapCoordinate(positions.x[l] - shiftX, width);
+    else {
+      x = positions.x[l] > width ? width : positions.x[l];
+      x -= shiftX;
+      x = x < 0.0f ? 0.0f : x;
+    }
+    if (wrapY)
+      y = wrapCoordinate(positions.y[l] - shiftY, height);
+    else {
+      y = positions.y[l] > height ? height : positions.y[l];
+      y -= shiftY;
+      y = y < 0.0f ? 0.0f : y;
+    }
+    unsigned i = static_cast<unsigned>(x);
+    unsigned j = static_cast<unsigned>(y);
+    fracX[l] = x - i;
+    fracY[l] = y - j;
+    index[l] = j * _rowStride + i;
+  }
+
+  // Gather the four surrounding velocity samples, treating missing
+  // neighbors as 0 velocity.
+  float origin[N], posX[N], posY[N], posXY[N];
+  for (unsigned l = 0; l < N; ++l) {
+    const Cell &cell = _cells[index[l]];
+    origin[l] = cell.vel[dim];
+    if (cell.allNeighbors) {
+      posX[l]  = cell.neighbors[Cell::POS_X]->vel[dim];
+      posY[l]  = cell.neighbors[Cell::POS_Y]->vel[dim];
+      posXY[l] = cell.neighbors[Cell::POS_XY]->vel[dim];
+    }
+    else {
+      posX[l]  = cell.neighbors[Cell::POS_X]
+	? cell.neighbors[Cell::POS_X]->vel[dim] : 0;
+      posY[l]  = cell.neighbors[Cell::POS_Y]
+	? cell.neighbors[Cell::POS_Y]->vel[dim] : 0;
+      posXY[l] = cell.neighbors[Cell::POS_XY]
+	? cell.neighbors[Cell::POS_XY]->vel[dim] : 0;
+    }
+  }
+
+  // Perform the bilinear interpolations.
+  for (unsigned l = 0; l < N; ++l)
+    result[l] = (1-fracX[l]) * (1-fracY[l]) * origin[l] +
+                fracX[l]     * (1-fracY[l]) * posX[l] +
+                (1-fracX[l]) * fracY[l]     * posY[l] +
+                fracX[l]     * fracY[l]     * posXY[l];
+}
+
+
 #endif //__GRID_H__
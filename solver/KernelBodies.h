@@ -0,0 +1,82 @@
+// Kernel bodies shared by every instruction set.  This file has no include
+// guard: Kernels.cpp includes it once per set, each time inside its own
+// namespace and under its own target options, with KERNEL_LANES set to the
+// batch width for the set.  It must not include anything itself.
+//
+// Kernels that call into shared inline code (such as Grid's sampling) are
+// marked KERNEL_FLATTEN so that code is inlined and compiled for the set,
+// rather than called at the baseline instruction set.
+
+
+KERNEL_FLATTEN static void advectParticles(const Grid &grid, Vector2 *particles,
+			    unsigned count, float timeStepSec)
+{
+  const unsigned batched = count - count % KERNEL_LANES;
+  Vector2xN<KERNEL_LANES> positions, velocities;
+  for (unsigned i = 0; i < batched; i += KERNEL_LANES) {
+    positions.load(&particles[i]);
+    grid.getVelocity(positions, velocities);
+    positions += velocities * timeStepSec;
+    positions.store(&particles[i]);
+  }
+  for (unsigned i = batched; i < count; ++i)
+    particles[i] += grid.getVelocity(particles[i]) * timeStepSec;
+}
+
+
+static double dot(const double *a, const double *b, unsigned count)
+{
+  // Accumulate into a fixed number of partial sums so the loop vectorizes
+  // without reassociating, and sum them in a fixed order.  This keeps the
+  // result identical for every instruction set.
+  double partial[8] = { 0.0 };
+  const unsigned batched = count - count % 8;
+  for (unsigned i = 0; i < batched; i += 8)
+    for (unsigned k = 0; k < 8; ++k)
+      partial[k] += a[i + k] * b[i + k];
+  double sum = 0.0;
+  for (unsigned k = 0; k < 8; ++k)
+    sum += partial[k];
+  for (unsigned i = batched; i < count; ++i)
+    sum += a[i] * b[i];
+  return sum;
+}
+
+
+static void cgUpdate(double alpha, const double *direction,
+		     const double *product, double *x, double *residual,
+		     unsigned count)
+{
+  for (unsigned i = 0; i < count; ++i) {
+    x[i] += alpha * direction[i];
+    residual[i] -= alpha * product[i];
+  }
+}
+
+
+static void multiply(const double *a, const double *b, double *result,
+		     unsigned count)
+{
+  for (unsigned i = 0; i < count; ++i)
+    result[i] = a[i] * b[i];
+}
+
+
+static void xpby(const double *x, double beta, double *y, unsigned count)
+{
+  for (unsigned i = 0; i < count; ++i)
+    y[i] = x[i] + beta * y[i];
+}
+
+
+static void divergence(const Cell *row, const Cell *above, double *out,
+		       unsigned count)
+{
+  // The same two differences, summed in the same order, as
+  // Grid::getVelocityDivergence().
+  for (unsigned i = 0; i < count; ++i) {
+    const float dx = row[i + 1].vel[Cell::X] - row[i].vel[Cell::X];
+    const float dy = above[i].vel[Cell::Y] - row[i].vel[Cell::Y];
+    out[i] = row[i].cellType == Cell::FLUID ? -(dx + dy) : 0.0;
+  }
+}
@@ -0,0 +1,168 @@
+#include "Kernels.h"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include "Grid.h"
+
+// Everything the kernel bodies use must be included above, before any
+// target options change, so that shared inline code and template
+// instantiations outside the kernel namespaces stay at the baseline ISA.
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KERNELS_X86
+#endif
+
+#ifdef __GNUC__
+#define KERNEL_FLATTEN __attribute__((flatten))
+#else
+#define KERNEL_FLATTEN
+#endif
+
+// Sets with FMA would otherwise fuse multiplies into adds, rounding once
+// where the generic set rounds twice.  config.pri turns contraction off for
+// the whole build as well, so the shared inline code agrees everywhere.
+#ifdef __GNUC__
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+
+namespace generic_kernels {
+#define KERNEL_LANES 8
+#include "KernelBodies.h"
+#undef KERNEL_LANES
+}
+
+#ifdef KERNELS_X86
+#pragma GCC push_options
+#pragma GCC target("sse4.2")
+namespace sse4_kernels {
+#define KERNEL_LANES 8
+#include "KernelBodies.h"
+#undef KERNEL_LANES
+}
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+namespace avx2_kernels {
+#define KERNEL_LANES 8
+#include "KernelBodies.h"
+#undef KERNEL_LANES
+}
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+namespace avx512_kernels {
+#define KERNEL_LANES 16
+#include "KernelBodies.h"
+#undef KERNEL_LANES
+}
+#pragma GCC pop_options
+#endif // KERNELS_X86
+
+
+namespace {
+
+#define KERNEL_TABLE(ISA, NAME, NS) \
+  { Kernels::ISA, NAME, NS::advectParticles, NS::dot, NS::cgUpdate, \
+    NS::multiply, NS::xpby, NS::divergence }
+
+// Kernel sets that weren't compiled fall back to the generic kernels, and
+// are reported as unsupported by isSupported().
+const Kernels kernelTable[Kernels::ISA_COUNT] = {
+  KERNEL_TABLE(GENERIC, "generic", generic_kernels),
+#ifdef KERNELS_X86
+  KERNEL_TABLE(SSE4,    "sse4",    sse4_kernels),
+  KERNEL_TABLE(AVX2,    "avx2",    avx2_kernels),
+  KERNEL_TABLE(AVX512,  "avx512",  avx512_kernels)
+#else
+  KERNEL_TABLE(SSE4,    "sse4",    generic_kernels),
+  KERNEL_TABLE(AVX2,    "avx2",    generic_kernels),
+  KERNEL_TABLE(AVX512,  "avx512",  generic_kernels)
+#endif
+};
+
+#undef KERNEL_TABLE
+
+// Picks the kernels for this process, honoring the environment override.
+const Kernels * selectKernels()
+{
+  Kernels::Isa isa = Kernels::getWidestSupported();
+  const char *requested = getenv("FLUID_SOLVER_KERNELS");
+  if (requested && *requested) {
+    unsigned i = 0;
+    while (i < Kernels::ISA_COUNT && strcmp(requested, kernelTable[i].name))
+      ++i;
+    if (i == Kernels::ISA_COUNT)
+      std::cerr << "FLUID_SOLVER_KERNELS: unknown kernel set \""
+		<< requested << "\", using " << kernelTable[isa].name
+		<< std::endl;
+    else if (!Kernels::isSupported(static_cast<Kernels::Isa>(i)))
+      std::cerr << "FLUID_SOLVER_KERNELS: " << requested
+		<< " is not supported by this CPU, using "
+		<< kernelTable[isa].name << std::endl;
+    else
+      isa = static_cast<Kernels::Isa>(i);
+  }
+  return &kernelTable[isa];
+}
+
+// The kernels chosen by Kernels::select(), if it was called.
+const Kernels *selectedKernels = NULL;
+
+}
+
+
+const Kernels & Kernels::get()
+{
+  static const Kernels *selected = selectKernels();
+  return selectedKernels ? *selectedKernels : *selected;
+}
+
+
+bool Kernels::select(Isa isa)
+{
+  if (isa >= ISA_COUNT || !isSupported(isa))
+    return false;
+  selectedKernels = &kernelTable[isa];
+  return true;
+}
+
+
+const Kernels & Kernels::get(Isa isa)
+{
+  return kernelTable[isa];
+}
+
+
+bool Kernels::isSupported(Isa isa)
+{
+#ifdef KERNELS_X86
+  __builtin_cpu_init();
+  switch (isa) {
+    case GENERIC:
+      return true;
+    case SSE4:
+      return __builtin_cpu_supports("sse4.2");
+    case AVX2:
+      return __builtin_cpu_supports("avx2");
+    case AVX512:
+      return __builtin_cpu_supports("avx512f");
+    default:
+      return false;
+  }
+#else
+  return isa == GENERIC;
+#endif
+}
+
+
+Kernels::Isa Kernels::getWidestSupported()
+{
+  Isa widest = GENERIC;
+  for (unsigned i = GENERIC + 1; i < ISA_COUNT; ++i)
+    if (isSupported(static_cast<Isa>(i)))
+      widest = static_cast<Isa>(i);
+  return widest;
+}
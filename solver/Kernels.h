@@ -0,0 +1,106 @@
+#ifndef __KERNELS_H__
+#define __KERNELS_H__
+
+#include "Vector2.h"
+
+struct Cell;
+class Grid;
+
+// The solver's innermost loops, compiled once per instruction set.  The
+// widest set the running CPU supports is selected on first use, so one
+// binary uses the full SIMD width of whatever machine it runs on.  Every
+// set is compiled from the same source without floating point contraction
+// (Kernels.cpp and config.pri both turn it off), so all sets produce
+// bit-identical results.
+//
+// FluidSolver dispatches particle advection and the pressure solve's
+// divergence, and SlabSolver its conjugate gradient vector operations.
+// FluidSolver's Laplacian and conjugate gradient run inside Eigen, whose
+// SIMD path is fixed when the solver is compiled.
+struct Kernels {
+  // The instruction sets kernels are compiled for, narrowest first.
+  enum Isa { GENERIC, SSE4, AVX2, AVX512, ISA_COUNT };
+
+  Isa isa;            // The instruction set these kernels were compiled for.
+  const char *name;   // The name of the instruction set, e.g. "avx2".
+
+  // Advances particles by one forward Euler step through the grid velocity.
+  void (*advectParticles)(const Grid &grid, Vector2 *particles,
+			  unsigned count, float timeStepSec);
+
+  // Returns the dot product of two vectors.
+  double (*dot)(const double *a, const double *b, unsigned count);
+
+  // The conjugate gradient update: x += alpha * direction and
+  // residual -= alpha * product.
+  void (*cgUpdate)(double alpha, const double *direction,
+		   const double *product, double *x, double *residual,
+		   unsigned count);
+
+  // Element-wise product: result = a * b.
+  void (*multiply)(const double *a, const double *b, double *result,
+		   unsigned count);
+
+  // Scaled accumulate: y = x + beta * y.
+  void (*xpby)(const double *x, double beta, double *y, unsigned count);
+
+  // Writes the negative velocity divergence of count cells of a grid row,
+  // exactly as -Grid::getVelocityDivergence() gives it, or zero for cells
+  // that aren't FLUID.  row must hold count + 1 cells, and above is the
+  // row above it.
+  void (*divergence)(const Cell *row, const Cell *above, double *out,
+		     unsigned count);
+
+  // Gets the kernels selected for this process: the widest supported set,
+  // unless the FLUID_SOLVER_KERNELS environment variable names another
+  // ("generic", "sse4", "avx2" or "avx512").  An unknown or unsupported
+  // name falls back to the widest supported set with a warning.
+  //
+  // Arguments:
+  //   None
+  //
+  // Returns:
+  //   const Kernels & - The selected kernels.
+  static const Kernels & get();
+
+  // Overrides the kernels get() returns for the rest of the process, as
+  // AutoTuner does with the set it measured fastest.  Call it between
+  // frames, not while solvers are running on other threads.
+  //
+  // Arguments:
+  //   Isa isa - The instruction set.
+  //
+  // Returns:
+  //   bool - False, changing nothing, if the CPU can't execute the set.
+  static bool select(Isa isa);
+
+  // Gets the kernels for a specific instruction set.  Calling them on a
+  // CPU that doesn't support the set is undefined; check isSupported().
+  //
+  // Arguments:
+  //   Isa isa - The instruction set.
+  //
+  // Returns:
+  //   const Kernels & - The kernels for the set.
+  static const Kernels & get(Isa isa);
+
+  // Determines whether the running CPU can execute a kernel set.
+  //
+  // Arguments:
+  //   Isa isa - The instruction set.
+  //
+  // Returns:
+  //   bool - Whether kernels for the set were compiled and can run here.
+  static bool isSupported(Isa isa);
+
+  // Gets the widest kernel set the running CPU can execute.
+  //
+  // Arguments:
+  //   None
+  //
+  // Returns:
+  //   Isa - The widest supported instruction set.
+  static Isa getWidestSupported();
+};
+
+#endif // __KERNELS_H__
@@ -0,0 +1,53 @@
+#include "SlabDecomposition.h"
+
+SlabDecomposition::SlabDecomposition(unsigned rowCount, unsigned slabCount,
+				     unsigned minRowsPerSlab)
+  : _rowCount(rowCount),
+    _slabCount(slabCount)
+{
+  if (minRowsPerSlab < 1)
+    minRowsPerSlab = 1;
+  if (_slabCount > _rowCount / minRowsPerSlab)
+    _slabCount = _rowCount / minRowsPerSlab;
+  if (_slabCount < 1)
+    _slabCount = 1;
+}
+
+
+unsigned SlabDecomposition::getSlabCount() const
+{
+  return _slabCount;
+}
+
+
+unsigned SlabDecomposition::getRowCount() const
+{
+  return _rowCount;
+}
+
+
+unsigned SlabDecomposition::getFirstRow(unsigned slab) const
+{
+  // Use 64-bit intermediates so that large grids don't overflow.
+  return static_cast<unsigned>
+    (static_cast<unsigned long long>(slab) * _rowCount / _slabCount);
+}
+
+
+unsigned SlabDecomposition::getSlabRowCount(unsigned slab) const
+{
+  return getFirstRow(slab + 1) - getFirstRow(slab);
+}
+
+
+unsigned SlabDecomposition::getOwner(unsigned row) const
+{
+  // Estimate the owner, then correct for rounding in getFirstRow().
+  unsigned slab = static_cast<unsigned>
+    (static_cast<unsigned long long>(row) * _slabCount / _rowCount);
+  while (slab > 0 && getFirstRow(slab) > row)
+    --slab;
+  while (slab + 1 < _slabCount && getFirstRow(slab + 1) <= row)
+    ++slab;
+  return slab;
+}
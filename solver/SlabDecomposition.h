@@ -0,0 +1,71 @@
+#ifndef __SLAB_DECOMPOSITION_H__
+#define __SLAB_DECOMPOSITION_H__
+
+// Splits the rows of a MAC grid into contiguous horizontal slabs, one per
+// cooperating solver.  Rows are distributed as evenly as possible, and
+// because the Grid stores cells in row-major order, each slab's cells are
+// contiguous in memory.
+class SlabDecomposition {
+  unsigned _rowCount;   // The number of grid rows being decomposed.
+  unsigned _slabCount;  // The number of slabs the rows are split into.
+
+public:
+  // Constructs a decomposition of rowCount rows into slabCount slabs.  The
+  // slab count is reduced, if necessary, so that every slab has at least
+  // minRowsPerSlab rows.
+  //
+  // Arguments:
+  //   unsigned rowCount - The number of grid rows to decompose.
+  //   unsigned slabCount - The requested number of slabs.
+  //   unsigned minRowsPerSlab - The minimum number of rows in any slab.
+  SlabDecomposition(unsigned rowCount, unsigned slabCount,
+		    unsigned minRowsPerSlab = 1);
+
+  // Returns the number of slabs in the decomposition.
+  //
+  // Arguments:
+  //   None
+  //
+  // Returns:
+  //   unsigned - The number of slabs.
+  unsigned getSlabCount() const;
+
+  // Returns the number of rows being decomposed.
+  //
+  // Arguments:
+  //   None
+  //
+  // Returns:
+  //   unsigned - The number of grid rows.
+  unsigned getRowCount() const;
+
+  // Returns the first grid row owned by a slab.
+  //
+  // Arguments:
+  //   unsigned slab - The slab index, in [0, getSlabCount()].  Passing
+  //                   getSlabCount() returns getRowCount().
+  //
+  // Returns:
+  //   unsigned - The index of the slab's first row.
+  unsigned getFirstRow(unsigned slab) const;
+
+  // Returns the number of grid rows owned by a slab.
+  //
+  // Arguments:
+  //   unsigned slab - The slab index.
+  //
+  // Returns:
+  //   unsigned - The number of rows owned by the slab.
+  unsigned getSlabRowCount(unsigned slab) const;
+
+  // Returns the slab owning a grid row.
+  //
+  // Arguments:
+  //   unsigned row - The grid row, in [0, getRowCount()).
+  //
+  // Returns:
+  //   unsigned - The index of the owning slab.
+  unsigned getOwner(unsigned row) const;
+};
+
+#endif //__SLAB_DECOMPOSITION_H__
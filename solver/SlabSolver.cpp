@@ -0,0 +1,532 @@
+#include "SlabSolver.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include "Cell.h"
+#include "Kernels.h"
+#include "SharedMemoryTransport.h"
+
+using std::vector;
+
+namespace {
+
+// Matches the row/column counts chosen by the Grid constructor.
+unsigned gridLines(float extent)
+{
+  return extent < 2.0f ? 2 : static_cast<unsigned>(ceil(extent)) + 1;
+}
+
+// Values exchanged per cell by exchangeCells(): x-vel, y-vel and type.
+const unsigned CELL_VALUES = 3;
+
+} // namespace
+
+
+SlabSolver::SlabSolver(float width, float height,
+		       SharedMemoryTransport *transport, unsigned slab)
+  : _width(width),
+    _height(height),
+    _cols(gridLines(width)),
+    _rows(gridLines(height)),
+    _transport(transport),
+    _slab(slab),
+    _decomposition(decompose(height, transport->getSlabCount())),
+    _firstRow(_decomposition.getFirstRow(slab)),
+    _ownedRows(_decomposition.getSlabRowCount(slab)),
+    _grid(width, _ownedRows + 2 * HALO_ROWS - 1),
+    _particles(),
+    _gravity(0.0f, -9.8f),
+    _initialFill(0.5f),
+    _lastIterations(0)
+{
+  if (_decomposition.getSlabCount() != transport->getSlabCount())
+    std::cerr << "SlabSolver: transport has "
+	      << transport->getSlabCount() << " slabs, but only "
+	      << _decomposition.getSlabCount() << " fit this grid."
+	      << std::endl;
+
+  const unsigned haloValues = getHaloCapacity(width);
+  _sendDown.resize(haloValues);
+  _sendUp.resize(haloValues);
+  _recvBelow.resize(haloValues);
+  _recvAbove.resize(haloValues);
+
+  const unsigned localCells = _grid.getCellCount();
+  _pressure.resize(localCells);
+  _residual.resize(localCells);
+  _direction.resize(localCells);
+  _product.resize(localCells);
+  _precond.resize(localCells);
+
+  reset();
+}
+
+
+SlabDecomposition SlabSolver::decompose(float height, unsigned slabCount)
+{
+  return SlabDecomposition(gridLines(height), slabCount, HALO_ROWS);
+}
+
+
+unsigned SlabSolver::getHaloCapacity(float width)
+{
+  return HALO_ROWS * gridLines(width) * CELL_VALUES;
+}
+
+
+void SlabSolver::reset()
+{
+  // Mirrors FluidSolver::reset(), restricted to the rows this slab owns.
+  _particles.clear();
+  _grid = Grid(_width, _grid.getRowCount() - 1);
+
+  const unsigned startX = _width  * (1.0f - _initialFill);
+  const unsigned startY = _height * (1.0f - _initialFill);
+  const unsigned endY = std::min<unsigned>(_firstRow + _ownedRows, _height);
+  for (unsigned y = std::max(startY, _firstRow); y < endY; ++y)
+    for (unsigned x = startX; x < _width; ++x) {
+      _grid.setCellType(x, toLocalRow(y), Cell::FLUID);
+
+      // Initialize marker particle positions.
+      for (unsigned i = 0; i < 4; i++)
+	for (unsigned j = 0; j < 4; j++)
+	  _particles.push_back(Vector2(x + 0.20f * (i + 1),
+				       y + 0.20f * (j + 1)));
+    }
+
+  boundaryCollide();
+}
+
+
+void SlabSolver::advanceFrame()
+{
+  float frameTimeSec = 1.0f/30.0f; // Match FluidSolver's 30 Hz framerate.
+  float CFLCoefficient = 2.0f;     // Match FluidSolver's CFL coefficient.
+
+  // Every slab sees the same global maximum velocity, so every slab takes
+  // identical substeps.
+  while (frameTimeSec > 0.0f) {
+    float simTimeStepSec = CFLCoefficient / getGlobalMaxVelocity();
+    if (simTimeStepSec > frameTimeSec)
+      simTimeStepSec = frameTimeSec;
+    advanceTimeStep(simTimeStepSec);
+    frameTimeSec -= simTimeStepSec;
+  }
+}
+
+
+void SlabSolver::advanceTimeStep(float timeStepSec)
+{
+  exchangeCells();
+  advectVelocity(timeStepSec);
+  applyGlobalVelocity(_gravity * timeStepSec);
+  boundaryCollide();
+  exchangeCells();
+  pressureSolve(timeStepSec);
+  boundaryCollide();
+  exchangeCells();
+  moveParticles(timeStepSec);
+  markCells();
+}
+
+
+void SlabSolver::setGravity(Vector2 gravity)
+{
+  _gravity = gravity;
+}
+
+
+void SlabSolver::setInitialFill(float fraction)
+{
+  _initialFill = std::min(std::max(fraction, 0.0f), 1.0f);
+}
+
+
+unsigned SlabSolver::getGlobalParticleCount()
+{
+  return static_cast<unsigned>
+    (_transport->allReduce(_slab, _particles.size(),
+			   SharedMemoryTransport::SUM));
+}
+
+
+const Grid & SlabSolver::getGrid() const
+{
+  return _grid;
+}
+
+
+const vector<Vector2> & SlabSolver::getParticles() const
+{
+  return _particles;
+}
+
+
+unsigned SlabSolver::getFirstRow() const
+{
+  return _firstRow;
+}
+
+
+unsigned SlabSolver::getOwnedRowCount() const
+{
+  return _ownedRows;
+}
+
+
+unsigned SlabSolver::getLastIterationCount() const
+{
+  return _lastIterations;
+}
+
+
+void SlabSolver::exchangeCells()
+{
+  // Pack the lowest and highest HALO_ROWS owned rows.
+  const unsigned cols = _cols;
+  const unsigned count = HALO_ROWS * cols * CELL_VALUES;
+  const unsigned lowRow = HALO_ROWS;
+  const unsigned highRow = HALO_ROWS + _ownedRows - HALO_ROWS;
+  for (unsigned r = 0; r < HALO_ROWS; ++r)
+    for (unsigned x = 0; x < cols; ++x) {
+      unsigned i = (r * cols + x) * CELL_VALUES;
+      const Cell &low = _grid(x, lowRow + r);
+      const Cell &high = _grid(x, highRow + r);
+      _sendDown[i]   = low.vel[Cell::X];
+      _sendDown[i+1] = low.vel[Cell::Y];
+      _sendDown[i+2] = low.cellType;
+      _sendUp[i]     = high.vel[Cell::X];
+      _sendUp[i+1]   = high.vel[Cell::Y];
+      _sendUp[i+2]   = high.cellType;
+    }
+
+  _transport->exchangeHalo(_slab, &_sendDown[0], &_sendUp[0],
+			   &_recvBelow[0], &_recvAbove[0], count);
+
+  // Unpack into the ghost rows below and above the owned rows.
+  const unsigned slabCount = _decomposition.getSlabCount();
+  const unsigned aboveRow = HALO_ROWS + _ownedRows;
+  for (unsigned r = 0; r < HALO_ROWS; ++r)
+    for (unsigned x = 0; x < cols; ++x) {
+      unsigned i = (r * cols + x) * CELL_VALUES;
+      if (_slab > 0) {
+	Cell &below = _grid(x, r);
+	below.vel[Cell::X] = _recvBelow[i];
+	below.vel[Cell::Y] = _recvBelow[i+1];
+	_grid.setCellType(x, r,
+			  static_cast<Cell::Type>(int(_recvBelow[i+2])));
+      }
+      if (_slab + 1 < slabCount) {
+	Cell &above = _grid(x, aboveRow + r);
+	above.vel[Cell::X] = _recvAbove[i];
+	above.vel[Cell::Y] = _recvAbove[i+1];
+	_grid.setCellType(x, aboveRow + r,
+			  static_cast<Cell::Type>(int(_recvAbove[i+2])));
+      }
+    }
+}
+
+
+void SlabSolver::exchangeField(vector<double> &field)
+{
+  // Only the nearest row on each side is needed by the 5-point stencil.
+  const unsigned stride = _grid.getRowStride();
+  const unsigned lowRow = HALO_ROWS;
+  const unsigned highRow = HALO_ROWS + _ownedRows - 1;
+  double *below = &field[(lowRow - 1) * stride];
+  double *above = &field[(highRow + 1) * stride];
+  _transport->exchangeHalo(_slab, &field[lowRow * stride],
+			   &field[highRow * stride], below, above, _cols);
+}
+
+
+Vector2 SlabSolver::sampleVelocity(Vector2 position) const
+{
+  // Clamp to the simulated area, then to the rows this slab can see.
+  const float maxX = _cols - 1;
+  const float maxY = _rows - 1;
+  position.x = std::min(std::max(position.x, 0.0f), maxX);
+  position.y = std::min(std::max(position.y, 0.0f), maxY);
+  float localY = toLocalY(position.y);
+  localY = std::min(std::max(localY, 0.0f), _grid.getHeight());
+  return _grid.getVelocity(Vector2(position.x, localY));
+}
+
+
+float SlabSolver::getGlobalMaxVelocity()
+{
+  // Sample the center of every owned simulation cell, like
+  // Grid::getMaxVelocity().
+  float maxVel = 0.0f;
+  const unsigned endRow = std::min(_firstRow + _ownedRows, _rows - 1);
+  for (unsigned y = _firstRow; y < endRow; ++y)
+    for (unsigned x = 0; x + 1 < _cols; ++x) {
+      float localY = toLocalY(y + 0.5f);
+      float vel = _grid.getVelocity(Vector2(x + 0.5f, localY)).magnitude();
+      maxVel = std::max(maxVel, vel);
+    }
+  return _transport->allReduce(_slab, maxVel, SharedMemoryTransport::MAX);
+}
+
+
+void SlabSolver::advectVelocity(float timeStepSec)
+{
+  const unsigned endRow = std::min(_firstRow + _ownedRows, _rows - 1);
+  for (unsigned y = _firstRow; y < endRow; ++y)
+    for (unsigned x = 0; x + 1 < _cols; ++x) {
+      Cell &cell = _grid(x, toLocalRow(y));
+
+      // X velocity, sampled at the left face.
+      Vector2 position(x, y + 0.5f);
+      position -= sampleVelocity(position) * timeStepSec;
+      cell.stagedVel[Cell::X] = sampleVelocity(position).x;
+
+      // Y velocity, sampled at the bottom face.
+      position = Vector2(x + 0.5f, y);
+      position -= sampleVelocity(position) * timeStepSec;
+      cell.stagedVel[Cell::Y] = sampleVelocity(position).y;
+    }
+
+  for (unsigned y = _firstRow; y < endRow; ++y)
+    for (unsigned x = 0; x + 1 < _cols; ++x)
+      _grid(x, toLocalRow(y)).commitStagedVel();
+}
+
+
+void SlabSolver::applyGlobalVelocity(Vector2 velocity)
+{
+  for (unsigned y = 0; y < _ownedRows; ++y)
+    for (unsigned x = 0; x < _cols; ++x) {
+      Cell &cell = _grid(x, HALO_ROWS + y);
+      if (cell.cellType == Cell::FLUID) {
+	cell.vel[Cell::X] += velocity.x;
+	cell.vel[Cell::Y] += velocity.y;
+      }
+    }
+}
+
+
+void SlabSolver::boundaryCollide()
+{
+  // Equivalent to FluidSolver::boundaryCollide(), for the owned rows only.
+  const unsigned cols = _cols;
+  for (unsigned y = _firstRow; y < _firstRow + _ownedRows; ++y) {
+    const unsigned local = toLocalRow(y);
+    if (y == 0)
+      for (unsigned x = 0; x < cols; ++x)
+	_grid(x, local).vel[Cell::Y] = 0.0f;
+    if (y == _rows - 1)
+      for (unsigned x = 0; x < cols; ++x) {
+	_grid(x, local).vel[Cell::X] = 0.0f;
+	_grid(x, local).vel[Cell::Y] = 0.0f;
+	_grid.setCellType(x, local, Cell::SOLID);
+      }
+    _grid(0, local).vel[Cell::X] = 0.0f;
+    _grid(cols-1, local).vel[Cell::X] = 0.0f;
+    _grid(cols-1, local).vel[Cell::Y] = 0.0f;
+    _grid.setCellType(cols-1, local, Cell::SOLID);
+  }
+}
+
+
+void SlabSolver::applyPressureMatrix(const vector<double> &v,
+				     vector<double> &out,
+				     float timeStepSec) const
+{
+  // The standard 5-point pressure operator over FLUID cells: each non-SOLID
+  // neighbor adds to the diagonal, and each FLUID neighbor couples to this
+  // cell.  AIR neighbors have zero pressure and so drop out.
+  const int cols = _cols;
+  const int stride = _grid.getRowStride();
+  const int dx[4] = { 1, -1, 0, 0 };
+  const int dy[4] = { 0, 0, 1, -1 };
+  for (unsigned y = _firstRow; y < _firstRow + _ownedRows; ++y)
+    for (int x = 0; x < cols; ++x) {
+      const int i = toLocalRow(y) * stride + x;
+      if (_grid[i].cellType != Cell::FLUID) {
+	out[i] = 0.0;
+	continue;
+      }
+      double diag = 0.0;
+      double sum = 0.0;
+      for (unsigned n = 0; n < 4; ++n) {
+	if (!inDomain(x + dx[n], y + dy[n]))
+	  continue;
+	const int j = i + dy[n] * stride + dx[n];
+	if (_grid[j].cellType == Cell::SOLID)
+	  continue;
+	diag += 1.0;
+	if (_grid[j].cellType == Cell::FLUID)
+	  sum += v[j];
+      }
+      out[i] = timeStepSec * (diag * v[i] - sum);
+    }
+}
+
+
+double SlabSolver::globalDot(const vector<double> &a, const vector<double> &b)
+{
+  const unsigned begin = HALO_ROWS * _grid.getRowStride();
+  const unsigned end = (HALO_ROWS + _ownedRows) * _grid.getRowStride();
+  double sum = Kernels::get().dot(&a[begin], &b[begin], end - begin);
+  return _transport->allReduce(_slab, sum, SharedMemoryTransport::SUM);
+}
+
+
+void SlabSolver::pressureSolve(float timeStepSec)
+{
+  const int cols = _cols;
+  const int stride = _grid.getRowStride();
+  const unsigned begin = HALO_ROWS * stride;
+  const unsigned end = (HALO_ROWS + _ownedRows) * stride;
+  const int dx[4] = { 1, -1, 0, 0 };
+  const int dy[4] = { 0, 0, 1, -1 };
+
+  // Assemble the negative divergence and the Jacobi preconditioner for all
+  // owned FLUID cells.  The pressure is solved from zero every step.
+  std::fill(_pressure.begin(), _pressure.end(), 0.0);
+  std::fill(_residual.begin(), _residual.end(), 0.0);
+  std::fill(_direction.begin(), _direction.end(), 0.0);
+  for (unsigned y = _firstRow; y < _firstRow + _ownedRows; ++y)
+    for (int x = 0; x < cols; ++x) {
+      const int i = toLocalRow(y) * stride + x;
+      _precond[i] = 0.0;
+      if (_grid[i].cellType != Cell::FLUID)
+	continue;
+      _residual[i] = -(_grid[i + 1].vel[Cell::X] - _grid[i].vel[Cell::X] +
+		       _grid[i + stride].vel[Cell::Y] - _grid[i].vel[Cell::Y]);
+      double diag = 0.0;
+      for (unsigned n = 0; n < 4; ++n)
+	if (inDomain(x + dx[n], y + dy[n]) &&
+	    _grid[i + dy[n] * stride + dx[n]].cellType != Cell::SOLID)
+	  diag += 1.0;
+      if (diag > 0.0)
+	_precond[i] = 1.0 / (timeStepSec * diag);
+    }
+
+  // Preconditioned conjugate gradient.  z is kept in _product between uses.
+  const Kernels &kernels = Kernels::get();
+  const unsigned count = end - begin;
+  const unsigned maxIterations = 4 * (_cols + _rows) + 100;
+  const double tolerance = 1e-6;
+  kernels.multiply(&_precond[begin], &_residual[begin], &_direction[begin],
+		   count);
+  double rz = globalDot(_residual, _direction);
+  double initial = sqrt(globalDot(_residual, _residual));
+  _lastIterations = 0;
+  while (initial > 0.0 && _lastIterations < maxIterations) {
+    exchangeField(_direction);
+    applyPressureMatrix(_direction, _product, timeStepSec);
+    double alpha = rz / globalDot(_direction, _product);
+    kernels.cgUpdate(alpha, &_direction[begin], &_product[begin],
+		     &_pressure[begin], &_residual[begin], count);
+    ++_lastIterations;
+    if (sqrt(globalDot(_residual, _residual)) <= tolerance * initial)
+      break;
+
+    kernels.multiply(&_precond[begin], &_residual[begin], &_product[begin],
+		     count);
+    double rzNew = globalDot(_residual, _product);
+    double beta = rzNew / rz;
+    rz = rzNew;
+    kernels.xpby(&_product[begin], beta, &_direction[begin], count);
+  }
+
+  // Store the pressure, and fetch the row below for the bottom faces.
+  exchangeField(_pressure);
+  std::copy(_pressure.begin() + begin, _pressure.begin() + end,
+	    _grid.getPressureData() + begin);
+
+  // Subtract the pressure gradient from every face between two non-SOLID
+  // cells where at least one is FLUID.  Faces touching SOLID cells are zero.
+  for (unsigned y = _firstRow; y < _firstRow + _ownedRows; ++y)
+    for (int x = 0; x < cols; ++x) {
+      const int i = toLocalRow(y) * stride + x;
+      Cell &cell = _grid[i];
+      const bool here = inDomain(x, y);
+
+      if (x > 0) {
+	const Cell &left = _grid[i - 1];
+	if (!here || !inDomain(x - 1, y) ||
+	    cell.cellType == Cell::SOLID || left.cellType == Cell::SOLID)
+	  cell.vel[Cell::X] = 0.0f;
+	else if (cell.cellType == Cell::FLUID || left.cellType == Cell::FLUID)
+	  cell.vel[Cell::X] -= timeStepSec * (_pressure[i] - _pressure[i - 1]);
+      }
+      if (y > 0) {
+	const Cell &below = _grid[i - stride];
+	if (!here || !inDomain(x, y - 1) ||
+	    cell.cellType == Cell::SOLID || below.cellType == Cell::SOLID)
+	  cell.vel[Cell::Y] = 0.0f;
+	else if (cell.cellType == Cell::FLUID || below.cellType == Cell::FLUID)
+	  cell.vel[Cell::Y] -= timeStepSec *
+	    (_pressure[i] - _pressure[i - stride]);
+      }
+    }
+}
+
+
+void SlabSolver::moveParticles(float timeStepSec)
+{
+  // Advect using simple forward Euler, keeping particles inside the walls.
+  // Nothing lies below the first slab or above the last, so their
+  // particles never leave that way.
+  const float maxX = _cols - 1 - 1e-3f;
+  const float maxY = _rows - 1 - 1e-3f;
+  const float lowY = _slab > 0 ? float(_firstRow) : -std::numeric_limits<float>::infinity();
+  const float highY = _slab + 1 < _decomposition.getSlabCount()
+    ? float(_firstRow + _ownedRows) : std::numeric_limits<float>::infinity();
+  vector<Vector2> down, up;
+  vector<Vector2>::iterator itr = _particles.begin();
+  vector<Vector2>::iterator kept = itr;
+  for (; itr != _particles.end(); ++itr) {
+    Vector2 p = *itr + sampleVelocity(*itr) * timeStepSec;
+    p.x = std::min(std::max(p.x, 0.0f), maxX);
+    p.y = std::min(std::max(p.y, 0.0f), maxY);
+    if (p.y < lowY)
+      down.push_back(p);
+    else if (p.y >= highY)
+      up.push_back(p);
+    else
+      *kept++ = p;
+  }
+  _particles.erase(kept, _particles.end());
+
+  // Hand particles that left this slab to the neighbors.  A particle that
+  // crossed an entire neighboring slab is forwarded again until it arrives.
+  for (;;) {
+    vector<Vector2> incoming;
+    _transport->migrateParticles(_slab, down, up, incoming);
+    for (itr = incoming.begin(); itr != incoming.end(); ++itr) {
+      if (itr->y < lowY)
+	down.push_back(*itr);
+      else if (itr->y >= highY)
+	up.push_back(*itr);
+      else
+	_particles.push_back(*itr);
+    }
+    double pending = down.size() + up.size();
+    if (_transport->allReduce(_slab, pending,
+			      SharedMemoryTransport::SUM) == 0.0)
+      break;
+  }
+}
+
+
+void SlabSolver::markCells()
+{
+  // Cell types go through the grid so that its CellMask stays current.
+  for (unsigned y = 0; y < _ownedRows; ++y)
+    for (unsigned x = 0; x < _cols; ++x)
+      if (_grid(x, HALO_ROWS + y).cellType == Cell::FLUID)
+	_grid.setCellType(x, HALO_ROWS + y, Cell::AIR);
+
+  vector<Vector2>::iterator itr = _particles.begin();
+  for (; itr != _particles.end(); ++itr) {
+    const unsigned x = itr->x;
+    const unsigned y = toLocalRow(itr->y);
+    if (_grid(x, y).cellType == Cell::AIR)
+      _grid.setCellType(x, y, Cell::FLUID);
+  }
+}
@@ -0,0 +1,201 @@
+#ifndef __SLAB_SOLVER_H__
+#define __SLAB_SOLVER_H__
+
+#include <vector>
+#include "Grid.h"
+#include "Vector2.h"
+#include "SlabDecomposition.h"
+
+class SharedMemoryTransport;
+
+// One slab of a domain-decomposed simulation.  The simulation's grid rows
+// are split into horizontal slabs (see SlabDecomposition), each advanced by
+// its own SlabSolver, typically in its own process.  A slab stores only the
+// rows it owns plus HALO_ROWS ghost rows on each side, which are refreshed
+// from the neighboring slabs through a SharedMemoryTransport.
+//
+// Each timestep follows the same stages as FluidSolver: advection, gravity,
+// boundary enforcement, pressure projection, particle advection and cell
+// marking.  The pressure projection is a Jacobi-preconditioned conjugate
+// gradient solve distributed across all slabs, exchanging one halo row of
+// the search direction per iteration and reducing dot products globally.
+// Marker particles that leave a slab migrate to the slab that now owns them.
+//
+// The stages reproduce FluidSolver's for a walled domain without velocity
+// extrapolation, sources, viscosity or periodic axes, up to the tolerance of
+// the pressure solve; SlabSolverTest compares the two.  Cell types are set
+// through Grid::setCellType(), so the grid's CellMask stays current.
+//
+// All public methods other than the accessors are collective: every slab
+// sharing a transport must call them in the same order.
+class SlabSolver {
+public:
+  // Number of ghost rows kept on each side of the slab.  This covers the
+  // furthest a CFL-limited backtrace can reach, plus the bilinear stencil.
+  static const unsigned HALO_ROWS = 3;
+
+  // Constructs the solver for one slab of a width by height simulation.
+  //
+  // Arguments:
+  //   float width - The width of the whole simulation, in world coordinates.
+  //   float height - The height of the whole simulation, in world coords.
+  //   SharedMemoryTransport *transport - The transport shared by all slabs.
+  //                                      Not owned; must outlive the solver.
+  //   unsigned slab - The index of this slab, in [0, slab count).
+  SlabSolver(float width, float height, SharedMemoryTransport *transport,
+	     unsigned slab);
+
+  // Returns the decomposition used for a simulation of the given height.
+  // Use this to decide how many slabs (and processes) to create.
+  //
+  // Arguments:
+  //   float height - The height of the whole simulation, in world coords.
+  //   unsigned slabCount - The requested number of slabs.
+  //
+  // Returns:
+  //   SlabDecomposition - The decomposition used by every slab.
+  static SlabDecomposition decompose(float height, unsigned slabCount);
+
+  // Returns the halo capacity the transport must be created with.
+  //
+  // Arguments:
+  //   float width - The width of the whole simulation, in world coordinates.
+  //
+  // Returns:
+  //   unsigned - The number of values exchanged with each neighbor.
+  static unsigned getHaloCapacity(float width);
+
+  // Resets this slab to its part of the default starting state.
+  void reset();
+
+  // Advances the simulation by a single frame, in CFL-limited substeps.
+  void advanceFrame();
+
+  // Sets the global acceleration applied to all fluid cells every timestep.
+  void setGravity(Vector2 gravity);
+
+  // Sets the fraction of each axis filled with fluid by reset().
+  void setInitialFill(float fraction);
+
+  // Returns the total number of marker particles across all slabs.
+  //
+  // Arguments:
+  //   None
+  //
+  // Returns:
+  //   unsigned - The global particle count.
+  unsigned getGlobalParticleCount();
+
+  // Returns this slab's local grid.  Local row HALO_ROWS holds global row
+  // getFirstRow().
+  const Grid & getGrid() const;
+
+  // Returns the marker particles owned by this slab, in global coordinates.
+  const std::vector<Vector2> & getParticles() const;
+
+  // Returns the first global grid row owned by this slab.
+  unsigned getFirstRow() const;
+
+  // Returns the number of global grid rows owned by this slab.
+  unsigned getOwnedRowCount() const;
+
+  // Returns the CG iteration count of the most recent pressure solve.
+  unsigned getLastIterationCount() const;
+
+protected:
+  // Advances the slab by a specific amount of time.
+  void advanceTimeStep(float timeStepSec);
+
+  // Advects face velocities of owned rows via a backward particle trace.
+  void advectVelocity(float timeStepSec);
+
+  // Applies a global velocity to all owned fluid cells.
+  void applyGlobalVelocity(Vector2 velocity);
+
+  // Zeroes velocities through the simulation's outer walls.
+  void boundaryCollide();
+
+  // Projects the velocity field to be divergence free.
+  void pressureSolve(float timeStepSec);
+
+  // Moves owned particles, then migrates those that left the slab.
+  void moveParticles(float timeStepSec);
+
+  // Updates owned FLUID and AIR cells to reflect the marker particles.
+  void markCells();
+
+private:
+  const float        _width;      // The width of the whole simulation.
+  const float        _height;     // The height of the whole simulation.
+  const unsigned     _cols;       // Global (and local) column count.
+  const unsigned     _rows;       // Global row count.
+  SharedMemoryTransport *_transport; // Communication with other slabs.
+  const unsigned     _slab;       // The index of this slab.
+  SlabDecomposition  _decomposition; // The row split shared by all slabs.
+  const unsigned     _firstRow;   // First global row owned by this slab.
+  const unsigned     _ownedRows;  // Number of global rows owned.
+  Grid               _grid;       // Owned rows plus ghost rows.
+  std::vector<Vector2> _particles; // Owned particles, global coordinates.
+  Vector2            _gravity;    // Global acceleration.
+  float              _initialFill; // Fraction of each axis filled by reset().
+  unsigned           _lastIterations; // CG iterations of the last solve.
+
+  // Halo exchange buffers.
+  std::vector<double> _sendDown, _sendUp, _recvBelow, _recvAbove;
+
+  // Pressure solve workspace, one value per local cell.
+  std::vector<double> _pressure, _residual, _direction, _product, _precond;
+
+  // Converts between global and local row indices.
+  inline int toLocalRow(int globalRow) const;
+  inline float toLocalY(float globalY) const;
+
+  // Returns true if the global cell lies inside the simulated area.
+  inline bool inDomain(int x, int globalRow) const;
+
+  // Refreshes ghost rows of velocity and cell type from the neighbors.
+  void exchangeCells();
+
+  // Refreshes one ghost row on each side of a per-cell scalar field.
+  void exchangeField(std::vector<double> &field);
+
+  // Samples the velocity at a global position, clamped to the simulation.
+  Vector2 sampleVelocity(Vector2 position) const;
+
+  // Returns the maximum velocity over all slabs, sampled at cell centers.
+  float getGlobalMaxVelocity();
+
+  // Applies the pressure matrix to owned entries of v, storing into out.
+  void applyPressureMatrix(const std::vector<double> &v,
+			   std::vector<double> &out, float timeStepSec) const;
+
+  // Returns the dot product of owned entries of a and b over all slabs.
+  double globalDot(const std::vector<double> &a,
+		   const std::vector<double> &b);
+
+  // Hidden default constructor, copy constructor and assignment.
+  SlabSolver();
+  SlabSolver(const SlabSolver &);
+  SlabSolver & operator=(const SlabSolver &);
+};
+
+
+int SlabSolver::toLocalRow(int globalRow) const
+{
+  return globalRow - static_cast<int>(_firstRow) + HALO_ROWS;
+}
+
+
+float SlabSolver::toLocalY(float globalY) const
+{
+  return globalY - static_cast<float>(_firstRow) + HALO_ROWS;
+}
+
+
+bool SlabSolver::inDomain(int x, int globalRow) const
+{
+  return x >= 0 && x < static_cast<int>(_cols) - 1 &&
+    globalRow >= 0 && globalRow < static_cast<int>(_rows) - 1;
+}
+
+#endif //__SLAB_SOLVER_H__
@@ -0,0 +1,319 @@
+#include "StencilSmoother.h"
+#include <algorithm>
+#include <cmath>
+#include "CellMask.h"
+#include "Grid.h"
+
+// Extracts cell x's type from a row of packed types.
+static inline unsigned typeAt(const uint32_t *row, unsigned x)
+{
+  return (row[x / CellMask::CELLS_PER_WORD] >>
+	  (2 * (x % CellMask::CELLS_PER_WORD))) & 3u;
+}
+
+
+StencilSmoother::StencilSmoother(Method method, double omega)
+  : _method(method),
+    _omega(omega),
+    _schedule(BLOCKED),
+    _blockDepth(4),
+    _invScale(1.0),
+    _stride(0)
+{
+}
+
+
+void StencilSmoother::smooth(Grid &grid, float timeStepSec, unsigned sweeps)
+{
+  smooth(grid.getCellMask(), timeStepSec, grid.getDivergenceData(),
+	 grid.getPressureData(), sweeps, grid.getRowStride());
+}
+
+
+void StencilSmoother::smooth(const CellMask &mask, double scale,
+			     const double *rhs, double *pressure,
+			     unsigned sweeps, unsigned stride)
+{
+  if (mask.getColCount() < 2 || mask.getRowCount() < 2 || sweeps == 0)
+    return;
+  _invScale = 1.0 / scale;
+  _stride = stride > 0 ? stride : mask.getColCount();
+
+  if (_schedule == NAIVE) {
+    if (_method == JACOBI)
+      jacobiNaive(mask, rhs, pressure, sweeps);
+    else
+      redBlackNaive(mask, rhs, pressure, sweeps);
+    return;
+  }
+
+  while (sweeps > 0) {
+    const unsigned depth = std::min(sweeps, std::max(_blockDepth, 1u));
+    if (_method == JACOBI)
+      jacobiBlocked(mask, rhs, pressure, depth);
+    else
+      redBlackBlocked(mask, rhs, pressure, depth);
+    sweeps -= depth;
+  }
+}
+
+
+double StencilSmoother::getResidual(const CellMask &mask, double scale,
+				    const double *rhs, const double *pressure,
+				    unsigned stride)
+{
+  const unsigned width  = mask.getColCount() - 1;
+  if (stride == 0)
+    stride = mask.getColCount();
+  const unsigned height = mask.getRowCount() - 1;
+  double residual = 0.0;
+  for (unsigned y = 0; y < height; ++y) {
+    if (!mask.rowHasFluid(y))
+      continue;
+    const uint32_t *types = mask.getRow(y);
+    const uint32_t *above = mask.getRow(y + 1);
+    const uint32_t *below = y > 0 ? mask.getRow(y - 1) : NULL;
+    const double *p = pressure + y * stride;
+    for (unsigned x = 0; x < width; ++x) {
+      if (typeAt(types, x) != Cell::FLUID)
+	continue;
+      double sum = 0.0;
+      unsigned n = 0;
+      unsigned type;
+      if (x > 0 && (type = typeAt(types, x - 1)) != Cell::SOLID) {
+	++n;
+	if (type == Cell::FLUID) sum += p[x - 1];
+      }
+      if ((type = typeAt(types, x + 1)) != Cell::SOLID) {
+	++n;
+	if (type == Cell::FLUID) sum += p[x + 1];
+      }
+      if (below && (type = typeAt(below, x)) != Cell::SOLID) {
+	++n;
+	if (type == Cell::FLUID) sum += (p - stride)[x];
+      }
+      if ((type = typeAt(above, x)) != Cell::SOLID) {
+	++n;
+	if (type == Cell::FLUID) sum += (p + stride)[x];
+      }
+      const double r = rhs[y * stride + x] - scale * (n * p[x] - sum);
+      residual = std::max(residual, std::fabs(r));
+    }
+  }
+  return residual;
+}
+
+
+StencilSmoother::Method StencilSmoother::getMethod() const
+{
+  return _method;
+}
+
+
+void StencilSmoother::setMethod(Method method)
+{
+  _method = method;
+}
+
+
+double StencilSmoother::getOmega() const
+{
+  return _omega;
+}
+
+
+void StencilSmoother::setOmega(double omega)
+{
+  _omega = omega;
+}
+
+
+StencilSmoother::Schedule StencilSmoother::getSchedule() const
+{
+  return _schedule;
+}
+
+
+void StencilSmoother::setSchedule(Schedule schedule)
+{
+  _schedule = schedule;
+}
+
+
+unsigned StencilSmoother::getBlockDepth() const
+{
+  return _blockDepth;
+}
+
+
+void StencilSmoother::setBlockDepth(unsigned depth)
+{
+  _blockDepth = std::max(depth, 1u);
+}
+
+
+void StencilSmoother::relaxRow(const CellMask &mask, unsigned y, Color color,
+			       const double *below, const double *here,
+			       const double *above, const double *rhs,
+			       double *out) const
+{
+  const unsigned width = mask.getColCount() - 1;
+  const bool copy = out != here;
+  if (!mask.rowHasFluid(y)) {
+    if (copy)
+      std::copy(here, here + width + 1, out);
+    return;
+  }
+
+  const uint32_t *types      = mask.getRow(y);
+  const uint32_t *typesAbove = mask.getRow(y + 1);
+  const uint32_t *typesBelow = y > 0 ? mask.getRow(y - 1) : NULL;
+  // A red-black half sweep visits every other cell: those with
+  // (x + y) % 2 == color.
+  const unsigned step  = color == ALL ? 1 : 2;
+  const unsigned first = color == ALL ? 0 : (y + color) & 1u;
+  for (unsigned x = first; x < width; x += step) {
+    if (typeAt(types, x) != Cell::FLUID) {
+      if (copy)
+	out[x] = here[x];
+      continue;
+    }
+
+    // Gather the stencil straight from the packed types: every non-SOLID
+    // neighbor adds to the diagonal, and FLUID neighbors couple.
+    double sum = 0.0;
+    unsigned n = 0;
+    unsigned type;
+    if (x > 0 && (type = typeAt(types, x - 1)) != Cell::SOLID) {
+      ++n;
+      if (type == Cell::FLUID) sum += here[x - 1];
+    }
+    if ((type = typeAt(types, x + 1)) != Cell::SOLID) {
+      ++n;
+      if (type == Cell::FLUID) sum += here[x + 1];
+    }
+    if (typesBelow && (type = typeAt(typesBelow, x)) != Cell::SOLID) {
+      ++n;
+      if (type == Cell::FLUID) sum += below[x];
+    }
+    if ((type = typeAt(typesAbove, x)) != Cell::SOLID) {
+      ++n;
+      if (type == Cell::FLUID) sum += above[x];
+    }
+
+    if (n == 0)
+      out[x] = here[x];
+    else
+      out[x] = here[x] + _omega * ((rhs[x] * _invScale + sum) / n - here[x]);
+  }
+  if (copy)
+    out[width] = here[width];
+}
+
+
+void StencilSmoother::jacobiNaive(const CellMask &mask, const double *rhs,
+				  double *pressure, unsigned sweeps)
+{
+  // Ping-pong between the pressure and a second full field.  Every sweep
+  // rewrites rows [0, height), so only the extra top row is copied once.
+  const unsigned stride = _stride;
+  const unsigned height = mask.getRowCount() - 1;
+  _scratch.resize(stride * (height + 1));
+  std::copy(pressure + height * stride, pressure + (height + 1) * stride,
+	    &_scratch[height * stride]);
+
+  double *src = pressure;
+  double *dst = &_scratch[0];
+  for (unsigned s = 0; s < sweeps; ++s) {
+    for (unsigned y = 0; y < height; ++y)
+      relaxRow(mask, y, ALL, y > 0 ? src + (y - 1) * stride : NULL,
+	       src + y * stride, src + (y + 1) * stride, rhs + y * stride,
+	       dst + y * stride);
+    std::swap(src, dst);
+  }
+  if (src != pressure)
+    std::copy(src, src + height * stride, pressure);
+}
+
+
+void StencilSmoother::jacobiBlocked(const CellMask &mask, const double *rhs,
+				    double *pressure, unsigned depth)
+{
+  // Sweep t (1 to depth) keeps rows r - 1, r and r + 1 of its result in a
+  // ring of three row buffers; sweep 0 is the pressure itself.  At step k,
+  // sweep t relaxes row k - t + 1, reading rows of sweep t - 1 that are
+  // either older or were produced earlier in the same step.  A row of the
+  // last sweep is stored back into the pressure once sweep 1 no longer
+  // reads that row's old values.
+  const unsigned stride = _stride;
+  const unsigned height = mask.getRowCount() - 1;
+  _scratch.resize(3 * depth * stride);
+  double *const top = pressure + height * stride;
+
+  for (unsigned k = 0; k < height + depth + 1; ++k) {
+    for (unsigned t = 1; t <= depth && t <= k + 1; ++t) {
+      const unsigned r = k + 1 - t;
+      if (r >= height)
+	continue;
+      const double *below = NULL, *here, *above;
+      if (t == 1) {
+	here  = pressure + r * stride;
+	above = here + stride;
+	if (r > 0) below = here - stride;
+      }
+      else {
+	const double *ring = &_scratch[3 * (t - 2) * stride];
+	here  = ring + (r % 3) * stride;
+	above = r + 1 < height ? ring + ((r + 1) % 3) * stride : top;
+	if (r > 0) below = ring + ((r - 1) % 3) * stride;
+      }
+      relaxRow(mask, r, ALL, below, here, above, rhs + r * stride,
+	       &_scratch[(3 * (t - 1) + r % 3) * stride]);
+    }
+
+    if (k >= depth + 1) {
+      const unsigned r = k - depth - 1;
+      const double *row = &_scratch[(3 * (depth - 1) + r % 3) * stride];
+      std::copy(row, row + mask.getColCount(), pressure + r * stride);
+    }
+  }
+}
+
+
+void StencilSmoother::redBlackNaive(const CellMask &mask, const double *rhs,
+				    double *pressure, unsigned sweeps)
+{
+  const unsigned stride = _stride;
+  const unsigned height = mask.getRowCount() - 1;
+  for (unsigned s = 0; s < sweeps; ++s)
+    for (unsigned c = RED; c <= BLACK; ++c)
+      for (unsigned y = 0; y < height; ++y) {
+	double *row = pressure + y * stride;
+	relaxRow(mask, y, Color(c), y > 0 ? row - stride : NULL, row,
+		 row + stride, rhs + y * stride, row);
+      }
+}
+
+
+void StencilSmoother::redBlackBlocked(const CellMask &mask, const double *rhs,
+				      double *pressure, unsigned depth)
+{
+  // Each sweep is two half sweeps, red then black, which update the field
+  // in place.  Half sweep h reads only the other color, written by half
+  // sweep h - 1, so at step k half sweep h may relax row k - h once half
+  // sweeps are run in order within the step: row k - h + 1 of half sweep
+  // h - 1 was relaxed just before, and half sweep h + 1 overwrites row
+  // k - h - 1 just after this step's read.
+  const unsigned stride = _stride;
+  const unsigned height = mask.getRowCount() - 1;
+  const unsigned halves = 2 * depth;
+  for (unsigned k = 0; k + 1 < height + halves; ++k)
+    for (unsigned h = 0; h < halves && h <= k; ++h) {
+      const unsigned r = k - h;
+      if (r >= height)
+	continue;
+      double *row = pressure + r * stride;
+      relaxRow(mask, r, Color(h & 1u), r > 0 ? row - stride : NULL, row,
+	       row + stride, rhs + r * stride, row);
+    }
+}
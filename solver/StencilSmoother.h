@@ -0,0 +1,146 @@
+#ifndef __STENCIL_SMOOTHER_H__
+#define __STENCIL_SMOOTHER_H__
+
+#include <vector>
+#include "FieldMemory.h"
+
+class CellMask;
+class Grid;
+
+// Relaxation sweeps on a pressure Poisson system: for each FLUID cell,
+// scale * (n * p - sum of FLUID neighbors' p) = b, where n counts the
+// cell's non-SOLID neighbors.  Cells that are not FLUID are left untouched,
+// and the grid's edges act as solid walls.  This is the system FluidSolver
+// assembles only for a domain walled on every side: the smoother has no
+// diagonal terms for OUTFLOW left and bottom sides and doesn't wrap around
+// periodic axes.
+//
+// A plain sweep streams the whole pressure field through memory once, so a
+// large grid runs at memory bandwidth no matter how little arithmetic each
+// cell takes.  The BLOCKED schedule instead pipelines up to getBlockDepth()
+// sweeps through the grid a row at a time: sweep t updates row y - t + 1
+// while sweep 1 updates row y, so each row is reused by every sweep in the
+// block while it is still in cache.  Only a few rows per sweep are live at
+// once, so the working set stays in L2 even for a 2048 cell wide grid.
+//
+// Both schedules perform the same arithmetic on the same operands in the
+// same order, so their results are bit-identical.
+class StencilSmoother {
+public:
+  // The relaxation methods.
+  enum Method {
+    JACOBI,        // Weighted Jacobi; every cell reads the previous sweep.
+    RED_BLACK_SOR  // Successive over-relaxation in red-black order.
+  };
+
+  // The order in which sweeps visit the grid.
+  enum Schedule {
+    NAIVE,         // One full pass over the grid per sweep.
+    BLOCKED        // getBlockDepth() sweeps per pass, pipelined by row.
+  };
+
+  // Constructs a smoother.
+  //
+  // Arguments:
+  //   Method method - The relaxation method.
+  //   double omega - The relaxation weight.  1.0 gives plain Jacobi or
+  //                  Gauss-Seidel; Jacobi smooths best near 2/3.
+  StencilSmoother(Method method = JACOBI, double omega = 2.0 / 3.0);
+
+  // Applies sweeps to the grid's pressure, using the grid's divergence
+  // array as the right hand side and its cell mask as the stencil.
+  //
+  // Arguments:
+  //   Grid &grid - The grid.  Its pressure is updated in place.
+  //   float timeStepSec - The timestep the system was assembled with.
+  //   unsigned sweeps - The number of sweeps to apply.
+  //
+  // Returns:
+  //   None
+  void smooth(Grid &grid, float timeStepSec, unsigned sweeps);
+
+  // Applies sweeps to a pressure field stored with the grid's layout.
+  //
+  // Arguments:
+  //   const CellMask &mask - The cell types.  The field spans the mask's
+  //                          columns and rows; its last row and column, the
+  //                          grid's extra ones, are never updated.
+  //   double scale - The factor the system is scaled by (the timestep).
+  //   const double *rhs - The right hand side, b.
+  //   double *pressure - The pressure, p.  Updated in place.
+  //   unsigned sweeps - The number of sweeps to apply.
+  //   unsigned stride - The elements from one row to the next, as given by
+  //                     Grid::getRowStride(); 0 for the mask's column count.
+  //
+  // Returns:
+  //   None
+  void smooth(const CellMask &mask, double scale, const double *rhs,
+	      double *pressure, unsigned sweeps, unsigned stride = 0);
+
+  // Returns the largest magnitude of b - Ap over the FLUID cells.
+  //
+  // Arguments:
+  //   const CellMask &mask - The cell types.
+  //   double scale - The factor the system is scaled by.
+  //   const double *rhs - The right hand side, b.
+  //   const double *pressure - The pressure, p.
+  //   unsigned stride - The elements from one row to the next; 0 for the
+  //                     mask's column count.
+  //
+  // Returns:
+  //   double - The residual's infinity norm.
+  static double getResidual(const CellMask &mask, double scale,
+			    const double *rhs, const double *pressure,
+			    unsigned stride = 0);
+
+  // Gets or sets the relaxation method and weight.
+  Method getMethod() const;
+  void setMethod(Method method);
+  double getOmega() const;
+  void setOmega(double omega);
+
+  // Gets or sets the schedule.  Defaults to BLOCKED.
+  Schedule getSchedule() const;
+  void setSchedule(Schedule schedule);
+
+  // Gets or sets the number of sweeps pipelined through the grid per pass
+  // in the BLOCKED schedule.  Each sweep in a block keeps three rows of its
+  // own live, so deeper blocks trade cache footprint for fewer passes.
+  unsigned getBlockDepth() const;
+  void setBlockDepth(unsigned depth);
+
+private:
+  typedef std::vector<double, FieldAllocator<double> > DoubleArray;
+
+  // The cells a call to relaxRow updates.
+  enum Color { RED = 0, BLACK = 1, ALL = 2 };
+
+  // Relaxes one row.  below, here and above are row y - 1, y and y + 1 of
+  // the values being relaxed; below is only read when y > 0.  For JACOBI
+  // the row is written to out (which differs from here), with cells that
+  // are not FLUID copied across; for a red-black half sweep out is here,
+  // and only cells of the given color are written.
+  void relaxRow(const CellMask &mask, unsigned y, Color color,
+		const double *below, const double *here, const double *above,
+		const double *rhs, double *out) const;
+
+  // The four ways of running sweeps.
+  void jacobiNaive(const CellMask &mask, const double *rhs, double *pressure,
+		   unsigned sweeps);
+  void jacobiBlocked(const CellMask &mask, const double *rhs,
+		     double *pressure, unsigned depth);
+  void redBlackNaive(const CellMask &mask, const double *rhs,
+		     double *pressure, unsigned sweeps);
+  void redBlackBlocked(const CellMask &mask, const double *rhs,
+		       double *pressure, unsigned depth);
+
+  Method _method;       // The relaxation method.
+  double _omega;        // The relaxation weight.
+  Schedule _schedule;   // The order sweeps visit the grid in.
+  unsigned _blockDepth; // Sweeps per pass in the BLOCKED schedule.
+  double _invScale;     // 1 / scale, for the call in progress.
+  unsigned _stride;     // The row stride, for the call in progress.
+  DoubleArray _scratch; // The second Jacobi field, or the row buffers.
+};
+
+#endif // __STENCIL_SMOOTHER_H__
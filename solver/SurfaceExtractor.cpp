@@ -0,0 +1,200 @@
+#include "SurfaceExtractor.h"
+#include <algorithm>
+#include <cmath>
+#include "Grid.h"
+
+using std::vector;
+
+const unsigned SurfaceExtractor::TILE_SIZE;
+
+namespace {
+
+// The edges of a square, and the corners (as sample offsets) each joins.
+// Every edge runs from its lower or left corner, so neighboring squares
+// interpolate a shared edge identically.
+enum Edge { BOTTOM = 0, RIGHT, TOP, LEFT };
+const unsigned EDGE_CORNERS[4][2][2] = {
+  { {0, 0}, {1, 0} },  // BOTTOM
+  { {1, 0}, {1, 1} },  // RIGHT
+  { {0, 1}, {1, 1} },  // TOP
+  { {0, 0}, {0, 1} }   // LEFT
+};
+
+// The segments of each case, as pairs of edges, with the liquid on the
+// right of each.  Corner bits are 1 lower left, 2 lower right, 4 upper
+// right and 8 upper left.  The saddles, 5 and 10, list the segments that
+// keep their liquid corners apart; they are joined instead when the
+// square's center is liquid too.
+const int SEGMENTS[16][4] = {
+  { -1 },                         // 0
+  { LEFT, BOTTOM, -1 },           // 1
+  { BOTTOM, RIGHT, -1 },          // 2
+  { LEFT, RIGHT, -1 },            // 3
+  { RIGHT, TOP, -1 },             // 4
+  { LEFT, BOTTOM, RIGHT, TOP },   // 5
+  { BOTTOM, TOP, -1 },            // 6
+  { LEFT, TOP, -1 },              // 7
+  { TOP, LEFT, -1 },              // 8
+  { TOP, BOTTOM, -1 },            // 9
+  { BOTTOM, RIGHT, TOP, LEFT },   // 10
+  { TOP, RIGHT, -1 },             // 11
+  { RIGHT, LEFT, -1 },            // 12
+  { RIGHT, BOTTOM, -1 },          // 13
+  { BOTTOM, LEFT, -1 },           // 14
+  { -1 }                          // 15
+};
+const int JOINED_SADDLES[2][4] = {
+  { LEFT, TOP, RIGHT, BOTTOM },   // 5
+  { BOTTOM, LEFT, TOP, RIGHT }    // 10
+};
+
+} // namespace
+
+
+SurfaceExtractor::SurfaceExtractor()
+  : _cols(0),
+    _rows(0),
+    _samples(),
+    _offsets(),
+    _vertices()
+{}
+
+
+void SurfaceExtractor::resize(const Grid &grid, float value)
+{
+  // One sample per cell, plus the padding on either side.
+  _cols = unsigned(grid.getWidth()) + 2;
+  _rows = unsigned(grid.getHeight()) + 2;
+  _samples.assign(_cols * _rows, value);
+}
+
+
+void SurfaceExtractor::sampleParticles(const Grid &grid,
+				       const ParticleArray &particles,
+				       float particlesPerCell)
+{
+  resize(grid, 0.0f);
+
+  // Sample (i, j) lies at the center of cell (i - 1, j - 1).  Particles
+  // beyond the outer samples are ignored.
+  const float weight = 1.0f / particlesPerCell;
+  ParticleArray::const_iterator itr = particles.begin();
+  for (; itr != particles.end(); ++itr) {
+    const float u = itr->x + 0.5f;
+    const float v = itr->y + 0.5f;
+    if (u < 0.0f || v < 0.0f || u >= _cols - 1 || v >= _rows - 1)
+      continue;
+    const unsigned i = u;
+    const unsigned j = v;
+    const float fx = u - i;
+    const float fy = v - j;
+    float *sample = &_samples[j * _cols + i];
+    sample[0]         += (1 - fx) * (1 - fy) * weight;
+    sample[1]         += fx       * (1 - fy) * weight;
+    sample[_cols]     += (1 - fx) * fy       * weight;
+    sample[_cols + 1] += fx       * fy       * weight;
+  }
+}
+
+
+void SurfaceExtractor::sampleScalar(const Grid &grid, unsigned field,
+				    float outside)
+{
+  resize(grid, outside);
+  for (unsigned y = 0; y + 2 < _rows; ++y)
+    for (unsigned x = 0; x + 2 < _cols; ++x)
+      _samples[(y + 1) * _cols + x + 1] = grid.getScalar(x, y, field);
+}
+
+
+unsigned SurfaceExtractor::getCase(unsigned x, unsigned y,
+				   float isoValue) const
+{
+  const float *sample = &_samples[y * _cols + x];
+  return (sample[0]         >= isoValue ? 1 : 0) |
+         (sample[1]         >= isoValue ? 2 : 0) |
+         (sample[_cols + 1] >= isoValue ? 4 : 0) |
+         (sample[_cols]     >= isoValue ? 8 : 0);
+}
+
+
+unsigned SurfaceExtractor::processTile(unsigned tx, unsigned ty,
+				       float isoValue, Vector2 *output) const
+{
+  const unsigned endX = std::min((tx + 1) * TILE_SIZE, _cols - 1);
+  const unsigned endY = std::min((ty + 1) * TILE_SIZE, _rows - 1);
+  unsigned count = 0;
+  for (unsigned y = ty * TILE_SIZE; y < endY; ++y)
+    for (unsigned x = tx * TILE_SIZE; x < endX; ++x) {
+      const unsigned index = getCase(x, y, isoValue);
+      if (index == 0 || index == 15)
+	continue;
+
+      // Resolve the saddles by the average of the corners.
+      const int *edges = SEGMENTS[index];
+      if (index == 5 || index == 10) {
+	const float *sample = &_samples[y * _cols + x];
+	const float center = 0.25f * (sample[0] + sample[1] +
+				      sample[_cols] + sample[_cols + 1]);
+	if (center >= isoValue)
+	  edges = JOINED_SADDLES[index == 10];
+      }
+
+      for (unsigned e = 0; e < 4 && edges[e] >= 0; ++e) {
+	if (output) {
+	  // Place the vertex where the field crosses the iso value along
+	  // the edge.  Samples lie half a cell before their cells' centers.
+	  const unsigned *a = EDGE_CORNERS[edges[e]][0];
+	  const unsigned *b = EDGE_CORNERS[edges[e]][1];
+	  const float va = _samples[(y + a[1]) * _cols + x + a[0]];
+	  const float vb = _samples[(y + b[1]) * _cols + x + b[0]];
+	  const float t = (isoValue - va) / (vb - va);
+	  *output++ = Vector2(x + a[0] - 0.5f + t * (b[0] - a[0]),
+			      y + a[1] - 0.5f + t * (b[1] - a[1]));
+	}
+	++count;
+      }
+    }
+  return count / 2;
+}
+
+
+void SurfaceExtractor::extract(float isoValue)
+{
+  if (_cols < 2 || _rows < 2) {
+    _vertices.clear();
+    return;
+  }
+
+  // Count each tile's segments, then lay the tiles out back to back.
+  const unsigned tileCols = (_cols - 1 + TILE_SIZE - 1) / TILE_SIZE;
+  const unsigned tileRows = (_rows - 1 + TILE_SIZE - 1) / TILE_SIZE;
+  const int tiles = tileCols * tileRows;
+  _offsets.resize(tiles + 1);
+#pragma omp parallel for schedule(static)
+  for (int t = 0; t < tiles; ++t)
+    _offsets[t + 1] = processTile(t % tileCols, t / tileCols, isoValue, NULL);
+  _offsets[0] = 0;
+  for (int t = 0; t < tiles; ++t)
+    _offsets[t + 1] += _offsets[t];
+
+  // Write every tile's segments at its offset.
+  _vertices.resize(2 * _offsets[tiles]);
+#pragma omp parallel for schedule(static)
+  for (int t = 0; t < tiles; ++t)
+    if (_offsets[t + 1] > _offsets[t])
+      processTile(t % tileCols, t / tileCols, isoValue,
+		  &_vertices[2 * _offsets[t]]);
+}
+
+
+const vector<Vector2> & SurfaceExtractor::getVertices() const
+{
+  return _vertices;
+}
+
+
+unsigned SurfaceExtractor::getSegmentCount() const
+{
+  return _vertices.size() / 2;
+}
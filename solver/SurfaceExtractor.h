@@ -0,0 +1,102 @@
+#ifndef __SURFACE_EXTRACTOR_H__
+#define __SURFACE_EXTRACTOR_H__
+
+#include <vector>
+#include "FieldMemory.h"
+#include "Vector2.h"
+
+class Grid;
+
+// Extracts the outline of the liquid as line segments, for display and
+// export, by running marching squares over a scalar field sampled at cell
+// centers.  The field is either the density of the marker particles, or
+// one of the grid's scalar fields (such as a level set).  Samples are
+// padded with a ring of air just outside the simulation, so liquid
+// touching a wall is closed off at the wall.
+//
+// The squares are processed in tiles, in parallel, in two passes: the first
+// counts each tile's segments, the second writes them into one contiguous
+// vertex buffer at offsets found from those counts.  The buffer is reused
+// from one extraction to the next, so steady-state extraction never
+// allocates, and the segments come out in the same order whatever the
+// number of threads.
+//
+// Segments run clockwise around the liquid: the liquid is on the right of
+// each one.  Both squares sharing an edge compute its vertex from the same
+// two samples in the same order, so the segments of a closed outline meet
+// at bit-identical vertices.
+class SurfaceExtractor {
+public:
+  // The number of squares along each side of a tile.
+  static const unsigned TILE_SIZE = 16;
+
+  // Constructs an extractor with no field.
+  //
+  // Arguments:
+  //   None
+  SurfaceExtractor();
+
+  // Samples the density of the marker particles at every cell center,
+  // splatting each particle onto its four nearest centers with bilinear
+  // weights.  A density of 1.0 means particlesPerCell particles per cell.
+  //
+  // Arguments:
+  //   Grid &grid - The simulation's grid, for its size.
+  //   ParticleArray &particles - The marker particles.
+  //   float particlesPerCell - The particles in a cell full of liquid.
+  //
+  // Returns:
+  //   None
+  void sampleParticles(const Grid &grid, const ParticleArray &particles,
+		       float particlesPerCell = 16.0f);
+
+  // Samples one of the grid's scalar fields at every cell center.
+  //
+  // Arguments:
+  //   Grid &grid - The simulation's grid.
+  //   unsigned field - The index of the scalar field.
+  //   float outside - The field's value outside the simulation; it should
+  //     lie below the iso value passed to extract().
+  //
+  // Returns:
+  //   None
+  void sampleScalar(const Grid &grid, unsigned field, float outside = 0.0f);
+
+  // Extracts the contour where the sampled field crosses a value, samples
+  // at or above it counting as liquid.
+  //
+  // Arguments:
+  //   float isoValue - The field's value on the surface.
+  //
+  // Returns:
+  //   None
+  void extract(float isoValue = 0.5f);
+
+  // Returns the extracted segments, as consecutive pairs of endpoints in
+  // world coordinates, ready to be drawn as lines.
+  const std::vector<Vector2> & getVertices() const;
+
+  // Returns the number of extracted segments.
+  unsigned getSegmentCount() const;
+
+private:
+  // Sizes the samples for a grid, setting them all to a value.
+  void resize(const Grid &grid, float value);
+
+  // Computes the marching squares case of the square whose lower left
+  // sample is (x, y): a bit per corner at or above the iso value.
+  inline unsigned getCase(unsigned x, unsigned y, float isoValue) const;
+
+  // Counts or writes the segments of one tile.  With a NULL output, only
+  // counts them.
+  unsigned processTile(unsigned tx, unsigned ty, float isoValue,
+		       Vector2 *output) const;
+
+  unsigned           _cols;       // Samples along X, padding included.
+  unsigned           _rows;       // Samples along Y, padding included.
+  std::vector<float> _samples;    // Field values, row by row from the bottom.
+  std::vector<unsigned> _offsets; // First segment of each tile.
+  std::vector<Vector2> _vertices; // Two endpoints per segment.
+};
+
+#endif // __SURFACE_EXTRACTOR_H__
@@ -4,36 +4,311 @@
 #include<math.h>
 
 // This is a class to perform standard mathematical operations typical to vector classes.
+// All members are defined inline in this header so that vector math in the
+// solver's inner loops compiles down to plain arithmetic, with no calls.
 class Vector2 {
 public:
   float x, y;
   // Constructors
-  Vector2();
-  Vector2(float nx, float ny);
+  inline Vector2();
+  inline Vector2(float nx, float ny);
 
   // Vector math operators
-  Vector2& zero();
-  Vector2& zeroX();
-  Vector2& zeroY();
-  Vector2 negate() const;
-  Vector2 negateX() const;
-  Vector2 negateY() const;
-  float magnitude() const;
-  Vector2 unit() const;
-  Vector2& normalize();
-  float dot(const Vector2 &rhs) const;
-  Vector2 operator+(const Vector2 &rhs) const;
-  Vector2 operator-(const Vector2 &rhs) const;
-  Vector2 operator*(const float &rhs) const;
-  Vector2 operator/(const float &rhs) const;
-  Vector2& operator+=(const Vector2 &rhs);
-  Vector2& operator-=(const Vector2 &rhs);
-  Vector2& operator*=(const float &rhs);
-  Vector2& operator/=(const float &rhs);
+  inline Vector2& zero();
+  inline Vector2& zeroX();
+  inline Vector2& zeroY();
+  inline Vector2 negate() const;
+  inline Vector2 negateX() const;
+  inline Vector2 negateY() const;
+  inline float magnitude() const;
+  inline Vector2 unit() const;
+  inline Vector2& normalize();
+  inline float dot(const Vector2 &rhs) const;
+  inline Vector2 operator+(const Vector2 &rhs) const;
+  inline Vector2 operator-(const Vector2 &rhs) const;
+  inline Vector2 operator*(const float &rhs) const;
+  inline Vector2 operator/(const float &rhs) const;
+  inline Vector2& operator+=(const Vector2 &rhs);
+  inline Vector2& operator-=(const Vector2 &rhs);
+  inline Vector2& operator*=(const float &rhs);
+  inline Vector2& operator/=(const float &rhs);
 
   // Comparison operators
-  bool operator==(const Vector2 &rhs) const;
-  bool operator!=(const Vector2 &rhs) const;
+  inline bool operator==(const Vector2 &rhs) const;
+  inline bool operator!=(const Vector2 &rhs) const;
 };
 
+
+// A batch of N vectors stored as separate arrays of x and y components
+// (structure of arrays).  Each operation is a simple loop over the lanes,
+// which the compiler turns into SIMD instructions, so code written against
+// Vector2xN processes N vectors per instruction where Vector2 processes one.
+// Use load() and store() to convert to and from arrays of Vector2.
+template <unsigned N>
+class Vector2xN {
+public:
+  float x[N];
+  float y[N];
+
+  // The number of vectors in the batch.
+  static const unsigned SIZE = N;
+
+  // Gathers N consecutive vectors into the batch.
+  inline void load(const Vector2 *source);
+
+  // Scatters the batch into N consecutive vectors.
+  inline void store(Vector2 *destination) const;
+
+  // Gets or sets a single vector within the batch.
+  inline Vector2 get(unsigned lane) const;
+  inline void set(unsigned lane, const Vector2 &value);
+
+  // Lane-wise vector math operators.
+  inline Vector2xN& operator+=(const Vector2xN &rhs);
+  inline Vector2xN& operator-=(const Vector2xN &rhs);
+  inline Vector2xN& operator*=(const float &rhs);
+  inline Vector2xN& operator/=(const float &rhs);
+  inline Vector2xN operator+(const Vector2xN &rhs) const;
+  inline Vector2xN operator-(const Vector2xN &rhs) const;
+  inline Vector2xN operator*(const float &rhs) const;
+
+  // Stores the magnitude or dot product of each lane into result[lane].
+  inline void magnitude(float *result) const;
+  inline void dot(const Vector2xN &rhs, float *result) const;
+};
+
+// The batch size used by the solver's hot loops: 8 floats fill an AVX
+// register, or two SSE registers.
+typedef Vector2xN<8> Vector2x8;
+
+
+// Default constructor initializes the array elements to zero
+Vector2::Vector2() : x(0.0f), y(0.0f) {}
+
+Vector2::Vector2(float nx, float ny) : x(nx), y(ny) {}
+
+Vector2& Vector2::zero()
+{
+  (*this).x = (*this).y = 0.0f;
+  return *this;
+}
+
+Vector2& Vector2::zeroX()
+{
+  (*this).x = 0.0f;
+  return *this;
+}
+
+Vector2& Vector2::zeroY()
+{
+  (*this).y = 0.0f;
+  return *this;
+}
+
+Vector2 Vector2::negate() const
+{
+  return Vector2(x, y) * -1.0f;
+}
+
+Vector2 Vector2::negateX() const
+{
+  return Vector2(x * -1.0f, y);
+}
+
+Vector2 Vector2::negateY() const
+{
+  return Vector2(x, y * -1.0f);
+}
+
+float Vector2::magnitude() const
+{
+  return sqrt(x * x + y * y);
+}
+
+Vector2& Vector2::normalize()
+{
+  *this = unit();
+  return *this;
+}
+
+Vector2 Vector2::unit() const
+{
+  float mag = (*this).magnitude();
+  if (mag != 0) 
+    return *this / mag;
+  else
+    return *this;
+}
+
+float Vector2::dot(const Vector2 &rhs) const
+{
+  return x * rhs.x + y * rhs.y;
+}
+
+// Binary operator overloading
+Vector2 Vector2::operator+(const Vector2 &rhs) const
+{
+  return Vector2(x + rhs.x, y + rhs.y);
+}
+
+Vector2 Vector2::operator-(const Vector2 &rhs) const
+{
+  return Vector2(x - rhs.x, y - rhs.y);
+}
+
+Vector2 Vector2::operator*(const float &rhs) const
+{
+  return Vector2(x * rhs, y * rhs);
+}
+
+Vector2 Vector2::operator/(const float &rhs) const
+{
+  return Vector2(x / rhs, y / rhs);
+}
+
+Vector2& Vector2::operator+=(const Vector2 &rhs)
+{
+  *this = *this + rhs; 
+  return *this;
+}
+
+Vector2& Vector2::operator-=(const Vector2 &rhs)
+{
+  *this = *this - rhs;
+  return *this;
+}
+
+Vector2& Vector2::operator*=(const float &rhs)
+{
+  *this = *this * rhs;
+  return *this;
+}
+
+Vector2& Vector2::operator/=(const float &rhs)
+{
+  *this = *this / rhs;
+  return *this;
+}
+
+// Comparison operator overloading
+bool Vector2::operator==(const Vector2 &rhs) const
+{
+  bool eql = true;
+  if(x != rhs.x || y != rhs.y)
+    eql = false;
+  return eql;
+}
+
+bool Vector2::operator!=(const Vector2 &rhs) const
+{
+  return !(*this == rhs);
+}
+
+
+template <unsigned N>
+void Vector2xN<N>::load(const Vector2 *source)
+{
+  for (unsigned i = 0; i < N; ++i) {
+    x[i] = source[i].x;
+    y[i] = source[i].y;
+  }
+}
+
+template <unsigned N>
+void Vector2xN<N>::store(Vector2 *destination) const
+{
+  for (unsigned i = 0; i < N; ++i) {
+    destination[i].x = x[i];
+    destination[i].y = y[i];
+  }
+}
+
+template <unsigned N>
+Vector2 Vector2xN<N>::get(unsigned lane) const
+{
+  return Vector2(x[lane], y[lane]);
+}
+
+template <unsigned N>
+void Vector2xN<N>::set(unsigned lane, const Vector2 &value)
+{
+  x[lane] = value.x;
+  y[lane] = value.y;
+}
+
+template <unsigned N>
+Vector2xN<N>& Vector2xN<N>::operator+=(const Vector2xN &rhs)
+{
+  for (unsigned i = 0; i < N; ++i) {
+    x[i] += rhs.x[i];
+    y[i] += rhs.y[i];
+  }
+  return *this;
+}
+
+template <unsigned N>
+Vector2xN<N>& Vector2xN<N>::operator-=(const Vector2xN &rhs)
+{
+  for (unsigned i = 0; i < N; ++i) {
+    x[i] -= rhs.x[i];
+    y[i] -= rhs.y[i];
+  }
+  return *this;
+}
+
+template <unsigned N>
+Vector2xN<N>& Vector2xN<N>::operator*=(const float &rhs)
+{
+  for (unsigned i = 0; i < N; ++i) {
+    x[i] *= rhs;
+    y[i] *= rhs;
+  }
+  return *this;
+}
+
+template <unsigned N>
+Vector2xN<N>& Vector2xN<N>::operator/=(const float &rhs)
+{
+  for (unsigned i = 0; i < N; ++i) {
+    x[i] /= rhs;
+    y[i] /= rhs;
+  }
+  return *this;
+}
+
+template <unsigned N>
+Vector2xN<N> Vector2xN<N>::operator+(const Vector2xN &rhs) const
+{
+  Vector2xN result(*this);
+  return result += rhs;
+}
+
+template <unsigned N>
+Vector2xN<N> Vector2xN<N>::operator-(const Vector2xN &rhs) const
+{
+  Vector2xN result(*this);
+  return result -= rhs;
+}
+
+template <unsigned N>
+Vector2xN<N> Vector2xN<N>::operator*(const float &rhs) const
+{
+  Vector2xN result(*this);
+  return result *= rhs;
+}
+
+template <unsigned N>
+void Vector2xN<N>::magnitude(float *result) const
+{
+  for (unsigned i = 0; i < N; ++i)
+    result[i] = sqrtf(x[i] * x[i] + y[i] * y[i]);
+}
+
+template <unsigned N>
+void Vector2xN<N>::dot(const Vector2xN &rhs, float *result) const
+{
+  for (unsigned i = 0; i < N; ++i)
+    result[i] = x[i] * rhs.x[i] + y[i] * rhs.y[i];
+}
+
 #endif // __VECTOR2_H__
@@ -0,0 +1,196 @@
+#include "VelocityExtrapolator.h"
+#include <algorithm>
+#include "Grid.h"
+
+const unsigned char VelocityExtrapolator::UNKNOWN;
+
+
+VelocityExtrapolator::VelocityExtrapolator(unsigned bandWidth)
+  : _bandWidth(0)
+{
+  setBandWidth(bandWidth);
+}
+
+
+void VelocityExtrapolator::extrapolate(Grid &grid)
+{
+  if (_bandWidth == 0)
+    return;
+
+  const CellMask &mask  = grid.getCellMask();
+  const unsigned cols     = grid.getColCount();
+  const unsigned rows     = grid.getRowCount();
+  const unsigned tileCols = mask.getTileColCount();
+  const unsigned tileRows = mask.getTileRowCount();
+  const unsigned T        = CellMask::TILE_SIZE;
+  if (_layers.size() != 2 * cols * rows) {
+    _layers.assign(2 * cols * rows, UNKNOWN);
+    _pending.assign(2 * cols * rows, 0);
+    _tiles.assign(tileCols * tileRows, UNVISITED);
+  }
+
+  // Gather the tiles within reach of fluid, skipping those made up entirely
+  // of fluid, whose faces are all known already.  Each tile is examined
+  // once; _visited remembers them all so the map can be cleared after.
+  const unsigned reach = _bandWidth / T + 1;
+  _active.clear();
+  _visited.clear();
+  for (unsigned ty = 0; ty < tileRows; ++ty)
+    for (unsigned tx = 0; tx < tileCols; ++tx) {
+      if (!mask.tileHasFluid(tx, ty))
+	continue;
+      const unsigned endY = std::min(ty + reach + 1, tileRows);
+      const unsigned endX = std::min(tx + reach + 1, tileCols);
+      for (unsigned ny = ty > reach ? ty - reach : 0; ny < endY; ++ny)
+	for (unsigned nx = tx > reach ? tx - reach : 0; nx < endX; ++nx) {
+	  const unsigned tile = ny * tileCols + nx;
+	  if (_tiles[tile] != UNVISITED)
+	    continue;
+	  _visited.push_back(tile);
+	  if (isAllFluid(mask, nx, ny)) {
+	    _tiles[tile] = FULL;
+	    continue;
+	  }
+	  _tiles[tile] = ACTIVE;
+	  _active.push_back(tile);
+	}
+    }
+  const int activeCount = _active.size();
+
+  // Classify every face in the active tiles.
+#pragma omp parallel for schedule(dynamic, 4)
+  for (int a = 0; a < activeCount; ++a) {
+    const unsigned tx = _active[a] % tileCols, ty = _active[a] / tileCols;
+    const unsigned endY = std::min((ty + 1) * T, rows);
+    const unsigned endX = std::min((tx + 1) * T, cols);
+    for (unsigned y = ty * T; y < endY; ++y)
+      for (unsigned x = tx * T; x < endX; ++x)
+	for (unsigned dim = 0; dim < 2; ++dim)
+	  _layers[2 * (y * cols + x) + dim] =
+	    isKnown(grid, dim, x, y) ? 0 : UNKNOWN;
+  }
+
+  for (unsigned pass = 1; pass <= _bandWidth; ++pass) {
+    // Average each unknown face's neighbors that became known in earlier
+    // passes into its staged velocity...
+#pragma omp parallel for schedule(dynamic, 4)
+    for (int a = 0; a < activeCount; ++a) {
+      const unsigned tx = _active[a] % tileCols, ty = _active[a] / tileCols;
+      const unsigned endY = std::min((ty + 1) * T, rows);
+      const unsigned endX = std::min((tx + 1) * T, cols);
+      for (unsigned y = ty * T; y < endY; ++y)
+	for (unsigned x = tx * T; x < endX; ++x)
+	  for (unsigned dim = 0; dim < 2; ++dim) {
+	    const unsigned face = 2 * (y * cols + x) + dim;
+	    if (_layers[face] != UNKNOWN)
+	      continue;
+	    float sum = 0.0f;
+	    unsigned count = 0;
+	    if (x > 0 && getLayer(grid, dim, x - 1, y) < pass) {
+	      sum += grid(x - 1, y).vel[dim];
+	      ++count;
+	    }
+	    if (x + 1 < cols && getLayer(grid, dim, x + 1, y) < pass) {
+	      sum += grid(x + 1, y).vel[dim];
+	      ++count;
+	    }
+	    if (y > 0 && getLayer(grid, dim, x, y - 1) < pass) {
+	      sum += grid(x, y - 1).vel[dim];
+	      ++count;
+	    }
+	    if (y + 1 < rows && getLayer(grid, dim, x, y + 1) < pass) {
+	      sum += grid(x, y + 1).vel[dim];
+	      ++count;
+	    }
+	    if (count > 0) {
+	      grid(x, y).stagedVel[dim] = sum / count;
+	      _pending[face] = 1;
+	    }
+	  }
+    }
+
+    // ...then commit them, once no face of this pass is still being read.
+#pragma omp parallel for schedule(dynamic, 4)
+    for (int a = 0; a < activeCount; ++a) {
+      const unsigned tx = _active[a] % tileCols, ty = _active[a] / tileCols;
+      const unsigned endY = std::min((ty + 1) * T, rows);
+      const unsigned endX = std::min((tx + 1) * T, cols);
+      for (unsigned y = ty * T; y < endY; ++y)
+	for (unsigned x = tx * T; x < endX; ++x)
+	  for (unsigned dim = 0; dim < 2; ++dim) {
+	    const unsigned face = 2 * (y * cols + x) + dim;
+	    if (_pending[face]) {
+	      Cell &cell = grid(x, y);
+	      cell.vel[dim] = cell.stagedVel[dim];
+	      _layers[face] = pass;
+	      _pending[face] = 0;
+	    }
+	  }
+    }
+  }
+
+  // Clear the tile map for the next call.
+  for (unsigned v = 0; v < _visited.size(); ++v)
+    _tiles[_visited[v]] = UNVISITED;
+}
+
+
+unsigned VelocityExtrapolator::getBandWidth() const
+{
+  return _bandWidth;
+}
+
+
+void VelocityExtrapolator::setBandWidth(unsigned cells)
+{
+  // Layers are stored in bytes, with UNKNOWN reserved.
+  const unsigned maxBand = UNKNOWN - 1;
+  _bandWidth = std::min(cells, maxBand);
+}
+
+
+unsigned char VelocityExtrapolator::getLayer(const Grid &grid, unsigned dim,
+					     unsigned x, unsigned y) const
+{
+  // Faces outside the active tiles were never classified; those next to
+  // fluid are known, and the rest lie beyond the band.
+  const unsigned tile = (y / CellMask::TILE_SIZE) *
+    grid.getCellMask().getTileColCount() + x / CellMask::TILE_SIZE;
+  if (_tiles[tile] == ACTIVE)
+    return _layers[2 * (y * grid.getColCount() + x) + dim];
+  return isKnown(grid, dim, x, y) ? 0 : UNKNOWN;
+}
+
+
+bool VelocityExtrapolator::isKnown(const Grid &grid, unsigned dim, unsigned x,
+				   unsigned y)
+{
+  // Face (x, y) of dimension X lies between cells (x - 1, y) and (x, y);
+  // of dimension Y, between cells (x, y - 1) and (x, y).
+  const CellMask &mask = grid.getCellMask();
+  if (mask.isFluid(x, y))
+    return true;
+  if (dim == Cell::X)
+    return x > 0 && mask.isFluid(x - 1, y);
+  return y > 0 && mask.isFluid(x, y - 1);
+}
+
+
+bool VelocityExtrapolator::isAllFluid(const CellMask &mask, unsigned tx,
+				      unsigned ty)
+{
+  // A tile's row of cells is a 16 bit run of one packed word, which is all
+  // FLUID exactly when it matches FLUID_BITS.
+  const unsigned T = CellMask::TILE_SIZE;
+  const unsigned x = tx * T;
+  if (x + T > mask.getColCount() || (ty + 1) * T > mask.getRowCount())
+    return false;
+  const unsigned shift = 2 * (x % CellMask::CELLS_PER_WORD);
+  const uint32_t run = CellMask::FLUID_BITS >> (32 - 2 * T);
+  for (unsigned y = ty * T; y < (ty + 1) * T; ++y) {
+    const uint32_t word = mask.getRow(y)[x / CellMask::CELLS_PER_WORD];
+    if (((word >> shift) & (run | run << 1)) != run)
+      return false;
+  }
+  return true;
+}
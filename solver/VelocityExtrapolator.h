@@ -0,0 +1,73 @@
+#ifndef __VELOCITY_EXTRAPOLATOR_H__
+#define __VELOCITY_EXTRAPOLATOR_H__
+
+#include <vector>
+#include "CellMask.h"
+
+class Grid;
+
+// Extends the velocity of the fluid into the AIR around it.  Only faces that
+// border a FLUID cell carry a meaningful velocity after the pressure solve;
+// backtraces and particle moves near the surface also sample the faces
+// beyond them.  Each pass sets the unknown faces next to known ones to the
+// average of their known neighbors (of the same component), so after
+// getBandWidth() passes every face within that many cells of the fluid
+// carries a velocity continued from the fluid's.  Faces beyond the band are
+// left unchanged.
+//
+// The work is confined to CellMask tiles within reach of fluid that aren't
+// entirely fluid themselves, so it scales with the fluid's surface rather
+// than the grid's area, and the tiles are processed in parallel.  Each pass
+// reads only faces set by earlier passes, so the result does not depend on
+// the order tiles are processed in.
+class VelocityExtrapolator {
+public:
+  // Constructs an extrapolator.
+  //
+  // Arguments:
+  //   unsigned bandWidth - The number of cells to extrapolate into the air.
+  VelocityExtrapolator(unsigned bandWidth = 3);
+
+  // Extrapolates the grid's velocity by getBandWidth() cells.  The cells'
+  // staged velocities are used as scratch space.
+  //
+  // Arguments:
+  //   Grid &grid - The grid.
+  //
+  // Returns:
+  //   None
+  void extrapolate(Grid &grid);
+
+  // Gets or sets the number of cells to extrapolate into the air.  A band
+  // of 0 disables extrapolation.  Backtraces reach the CFL coefficient's
+  // worth of cells, plus one for the bilinear stencil.
+  unsigned getBandWidth() const;
+  void setBandWidth(unsigned cells);
+
+private:
+  // Returns the pass at which a face's velocity became known: 0 for faces
+  // bordering fluid, UNKNOWN for faces not yet reached.
+  inline unsigned char getLayer(const Grid &grid, unsigned dim, unsigned x,
+				unsigned y) const;
+
+  // Determines whether a face borders a FLUID cell.
+  static bool isKnown(const Grid &grid, unsigned dim, unsigned x, unsigned y);
+
+  // Determines whether every cell of a tile is FLUID.
+  static bool isAllFluid(const CellMask &mask, unsigned tx, unsigned ty);
+
+  // The layer of faces not yet reached.
+  static const unsigned char UNKNOWN = 0xff;
+
+  // The states of a tile in _tiles.
+  enum TileState { UNVISITED, ACTIVE, FULL };
+
+  unsigned _bandWidth;                 // Cells to extrapolate into the air.
+  std::vector<unsigned char> _layers;  // Each face's layer, two per cell.
+  std::vector<unsigned char> _pending; // Faces set by the current pass.
+  std::vector<unsigned char> _tiles;   // Each tile's TileState.
+  std::vector<unsigned> _active;       // The ACTIVE tiles.
+  std::vector<unsigned> _visited;      // Every tile not UNVISITED.
+};
+
+#endif // __VELOCITY_EXTRAPOLATOR_H__
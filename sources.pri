@@ -16,30 +16,82 @@ Debug:UI_DIR      = $$BaseDirectory/debug/.ui
 
 DEFINES += EIGEN_YES_I_KNOW_SPARSE_MODULE_IS_NOT_STABLE_YET
 
+# POSIX shared memory and process-shared barriers (see SharedMemoryTransport).
+unix:LIBS += -lrt -lpthread
+
+# OpenMP lets Eigen multithread the pressure and viscosity solves.
+unix:QMAKE_CXXFLAGS += -fopenmp
+unix:LIBS += -fopenmp
+
 INCLUDEPATH += $$BaseDirectory/ui \
                $$BaseDirectory/solver \
                $$BaseDirectory/renderers \
 	       $$BaseDirectory/infrastructure \
+	       $$BaseDirectory/capi \
 
 SOURCES += $$BaseDirectory/ui/MainWindow.cpp \
            $$BaseDirectory/ui/QRendererWidget.cpp \
-           $$BaseDirectory/solver/Vector2.cpp \
            $$BaseDirectory/solver/FluidSolver.cpp \
            $$BaseDirectory/solver/Grid.cpp \
            $$BaseDirectory/solver/Cell.cpp \
+           $$BaseDirectory/solver/CellMask.cpp \
+           $$BaseDirectory/solver/FluidSource.cpp \
+           $$BaseDirectory/solver/CommandQueue.cpp \
+           $$BaseDirectory/solver/Kernels.cpp \
+           $$BaseDirectory/solver/FieldMemory.cpp \
+           $$BaseDirectory/solver/SlabDecomposition.cpp \
+           $$BaseDirectory/solver/SlabSolver.cpp \
+           $$BaseDirectory/solver/StencilSmoother.cpp \
+           $$BaseDirectory/solver/VelocityExtrapolator.cpp \
+           $$BaseDirectory/solver/SurfaceExtractor.cpp \
            $$BaseDirectory/renderers/CompatibilityRenderer.cpp \
 	   $$BaseDirectory/renderers/bstrlib.c \
 	   $$BaseDirectory/renderers/glsw.c \
-	   $$BaseDirectory/infrastructure/SignalRelay.cpp
+	   $$BaseDirectory/infrastructure/SignalRelay.cpp \
+	   $$BaseDirectory/infrastructure/SweepSpec.cpp \
+	   $$BaseDirectory/infrastructure/EnsembleRunner.cpp \
+	   $$BaseDirectory/infrastructure/SharedMemoryTransport.cpp \
+	   $$BaseDirectory/infrastructure/FrameSnapshot.cpp \
+	   $$BaseDirectory/infrastructure/FrameServer.cpp \
+	   $$BaseDirectory/infrastructure/SharedFrameRing.cpp \
+	   $$BaseDirectory/infrastructure/SceneSpec.cpp \
+	   $$BaseDirectory/infrastructure/VtkExporter.cpp \
+	   $$BaseDirectory/infrastructure/AutoTuner.cpp \
+	   $$BaseDirectory/infrastructure/JobSpec.cpp \
+	   $$BaseDirectory/infrastructure/JobDaemon.cpp \
+	   $$BaseDirectory/capi/FluidSolverC.cpp
 
 HEADERS += $$BaseDirectory/ui/MainWindow.h \
            $$BaseDirectory/ui/QRendererWidget.h \
            $$BaseDirectory/solver/Vector2.h \
            $$BaseDirectory/solver/Cell.h \
+           $$BaseDirectory/solver/CellMask.h \
+           $$BaseDirectory/solver/FluidSource.h \
+           $$BaseDirectory/solver/CommandQueue.h \
            $$BaseDirectory/solver/FluidSolver.h \
            $$BaseDirectory/solver/Grid.h \
+           $$BaseDirectory/solver/Kernels.h \
+           $$BaseDirectory/solver/FieldMemory.h \
+           $$BaseDirectory/solver/KernelBodies.h \
+           $$BaseDirectory/solver/SlabDecomposition.h \
+           $$BaseDirectory/solver/SlabSolver.h \
+           $$BaseDirectory/solver/StencilSmoother.h \
+           $$BaseDirectory/solver/VelocityExtrapolator.h \
+           $$BaseDirectory/solver/SurfaceExtractor.h \
 	   $$BaseDirectory/renderers/bstrlib.h \
 	   $$BaseDirectory/renderers/glsw.h \
            $$BaseDirectory/renderers/IFluidRenderer.h \
            $$BaseDirectory/renderers/CompatibilityRenderer.h \
-	   $$BaseDirectory/infrastructure/SignalRelay.h
+	   $$BaseDirectory/infrastructure/SignalRelay.h \
+	   $$BaseDirectory/infrastructure/SweepSpec.h \
+	   $$BaseDirectory/infrastructure/EnsembleRunner.h \
+	   $$BaseDirectory/infrastructure/SharedMemoryTransport.h \
+	   $$BaseDirectory/infrastructure/FrameSnapshot.h \
+	   $$BaseDirectory/infrastructure/FrameServer.h \
+	   $$BaseDirectory/infrastructure/SharedFrameRing.h \
+	   $$BaseDirectory/infrastructure/SceneSpec.h \
+	   $$BaseDirectory/infrastructure/VtkExporter.h \
+	   $$BaseDirectory/infrastructure/AutoTuner.h \
+	   $$BaseDirectory/infrastructure/JobSpec.h \
+	   $$BaseDirectory/infrastructure/JobDaemon.h \
+	   $$BaseDirectory/capi/FluidSolverC.h
@@ -0,0 +1,74 @@
+#include <omp.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include "FieldMemory.h"
+#include "FluidSolver.h"
+#include "FrameServer.h"
+#include "SharedFrameRing.h"
+
+// Returns true if the argument is a TCP port number rather than a path.
+static bool isPort(const char *arg)
+{
+  return *arg && strspn(arg, "0123456789") == strlen(arg);
+}
+
+
+int main(int argc, char *argv[])
+{
+  if (argc < 4 || argc > 7) {
+    fprintf(stderr, "Usage: %s <width> <height> <socket path | tcp port> "
+	    "[max fps] [frames] [shared memory ring]\n", argv[0]);
+    return 1;
+  }
+  float width = atof(argv[1]);
+  float height = atof(argv[2]);
+  float maxRate = argc > 4 ? atof(argv[4]) : 30.0f;
+  unsigned frames = argc > 5 ? atoi(argv[5]) : 0;
+
+  FrameServer server;
+  server.setMaxFrameRate(maxRate);
+  bool listening = isPort(argv[3]) ? server.listenTcp(atoi(argv[3]))
+                                   : server.listenUnix(argv[3]);
+  if (!listening) {
+    perror(argv[3]);
+    return 1;
+  }
+  if (server.getPort())
+    printf("Streaming frames on port %u\n", server.getPort());
+  else
+    printf("Streaming frames on %s\n", argv[3]);
+  fflush(stdout);
+
+  // Simulate at full speed, publishing every frame.  Viewers are served by
+  // the server's own thread, and never slow the simulation down.
+  // Fields are first touched by the OpenMP threads that will sweep them.
+  FieldMemory::setFirstTouchThreads(omp_get_max_threads());
+  FluidSolver solver(width, height);
+
+  // Local tools may also read every frame in place from a shared-memory
+  // ring, sized for this solver.
+  SharedFrameRing ring;
+  if (argc > 6) {
+    if (!ring.create(argv[6], solver)) {
+      perror(argv[6]);
+      return 1;
+    }
+    printf("Publishing frames to shared memory %s\n", argv[6]);
+    fflush(stdout);
+  }
+
+  bool ringFull = false;
+  for (unsigned frame = 0; frames == 0 || frame < frames; ++frame) {
+    solver.advanceFrame();
+    solver.consumeFrame();
+    server.publish(solver);
+    if (ring.isOpen() && !ring.publish(solver) && !ringFull) {
+      fprintf(stderr, "%s: frame %u doesn't fit the ring's slots\n",
+	      argv[6], frame);
+      ringFull = true;
+    }
+  }
+  return 0;
+}
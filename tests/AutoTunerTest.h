@@ -0,0 +1,112 @@
+#ifndef __AUTO_TUNER_TEST__
+#define __AUTO_TUNER_TEST__
+
+#include <gtest/gtest.h>
+#include <omp.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include "AutoTuner.h"
+#include "FluidSolver.h"
+#include "Kernels.h"
+
+TEST(AutoTunerTest, ProfileRoundTrip)
+{
+  char path[] = "/tmp/auto-tuner-test-XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  close(fd);
+
+  AutoTuner::Settings small, large;
+  small.threads = 1;
+  small.kernels = Kernels::GENERIC;
+  small.preconditioner = FluidSolver::DIAGONAL;
+  small.frameSec = 0.25;
+  large.threads = 3;
+  large.kernels = Kernels::getWidestSupported();
+  large.preconditioner = FluidSolver::INCOMPLETE_CHOLESKY;
+  large.frameSec = 1.5;
+
+  AutoTuner tuner;
+  tuner.store(16, 16, large);
+  tuner.store(16, 16, small);  // Replaces the first.
+  tuner.store(128, 64, large);
+  ASSERT_TRUE(tuner.save(path));
+
+  AutoTuner loaded;
+  ASSERT_TRUE(loaded.load(path)) << loaded.getError();
+  AutoTuner::Settings settings;
+  ASSERT_TRUE(loaded.find(16, 16, settings));
+  EXPECT_EQ(1u, settings.threads);
+  EXPECT_EQ(Kernels::GENERIC, settings.kernels);
+  EXPECT_EQ(FluidSolver::DIAGONAL, settings.preconditioner);
+  EXPECT_DOUBLE_EQ(0.25, settings.frameSec);
+  ASSERT_TRUE(loaded.find(128, 64, settings));
+  EXPECT_EQ(3u, settings.threads);
+  EXPECT_EQ(large.kernels, settings.kernels);
+  EXPECT_EQ(FluidSolver::INCOMPLETE_CHOLESKY, settings.preconditioner);
+  EXPECT_FALSE(loaded.find(64, 128, settings));
+
+  // A malformed profile is rejected without losing the loaded one.
+  {
+    std::ofstream out(path);
+    out << "grid 32x32 threads 2 kernels generic preconditioner diagonal\n"
+	<< "grid 32x32 threads 0 kernels generic preconditioner diagonal\n";
+  }
+  EXPECT_FALSE(loaded.load(path));
+  EXPECT_FALSE(loaded.getError().empty());
+  EXPECT_TRUE(loaded.find(16, 16, settings));
+  EXPECT_FALSE(loaded.find(32, 32, settings));
+  unlink(path);
+}
+
+TEST(AutoTunerTest, CalibratesAndCaches)
+{
+  char path[] = "/tmp/auto-tuner-test-XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  unlink(path);
+
+  // Calibration tries several candidates, picks one of them, and leaves the
+  // process's own settings alone.
+  const int threads = omp_get_max_threads();
+  const Kernels::Isa kernels = Kernels::get().isa;
+  AutoTuner tuner;
+  tuner.setFrames(1);
+  AutoTuner::Settings best;
+  ASSERT_TRUE(tuner.tune(path, 12, 10, best));
+  EXPECT_EQ(threads, omp_get_max_threads());
+  EXPECT_EQ(kernels, Kernels::get().isa);
+  ASSERT_GE(tuner.getTrials().size(), 2u);
+  EXPECT_GE(best.threads, 1u);
+  EXPECT_LE(best.threads, std::max(unsigned(omp_get_num_procs()),
+				    unsigned(threads)));
+  EXPECT_TRUE(Kernels::isSupported(best.kernels));
+  EXPECT_GT(best.frameSec, 0.0);
+  for (unsigned i = 0; i < tuner.getTrials().size(); ++i)
+    EXPECT_LE(best.frameSec, tuner.getTrials()[i].frameSec);
+
+  // A second run finds the settings in the profile without calibrating.
+  AutoTuner cached;
+  AutoTuner::Settings settings;
+  ASSERT_TRUE(cached.tune(path, 12, 10, settings));
+  EXPECT_TRUE(cached.getTrials().empty());
+  EXPECT_EQ(best.threads, settings.threads);
+  EXPECT_EQ(best.kernels, settings.kernels);
+  EXPECT_EQ(best.preconditioner, settings.preconditioner);
+
+  // The settings take effect when applied.
+  FluidSolver solver(8.0f, 8.0f);
+  AutoTuner::apply(settings, solver);
+  EXPECT_EQ(int(settings.threads), omp_get_max_threads());
+  EXPECT_EQ(settings.kernels, Kernels::get().isa);
+  EXPECT_EQ(settings.preconditioner, solver.getPreconditioner());
+  omp_set_num_threads(threads);
+  Kernels::select(kernels);
+  unlink(path);
+}
+
+#endif // __AUTO_TUNER_TEST__
@@ -0,0 +1,67 @@
+#ifndef __CELL_MASK_TEST__
+#define __CELL_MASK_TEST__
+
+#include <gtest/gtest.h>
+#include "CellMask.h"
+#include "Grid.h"
+
+TEST(CellMaskTest, PackedTypes)
+{
+  // 37 columns spans three packed words and five tiles per row.
+  CellMask mask(37, 20);
+  EXPECT_EQ(3u, mask.getWordsPerRow());
+  EXPECT_EQ(5u, mask.getTileColCount());
+  EXPECT_EQ(3u, mask.getTileRowCount());
+  EXPECT_EQ(Cell::AIR, mask.get(36, 19));
+  EXPECT_FALSE(mask.rowHasFluid(0));
+
+  mask.set(0, 0, Cell::SOLID);
+  mask.set(16, 5, Cell::FLUID);
+  mask.set(36, 19, Cell::FLUID);
+  mask.set(17, 5, Cell::SOLID);
+  EXPECT_EQ(Cell::SOLID, mask.get(0, 0));
+  EXPECT_EQ(Cell::FLUID, mask.get(16, 5));
+  EXPECT_EQ(Cell::SOLID, mask.get(17, 5));
+  EXPECT_TRUE(mask.isFluid(36, 19));
+  EXPECT_EQ(1u, mask.getRow(5)[1] & CellMask::FLUID_BITS);
+
+  // Row and tile bits follow the FLUID cells.
+  EXPECT_FALSE(mask.rowHasFluid(0));
+  EXPECT_TRUE(mask.rowHasFluid(5));
+  EXPECT_TRUE(mask.rowHasFluid(19));
+  EXPECT_TRUE(mask.tileHasFluid(2, 0));
+  EXPECT_TRUE(mask.tileHasFluid(4, 2));
+  EXPECT_FALSE(mask.tileHasFluid(0, 0));
+
+  // Clearing the fluid keeps the solids.
+  mask.clearFluid();
+  EXPECT_EQ(Cell::AIR, mask.get(16, 5));
+  EXPECT_EQ(Cell::SOLID, mask.get(17, 5));
+  EXPECT_EQ(Cell::SOLID, mask.get(0, 0));
+  EXPECT_FALSE(mask.rowHasFluid(5));
+  EXPECT_FALSE(mask.tileHasFluid(4, 2));
+
+  mask.clear();
+  EXPECT_EQ(Cell::AIR, mask.get(0, 0));
+}
+
+TEST(CellMaskTest, TracksGrid)
+{
+  Grid grid(10.0f, 10.0f);
+  grid.setCellType(3, 4, Cell::FLUID);
+  EXPECT_EQ(Cell::FLUID, grid(3, 4).cellType);
+  EXPECT_TRUE(grid.getCellMask().isFluid(3, 4));
+
+  // Direct writes are picked up by updateCellMask().
+  grid(3, 4).cellType = Cell::AIR;
+  grid(9, 9).cellType = Cell::SOLID;
+  grid.updateCellMask();
+  EXPECT_FALSE(grid.getCellMask().rowHasFluid(4));
+  EXPECT_EQ(Cell::SOLID, grid.getCellMask().get(9, 9));
+
+  // Copies carry the mask.
+  Grid copy(grid);
+  EXPECT_EQ(Cell::SOLID, copy.getCellMask().get(9, 9));
+}
+
+#endif // __CELL_MASK_TEST__
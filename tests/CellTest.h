@@ -17,7 +17,6 @@ class CellTest : public testing::Test {
 
 
   virtual void SetUp() {
-    testCell.pressure = 5.0f;
     testCell.vel[Cell::X] = 1.0f;
     testCell.vel[Cell::Y] = 2.0f;
     testCell.stagedVel[Cell::X] = 3.0f;
@@ -35,7 +34,6 @@ class CellTest : public testing::Test {
 
 TEST_F(CellTest, DefaultConstructor)
 {
-  EXPECT_EQ(0.0f, defaultCell.pressure);
   for (int i = 0; i < Cell::DIM_COUNT; ++i) {
     EXPECT_EQ(0.0f, defaultCell.vel[i]);
     EXPECT_EQ(0.0f, defaultCell.stagedVel[i]);
@@ -51,7 +49,6 @@ TEST_F(CellTest, CopyConstructor)
 {
   Cell newCell(testCell);
 
-  EXPECT_EQ(testCell.pressure, newCell.pressure);
   for (int i = 0; i < Cell::DIM_COUNT; ++i) {
     EXPECT_EQ(testCell.vel[i], newCell.vel[i]);
     EXPECT_EQ(testCell.stagedVel[i], newCell.stagedVel[i]);
@@ -67,7 +64,6 @@ TEST_F(CellTest, Assignment)
 {
   Cell newCell = testCell;
 
-  EXPECT_EQ(testCell.pressure, newCell.pressure);
   for (int i = 0; i < Cell::DIM_COUNT; ++i) {
     EXPECT_EQ(testCell.vel[i], newCell.vel[i]);
     EXPECT_EQ(testCell.stagedVel[i], newCell.stagedVel[i]);
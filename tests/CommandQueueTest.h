@@ -0,0 +1,89 @@
+#ifndef __COMMAND_QUEUE_TEST__
+#define __COMMAND_QUEUE_TEST__
+
+#include <gtest/gtest.h>
+#include <pthread.h>
+#include <vector>
+#include "CommandQueue.h"
+
+TEST(CommandQueueTest, FifoAndFull)
+{
+  // Capacity rounds up to a power of two; a full queue rejects commands
+  // until the consumer frees a slot, and order is kept across the wrap.
+  CommandQueue queue(5);
+  ASSERT_EQ(8u, queue.getCapacity());
+  SolverCommand command;
+  EXPECT_FALSE(queue.pop(command));
+
+  for (unsigned lap = 0; lap < 3; ++lap) {
+    for (unsigned i = 0; i < 8; ++i)
+      ASSERT_TRUE(queue.push(SolverCommand::force(Vector2(i, lap),
+						  Vector2(), 1.0f)));
+    EXPECT_FALSE(queue.push(SolverCommand(SolverCommand::STEP)));
+    for (unsigned i = 0; i < 8; ++i) {
+      ASSERT_TRUE(queue.pop(command));
+      EXPECT_EQ(SolverCommand::ADD_FORCE, command.type);
+      EXPECT_EQ(Vector2(i, lap), command.position);
+    }
+    EXPECT_FALSE(queue.pop(command));
+  }
+}
+
+namespace {
+
+struct Producer {
+  CommandQueue *queue;
+  unsigned      id;
+  unsigned      count;
+};
+
+void * produce(void *arg)
+{
+  // Each command carries its producer and sequence number; a full queue is
+  // retried until the consumer catches up.
+  Producer *producer = static_cast<Producer *>(arg);
+  for (unsigned i = 0; i < producer->count; ++i) {
+    SolverCommand command(SolverCommand::SET_VISCOSITY);
+    command.value = Vector2(producer->id, i);
+    while (!producer->queue->push(command))
+      sched_yield();
+  }
+  return NULL;
+}
+
+} // namespace
+
+TEST(CommandQueueTest, ManyProducers)
+{
+  // Every command from every producer arrives exactly once, and each
+  // producer's commands arrive in the order it pushed them.
+  const unsigned PRODUCERS = 4;
+  const unsigned COUNT = 20000;
+  CommandQueue queue(64);
+  Producer producers[PRODUCERS];
+  pthread_t threads[PRODUCERS];
+  for (unsigned p = 0; p < PRODUCERS; ++p) {
+    producers[p].queue = &queue;
+    producers[p].id = p;
+    producers[p].count = COUNT;
+    pthread_create(&threads[p], NULL, produce, &producers[p]);
+  }
+
+  std::vector<unsigned> next(PRODUCERS, 0);
+  unsigned received = 0;
+  SolverCommand command;
+  while (received < PRODUCERS * COUNT) {
+    if (!queue.pop(command))
+      continue;
+    const unsigned p = command.value.x;
+    ASSERT_LT(p, PRODUCERS);
+    ASSERT_EQ(next[p], unsigned(command.value.y));
+    ++next[p];
+    ++received;
+  }
+  for (unsigned p = 0; p < PRODUCERS; ++p)
+    pthread_join(threads[p], NULL);
+  EXPECT_FALSE(queue.pop(command));
+}
+
+#endif // __COMMAND_QUEUE_TEST__
@@ -0,0 +1,68 @@
+#ifndef __FIELD_MEMORY_TEST__
+#define __FIELD_MEMORY_TEST__
+
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include "FieldMemory.h"
+
+TEST(FieldMemoryTest, Aligned)
+{
+  // Both small blocks and huge-page-mapped blocks are aligned; mapped ones
+  // are also zeroed.
+  const size_t sizes[3] = { 24, 4096 + 8, 3 * FieldMemory::HUGE_PAGE_SIZE + 5 };
+  for (unsigned s = 0; s < 3; ++s) {
+    unsigned char *block =
+      static_cast<unsigned char *>(FieldMemory::allocate(sizes[s]));
+    ASSERT_TRUE(block != NULL);
+    EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(block) % FieldMemory::ALIGNMENT);
+    if (sizes[s] >= FieldMemory::HUGE_PAGE_SIZE) {
+      EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(block) %
+		FieldMemory::HUGE_PAGE_SIZE);
+      EXPECT_EQ(0, block[0]);
+      EXPECT_EQ(0, block[sizes[s] - 1]);
+    }
+    block[sizes[s] - 1] = 1;
+    FieldMemory::release(block, sizes[s]);
+  }
+}
+
+TEST(FieldMemoryTest, ThreadedFirstTouch)
+{
+  // Blocks touched by several threads, with or without huge pages, are
+  // zeroed through to a partial last page.
+  const size_t bytes = 5 * FieldMemory::HUGE_PAGE_SIZE + 4096 + 3;
+  FieldMemory::setFirstTouchThreads(4);
+  for (unsigned huge = 0; huge < 2; ++huge) {
+    FieldMemory::setHugePages(huge != 0);
+    unsigned char *block =
+      static_cast<unsigned char *>(FieldMemory::allocate(bytes));
+    ASSERT_TRUE(block != NULL);
+    unsigned nonzero = 0;
+    for (size_t i = 0; i < bytes; i += 1021)
+      nonzero += block[i] != 0;
+    EXPECT_EQ(0u, nonzero);
+    EXPECT_EQ(0, block[bytes - 1]);
+    FieldMemory::release(block, bytes);
+  }
+  FieldMemory::setHugePages(true);
+  FieldMemory::setFirstTouchThreads(1);
+}
+
+TEST(FieldMemoryTest, Containers)
+{
+  ParticleArray particles;
+  particles.reserve(FieldMemory::HUGE_PAGE_SIZE / sizeof(Vector2));
+  particles.push_back(Vector2(1.0f, 2.0f));
+  ParticleArray copy(particles);
+  EXPECT_EQ(Vector2(1.0f, 2.0f), copy[0]);
+  EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(&particles[0]) %
+	    FieldMemory::ALIGNMENT);
+
+  // A grid big enough for huge pages behaves like any other.
+  Grid grid(200.0f, 200.0f);
+  grid.setPressure(199, 199, 3.0);
+  Grid other(grid);
+  EXPECT_EQ(3.0, other.getPressure(199, 199));
+}
+
+#endif // __FIELD_MEMORY_TEST__
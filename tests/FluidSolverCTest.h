@@ -0,0 +1,92 @@
+#ifndef __FLUID_SOLVER_C_TEST__
+#define __FLUID_SOLVER_C_TEST__
+
+#include <gtest/gtest.h>
+#include <sstream>
+#include "FluidSolverC.h"
+#include "SceneSpec.h"
+
+// Reads element (x, y) of a view the way a C host would.
+template <typename T>
+T viewAt(const fluid_view &view, unsigned x, unsigned y)
+{
+  const char *base = static_cast<const char *>(view.data);
+  return *reinterpret_cast<const T *>(base + y * view.row_stride +
+				      x * view.col_stride);
+}
+
+TEST(FluidSolverCTest, ViewsReadInPlace)
+{
+  char error[128];
+  fluid_solver *solver =
+    fluid_solver_load_scene_text("resolution 16x8\nfill 0.75\n",
+				 error, sizeof(error));
+  ASSERT_TRUE(solver != NULL) << error;
+  EXPECT_EQ(16.0f, fluid_solver_get_width(solver));
+  EXPECT_EQ(8.0f, fluid_solver_get_height(solver));
+  ASSERT_EQ(0, fluid_solver_step(solver, 2));
+
+  // The views walk the same fields as the C++ solver's own accessors.
+  std::istringstream in("resolution 16x8\nfill 0.75\n");
+  SceneSpec scene;
+  ASSERT_TRUE(scene.parse(in));
+  FluidSolver cpp(scene.getWidth(), scene.getHeight());
+  scene.apply(cpp);
+  for (unsigned frame = 0; frame < 2; ++frame) {
+    cpp.advanceFrame();
+    cpp.consumeFrame();
+  }
+  const Grid &grid = cpp.getGrid();
+  fluid_view u, v, p, types;
+  ASSERT_EQ(0, fluid_solver_get_view(solver, FLUID_FIELD_VELOCITY_X, &u));
+  ASSERT_EQ(0, fluid_solver_get_view(solver, FLUID_FIELD_VELOCITY_Y, &v));
+  ASSERT_EQ(0, fluid_solver_get_view(solver, FLUID_FIELD_PRESSURE, &p));
+  ASSERT_EQ(0, fluid_solver_get_view(solver, FLUID_FIELD_CELL_TYPE, &types));
+  EXPECT_EQ(FLUID_FLOAT32, u.type);
+  EXPECT_EQ(FLUID_FLOAT64, p.type);
+  EXPECT_EQ(FLUID_INT32, types.type);
+  ASSERT_EQ(grid.getColCount(), u.cols);
+  ASSERT_EQ(grid.getRowCount(), u.rows);
+  for (unsigned y = 0; y < u.rows; ++y)
+    for (unsigned x = 0; x < u.cols; ++x) {
+      ASSERT_EQ(grid(x, y).vel[Cell::X], viewAt<float>(u, x, y));
+      ASSERT_EQ(grid(x, y).vel[Cell::Y], viewAt<float>(v, x, y));
+      ASSERT_EQ(grid.getPressure(x, y), viewAt<double>(p, x, y));
+      ASSERT_EQ(int(grid(x, y).cellType), viewAt<int>(types, x, y));
+    }
+
+  const ParticleArray &particles = cpp.getParticles();
+  fluid_view px, py;
+  ASSERT_EQ(0, fluid_solver_get_view(solver, FLUID_FIELD_PARTICLE_X, &px));
+  ASSERT_EQ(0, fluid_solver_get_view(solver, FLUID_FIELD_PARTICLE_Y, &py));
+  ASSERT_EQ(particles.size(), fluid_solver_get_particle_count(solver));
+  ASSERT_EQ(particles.size(), px.cols);
+  EXPECT_EQ(1u, px.rows);
+  for (unsigned i = 0; i < particles.size(); ++i) {
+    ASSERT_EQ(particles[i].x, viewAt<float>(px, i, 0));
+    ASSERT_EQ(particles[i].y, viewAt<float>(py, i, 0));
+  }
+
+  fluid_view unknown;
+  EXPECT_EQ(-1, fluid_solver_get_view(solver, fluid_field(99), &unknown));
+  fluid_solver_destroy(solver);
+}
+
+TEST(FluidSolverCTest, SceneErrors)
+{
+  char error[128] = "";
+  EXPECT_TRUE(fluid_solver_load_scene_text("resolution 0\n", error,
+					   sizeof(error)) == NULL);
+  EXPECT_STRNE("", error);
+  EXPECT_TRUE(fluid_solver_load_scene("/nonexistent/scene.txt", NULL, 0) ==
+	      NULL);
+
+  fluid_solver *solver = fluid_solver_create(8.0f, 8.0f);
+  ASSERT_TRUE(solver != NULL);
+  EXPECT_EQ(0, fluid_solver_step(solver, 1));
+  EXPECT_EQ(0, fluid_solver_reset(solver));
+  fluid_solver_destroy(solver);
+  fluid_solver_destroy(NULL);
+}
+
+#endif // __FLUID_SOLVER_C_TEST__
@@ -0,0 +1,481 @@
+#ifndef __FLUID_SOLVER_TEST__
+#define __FLUID_SOLVER_TEST__
+
+#include <gtest/gtest.h>
+#include <cfloat>
+#include <cmath>
+#include <sstream>
+#include <vector>
+#include "Vector2.h"
+#include "Grid.h"
+#include "FluidSolver.h"
+
+// Compares the velocities and cell types of two equally sized grids.
+static bool sameGridState(const Grid &a, const Grid &b)
+{
+  if (a.getRowCount() != b.getRowCount() ||
+      a.getColCount() != b.getColCount())
+    return false;
+  const unsigned size = a.getCellCount();
+  for (unsigned i = 0; i < size; ++i) {
+    if (a[i].cellType != b[i].cellType ||
+	a[i].vel[Cell::X] != b[i].vel[Cell::X] ||
+	a[i].vel[Cell::Y] != b[i].vel[Cell::Y])
+      return false;
+  }
+  return true;
+}
+
+TEST(FluidSolverTest, IndependentInstances)
+{
+  FluidSolver small(4.0f, 4.0f);
+  FluidSolver large(8.0f, 8.0f);
+  FluidSolver reference(8.0f, 8.0f);
+  EXPECT_EQ(4.0f, small.getSimulationWidth());
+  EXPECT_EQ(8.0f, large.getSimulationWidth());
+
+  // Advancing one solver must leave every other instance untouched.
+  small.advanceFrame();
+  EXPECT_TRUE(sameGridState(reference.getGrid(), large.getGrid()));
+  EXPECT_EQ(reference.getParticles().size(), large.getParticles().size());
+  EXPECT_NE(small.getParticles().size(), large.getParticles().size());
+
+  // Resetting one solver restores only that solver's starting state.
+  large.advanceFrame();
+  small.reset();
+  FluidSolver freshSmall(4.0f, 4.0f);
+  EXPECT_TRUE(sameGridState(freshSmall.getGrid(), small.getGrid()));
+  EXPECT_FALSE(sameGridState(reference.getGrid(), large.getGrid()));
+}
+
+TEST(FluidSolverTest, ScalarFieldsSurviveReset)
+{
+  FluidSolver solver(4.0f, 4.0f);
+  unsigned density = solver.addScalarField(0.0f);
+  unsigned temperature = solver.addScalarField(293.0f);
+  EXPECT_EQ(0u, density);
+  EXPECT_EQ(1u, temperature);
+
+  solver.setScalar(2, 2, density, 1.0f);
+  EXPECT_EQ(1.0f, solver.getGrid().getScalar(2, 2, density));
+
+  // Resetting keeps the fields, restoring their initial values.
+  solver.reset();
+  ASSERT_EQ(2u, solver.getGrid().getScalarFieldCount());
+  EXPECT_EQ(0.0f, solver.getGrid().getScalar(2, 2, density));
+  EXPECT_EQ(293.0f, solver.getGrid().getScalar(2, 2, temperature));
+}
+
+TEST(FluidSolverTest, ScalarAdvection)
+{
+  // Dye in the falling fluid stays finite everywhere, border cells
+  // included, and is carried down with the fluid.
+  FluidSolver solver(16.0f, 16.0f);
+  const unsigned dye = solver.addScalarField(0.0f);
+  for (unsigned y = 10; y < 14; ++y)
+    for (unsigned x = 10; x < 14; ++x)
+      solver.setScalar(x, y, dye, 1.0f);
+
+  for (unsigned frame = 0; frame < 20; ++frame) {
+    solver.advanceFrame();
+    solver.consumeFrame();
+  }
+
+  const Grid &grid = solver.getGrid();
+  double total = 0.0, weightedY = 0.0;
+  for (unsigned y = 0; y < grid.getRowCount(); ++y)
+    for (unsigned x = 0; x < grid.getColCount(); ++x) {
+      const float value = grid.getScalar(x, y, dye);
+      ASSERT_TRUE(value == value && std::fabs(value) <= FLT_MAX)
+	<< "cell " << x << ", " << y;
+      if (x + 1 < grid.getColCount() && y + 1 < grid.getRowCount()) {
+	total += value;
+	weightedY += value * (y + 0.5);
+      }
+    }
+  ASSERT_GT(total, 0.0);
+  EXPECT_LT(weightedY / total, 11.0);
+}
+
+// Sums the squared face velocities of every cell in a grid.
+static double kineticEnergy(const Grid &grid)
+{
+  double energy = 0.0;
+  const unsigned size = grid.getCellCount();
+  for (unsigned i = 0; i < size; ++i)
+    energy += grid[i].vel[Cell::X] * grid[i].vel[Cell::X] +
+              grid[i].vel[Cell::Y] * grid[i].vel[Cell::Y];
+  return energy;
+}
+
+TEST(FluidSolverTest, ImplicitViscosity)
+{
+  FluidSolver inviscid(8.0f, 8.0f);
+  FluidSolver viscous(8.0f, 8.0f);
+  FluidSolver honey(8.0f, 8.0f);
+  viscous.setViscosity(1.0f);
+  honey.setViscosity(1000.0f);
+
+  for (unsigned frame = 0; frame < 4; ++frame) {
+    inviscid.advanceFrame();
+    inviscid.consumeFrame();
+    viscous.advanceFrame();
+    viscous.consumeFrame();
+    honey.advanceFrame();
+    honey.consumeFrame();
+  }
+
+  // Viscosity dissipates energy, and remains stable when very large.
+  double inviscidEnergy = kineticEnergy(inviscid.getGrid());
+  double viscousEnergy = kineticEnergy(viscous.getGrid());
+  double honeyEnergy = kineticEnergy(honey.getGrid());
+  EXPECT_LT(viscousEnergy, inviscidEnergy);
+  EXPECT_LT(honeyEnergy, viscousEnergy);
+  EXPECT_TRUE(honeyEnergy == honeyEnergy);  // Not NaN.
+}
+
+TEST(FluidSolverTest, EmittersReuseParticleStorage)
+{
+  FluidSolver solver(8.0f, 8.0f);
+  solver.setInitialFill(0.0f);
+  solver.setParticleCapacity(500);
+  solver.addEmitter(Vector2(1.0f, 5.0f), Vector2(3.0f, 7.0f),
+		    Vector2(1.0f, 0.0f), 900.0f);
+  solver.addSink(Vector2(0.0f, 0.0f), Vector2(8.0f, 2.0f));
+  solver.reset();
+  ASSERT_EQ(0u, solver.getParticles().size());
+  ASSERT_EQ(500u, solver.getParticleCapacity());
+  const Vector2 *storage = solver.getParticles().data();
+
+  // 900 particles/sec at 30 frames/sec adds 30 particles per frame.
+  solver.advanceFrame();
+  solver.consumeFrame();
+  EXPECT_EQ(30u, solver.getParticles().size());
+
+  // Emission stops once the reserved storage is full, and the storage is
+  // never reallocated.
+  for (unsigned frame = 0; frame < 30; ++frame) {
+    solver.advanceFrame();
+    solver.consumeFrame();
+    ASSERT_EQ(storage, solver.getParticles().data());
+    ASSERT_LE(solver.getParticles().size(), 500u);
+  }
+  EXPECT_EQ(500u, solver.getParticleCapacity());
+
+  // No particles survive inside the sink.
+  const ParticleArray &particles = solver.getParticles();
+  for (unsigned i = 0; i < particles.size(); ++i)
+    EXPECT_FALSE(particles[i].y >= 0.0f && particles[i].y < 2.0f &&
+		 particles[i].x >= 0.0f && particles[i].x < 8.0f);
+}
+
+TEST(FluidSolverTest, DefaultParticleCapacity)
+{
+  // Without a requested capacity, storage is reserved for the seeded
+  // particles plus a second of emission, and emitters fill exactly that.
+  FluidSolver solver(8.0f, 8.0f);
+  solver.setInitialFill(0.5f);
+  solver.addEmitter(Vector2(1.0f, 1.0f), Vector2(7.0f, 7.0f),
+		    Vector2(0.0f, 0.0f), 1800.0f);
+  solver.reset();
+  ASSERT_EQ(256u, solver.getParticles().size());
+  ASSERT_EQ(256u + 1800u, solver.getParticleCapacity());
+  const Vector2 *storage = solver.getParticles().data();
+
+  for (unsigned frame = 0; frame < 40; ++frame) {
+    solver.advanceFrame();
+    solver.consumeFrame();
+  }
+  EXPECT_EQ(256u + 1800u, solver.getParticles().size());
+  EXPECT_EQ(storage, solver.getParticles().data());
+
+  // Without emitters, only the seeded particles are reserved for.
+  FluidSolver plain(8.0f, 8.0f);
+  EXPECT_EQ(256u, plain.getParticleCapacity());
+}
+
+TEST(FluidSolverTest, PeriodicEmitter)
+{
+  // An emitter in the last column of a domain that wraps along X pushes
+  // through the face it shares with the first column.
+  FluidSolver solver(8.0f, 8.0f);
+  solver.setInitialFill(0.0f);
+  solver.setPeriodic(Cell::X, true);
+  solver.setGravity(Vector2(0.0f, 0.0f));
+  solver.addEmitter(Vector2(7.0f, 2.0f), Vector2(8.0f, 6.0f),
+		    Vector2(3.0f, 0.0f), 300.0f);
+  solver.reset();
+  solver.advanceFrame();
+  solver.consumeFrame();
+
+  const Grid &grid = solver.getGrid();
+  for (unsigned y = 2; y < 6; ++y) {
+    EXPECT_FLOAT_EQ(3.0f, grid(7, y).vel[Cell::X]) << "row " << y;
+    EXPECT_FLOAT_EQ(3.0f, grid(0, y).vel[Cell::X]) << "row " << y;
+    EXPECT_EQ(grid(0, y).vel[Cell::X], grid(8, y).vel[Cell::X]);
+  }
+}
+
+// Counts the FLUID cells of a grid.
+static unsigned fluidCellCount(const Grid &grid)
+{
+  unsigned count = 0;
+  for (unsigned i = 0; i < grid.getCellCount(); ++i)
+    count += grid[i].cellType == Cell::FLUID;
+  return count;
+}
+
+TEST(FluidSolverTest, Resample)
+{
+  // Doubling the resolution splits every particle in four, and the fluid
+  // covers the same region with four cells for each.
+  FluidSolver fresh(8.0f, 8.0f);
+  const unsigned particleCount = fresh.getParticles().size();
+  const unsigned fluidCount = fluidCellCount(fresh.getGrid());
+  fresh.resample(16.0f, 16.0f);
+  EXPECT_EQ(16.0f, fresh.getSimulationWidth());
+  EXPECT_EQ(17u, fresh.getGrid().getColCount());
+  EXPECT_EQ(4 * particleCount, fresh.getParticles().size());
+  EXPECT_EQ(4 * fluidCount, fluidCellCount(fresh.getGrid()));
+
+  // Every face of the new grid samples the old grid at the same point of
+  // the world, in the new grid's cells per second.
+  FluidSolver solver(8.0f, 8.0f);
+  unsigned dye = solver.addScalarField(0.0f);
+  solver.reset();
+  solver.setScalar(6, 6, dye, 1.0f);
+  solver.advanceFrame();
+  solver.consumeFrame();
+  const Grid before(solver.getGrid());
+  solver.resample(16.0f, 16.0f);
+  const Grid &after = solver.getGrid();
+  EXPECT_FLOAT_EQ(2.0f * before.getVelocity(Vector2(3.0f, 5.75f)).x,
+		  after(6, 11).vel[Cell::X]);
+  EXPECT_FLOAT_EQ(2.0f * before.getVelocity(Vector2(5.75f, 3.0f)).y,
+		  after(11, 6).vel[Cell::Y]);
+  float dyeBefore;
+  before.sampleScalars(Vector2(6.25f, 6.25f), &dyeBefore);
+  EXPECT_FLOAT_EQ(dyeBefore, after.getScalar(12, 12, dye));
+
+  // The simulation carries on at the new resolution.
+  solver.advanceFrame();
+  solver.consumeFrame();
+  const double energy = kineticEnergy(solver.getGrid());
+  EXPECT_TRUE(energy == energy);  // Not NaN.
+}
+
+TEST(FluidSolverTest, PeriodicBoundaries)
+{
+  // Fluid pushed to the right in a domain that wraps along X re-enters
+  // from the left, and no particles are lost.
+  FluidSolver solver(16.0f, 8.0f);
+  solver.setPeriodic(Cell::X, true);
+  solver.setGravity(Vector2(40.0f, -9.8f));
+  solver.reset();
+  EXPECT_TRUE(solver.isPeriodic(Cell::X));
+  EXPECT_FALSE(solver.isPeriodic(Cell::Y));
+  const unsigned particleCount = solver.getParticles().size();
+
+  for (unsigned frame = 0; frame < 15; ++frame) {
+    solver.advanceFrame();
+    solver.consumeFrame();
+  }
+
+  const ParticleArray &particles = solver.getParticles();
+  ASSERT_EQ(particleCount, particles.size());
+  unsigned wrapped = 0;
+  for (unsigned i = 0; i < particles.size(); ++i) {
+    ASSERT_TRUE(particles[i].x >= 0.0f && particles[i].x < 16.0f);
+    ASSERT_TRUE(particles[i].y >= 0.0f && particles[i].y <= 8.0f);
+    wrapped += particles[i].x < 4.0f;
+  }
+  EXPECT_GT(wrapped, 0u);
+  const double energy = kineticEnergy(solver.getGrid());
+  EXPECT_TRUE(energy == energy);  // Not NaN.
+}
+
+TEST(FluidSolverTest, OutflowBoundary)
+{
+  // Fluid pushed to the right through an open side leaves the domain, and
+  // its particles are removed rather than piling up against the side.
+  FluidSolver solver(16.0f, 8.0f);
+  solver.setBoundary(FluidSolver::RIGHT, FluidSolver::OUTFLOW);
+  solver.setGravity(Vector2(40.0f, -9.8f));
+  solver.reset();
+  EXPECT_EQ(FluidSolver::OUTFLOW, solver.getBoundary(FluidSolver::RIGHT));
+  EXPECT_EQ(FluidSolver::WALL, solver.getBoundary(FluidSolver::LEFT));
+  const unsigned particleCount = solver.getParticles().size();
+
+  for (unsigned frame = 0; frame < 15; ++frame) {
+    solver.advanceFrame();
+    solver.consumeFrame();
+  }
+
+  const ParticleArray &particles = solver.getParticles();
+  EXPECT_LT(particles.size(), particleCount);
+  for (unsigned i = 0; i < particles.size(); ++i)
+    ASSERT_LT(particles[i].x, 16.0f);
+  const double energy = kineticEnergy(solver.getGrid());
+  EXPECT_TRUE(energy == energy);  // Not NaN.
+}
+
+TEST(FluidSolverTest, InflowBoundary)
+{
+  // An INFLOW side fills an empty domain, holding its velocity on the
+  // side's faces.
+  FluidSolver solver(16.0f, 8.0f);
+  solver.setInitialFill(0.0f);
+  solver.setParticleCapacity(4000);
+  solver.setBoundary(FluidSolver::LEFT, FluidSolver::INFLOW,
+		     Vector2(10.0f, 0.0f));
+  solver.setBoundary(FluidSolver::RIGHT, FluidSolver::OUTFLOW);
+  solver.setGravity(Vector2(0.0f, 0.0f));
+  solver.reset();
+  ASSERT_EQ(0u, solver.getParticles().size());
+
+  for (unsigned frame = 0; frame < 15; ++frame) {
+    solver.advanceFrame();
+    solver.consumeFrame();
+  }
+
+  const ParticleArray &particles = solver.getParticles();
+  EXPECT_GT(particles.size(), 0u);
+  unsigned downstream = 0;
+  for (unsigned i = 0; i < particles.size(); ++i)
+    downstream += particles[i].x > 4.0f;
+  EXPECT_GT(downstream, 0u);
+  EXPECT_FLOAT_EQ(10.0f, solver.getGrid()(0, 0).vel[Cell::X]);
+}
+
+TEST(FluidSolverTest, Commands)
+{
+  // Commands queued from outside take effect at the next timestep: a
+  // paused solver only advances a frame per STEP, and a force changes the
+  // flow relative to an identical solver left alone.
+  FluidSolver solver(16.0f, 16.0f);
+  FluidSolver reference(16.0f, 16.0f);
+  CommandQueue &commands = solver.getCommandQueue();
+  commands.push(SolverCommand(SolverCommand::PAUSE));
+  solver.advanceFrame();
+  EXPECT_TRUE(solver.isPaused());
+  EXPECT_TRUE(sameGridState(reference.getGrid(), solver.getGrid()));
+
+  commands.push(SolverCommand(SolverCommand::STEP));
+  solver.advanceFrame();
+  solver.consumeFrame();
+  reference.advanceFrame();
+  reference.consumeFrame();
+  EXPECT_TRUE(sameGridState(reference.getGrid(), solver.getGrid()));
+  solver.advanceFrame();
+  solver.consumeFrame();
+  EXPECT_TRUE(sameGridState(reference.getGrid(), solver.getGrid()));
+
+  commands.push(SolverCommand::force(Vector2(12.0f, 12.0f),
+				     Vector2(-30.0f, 0.0f), 3.0f));
+  commands.push(SolverCommand::force(Vector2(14.0f, 10.0f),
+				     Vector2(0.0f, 30.0f), 2.0f));
+  commands.push(SolverCommand(SolverCommand::RESUME));
+  solver.advanceFrame();
+  solver.consumeFrame();
+  reference.advanceFrame();
+  reference.consumeFrame();
+  EXPECT_FALSE(solver.isPaused());
+  EXPECT_FALSE(sameGridState(reference.getGrid(), solver.getGrid()));
+  const double energy = kineticEnergy(solver.getGrid());
+  EXPECT_TRUE(energy == energy);  // Not NaN.
+
+  // A queued reset restarts the simulation before the next timestep.
+  commands.push(SolverCommand(SolverCommand::RESET));
+  FluidSolver fresh(16.0f, 16.0f);
+  solver.advanceFrame();
+  fresh.advanceFrame();
+  EXPECT_TRUE(sameGridState(fresh.getGrid(), solver.getGrid()));
+}
+
+TEST(FluidSolverTest, Preconditioners)
+{
+  // Both preconditioners solve the same systems, so the simulations only
+  // part by the solver's tolerance.
+  FluidSolver diagonal(16.0f, 16.0f);
+  FluidSolver cholesky(16.0f, 16.0f);
+  diagonal.setViscosity(0.5f);
+  cholesky.setViscosity(0.5f);
+  EXPECT_EQ(FluidSolver::DIAGONAL, diagonal.getPreconditioner());
+  cholesky.setPreconditioner(FluidSolver::INCOMPLETE_CHOLESKY);
+  EXPECT_EQ(FluidSolver::INCOMPLETE_CHOLESKY, cholesky.getPreconditioner());
+  for (unsigned frame = 0; frame < 3; ++frame) {
+    diagonal.advanceFrame();
+    diagonal.consumeFrame();
+    cholesky.advanceFrame();
+    cholesky.consumeFrame();
+  }
+
+  const ParticleArray &a = diagonal.getParticles();
+  const ParticleArray &b = cholesky.getParticles();
+  ASSERT_EQ(a.size(), b.size());
+  for (unsigned i = 0; i < a.size(); ++i) {
+    EXPECT_NEAR(a[i].x, b[i].x, 1e-3f);
+    EXPECT_NEAR(a[i].y, b[i].y, 1e-3f);
+  }
+}
+
+// Sets up a solver with an emitter, a sink and a scalar field.
+static void setUpCheckpointScene(FluidSolver &solver)
+{
+  solver.addScalarField(1.0f);
+  solver.addEmitter(Vector2(1.0f, 10.0f), Vector2(3.0f, 12.0f),
+		    Vector2(4.0f, 0.0f), 300.0f);
+  solver.addSink(Vector2(13.0f, 0.0f), Vector2(16.0f, 2.0f));
+  solver.setViscosity(0.2f);
+  solver.reset();
+}
+
+TEST(FluidSolverTest, Checkpoint)
+{
+  // A solver restored from a checkpoint continues exactly as the original.
+  FluidSolver original(16.0f, 16.0f);
+  setUpCheckpointScene(original);
+  for (unsigned frame = 0; frame < 4; ++frame) {
+    original.advanceFrame();
+    original.consumeFrame();
+  }
+  std::stringstream checkpoint;
+  ASSERT_TRUE(original.writeCheckpoint(checkpoint));
+
+  FluidSolver restored(16.0f, 16.0f);
+  setUpCheckpointScene(restored);
+  ASSERT_TRUE(restored.readCheckpoint(checkpoint));
+  for (unsigned frame = 0; frame < 4; ++frame) {
+    original.advanceFrame();
+    original.consumeFrame();
+    restored.advanceFrame();
+    restored.consumeFrame();
+  }
+  EXPECT_TRUE(sameGridState(original.getGrid(), restored.getGrid()));
+  ASSERT_EQ(original.getParticles().size(), restored.getParticles().size());
+  for (unsigned i = 0; i < original.getParticles().size(); ++i) {
+    EXPECT_EQ(original.getParticles()[i].x, restored.getParticles()[i].x);
+    EXPECT_EQ(original.getParticles()[i].y, restored.getParticles()[i].y);
+  }
+  for (unsigned y = 0; y < 16; ++y)
+    for (unsigned x = 0; x < 16; ++x)
+      EXPECT_EQ(original.getGrid().getScalar(x, y, 0),
+		restored.getGrid().getScalar(x, y, 0));
+
+  // Checkpoints of differently set up solvers, and truncated ones, are
+  // rejected without touching the solver.
+  std::stringstream full;
+  ASSERT_TRUE(original.writeCheckpoint(full));
+  FluidSolver other(16.0f, 8.0f);
+  setUpCheckpointScene(other);
+  FluidSolver fresh(16.0f, 8.0f);
+  setUpCheckpointScene(fresh);
+  EXPECT_FALSE(other.readCheckpoint(full));
+  const std::string bytes = full.str();
+  std::stringstream truncated(bytes.substr(0, bytes.size() / 2));
+  EXPECT_FALSE(restored.readCheckpoint(truncated));
+  EXPECT_TRUE(sameGridState(fresh.getGrid(), other.getGrid()));
+  EXPECT_TRUE(sameGridState(original.getGrid(), restored.getGrid()));
+}
+
+#endif // __FLUID_SOLVER_TEST__
@@ -0,0 +1,141 @@
+#ifndef __FRAME_SERVER_TEST__
+#define __FRAME_SERVER_TEST__
+
+#include <gtest/gtest.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "FluidSolver.h"
+#include "FrameServer.h"
+#include "FrameSnapshot.h"
+
+// Connects to a Unix socket, returning the descriptor or -1.
+static int connectUnix(const std::string &path)
+{
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, path.c_str());
+  if (connect(fd, reinterpret_cast<struct sockaddr *>(&address),
+	      sizeof(address)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Reads exactly count bytes, returning false if the stream ended first.
+static bool readFully(int fd, char *data, unsigned count)
+{
+  while (count > 0) {
+    ssize_t received = recv(fd, data, count, 0);
+    if (received <= 0)
+      return false;
+    data += received;
+    count -= received;
+  }
+  return true;
+}
+
+// Reads one snapshot from a viewer's socket.
+static bool readSnapshot(int fd, std::vector<char> &snapshot)
+{
+  snapshot.resize(sizeof(FrameSnapshot::Header));
+  if (!readFully(fd, &snapshot[0], snapshot.size()))
+    return false;
+  FrameSnapshot::Header header;
+  memcpy(&header, &snapshot[0], sizeof(header));
+  if (header.magic != FrameSnapshot::MAGIC || header.size < sizeof(header))
+    return false;
+  snapshot.resize(header.size);
+  return readFully(fd, &snapshot[sizeof(header)], header.size - sizeof(header));
+}
+
+TEST(FrameServerTest, SnapshotLayout)
+{
+  // Particles are quantized over the domain, and each block of cells keeps
+  // its fluid fraction and center velocity.
+  FluidSolver solver(16.0f, 8.0f);
+  FrameSnapshot snapshot;
+  snapshot.encode(solver.getGrid(), solver.getParticles(), 7, 4);
+  const FrameSnapshot::Header &header = snapshot.getHeader();
+  const ParticleArray &particles = solver.getParticles();
+  EXPECT_EQ(FrameSnapshot::MAGIC, header.magic);
+  EXPECT_EQ(7u, header.frame);
+  EXPECT_EQ(snapshot.getSize(), header.size);
+  EXPECT_EQ(particles.size(), header.particleCount);
+  EXPECT_EQ(4u, header.fieldCols);
+  EXPECT_EQ(2u, header.fieldRows);
+  EXPECT_EQ(sizeof(header) + 4 * particles.size() + 3 * 8, header.size);
+
+  const uint16_t *quantized = FrameSnapshot::getParticles(snapshot.getData());
+  for (unsigned i = 0; i < particles.size(); ++i) {
+    EXPECT_NEAR(particles[i].x, quantized[2 * i] * 16.0f / 65535.0f, 1e-3f);
+    EXPECT_NEAR(particles[i].y, quantized[2 * i + 1] * 8.0f / 65535.0f, 1e-3f);
+  }
+
+  // reset() fills the top right quarter.
+  const uint8_t *fluid = FrameSnapshot::getFluid(snapshot.getData());
+  EXPECT_EQ(0, fluid[0]);
+  EXPECT_EQ(255, fluid[7]);
+  EXPECT_EQ(0, fluid[4]);
+  const int8_t *velocities = FrameSnapshot::getVelocities(snapshot.getData());
+  EXPECT_EQ(velocities + 16, reinterpret_cast<const int8_t *>
+	    (snapshot.getData() + snapshot.getSize()));
+}
+
+TEST(FrameServerTest, StreamsToViewers)
+{
+  std::ostringstream path;
+  path << "/tmp/fluid-frames-test-" << getpid();
+  FrameServer server;
+  ASSERT_TRUE(server.listenUnix(path.str()));
+  // Each frame is larger than a socket's buffer, so the stalled viewer
+  // soon stops accepting data.
+  FluidSolver solver(96.0f, 96.0f);
+
+  // Nothing is encoded until a viewer connects.
+  EXPECT_FALSE(server.publish(solver));
+  int fast = connectUnix(path.str());
+  int stalled = connectUnix(path.str());
+  ASSERT_GE(fast, 0);
+  ASSERT_GE(stalled, 0);
+  while (server.getClientCount() < 2)
+    usleep(1000);
+
+  // A viewer that never reads must not hold up publishing, nor the viewer
+  // that keeps up, which always sees newer frames, whole.
+  std::vector<char> snapshot;
+  unsigned lastFrame = 0;
+  for (unsigned frame = 0; frame < 20; ++frame) {
+    solver.advanceFrame();
+    solver.consumeFrame();
+    server.publish(solver);
+    ASSERT_TRUE(readSnapshot(fast, snapshot));
+    FrameSnapshot::Header header;
+    memcpy(&header, &snapshot[0], sizeof(header));
+    EXPECT_EQ(solver.getParticles().size(), header.particleCount);
+    if (frame > 0) {
+      EXPECT_GT(header.frame, lastFrame);
+    }
+    lastFrame = header.frame;
+  }
+
+  // Disconnected viewers are noticed.
+  close(fast);
+  close(stalled);
+  while (server.getClientCount() > 0) {
+    server.publish(solver);
+    usleep(1000);
+  }
+  server.close();
+  EXPECT_FALSE(server.isOpen());
+  EXPECT_NE(0, access(path.str().c_str(), F_OK));
+}
+
+#endif // __FRAME_SERVER_TEST__
@@ -34,7 +34,7 @@ protected:
     for (unsigned y = 0; y < testGrid.getRowCount(); ++y) {
       for (unsigned x = 0; x < testGrid.getColCount(); ++x) {
 	testGrid(x, y).cellType = Cell::FLUID;
-	testGrid(x, y).pressure = 1.0f;
+	testGrid.setPressure(x, y, 1.0);
 	testGrid(x, y).vel[Cell::X] = static_cast<float>(x);
 	testGrid(x, y).vel[Cell::Y] = static_cast<float>(y);
       }
@@ -59,7 +59,6 @@ protected:
   {
     bool result = true;
     result = result &&
-      (a.pressure == b.pressure) &&
       (a.cellType == b.cellType) &&
       (a.allNeighbors == b.allNeighbors);
     for (int i = 0; i < Cell::DIM_COUNT; ++i) {
@@ -102,6 +101,7 @@ TEST_F(GridTest, CopyConstructor)
   for (unsigned i = 0; i < size; ++i) {
     EXPECT_TRUE(sameCellData(testGrid[i], copyGrid[i]));
   }
+  EXPECT_EQ(1.0, copyGrid.getPressure(1, 2));
 }
 
 TEST_F(GridTest, Assignment)
@@ -113,16 +113,32 @@ TEST_F(GridTest, Assignment)
   for (unsigned i = 0; i < size; ++i) {
     EXPECT_TRUE(sameCellData(testGrid[i], assignGrid[i]));
   }
+  EXPECT_EQ(1.0, assignGrid.getPressure(1, 2));
 }
 
 TEST_F(GridTest, Accessors)
 {
   const unsigned x = 2;
   const unsigned y = 1;
-  const unsigned i = testGrid.getColCount() * y + x;
+  const unsigned i = testGrid.getRowStride() * y + x;
   EXPECT_EQ(&testGrid[i], &testGrid(x, y));
 }
 
+TEST(GridLayoutTest, RowsStartOnCacheLines)
+{
+  // A 10 column grid pads each row out to 16 cells, so that every row of
+  // cells and of pressures starts on a 64 byte line.
+  Grid grid(9.0f, 3.0f);
+  ASSERT_EQ(10u, grid.getColCount());
+  EXPECT_EQ(16u, grid.getRowStride());
+  EXPECT_EQ(grid.getRowCount() * 16u, grid.getCellCount());
+  for (unsigned y = 0; y < grid.getRowCount(); ++y) {
+    EXPECT_EQ(0u, reinterpret_cast<size_t>(&grid(0, y)) % 64);
+    EXPECT_EQ(0u, reinterpret_cast<size_t>(grid.getPressureData() +
+					   y * grid.getRowStride()) % 64);
+  }
+}
+
 TEST_F(GridTest, SetCellLinkage)
 {
   unsigned x, y;
@@ -208,6 +224,25 @@ TEST_F(GridTest, GetVelocity)
   EXPECT_EQ(Vector2(1.5f, 1.5f), edgeTestGrid.getVelocity(Vector2(3.0f, 3.0f)));
 }
 
+TEST_F(GridTest, GetVelocityBatch)
+{
+  // Batched sampling must agree with scalar sampling, including clamping.
+  const Vector2 samples[8] = {
+    Vector2(0.0f, 0.0f), Vector2(1.5f, 1.0f), Vector2(1.0f, 1.5f),
+    Vector2(2.5f, 3.0f), Vector2(3.0f, 3.0f), Vector2(-5.0f, -5.0f),
+    Vector2(100.0f, 100.0f), Vector2(0.3f, 2.7f)
+  };
+  Vector2x8 positions, velocities;
+  positions.load(samples);
+  testGrid.getVelocity(positions, velocities);
+  for (unsigned i = 0; i < 8; ++i)
+    EXPECT_EQ(testGrid.getVelocity(samples[i]), velocities.get(i));
+
+  edgeTestGrid.getVelocity(positions, velocities);
+  for (unsigned i = 0; i < 8; ++i)
+    EXPECT_EQ(edgeTestGrid.getVelocity(samples[i]), velocities.get(i));
+}
+
 TEST_F(GridTest, GetMaxVelocity)
 {
   // Fetch maximum velocity from testGrid.
@@ -228,4 +263,85 @@ TEST_F(GridTest, GetVelocityDivergence)
   EXPECT_EQ(-6.0f, testGrid.getVelocityDivergence(3, 3));
 }
 
+TEST_F(GridTest, ScalarFields)
+{
+  // Two fields: one holding x + 10y per cell, one constant.
+  EXPECT_EQ(0u, testGrid.getScalarFieldCount());
+  EXPECT_EQ(0u, testGrid.addScalarField(0.0f));
+  EXPECT_EQ(1u, testGrid.addScalarField(5.0f));
+  ASSERT_EQ(2u, testGrid.getScalarFieldCount());
+  for (unsigned y = 0; y < testGrid.getRowCount(); ++y)
+    for (unsigned x = 0; x < testGrid.getColCount(); ++x) {
+      EXPECT_EQ(5.0f, testGrid.getScalar(x, y, 1));
+      testGrid.setScalar(x, y, 0, x + 10.0f * y);
+    }
+  EXPECT_EQ(21.0f, testGrid.getScalar(1, 2, 0));
+
+  // Sampling at a cell center returns that cell's values.
+  float values[2];
+  testGrid.sampleScalars(Vector2(1.5f, 2.5f), values);
+  EXPECT_EQ(21.0f, values[0]);
+  EXPECT_EQ(5.0f, values[1]);
+
+  // Between centers, every field is interpolated with the same weights.
+  testGrid.sampleScalars(Vector2(1.75f, 1.0f), values);
+  EXPECT_FLOAT_EQ(6.25f, values[0]);
+  EXPECT_FLOAT_EQ(5.0f, values[1]);
+
+  // Positions outside the grid clamp to the nearest cell center.
+  testGrid.sampleScalars(Vector2(-5.0f, 100.0f), values);
+  EXPECT_EQ(30.0f, values[0]);
+
+  // Adding a field preserves existing values.
+  testGrid.addScalarField(-1.0f);
+  EXPECT_EQ(21.0f, testGrid.getScalar(1, 2, 0));
+  EXPECT_EQ(5.0f, testGrid.getScalar(1, 2, 1));
+  EXPECT_EQ(-1.0f, testGrid.getScalar(1, 2, 2));
+
+  // Staged values become current once committed, and copies keep fields.
+  for (unsigned y = 0; y < testGrid.getRowCount(); ++y)
+    for (unsigned x = 0; x < testGrid.getColCount(); ++x)
+      for (unsigned f = 0; f < 3; ++f)
+	testGrid.getStagedScalars(x, y)[f] = 7.0f;
+  testGrid.commitStagedScalars();
+  Grid copyGrid(testGrid);
+  EXPECT_EQ(3u, copyGrid.getScalarFieldCount());
+  EXPECT_EQ(7.0f, copyGrid.getScalar(2, 3, 1));
+}
+
+TEST(GridPeriodicTest, WrapsSampling)
+{
+  // Four columns of X velocity 1, 2, 3, 4, periodic along X only.
+  Grid grid(4.0f, 4.0f);
+  for (unsigned y = 0; y < grid.getRowCount(); ++y)
+    for (unsigned x = 0; x < 4; ++x) {
+      grid(x, y).vel[Cell::X] = x + 1.0f;
+      grid(x, y).vel[Cell::Y] = x + 1.0f;
+    }
+  grid.setPeriodic(Cell::X, true);
+  EXPECT_TRUE(grid.isPeriodic(Cell::X));
+  EXPECT_FALSE(grid.isPeriodic(Cell::Y));
+  EXPECT_EQ(1.0f, grid(4, 2).vel[Cell::X]);
+
+  // Between the last face and the first, and the same point one period
+  // over.  The Y component is sampled between the last and first centers.
+  EXPECT_FLOAT_EQ(2.5f, grid.getVelocity(Vector2(3.5f, 1.5f)).x);
+  EXPECT_FLOAT_EQ(2.5f, grid.getVelocity(Vector2(-0.5f, 1.5f)).x);
+  EXPECT_FLOAT_EQ(2.5f, grid.getVelocity(Vector2(7.5f, 1.5f)).x);
+  EXPECT_FLOAT_EQ(2.5f, grid.getVelocity(Vector2(0.0f, 2.0f)).y);
+  EXPECT_FLOAT_EQ(1.0f, grid.getVelocity(Vector2(0.5f, 2.0f)).y);
+
+  // Batched sampling wraps the same way.
+  const Vector2 samples[8] = {
+    Vector2(3.5f, 1.5f), Vector2(-0.5f, 1.5f), Vector2(7.5f, 1.5f),
+    Vector2(0.0f, 2.0f), Vector2(0.2f, 3.9f), Vector2(-5.0f, -5.0f),
+    Vector2(100.0f, 100.0f), Vector2(3.99f, 0.1f)
+  };
+  Vector2x8 positions, velocities;
+  positions.load(samples);
+  grid.getVelocity(positions, velocities);
+  for (unsigned i = 0; i < 8; ++i)
+    EXPECT_EQ(grid.getVelocity(samples[i]), velocities.get(i));
+}
+
 #endif // __GRID_TEST__
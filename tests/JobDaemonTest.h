@@ -0,0 +1,192 @@
+#ifndef __JOB_DAEMON_TEST__
+#define __JOB_DAEMON_TEST__
+
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include "JobDaemon.h"
+#include "JobSpec.h"
+
+// Reads a whole text file, returning an empty string if it doesn't exist.
+static std::string readJobFile(const std::string &path)
+{
+  std::ifstream in(path.c_str());
+  return std::string(std::istreambuf_iterator<char>(in),
+		     std::istreambuf_iterator<char>());
+}
+
+// Submits a job the way users should: written under a hidden name, then
+// renamed into the spool directory.
+static void submitJob(const std::string &spool, const std::string &name,
+		      const std::string &description)
+{
+  const std::string hidden = spool + "/." + name + ".job";
+  {
+    std::ofstream out(hidden.c_str());
+    out << description;
+  }
+  rename(hidden.c_str(), (spool + "/" + name + ".job").c_str());
+}
+
+// Formats a job description.
+static std::string jobText(unsigned resolution, unsigned frames, int priority,
+			   const std::string &output)
+{
+  std::ostringstream text;
+  text << "resolution " << resolution << "\nframes " << frames
+       << "\npriority " << priority << "\noutput " << output << "\n";
+  return text.str();
+}
+
+// Polls a daemon until every job is done, or about a minute has passed.
+static bool waitForIdle(JobDaemon &daemon)
+{
+  for (unsigned i = 0; i < 6000; ++i) {
+    daemon.poll();
+    if (daemon.isIdle())
+      return true;
+    usleep(10000);
+  }
+  return false;
+}
+
+// Removes a spool directory created by a test.
+static void removeSpool(const std::string &spool)
+{
+  std::string command = "rm -rf '" + spool + "'";
+  EXPECT_EQ(0, system(command.c_str()));
+}
+
+TEST(JobDaemonTest, ParsesJobs)
+{
+  JobSpec spec;
+  std::istringstream job("# A job.\n"
+			 "resolution 24x12\n"
+			 "frames 7\n"
+			 "output out.txt  # Where frames go.\n"
+			 "priority -2\n");
+  ASSERT_TRUE(spec.parse(job)) << spec.getError();
+  EXPECT_EQ(24.0f, spec.getWidth());
+  EXPECT_EQ(12.0f, spec.getHeight());
+  EXPECT_EQ(7u, spec.getFrames());
+  EXPECT_EQ("out.txt", spec.getOutput());
+  EXPECT_EQ(-2, spec.getPriority());
+
+  // The scene's size applies unless a resolution is given.
+  std::istringstream defaults("output out.txt\n");
+  ASSERT_TRUE(spec.parse(defaults));
+  EXPECT_EQ(spec.getScene().getWidth(), spec.getWidth());
+  EXPECT_EQ(0, spec.getPriority());
+
+  const char *invalid[] = {
+    "frames 10\n",                         // No output.
+    "output a.txt\nframes -1\n",
+    "output a.txt\npriority high\n",
+    "output a.txt\nresolution 0\n",
+    "output a.txt\noutput b.txt c.txt\n",
+    "output a.txt\nscene /nonexistent/scene\n",
+    "output a.txt\nspeed 2\n"
+  };
+  for (unsigned i = 0; i < sizeof(invalid) / sizeof(invalid[0]); ++i) {
+    std::istringstream in(invalid[i]);
+    EXPECT_FALSE(spec.parse(in)) << invalid[i];
+    EXPECT_FALSE(spec.getError().empty());
+  }
+  EXPECT_EQ("out.txt", spec.getOutput());
+}
+
+TEST(JobDaemonTest, RunsPreemptsAndResumes)
+{
+  char base[] = "/tmp/job-daemon-test-XXXXXX";
+  ASSERT_TRUE(mkdtemp(base) != NULL);
+  const std::string dir = base;
+
+  // Reference outputs, from a daemon left alone.
+  {
+    JobDaemon daemon(dir + "/reference", 2);
+    ASSERT_TRUE(daemon.start()) << daemon.getError();
+    submitJob(dir + "/reference", "low",
+	      jobText(16, 300, 0, dir + "/reference-low.txt"));
+    submitJob(dir + "/reference", "high",
+	      jobText(12, 20, 5, dir + "/reference-high.txt"));
+    submitJob(dir + "/reference", "broken", "frames 3\n");
+    ASSERT_TRUE(waitForIdle(daemon));
+    EXPECT_EQ(2u, daemon.getCompletedCount());
+    EXPECT_EQ(1u, daemon.getFailedCount());
+    EXPECT_EQ(0u, daemon.getSuspendedCount());
+  }
+  EXPECT_NE(std::string::npos,
+	    readJobFile(dir + "/reference/failed/broken.error").find("output"));
+  const std::string referenceLow = readJobFile(dir + "/reference-low.txt");
+  ASSERT_NE(std::string::npos, referenceLow.find("frame 299 "));
+  EXPECT_EQ(std::string::npos, referenceLow.find("frame 300 "));
+
+  // On a single worker, a higher priority job preempts a running one, which
+  // later resumes from its checkpoint.  Stopping the daemon suspends the
+  // job, and a new daemon finishes it.
+  const std::string spool = dir + "/spool";
+  {
+    JobDaemon daemon(spool, 1);
+    daemon.setCheckpointInterval(7);
+    ASSERT_TRUE(daemon.start()) << daemon.getError();
+    submitJob(spool, "low", jobText(16, 300, 0, dir + "/low.txt"));
+    daemon.poll();
+    while (readJobFile(dir + "/low.txt").find("frame 10 ") ==
+	   std::string::npos)
+      usleep(1000);
+    submitJob(spool, "high", jobText(12, 20, 5, dir + "/high.txt"));
+    daemon.poll();
+    while (access((spool + "/done/high.job").c_str(), F_OK) != 0)
+      daemon.poll();
+    EXPECT_NE(0, access((spool + "/done/low.job").c_str(), F_OK));
+    EXPECT_EQ(1u, daemon.getSuspendedCount());
+    while (readJobFile(dir + "/low.txt").find("frame 40 ") ==
+	   std::string::npos)
+      usleep(1000);
+    daemon.stop();
+    EXPECT_EQ(2u, daemon.getSuspendedCount());
+  }
+  EXPECT_EQ(0, access((spool + "/active/low.checkpoint").c_str(), F_OK));
+  {
+    JobDaemon daemon(spool, 1);
+    ASSERT_TRUE(daemon.start()) << daemon.getError();
+    ASSERT_TRUE(waitForIdle(daemon));
+    EXPECT_EQ(1u, daemon.getCompletedCount());
+  }
+  EXPECT_EQ(0, access((spool + "/done/low.job").c_str(), F_OK));
+  EXPECT_NE(0, access((spool + "/active/low.checkpoint").c_str(), F_OK));
+  EXPECT_EQ(readJobFile(dir + "/reference-high.txt"),
+	    readJobFile(dir + "/high.txt"));
+  EXPECT_TRUE(referenceLow == readJobFile(dir + "/low.txt"));
+  removeSpool(dir);
+}
+
+TEST(JobDaemonTest, HoldsJobs)
+{
+  char base[] = "/tmp/job-daemon-test-XXXXXX";
+  ASSERT_TRUE(mkdtemp(base) != NULL);
+  const std::string spool = base;
+  JobDaemon daemon(spool, 1);
+  ASSERT_TRUE(daemon.start()) << daemon.getError();
+  const std::string hold = spool + "/active/held.hold";
+  {
+    std::ofstream out(hold.c_str());
+  }
+  submitJob(spool, "held", jobText(8, 5, 0, spool + "/held.txt"));
+  ASSERT_TRUE(waitForIdle(daemon));
+  EXPECT_EQ(0u, daemon.getCompletedCount());
+  EXPECT_EQ(0, access((spool + "/active/held.job").c_str(), F_OK));
+
+  unlink(hold.c_str());
+  ASSERT_TRUE(waitForIdle(daemon));
+  EXPECT_EQ(1u, daemon.getCompletedCount());
+  EXPECT_NE(std::string::npos,
+	    readJobFile(spool + "/held.txt").find("frame 4 "));
+  removeSpool(spool);
+}
+
+#endif // __JOB_DAEMON_TEST__
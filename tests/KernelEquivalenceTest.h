@@ -0,0 +1,502 @@
+#ifndef __KERNEL_EQUIVALENCE_TEST__
+#define __KERNEL_EQUIVALENCE_TEST__
+
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "Grid.h"
+#include "FluidSolver.h"
+#include "Kernels.h"
+#include "ReferenceKernels.h"
+
+// Holds every optimized kernel to the frozen scalar kernels in
+// ReferenceKernels.h, on randomized inputs and on the state of a few golden
+// scenes.  Each comparison keeps a Deviation report, printed whether or not
+// it passes, so a new variant's drift is visible before it becomes a
+// failure.  Variants that promise bit-identical results are held to 0 ULP,
+// which relies on the build turning floating point contraction off
+// (config.pri); with contraction, FMA-capable sets drift by hundreds.
+
+// Measures how far a kernel's results stray from the reference's.  A sample
+// passes if it is within either the ULP or the absolute tolerance.
+class Deviation {
+public:
+  Deviation(const std::string &name, uint64_t maxUlps = 0,
+	    double maxAbs = 0.0)
+    : _name(name), _maxUlps(maxUlps), _maxAbs(maxAbs), _count(0),
+      _failures(0), _worstUlps(0), _worstAbs(0.0), _worstIndex(0),
+      _worstExpected(0.0), _worstActual(0.0)
+  {}
+
+  // Records one sample.  Both values NaN counts as agreement.
+  void add(float expected, float actual, unsigned index)
+  {
+    record(expected, actual, index, ulps(expected, actual));
+  }
+
+  void add(double expected, double actual, unsigned index)
+  {
+    record(expected, actual, index, ulps(expected, actual));
+  }
+
+  // Returns the number of samples beyond both tolerances.
+  uint64_t getFailures() const { return _failures; }
+
+  // Returns the largest distance seen, in units in the last place.
+  uint64_t getWorstUlps() const { return _worstUlps; }
+
+  // Returns a one line summary of the comparison.
+  std::string describe() const
+  {
+    std::ostringstream text;
+    text.precision(9);
+    text << _name << ": " << _count << " samples, max " << _worstUlps
+	 << " ulps, max abs " << _worstAbs;
+    if (_worstUlps > 0)
+      text << " at " << _worstIndex << " (expected " << _worstExpected
+	   << ", got " << _worstActual << ")";
+    text << ", " << _failures << " beyond " << _maxUlps << " ulps/"
+	 << _maxAbs;
+    return text.str();
+  }
+
+  // Prints the summary, then checks that every sample passed.
+  void check() const
+  {
+    std::cout << "[ REPORT   ] " << describe() << std::endl;
+    EXPECT_EQ(0u, _failures) << describe();
+  }
+
+  // Returns the distance between two values in units in the last place.
+  static uint64_t ulps(float a, float b)
+  {
+    if (a != a || b != b)
+      return (a != a && b != b) ? 0 : UINT64_MAX;
+    int32_t x, y;
+    memcpy(&x, &a, sizeof(x));
+    memcpy(&y, &b, sizeof(y));
+    return distance(x < 0, x & 0x7fffffff, y < 0, y & 0x7fffffff);
+  }
+
+  static uint64_t ulps(double a, double b)
+  {
+    if (a != a || b != b)
+      return (a != a && b != b) ? 0 : UINT64_MAX;
+    int64_t x, y;
+    memcpy(&x, &a, sizeof(x));
+    memcpy(&y, &b, sizeof(y));
+    const uint64_t mask = 0x7fffffffffffffffull;
+    return distance(x < 0, x & mask, y < 0, y & mask);
+  }
+
+private:
+  // The distance between two values given as signs and magnitude bits.
+  static uint64_t distance(bool negativeA, uint64_t a, bool negativeB,
+			   uint64_t b)
+  {
+    if (negativeA != negativeB)
+      return a + b;
+    return a > b ? a - b : b - a;
+  }
+
+  void record(double expected, double actual, unsigned index, uint64_t ulps)
+  {
+    ++_count;
+    const double abs = ulps == 0 ? 0.0 : std::fabs(expected - actual);
+    if (ulps > _maxUlps && !(abs <= _maxAbs))
+      ++_failures;
+    if (ulps > _worstUlps) {
+      _worstUlps = ulps;
+      _worstIndex = index;
+      _worstExpected = expected;
+      _worstActual = actual;
+    }
+    if (abs > _worstAbs)
+      _worstAbs = abs;
+  }
+
+  std::string _name;       // What is compared.
+  uint64_t _maxUlps;       // Tolerance in units in the last place.
+  double   _maxAbs;        // Absolute tolerance.
+  uint64_t _count;         // Samples recorded.
+  uint64_t _failures;      // Samples beyond both tolerances.
+  uint64_t _worstUlps;     // The largest ULP distance seen, and where.
+  double   _worstAbs;
+  unsigned _worstIndex;
+  double   _worstExpected;
+  double   _worstActual;
+};
+
+// A small deterministic generator, so that failures reproduce on every
+// platform.
+class EquivalenceRandom {
+public:
+  explicit EquivalenceRandom(unsigned seed) : _state(seed * 2654435761u + 1) {}
+
+  // Returns a value in [low, high).
+  float uniform(float low, float high)
+  {
+    _state = _state * 1664525u + 1013904223u;
+    return low + (high - low) * ((_state >> 8) / 16777216.0f);
+  }
+
+  // Returns a value in [0, count).
+  unsigned below(unsigned count)
+  {
+    return static_cast<unsigned>(uniform(0.0f, 1.0f) * count) % count;
+  }
+
+private:
+  uint32_t _state;
+};
+
+// Fills a grid of random size and periodicity with random velocities.
+static Grid randomEquivalenceGrid(EquivalenceRandom &random)
+{
+  Grid grid(4.0f + random.below(37), 4.0f + random.below(37));
+  for (unsigned i = 0; i < grid.getCellCount(); ++i) {
+    grid[i].vel[Cell::X] = random.uniform(-3.0f, 3.0f);
+    grid[i].vel[Cell::Y] = random.uniform(-3.0f, 3.0f);
+  }
+  grid.setPeriodic(Cell::X, random.below(3) == 0);
+  grid.setPeriodic(Cell::Y, random.below(3) == 0);
+  return grid;
+}
+
+// Returns sample positions covering a grid: random ones, including some
+// outside the grid, and every cell corner and center.
+static std::vector<Vector2> equivalencePositions(const Grid &grid,
+						 EquivalenceRandom &random)
+{
+  std::vector<Vector2> positions;
+  const float width = grid.getWidth();
+  const float height = grid.getHeight();
+  for (unsigned i = 0; i < 509; ++i)
+    positions.push_back(Vector2(random.uniform(-2.0f, width + 2.0f),
+				random.uniform(-2.0f, height + 2.0f)));
+  for (float y = 0.0f; y <= height; y += 0.5f)
+    for (float x = 0.0f; x <= width; x += 0.5f)
+      positions.push_back(Vector2(x, y));
+  return positions;
+}
+
+// Compares the batched sampling path of one batch width.
+template <unsigned N>
+static void compareBatchedVelocity(const Grid &grid,
+				   const std::vector<Vector2> &positions,
+				   Deviation &deviation)
+{
+  Vector2xN<N> batch, velocities;
+  for (unsigned i = 0; i + N <= positions.size(); i += N) {
+    batch.load(&positions[i]);
+    grid.getVelocity(batch, velocities);
+    for (unsigned l = 0; l < N; ++l) {
+      const Vector2 expected =
+	ReferenceKernels::getVelocity(grid, positions[i + l]);
+      deviation.add(expected.x, velocities.x[l], i + l);
+      deviation.add(expected.y, velocities.y[l], i + l);
+    }
+  }
+}
+
+TEST(KernelEquivalenceTest, BilerpVel)
+{
+  const float timeStepSec = 0.05f;
+  Deviation scalar("Grid::getVelocity");
+  Deviation batched1("Grid::getVelocity<1>");
+  Deviation batched4("Grid::getVelocity<4>");
+  Deviation batched8("Grid::getVelocity<8>");
+  Deviation batched16("Grid::getVelocity<16>");
+  std::vector<Deviation> advect;
+  for (unsigned s = 0; s < Kernels::ISA_COUNT; ++s)
+    advect.push_back(Deviation(std::string("advectParticles/") +
+			       Kernels::get(Kernels::Isa(s)).name));
+
+  for (unsigned seed = 0; seed < 24; ++seed) {
+    EquivalenceRandom random(seed);
+    const Grid grid = randomEquivalenceGrid(random);
+    const std::vector<Vector2> positions =
+      equivalencePositions(grid, random);
+
+    for (unsigned i = 0; i < positions.size(); ++i) {
+      const Vector2 expected =
+	ReferenceKernels::getVelocity(grid, positions[i]);
+      const Vector2 actual = grid.getVelocity(positions[i]);
+      scalar.add(expected.x, actual.x, i);
+      scalar.add(expected.y, actual.y, i);
+    }
+    compareBatchedVelocity<1>(grid, positions, batched1);
+    compareBatchedVelocity<4>(grid, positions, batched4);
+    compareBatchedVelocity<8>(grid, positions, batched8);
+    compareBatchedVelocity<16>(grid, positions, batched16);
+
+    // Every instruction set's particle advection is one forward Euler step
+    // through the reference sampling.
+    for (unsigned s = 0; s < Kernels::ISA_COUNT; ++s) {
+      const Kernels::Isa isa = static_cast<Kernels::Isa>(s);
+      if (!Kernels::isSupported(isa))
+	continue;
+      std::vector<Vector2> moved(positions);
+      Kernels::get(isa).advectParticles(grid, &moved[0], moved.size(),
+					timeStepSec);
+      for (unsigned i = 0; i < positions.size(); ++i) {
+	Vector2 expected = positions[i];
+	expected += ReferenceKernels::getVelocity(grid, positions[i]) *
+	  timeStepSec;
+	advect[s].add(expected.x, moved[i].x, i);
+	advect[s].add(expected.y, moved[i].y, i);
+      }
+    }
+  }
+
+  scalar.check();
+  batched1.check();
+  batched4.check();
+  batched8.check();
+  batched16.check();
+  for (unsigned s = 0; s < Kernels::ISA_COUNT; ++s)
+    if (Kernels::isSupported(Kernels::Isa(s)))
+      advect[s].check();
+}
+
+TEST(KernelEquivalenceTest, VelocityDivergence)
+{
+  Deviation divergence("Grid::getVelocityDivergence");
+  for (unsigned seed = 0; seed < 24; ++seed) {
+    EquivalenceRandom random(seed);
+    const Grid grid = randomEquivalenceGrid(random);
+    for (unsigned y = 0; y < grid.getRowCount(); ++y)
+      for (unsigned x = 0; x < grid.getColCount(); ++x)
+	divergence.add(ReferenceKernels::getVelocityDivergence(grid, x, y),
+		       grid.getVelocityDivergence(x, y),
+		       y * grid.getRowStride() + x);
+  }
+  divergence.check();
+}
+
+// Exposes the solver's stages to the comparisons.
+class EquivalenceSolver : public FluidSolver {
+public:
+  EquivalenceSolver(float width, float height)
+    : FluidSolver(width, height)
+  {}
+
+  using FluidSolver::advectVelocity;
+  using FluidSolver::pressureSolve;
+};
+
+// A scene whose state after a few frames feeds the stage comparisons.
+struct EquivalenceScene {
+  std::string name;
+  float width;
+  float height;
+  bool periodic[Cell::DIM_COUNT];
+  FluidSolver::BoundaryType boundaries[FluidSolver::SIDE_COUNT];
+  Vector2 inflow;       // Velocity of an INFLOW side.
+  float viscosity;
+  unsigned frames;
+};
+
+// Returns the golden scenes, followed by randomized ones.
+static std::vector<EquivalenceScene> equivalenceScenes()
+{
+  std::vector<EquivalenceScene> scenes;
+  EquivalenceScene scene;
+  scene.periodic[Cell::X] = scene.periodic[Cell::Y] = false;
+  for (unsigned side = 0; side < FluidSolver::SIDE_COUNT; ++side)
+    scene.boundaries[side] = FluidSolver::WALL;
+
+  // The default dam break.
+  scene.name = "dam";
+  scene.width = 24.0f;
+  scene.height = 24.0f;
+  scene.inflow = Vector2();
+  scene.viscosity = 0.0f;
+  scene.frames = 6;
+  scenes.push_back(scene);
+
+  // A channel, periodic across and viscous.
+  scene.name = "channel";
+  scene.width = 20.0f;
+  scene.height = 16.0f;
+  scene.periodic[Cell::X] = true;
+  scene.viscosity = 0.3f;
+  scene.frames = 4;
+  scenes.push_back(scene);
+
+  // Fluid flowing in on the left and out on the right.
+  scene.name = "open";
+  scene.width = 24.0f;
+  scene.height = 12.0f;
+  scene.periodic[Cell::X] = false;
+  scene.boundaries[FluidSolver::LEFT] = FluidSolver::INFLOW;
+  scene.boundaries[FluidSolver::RIGHT] = FluidSolver::OUTFLOW;
+  scene.inflow = Vector2(3.0f, 0.0f);
+  scene.viscosity = 0.0f;
+  scene.frames = 5;
+  scenes.push_back(scene);
+
+  for (unsigned seed = 0; seed < 8; ++seed) {
+    EquivalenceRandom random(100 + seed);
+    std::ostringstream name;
+    name << "random" << seed;
+    scene.name = name.str();
+    scene.width = 8.0f + random.below(25);
+    scene.height = 8.0f + random.below(25);
+    scene.periodic[Cell::X] = random.below(4) == 0;
+    scene.periodic[Cell::Y] = random.below(4) == 0;
+    for (unsigned side = 0; side < FluidSolver::SIDE_COUNT; ++side)
+      scene.boundaries[side] = FluidSolver::BoundaryType(random.below(3));
+    scene.inflow = Vector2(random.uniform(-2.0f, 2.0f),
+			   random.uniform(-2.0f, 2.0f));
+    scene.viscosity = random.below(2) ? random.uniform(0.0f, 0.5f) : 0.0f;
+    scene.frames = 1 + random.below(6);
+    scenes.push_back(scene);
+  }
+  return scenes;
+}
+
+// Sets up a solver for a scene and runs its frames.
+static void runEquivalenceScene(const EquivalenceScene &scene,
+				FluidSolver &solver)
+{
+  solver.setPeriodic(Cell::X, scene.periodic[Cell::X]);
+  solver.setPeriodic(Cell::Y, scene.periodic[Cell::Y]);
+  for (unsigned side = 0; side < FluidSolver::SIDE_COUNT; ++side)
+    solver.setBoundary(FluidSolver::Side(side), scene.boundaries[side],
+		       scene.inflow);
+  solver.setViscosity(scene.viscosity);
+  solver.reset();
+  for (unsigned frame = 0; frame < scene.frames; ++frame) {
+    solver.advanceFrame();
+    solver.consumeFrame();
+  }
+}
+
+// Records the face velocities of two equally sized grids.
+static void addVelocities(const Grid &expected, const Grid &actual,
+			  Deviation &deviation)
+{
+  for (unsigned i = 0; i < expected.getCellCount(); ++i) {
+    deviation.add(expected[i].vel[Cell::X], actual[i].vel[Cell::X], i);
+    deviation.add(expected[i].vel[Cell::Y], actual[i].vel[Cell::Y], i);
+  }
+}
+
+TEST(KernelEquivalenceTest, AdvectVelocity)
+{
+  const float timeStepSec = 1.0f / 30.0f;
+  Deviation velocities("FluidSolver::advectVelocity");
+  const std::vector<EquivalenceScene> scenes = equivalenceScenes();
+  for (unsigned s = 0; s < scenes.size(); ++s) {
+    EquivalenceSolver solver(scenes[s].width, scenes[s].height);
+    runEquivalenceScene(scenes[s], solver);
+    Grid reference(solver.getGrid());
+    ReferenceKernels::advectVelocity(reference, timeStepSec);
+    solver.advectVelocity(timeStepSec);
+    Deviation scene("advectVelocity/" + scenes[s].name);
+    addVelocities(reference, solver.getGrid(), scene);
+    addVelocities(reference, solver.getGrid(), velocities);
+    EXPECT_EQ(0u, scene.getFailures()) << scene.describe();
+  }
+  velocities.check();
+}
+
+TEST(KernelEquivalenceTest, PressureSolve)
+{
+  // The diagonally preconditioned solve is the reference itself, so it must
+  // match bit for bit.  The other preconditioners converge to the same
+  // pressures within the solver's tolerance, which the float velocities
+  // round away to within a few ULPs.
+  const float timeStepSec = 1.0f / 30.0f;
+  const FluidSolver::Preconditioner preconditioners[] = {
+    FluidSolver::DIAGONAL, FluidSolver::INCOMPLETE_CHOLESKY
+  };
+  const char *names[] = { "diagonal", "incomplete-cholesky" };
+  const std::vector<EquivalenceScene> scenes = equivalenceScenes();
+
+  for (unsigned k = 0; k < 2; ++k) {
+    const bool exact = preconditioners[k] == FluidSolver::DIAGONAL;
+    Deviation pressure(std::string("pressureSolve/") + names[k] + " pressure",
+		       exact ? 0 : 1 << 20, exact ? 0.0 : 1e-9);
+    Deviation velocities(std::string("pressureSolve/") + names[k] +
+			 " velocity", exact ? 0 : 4, exact ? 0.0 : 1e-6);
+    for (unsigned s = 0; s < scenes.size(); ++s) {
+      EquivalenceSolver solver(scenes[s].width, scenes[s].height);
+      solver.setPreconditioner(preconditioners[k]);
+      runEquivalenceScene(scenes[s], solver);
+
+      Grid reference(solver.getGrid());
+      FluidSolver::BoundaryType boundaries[FluidSolver::SIDE_COUNT];
+      for (unsigned side = 0; side < FluidSolver::SIDE_COUNT; ++side)
+	boundaries[side] = solver.getBoundary(FluidSolver::Side(side));
+      EXPECT_TRUE(ReferenceKernels::pressureSolve(reference, boundaries,
+						  timeStepSec));
+      solver.pressureSolve(timeStepSec);
+
+      // Only FLUID cells' pressures are meaningful.
+      const Grid &grid = solver.getGrid();
+      const CellMask &mask = grid.getCellMask();
+      for (unsigned y = 0; y + 1 < grid.getRowCount(); ++y)
+	for (unsigned x = 0; x + 1 < grid.getColCount(); ++x) {
+	  const unsigned i = y * grid.getRowStride() + x;
+	  if (mask.isFluid(x, y))
+	    pressure.add(reference.getPressureData()[i],
+			 grid.getPressureData()[i], i);
+	}
+      addVelocities(reference, grid, velocities);
+    }
+    pressure.check();
+    velocities.check();
+  }
+}
+
+TEST(KernelEquivalenceTest, GoldenFrames)
+{
+  // Whole frames of the golden scenes, on every instruction set and
+  // preconditioner, against the generic kernels with the diagonal
+  // preconditioner.  The instruction sets are bit-identical; the other
+  // preconditioner drifts within the solver's tolerance, amplified over a
+  // few frames.
+  const Kernels::Isa selected = Kernels::get().isa;
+  std::vector<EquivalenceScene> scenes = equivalenceScenes();
+  scenes.resize(3);
+  for (unsigned s = 0; s < scenes.size(); ++s) {
+    Kernels::select(Kernels::GENERIC);
+    FluidSolver reference(scenes[s].width, scenes[s].height);
+    runEquivalenceScene(scenes[s], reference);
+    const ParticleArray &expected = reference.getParticles();
+
+    for (unsigned k = 0; k < Kernels::ISA_COUNT; ++k) {
+      const Kernels::Isa isa = static_cast<Kernels::Isa>(k);
+      if (!Kernels::select(isa))
+	continue;
+      for (unsigned c = 0; c < 2; ++c) {
+	const bool cholesky = c == 1;
+	FluidSolver solver(scenes[s].width, scenes[s].height);
+	if (cholesky)
+	  solver.setPreconditioner(FluidSolver::INCOMPLETE_CHOLESKY);
+	runEquivalenceScene(scenes[s], solver);
+
+	Deviation particles(scenes[s].name + "/" + Kernels::get(isa).name +
+			    (cholesky ? "/incomplete-cholesky" : "/diagonal"),
+			    0, cholesky ? 1e-3 : 0.0);
+	const ParticleArray &actual = solver.getParticles();
+	ASSERT_EQ(expected.size(), actual.size()) << particles.describe();
+	for (unsigned i = 0; i < expected.size(); ++i) {
+	  particles.add(expected[i].x, actual[i].x, i);
+	  particles.add(expected[i].y, actual[i].y, i);
+	}
+	particles.check();
+      }
+    }
+  }
+  Kernels::select(selected);
+}
+
+#endif // __KERNEL_EQUIVALENCE_TEST__
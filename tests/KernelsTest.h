@@ -0,0 +1,94 @@
+#ifndef __KERNELS_TEST__
+#define __KERNELS_TEST__
+
+#include <gtest/gtest.h>
+#include <vector>
+#include "Grid.h"
+#include "Kernels.h"
+
+TEST(KernelsTest, Selection)
+{
+  // The generic kernels always run, and the selected set is one this CPU
+  // supports.
+  EXPECT_TRUE(Kernels::isSupported(Kernels::GENERIC));
+  EXPECT_TRUE(Kernels::isSupported(Kernels::getWidestSupported()));
+  EXPECT_TRUE(Kernels::isSupported(Kernels::get().isa));
+  for (unsigned i = 0; i < Kernels::ISA_COUNT; ++i)
+    EXPECT_EQ(i, static_cast<unsigned>(
+		Kernels::get(static_cast<Kernels::Isa>(i)).isa));
+}
+
+TEST(KernelsTest, SetsAgree)
+{
+  // Every supported set must match the generic kernels bit for bit.  Odd
+  // sizes exercise the remainder loops.
+  const unsigned count = 1003;
+  Grid grid(16.0f, 16.0f);
+  for (unsigned i = 0; i < grid.getCellCount(); ++i) {
+    grid[i].vel[Cell::X] = (i % 7) * 0.5f - 1.5f;
+    grid[i].vel[Cell::Y] = (i % 5) * 0.25f - 0.5f;
+  }
+  for (unsigned y = 0; y < 16; ++y)
+    for (unsigned x = 0; x < 16; ++x)
+      grid.setCellType(x, y, (x * 3 + y) % 4 ? Cell::FLUID : Cell::AIR);
+  const unsigned width = grid.getColCount() - 1;
+  const unsigned stride = grid.getRowStride();
+  std::vector<Vector2> particles(count);
+  std::vector<double> a(count), b(count);
+  for (unsigned i = 0; i < count; ++i) {
+    particles[i] = Vector2((i * 37 % 160) * 0.1f, (i * 91 % 160) * 0.1f);
+    a[i] = 1.0 / (i + 1);
+    b[i] = (i % 13) - 6.0;
+  }
+
+  const Kernels &reference = Kernels::get(Kernels::GENERIC);
+  std::vector<Vector2> expectedParticles(particles);
+  reference.advectParticles(grid, &expectedParticles[0], count, 0.1f);
+  std::vector<double> expectedX(a), expectedR(b), expectedY(b), expectedZ(count);
+  reference.cgUpdate(0.5, &a[0], &b[0], &expectedX[0], &expectedR[0], count);
+  reference.xpby(&a[0], 0.25, &expectedY[0], count);
+  reference.multiply(&a[0], &b[0], &expectedZ[0], count);
+  std::vector<double> expectedDiv(grid.getCellCount());
+  for (unsigned y = 0; y < 16; ++y)
+    reference.divergence(&grid(0, y), &grid(0, y + 1),
+			 &expectedDiv[y * stride], width);
+
+  // The generic divergence is the one Grid computes.
+  for (unsigned y = 0; y < 16; ++y)
+    for (unsigned x = 0; x < width; ++x)
+      ASSERT_EQ(grid(x, y).cellType == Cell::FLUID
+		? -grid.getVelocityDivergence(x, y) : 0.0,
+		expectedDiv[y * stride + x]);
+
+  for (unsigned s = 0; s < Kernels::ISA_COUNT; ++s) {
+    const Kernels::Isa isa = static_cast<Kernels::Isa>(s);
+    if (!Kernels::isSupported(isa))
+      continue;
+    const Kernels &kernels = Kernels::get(isa);
+    SCOPED_TRACE(kernels.name);
+
+    std::vector<Vector2> moved(particles);
+    kernels.advectParticles(grid, &moved[0], count, 0.1f);
+    std::vector<double> x(a), r(b), y(b), z(count);
+    kernels.cgUpdate(0.5, &a[0], &b[0], &x[0], &r[0], count);
+    kernels.xpby(&a[0], 0.25, &y[0], count);
+    kernels.multiply(&a[0], &b[0], &z[0], count);
+    std::vector<double> div(grid.getCellCount());
+    for (unsigned y = 0; y < 16; ++y)
+      kernels.divergence(&grid(0, y), &grid(0, y + 1), &div[y * stride],
+			 width);
+    EXPECT_EQ(reference.dot(&a[0], &b[0], count),
+	      kernels.dot(&a[0], &b[0], count));
+    for (unsigned i = 0; i < count; ++i) {
+      ASSERT_EQ(expectedParticles[i], moved[i]);
+      ASSERT_EQ(expectedX[i], x[i]);
+      ASSERT_EQ(expectedR[i], r[i]);
+      ASSERT_EQ(expectedY[i], y[i]);
+      ASSERT_EQ(expectedZ[i], z[i]);
+    }
+    for (unsigned i = 0; i < div.size(); ++i)
+      ASSERT_EQ(expectedDiv[i], div[i]);
+  }
+}
+
+#endif // __KERNELS_TEST__
@@ -0,0 +1,388 @@
+#ifndef __REFERENCE_KERNELS__
+#define __REFERENCE_KERNELS__
+
+#include <cmath>
+#include <vector>
+#include <eigen3/Eigen/Sparse>
+#include <eigen3/Eigen/IterativeLinearSolvers>
+#include "Grid.h"
+#include "FluidSolver.h"
+
+// Frozen copies of the solver's scalar kernels, as they stood before any
+// SIMD, parallel or matrix-free variant replaced them.  KernelEquivalenceTest
+// holds every optimized implementation to these.  They are deliberately
+// written against Grid's public interface only, and must never be "fixed"
+// or sped up: a change in behavior belongs in the solver, with the
+// equivalence tolerances updated to match.  Only their indexing follows
+// the grid's layout: rows are getRowStride() cells apart, and the system
+// pins each row's padding as it does the extra column.
+//
+// Like the solver (see config.pri), they are compiled without floating
+// point contraction, so a multiply and add fused on an FMA-capable target
+// can't make them round differently from the code they stand for.
+#ifdef __GNUC__
+#pragma GCC push_options
+#pragma GCC optimize("fp-contract=off")
+#endif
+class ReferenceKernels {
+public:
+  // Grid::bilerpVel: bilinearly interpolates one velocity component on the
+  // MAC grid, clamping to the walls or wrapping along periodic axes.
+  static float bilerpVel(const Grid &grid, Vector2 position,
+			 Cell::Dimension dim);
+
+  // Grid::getVelocity: both components at a position.
+  static Vector2 getVelocity(const Grid &grid, Vector2 position);
+
+  // Grid::getVelocityDivergence: the divergence of a cell, with missing
+  // neighbors at 0 velocity.
+  static float getVelocityDivergence(const Grid &grid, unsigned x,
+				     unsigned y);
+
+  // FluidSolver::particleTrace: the backwards trace of a position.
+  static Vector2 particleTrace(const Grid &grid, Vector2 position,
+			       float timeStepSec);
+
+  // FluidSolver::advectVelocity: semi-Lagrangian advection of the velocity
+  // field, staged through each cell's stagedVel.
+  static void advectVelocity(Grid &grid, float timeStepSec);
+
+  // FluidSolver::pressureSolve, with the diagonally preconditioned
+  // conjugate gradient solver.  Fills the grid's divergence and pressure
+  // arrays and projects the velocities.
+  //
+  // Arguments:
+  //   Grid &grid - The grid to project.
+  //   FluidSolver::BoundaryType boundaries[] - Each side's boundary type,
+  //                                           indexed by FluidSolver::Side.
+  //   float timeStepSec - The amount of time simulated.
+  //
+  // Returns:
+  //   bool - Whether the solver converged.
+  static bool pressureSolve(Grid &grid,
+			    const FluidSolver::BoundaryType boundaries[],
+			    float timeStepSec);
+};
+
+
+inline float ReferenceKernels::bilerpVel(const Grid &grid, Vector2 position,
+					 Cell::Dimension dim)
+{
+  const bool periodicX = grid.isPeriodic(Cell::X);
+  const bool periodicY = grid.isPeriodic(Cell::Y);
+  if (position.x > grid.getWidth() && !periodicX)
+    position.x = grid.getWidth();
+  if (position.y > grid.getHeight() && !periodicY)
+    position.y = grid.getHeight();
+
+  switch(dim) {
+    case Cell::X:
+      position.y -= 0.5;
+      break;
+    case Cell::Y:
+      position.x -= 0.5;
+      break;
+    default:
+      break;
+  }
+
+  if (periodicX)
+    position.x = Grid::wrapCoordinate(position.x, grid.getWidth());
+  else if (position.x < 0.0f)
+    position.zeroX();
+  if (periodicY)
+    position.y = Grid::wrapCoordinate(position.y, grid.getHeight());
+  else if (position.y < 0.0f)
+    position.zeroY();
+
+  unsigned i, j;
+  i = floor(position.x);
+  j = floor(position.y);
+  position -= Vector2(i,j);
+
+  const Cell cell = grid[j * grid.getRowStride() + i];
+  float thisVel, rightVel, topVel, topRightVel;
+  if (cell.allNeighbors) {
+    thisVel  = cell.vel[dim];
+    rightVel = cell.neighbors[Cell::POS_X]->vel[dim];
+    topVel   = cell.neighbors[Cell::POS_Y]->vel[dim];
+    topRightVel = cell.neighbors[Cell::POS_XY]->vel[dim];
+  }
+  else {
+    thisVel  = cell.vel[dim];
+    rightVel = cell.neighbors[Cell::POS_X]
+      ? cell.neighbors[Cell::POS_X]->vel[dim] : 0;
+    topVel   = cell.neighbors[Cell::POS_Y]
+      ? cell.neighbors[Cell::POS_Y]->vel[dim] : 0;
+    topRightVel = cell.neighbors[Cell::POS_XY]
+      ? cell.neighbors[Cell::POS_XY]->vel[dim] : 0;
+  }
+
+  return (1-position.x) * (1-position.y) * thisVel +
+         position.x     * (1-position.y) * rightVel +
+         (1-position.x) * position.y     * topVel +
+         position.x     * position.y     * topRightVel;
+}
+
+
+inline Vector2 ReferenceKernels::getVelocity(const Grid &grid,
+					     Vector2 position)
+{
+  Vector2 result;
+  result.x = bilerpVel(grid, position, Cell::X);
+  result.y = bilerpVel(grid, position, Cell::Y);
+  return result;
+}
+
+
+inline float ReferenceKernels::getVelocityDivergence(const Grid &grid,
+						     unsigned x, unsigned y)
+{
+  Cell cell = grid(x,y);
+  float xDivergence;
+  float yDivergence;
+  if (cell.allNeighbors) {
+    xDivergence = cell.neighbors[Cell::POS_X]->vel[Cell::X] - cell.vel[Cell::X];
+    yDivergence = cell.neighbors[Cell::POS_Y]->vel[Cell::Y] - cell.vel[Cell::Y];
+  }
+  else {
+    float rightXVel = cell.neighbors[Cell::POS_X]
+      ? cell.neighbors[Cell::POS_X]->vel[Cell::X] : 0.0f;
+    float topYVel = cell.neighbors[Cell::POS_Y]
+      ? cell.neighbors[Cell::POS_Y]->vel[Cell::Y] : 0.0f;
+    xDivergence = rightXVel - cell.vel[Cell::X];
+    yDivergence = topYVel - cell.vel[Cell::Y];
+  }
+  return xDivergence + yDivergence;
+}
+
+
+inline Vector2 ReferenceKernels::particleTrace(const Grid &grid,
+					       Vector2 position,
+					       float timeStepSec)
+{
+  Vector2 velocity = getVelocity(grid, position) * -timeStepSec;
+  Vector2 toPosition = position + velocity;
+  Vector2 tempPos;
+  float width = grid.getWidth();
+  float height = grid.getHeight();
+  float dist;
+  float interceptX = 0.0f;
+  float interceptY = 0.0f;
+
+  if (grid.isPeriodic(Cell::X))
+    toPosition.x = Grid::wrapCoordinate(toPosition.x, width);
+  if (grid.isPeriodic(Cell::Y))
+    toPosition.y = Grid::wrapCoordinate(toPosition.y, height);
+  bool intersectX = toPosition.x < 0 || toPosition.x > grid.getWidth();
+  bool intersectY = toPosition.y < 0 || toPosition.y > grid.getHeight();
+
+  if (intersectX || intersectY) {
+    if (velocity.x > 0)
+      interceptX = width;
+    if (velocity.y > 0)
+      interceptY = height;
+    dist = interceptX - position.x / velocity.x;
+    tempPos.y = position.y + dist * velocity.y;
+    tempPos.x = interceptX;
+    dist = interceptY - position.y / velocity.y;
+    position.x += dist * velocity.y;
+    if (tempPos.magnitude() < position.magnitude())
+      tempPos = position;
+  }
+  else
+    position = toPosition;
+  return position;
+}
+
+
+inline void ReferenceKernels::advectVelocity(Grid &grid, float timeStepSec)
+{
+  for(float x = 0; x < grid.getWidth(); x += 1.0f)
+    for( float y = 0.5; y < grid.getHeight(); y += 1.0f) {
+      Cell &cell = grid(floor(x), floor(y));
+      Vector2 position(x, y);
+      position = particleTrace(grid, position, timeStepSec);
+      cell.stagedVel[Cell::X] = getVelocity(grid, position).x;
+    }
+  for(float y = 0; y < grid.getHeight(); y += 1.0f)
+    for(float x = 0.5; x < grid.getWidth(); x+= 1.0f) {
+      Cell &cell = grid(floor(x), floor(y));
+      Vector2 position(x, y);
+      position = particleTrace(grid, position, timeStepSec);
+      cell.stagedVel[Cell::Y] = getVelocity(grid, position).y;
+    }
+  for(unsigned i = 0; i < grid.getCellCount(); i++) {
+    grid[i].commitStagedVel();
+  }
+}
+
+
+inline bool ReferenceKernels::pressureSolve(
+  Grid &grid, const FluidSolver::BoundaryType boundaries[],
+  float timeStepSec)
+{
+  const unsigned cols   = grid.getRowStride();
+  const unsigned width  = grid.getColCount() - 1;
+  const unsigned height = grid.getRowCount() - 1;
+  int dim = grid.getCellCount();
+  const bool periodicX = grid.isPeriodic(Cell::X);
+  const bool periodicY = grid.isPeriodic(Cell::Y);
+  bool wall[FluidSolver::SIDE_COUNT];
+  for (unsigned side = 0; side < FluidSolver::SIDE_COUNT; ++side)
+    wall[side] = !(side < FluidSolver::BOTTOM ? periodicX : periodicY) &&
+      boundaries[side] == FluidSolver::WALL;
+
+  const CellMask &mask = grid.getCellMask();
+  Eigen::Map<Eigen::VectorXd> b(grid.getDivergenceData(), dim);
+  for (unsigned y = 0; y < height; ++y)
+    for (unsigned x = 0; x < width; ++x) {
+      unsigned index = y * cols + x;
+      b(index) = mask.isFluid(x, y) ?
+	-getVelocityDivergence(grid, x, y) : 0.0;
+    }
+
+  for (unsigned x = 0; x < width && wall[FluidSolver::BOTTOM]; ++x) {
+    unsigned y = 0;
+    unsigned index = y * cols + x;
+    b(index) -= grid(x,y).vel[Cell::Y];
+  }
+  for (unsigned x = 0; x < width && wall[FluidSolver::TOP]; ++x) {
+    unsigned y = height - 1;
+    unsigned index = y * cols + x;
+    b(index) += grid(x,y+1).vel[Cell::Y];
+  }
+  for (unsigned y = 0; y < height && wall[FluidSolver::LEFT]; ++y) {
+    unsigned x = 0;
+    unsigned index = y * cols + x;
+    b(index) -= grid(x,y).vel[Cell::X];
+  }
+  for (unsigned y = 0; y < height && wall[FluidSolver::RIGHT]; ++y) {
+    unsigned x = width - 1;
+    unsigned index = y * cols + x;
+    b(index) += grid(x+1,y).vel[Cell::X];
+  }
+
+  std::vector< Tripletd > vals;
+  const bool openLeft   = !periodicX &&
+    boundaries[FluidSolver::LEFT] == FluidSolver::OUTFLOW;
+  const bool openBottom = !periodicY &&
+    boundaries[FluidSolver::BOTTOM] == FluidSolver::OUTFLOW;
+  for (unsigned y = 0; y < height; ++y) {
+    if (!mask.rowHasFluid(y) && !mask.rowHasFluid(y + 1)) {
+      for (unsigned i = y * cols; i < y * cols + width; ++i) {
+	vals.push_back( Tripletd(i,i,1.0) );
+	b(i) = 0.0;
+      }
+      continue;
+    }
+
+    for (unsigned x = 0; x < width; ++x) {
+      unsigned i = y * cols + x;
+      unsigned j;
+      const Cell::Type right = mask.get(x + 1, y);
+      const Cell::Type up    = mask.get(x, y + 1);
+      const unsigned rightIndex =
+	periodicX && x + 1 == width ? y * cols : y * cols + x + 1;
+      const unsigned upIndex =
+	periodicY && y + 1 == height ? x : (y + 1) * cols + x;
+
+      switch (mask.get(x, y)) {
+      case (Cell::SOLID):
+	vals.push_back( Tripletd(i,i,1.0) );
+	b(i) = 0.0;
+	break;
+
+      case (Cell::AIR):
+	vals.push_back( Tripletd(i,i,1.0) );
+	b(i) = 0.0;
+	if (right == Cell::FLUID) {
+	  j = rightIndex;
+	  vals.push_back( Tripletd(j,j,timeStepSec) );
+	}
+	if (up == Cell::FLUID) {
+	  j = upIndex;
+	  vals.push_back( Tripletd(j,j,timeStepSec) );
+	}
+	break;
+
+      case (Cell::FLUID):
+	if (x == 0 && openLeft)
+	  vals.push_back( Tripletd(i,i,timeStepSec) );
+	if (y == 0 && openBottom)
+	  vals.push_back( Tripletd(i,i,timeStepSec) );
+	if (right == Cell::FLUID) {
+	  j = rightIndex;
+	  vals.push_back( Tripletd(i,i,timeStepSec) );
+	  vals.push_back( Tripletd(i,j,-timeStepSec) );
+	  vals.push_back( Tripletd(j,i,-timeStepSec) );
+	  vals.push_back( Tripletd(j,j,timeStepSec) );
+	}
+	else if (right == Cell::AIR) {
+	  vals.push_back( Tripletd(i,i,timeStepSec) );
+	}
+	if (up == Cell::FLUID) {
+	  j = upIndex;
+	  vals.push_back( Tripletd(i,i,timeStepSec) );
+	  vals.push_back( Tripletd(i,j,-timeStepSec) );
+	  vals.push_back( Tripletd(j,i,-timeStepSec) );
+	  vals.push_back( Tripletd(j,j,timeStepSec) );
+	}
+	else if (up == Cell::AIR) {
+	  vals.push_back( Tripletd(i,i,timeStepSec) );
+	}
+	break;
+
+      default:
+	break;
+      }
+    }
+  }
+
+  for (unsigned y = 0; y <= height; ++y)
+    for (unsigned i = y * cols + width; i < (y + 1) * cols; ++i) {
+      vals.push_back( Tripletd(i,i,1.0) );
+      b(i) = 0.0;
+    }
+  for (unsigned x = 0; x < width; ++x) {
+    unsigned i = height * cols + x;
+    vals.push_back( Tripletd(i,i,1.0) );
+    b(i) = 0.0;
+  }
+
+  SparseMatrixd A(dim, dim);
+  A.setFromTriplets(vals.begin(), vals.end());
+  Eigen::ConjugateGradient<SparseMatrixd, Eigen::Lower | Eigen::Upper> solver;
+  solver.compute(A);
+  Eigen::Map<Eigen::VectorXd> p(grid.getPressureData(), dim);
+  p = solver.solve(b);
+  const bool converged = solver.info() == Eigen::Success;
+
+  for (unsigned y = 0; y < height; ++y) {
+    if (!mask.rowHasFluid(y))
+      continue;
+    for (unsigned x = 0; x < width; ++x) {
+      if (mask.isFluid(x, y)) {
+	Cell &cell = grid(x,y);
+	float pressureVel = timeStepSec * p(y * cols + x);
+	Cell *right = periodicX && x + 1 == width
+	  ? &grid(0, y) : cell.neighbors[Cell::POS_X];
+	Cell *up = periodicY && y + 1 == height
+	  ? &grid(x, 0) : cell.neighbors[Cell::POS_Y];
+	cell.vel[Cell::X] -= pressureVel;
+	cell.vel[Cell::Y] -= pressureVel;
+	if (right)
+	  right->vel[Cell::X] += pressureVel;
+	if (up)
+	  up->vel[Cell::Y] += pressureVel;
+      }
+    }
+  }
+  return converged;
+}
+
+#ifdef __GNUC__
+#pragma GCC pop_options
+#endif
+
+#endif // __REFERENCE_KERNELS__
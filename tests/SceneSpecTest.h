@@ -0,0 +1,62 @@
+#ifndef __SCENE_SPEC_TEST__
+#define __SCENE_SPEC_TEST__
+
+#include <gtest/gtest.h>
+#include <sstream>
+#include "SceneSpec.h"
+
+TEST(SceneSpecTest, ParseAndApply)
+{
+  std::istringstream in("# A channel.\n"
+			"resolution 24x12\n"
+			"gravity 0\n"
+			"capacity 5000\n"
+			"periodic y\n"
+			"boundary left inflow 4 0   # Fluid enters here,\n"
+			"boundary right outflow     # and leaves here.\n"
+			"emitter 2 2 4 4  0 5  500\n"
+			"sink 20 0 24 2\n"
+			"scalar 1.0\n"
+			"scalar 0.0\n");
+  SceneSpec scene;
+  ASSERT_TRUE(scene.parse(in)) << scene.getError();
+  EXPECT_EQ(24.0f, scene.getWidth());
+  EXPECT_EQ(12.0f, scene.getHeight());
+
+  FluidSolver solver(scene.getWidth(), scene.getHeight());
+  scene.apply(solver);
+  EXPECT_EQ(5000u, solver.getParticleCapacity());
+  EXPECT_FALSE(solver.isPeriodic(Cell::X));
+  EXPECT_TRUE(solver.isPeriodic(Cell::Y));
+  EXPECT_EQ(FluidSolver::INFLOW, solver.getBoundary(FluidSolver::LEFT));
+  EXPECT_EQ(FluidSolver::OUTFLOW, solver.getBoundary(FluidSolver::RIGHT));
+  EXPECT_EQ(FluidSolver::WALL, solver.getBoundary(FluidSolver::TOP));
+  ASSERT_EQ(2u, solver.getGrid().getScalarFieldCount());
+  EXPECT_EQ(1.0f, solver.getGrid().getScalar(5, 5, 0));
+  EXPECT_EQ(0.0f, solver.getGrid().getScalar(5, 5, 1));
+}
+
+TEST(SceneSpecTest, InvalidInput)
+{
+  SceneSpec scene;
+  std::istringstream unknown("frames 10\n");
+  EXPECT_FALSE(scene.parse(unknown));
+  EXPECT_FALSE(scene.getError().empty());
+
+  std::istringstream badSide("boundary front outflow\n");
+  EXPECT_FALSE(scene.parse(badSide));
+
+  std::istringstream noVelocity("boundary left inflow\n");
+  EXPECT_FALSE(scene.parse(noVelocity));
+
+  std::istringstream shortEmitter("emitter 0 0 1 1 0 5\n");
+  EXPECT_FALSE(scene.parse(shortEmitter));
+
+  std::istringstream badFill("fill 1.5\n");
+  EXPECT_FALSE(scene.parse(badFill));
+
+  // A failed parse leaves the previous scene in place.
+  EXPECT_EQ(32.0f, scene.getWidth());
+}
+
+#endif // __SCENE_SPEC_TEST__
@@ -0,0 +1,74 @@
+#ifndef __SHARED_FRAME_RING_TEST__
+#define __SHARED_FRAME_RING_TEST__
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include <sstream>
+#include <string>
+#include "FluidSolver.h"
+#include "SharedFrameRing.h"
+
+TEST(SharedFrameRingTest, PublishAndRead)
+{
+  std::ostringstream name;
+  name << "/fluid-frames-test-" << getpid();
+  FluidSolver solver(16.0f, 8.0f);
+  unsigned dye = solver.addScalarField(0.0f);
+  solver.reset();
+  solver.setScalar(3, 2, dye, 0.75f);
+
+  SharedFrameRing writer, reader;
+  ASSERT_TRUE(writer.create(name.str(), solver, 3));
+  ASSERT_TRUE(reader.attach(name.str()));
+  SharedFrameRing::FrameView view;
+  EXPECT_FALSE(reader.acquireLatest(view));
+
+  // A reader sees the newest frame in place, array by array.
+  solver.advanceFrame();
+  solver.consumeFrame();
+  ASSERT_TRUE(writer.publish(solver));
+  ASSERT_TRUE(reader.acquireLatest(view));
+  const SharedFrameRing::Header *header = reader.getHeader();
+  const Grid &grid = solver.getGrid();
+  const ParticleArray &particles = solver.getParticles();
+  EXPECT_EQ(0u, view.header->frame);
+  EXPECT_EQ(16.0f, view.header->width);
+  ASSERT_EQ(particles.size(), view.header->particleCount);
+  const unsigned cols = header->cols;
+  for (unsigned y = 0; y < header->rows; ++y)
+    for (unsigned x = 0; x < cols; ++x) {
+      const unsigned i = y * cols + x;
+      ASSERT_EQ(grid(x, y).vel[Cell::X], view.velocityX[i]);
+      ASSERT_EQ(grid(x, y).vel[Cell::Y], view.velocityY[i]);
+      ASSERT_EQ(float(grid.getPressure(x, y)), view.pressure[i]);
+      ASSERT_EQ(grid(x, y).cellType, view.cellType[i]);
+      ASSERT_EQ(grid.getScalar(x, y, dye), view.scalars[i]);
+    }
+  for (unsigned i = 0; i < particles.size(); ++i) {
+    ASSERT_EQ(particles[i].x, view.particleX[i]);
+    ASSERT_EQ(particles[i].y, view.particleY[i]);
+  }
+  EXPECT_TRUE(reader.isValid(view));
+
+  // Once the writer laps the ring, the old view is no longer valid.
+  for (unsigned frame = 1; frame <= 3; ++frame) {
+    solver.advanceFrame();
+    solver.consumeFrame();
+    ASSERT_TRUE(writer.publish(solver));
+  }
+  EXPECT_FALSE(reader.isValid(view));
+  ASSERT_TRUE(reader.acquireLatest(view));
+  EXPECT_EQ(3u, view.header->frame);
+  EXPECT_EQ(4u, header->frameCount);
+
+  // Frames that no longer fit the slots are refused.
+  solver.resample(32.0f, 16.0f);
+  EXPECT_FALSE(writer.publish(solver));
+  EXPECT_FALSE(reader.publish(solver));
+
+  writer.detach();
+  SharedFrameRing late;
+  EXPECT_FALSE(late.attach(name.str()));
+}
+
+#endif // __SHARED_FRAME_RING_TEST__
@@ -0,0 +1,273 @@
+#ifndef __SLAB_SOLVER_TEST__
+#define __SLAB_SOLVER_TEST__
+
+#include <gtest/gtest.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "Vector2.h"
+#include "SlabDecomposition.h"
+#include "FluidSolver.h"
+#include "SlabSolver.h"
+#include "SharedMemoryTransport.h"
+
+#define TEST_SLAB_WIDTH  12.0f
+#define TEST_SLAB_HEIGHT 16.0f
+#define TEST_SLAB_FRAMES 3
+
+// Returns a shared-memory name unique to this test process.
+static std::string slabTestSegmentName(const char *suffix)
+{
+  std::ostringstream name;
+  name << "/fluid-solver-test-" << getpid() << "-" << suffix;
+  return name.str();
+}
+
+// Per-thread arguments and results for runSlabs().
+struct SlabTestRun {
+  SharedMemoryTransport *transport;
+  unsigned               slab;
+  unsigned               frames;
+  unsigned               globalParticles;
+  std::vector<Vector2>   particles;
+  std::vector<float>     pressure;   // Owned rows, global row-major order.
+  unsigned               firstRow;
+};
+
+// Thread body simulating one slab; stands in for a separate process.
+static void * runSlabThread(void *arg)
+{
+  SlabTestRun *run = static_cast<SlabTestRun *>(arg);
+  SlabSolver solver(TEST_SLAB_WIDTH, TEST_SLAB_HEIGHT,
+		    run->transport, run->slab);
+  for (unsigned frame = 0; frame < run->frames; ++frame)
+    solver.advanceFrame();
+
+  run->globalParticles = solver.getGlobalParticleCount();
+  run->particles = solver.getParticles();
+  run->firstRow = solver.getFirstRow();
+  const Grid &grid = solver.getGrid();
+  for (unsigned y = 0; y < solver.getOwnedRowCount(); ++y)
+    for (unsigned x = 0; x < grid.getColCount(); ++x)
+      run->pressure.push_back(grid.getPressure(x, SlabSolver::HALO_ROWS + y));
+  return NULL;
+}
+
+// Simulates the test scene split into slabCount slabs, one thread per slab.
+// Returns the whole simulation's particles and pressure field.
+static void runSlabs(unsigned slabCount, std::vector<Vector2> &particles,
+		     std::vector<float> &pressure, unsigned &globalCount,
+		     unsigned frames = TEST_SLAB_FRAMES)
+{
+  SharedMemoryTransport transport;
+  ASSERT_TRUE(transport.create(slabTestSegmentName("solver"), slabCount,
+			       SlabSolver::getHaloCapacity(TEST_SLAB_WIDTH),
+			       64));
+  std::vector<SlabTestRun> runs(slabCount);
+  std::vector<pthread_t> threads(slabCount);
+  for (unsigned s = 0; s < slabCount; ++s) {
+    runs[s].transport = &transport;
+    runs[s].slab = s;
+    runs[s].frames = frames;
+    pthread_create(&threads[s], NULL, runSlabThread, &runs[s]);
+  }
+  for (unsigned s = 0; s < slabCount; ++s)
+    pthread_join(threads[s], NULL);
+
+  particles.clear();
+  pressure.clear();
+  globalCount = runs[0].globalParticles;
+  for (unsigned s = 0; s < slabCount; ++s) {
+    particles.insert(particles.end(), runs[s].particles.begin(),
+		     runs[s].particles.end());
+    pressure.insert(pressure.end(), runs[s].pressure.begin(),
+		    runs[s].pressure.end());
+  }
+}
+
+// Orders particles so that particle sets from different runs can be compared.
+static bool particleLess(const Vector2 &a, const Vector2 &b)
+{
+  return a.y < b.y || (a.y == b.y && a.x < b.x);
+}
+
+TEST(SlabDecompositionTest, Partition)
+{
+  SlabDecomposition slabs(10, 3);
+  ASSERT_EQ(3u, slabs.getSlabCount());
+  EXPECT_EQ(0u, slabs.getFirstRow(0));
+  EXPECT_EQ(10u, slabs.getFirstRow(3));
+  unsigned total = 0;
+  for (unsigned s = 0; s < slabs.getSlabCount(); ++s) {
+    EXPECT_GE(slabs.getSlabRowCount(s), 3u);
+    EXPECT_LE(slabs.getSlabRowCount(s), 4u);
+    total += slabs.getSlabRowCount(s);
+  }
+  EXPECT_EQ(10u, total);
+  for (unsigned row = 0; row < 10; ++row) {
+    unsigned owner = slabs.getOwner(row);
+    EXPECT_LE(slabs.getFirstRow(owner), row);
+    EXPECT_GT(slabs.getFirstRow(owner + 1), row);
+  }
+
+  // Slab counts are limited by the minimum rows per slab.
+  EXPECT_EQ(2u, SlabDecomposition(7, 8, 3).getSlabCount());
+  EXPECT_EQ(1u, SlabDecomposition(2, 8, 3).getSlabCount());
+}
+
+// Thread body exercising each transport operation.
+static void * transportThread(void *arg)
+{
+  SlabTestRun *run = static_cast<SlabTestRun *>(arg);
+  SharedMemoryTransport *transport = run->transport;
+  const unsigned slab = run->slab;
+
+  // Halo values identify their sender and direction.
+  double down[2] = { slab * 10.0 + 1.0, slab * 10.0 + 2.0 };
+  double up[2]   = { slab * 10.0 + 3.0, slab * 10.0 + 4.0 };
+  double below[2] = { -1.0, -1.0 };
+  double above[2] = { -1.0, -1.0 };
+  transport->exchangeHalo(slab, down, up, below, above, 2);
+  run->pressure.push_back(below[0]);
+  run->pressure.push_back(above[1]);
+
+  // Reductions.
+  run->pressure.push_back(transport->allReduce(slab, slab + 1.0,
+					       SharedMemoryTransport::SUM));
+  run->pressure.push_back(transport->allReduce(slab, slab + 1.0,
+					       SharedMemoryTransport::MAX));
+
+  // Each slab sends more particles upward than fit in one round.
+  std::vector<Vector2> toDown, toUp, incoming;
+  for (unsigned i = 0; i < 10; ++i)
+    toUp.push_back(Vector2(i, slab));
+  toDown.push_back(Vector2(-1.0f, slab));
+  transport->migrateParticles(slab, toDown, toUp, incoming);
+  run->particles = incoming;
+  return NULL;
+}
+
+TEST(SharedMemoryTransportTest, Collectives)
+{
+  const unsigned slabCount = 3;
+  SharedMemoryTransport transport;
+  ASSERT_TRUE(transport.create(slabTestSegmentName("transport"),
+			       slabCount, 2, 4));
+  EXPECT_EQ(slabCount, transport.getSlabCount());
+
+  // A second mapping of the same segment sees the same layout.
+  SharedMemoryTransport attached;
+  ASSERT_TRUE(attached.attach(slabTestSegmentName("transport")));
+  EXPECT_EQ(slabCount, attached.getSlabCount());
+  EXPECT_EQ(2u, attached.getHaloCapacity());
+
+  std::vector<SlabTestRun> runs(slabCount);
+  std::vector<pthread_t> threads(slabCount);
+  for (unsigned s = 0; s < slabCount; ++s) {
+    runs[s].transport = &transport;
+    runs[s].slab = s;
+    pthread_create(&threads[s], NULL, transportThread, &runs[s]);
+  }
+  for (unsigned s = 0; s < slabCount; ++s)
+    pthread_join(threads[s], NULL);
+
+  EXPECT_EQ(-1.0, runs[0].pressure[0]);   // No slab below slab 0.
+  EXPECT_EQ(12.0, runs[0].pressure[1]);   // Slab 1's second "down" value.
+  EXPECT_EQ(3.0,  runs[1].pressure[0]);   // Slab 0's first "up" value.
+  EXPECT_EQ(22.0, runs[1].pressure[1]);   // Slab 2's second "down" value.
+  EXPECT_EQ(-1.0, runs[2].pressure[1]);   // No slab above slab 2.
+  for (unsigned s = 0; s < slabCount; ++s) {
+    EXPECT_EQ(6.0, runs[s].pressure[2]);
+    EXPECT_EQ(3.0, runs[s].pressure[3]);
+  }
+
+  // Slab 0 receives one particle from slab 1 and keeps the one it sent
+  // down; slab 1 receives ten from slab 0 and one from slab 2; slab 2
+  // receives ten from slab 1 and keeps the ten it sent up.
+  ASSERT_EQ(2u,  runs[0].particles.size());
+  EXPECT_EQ(11u, runs[1].particles.size());
+  ASSERT_EQ(20u, runs[2].particles.size());
+  EXPECT_EQ(Vector2(-1.0f, 0.0f), runs[0].particles[0]);
+  EXPECT_EQ(1.0f, runs[0].particles[1].y);
+  unsigned fromBelow = 0;
+  for (unsigned i = 0; i < runs[2].particles.size(); ++i)
+    fromBelow += runs[2].particles[i].y == 1.0f;
+  EXPECT_EQ(10u, fromBelow);
+}
+
+TEST(SlabSolverTest, MatchesSingleSlab)
+{
+  std::vector<Vector2> wholeParticles, slabParticles;
+  std::vector<float> wholePressure, slabPressure;
+  unsigned wholeCount = 0, slabCount = 0;
+  runSlabs(1, wholeParticles, wholePressure, wholeCount);
+  runSlabs(3, slabParticles, slabPressure, slabCount);
+
+  // Particles are conserved as they migrate between slabs.
+  EXPECT_EQ(wholeParticles.size(), wholeCount);
+  EXPECT_EQ(wholeCount, slabCount);
+  ASSERT_EQ(wholeParticles.size(), slabParticles.size());
+
+  // The decomposed run matches the single slab up to reduction order.
+  ASSERT_EQ(wholePressure.size(), slabPressure.size());
+  for (unsigned i = 0; i < wholePressure.size(); ++i)
+    EXPECT_NEAR(wholePressure[i], slabPressure[i], 1e-3f) << "cell " << i;
+  std::sort(wholeParticles.begin(), wholeParticles.end(), particleLess);
+  std::sort(slabParticles.begin(), slabParticles.end(), particleLess);
+  for (unsigned i = 0; i < wholeParticles.size(); ++i) {
+    EXPECT_NEAR(wholeParticles[i].x, slabParticles[i].x, 1e-3f);
+    EXPECT_NEAR(wholeParticles[i].y, slabParticles[i].y, 1e-3f);
+  }
+}
+
+TEST(SlabSolverTest, MatchesFluidSolver)
+{
+  // The slabs reproduce FluidSolver on the scenes they support: the default
+  // walled scene, without velocity extrapolation.  They only part by the
+  // pressure solvers' tolerances.
+  const unsigned frames = 20;
+  FluidSolver reference(TEST_SLAB_WIDTH, TEST_SLAB_HEIGHT);
+  reference.setExtrapolationBand(0);
+  reference.reset();
+  float initialMeanY = 0.0f;
+  for (unsigned i = 0; i < reference.getParticles().size(); ++i)
+    initialMeanY += reference.getParticles()[i].y /
+      reference.getParticles().size();
+  for (unsigned frame = 0; frame < frames; ++frame) {
+    reference.advanceFrame();
+    reference.consumeFrame();
+  }
+  std::vector<Vector2> expected(reference.getParticles().begin(),
+				reference.getParticles().end());
+
+  for (unsigned slabCount = 1; slabCount <= 3; slabCount += 2) {
+    SCOPED_TRACE(slabCount);
+    std::vector<Vector2> particles;
+    std::vector<float> pressure;
+    unsigned globalCount = 0;
+    runSlabs(slabCount, particles, pressure, globalCount, frames);
+    ASSERT_EQ(expected.size(), particles.size());
+
+    // A single slab keeps FluidSolver's particle order.
+    if (slabCount == 1)
+      for (unsigned i = 0; i < expected.size(); ++i) {
+	ASSERT_NEAR(expected[i].x, particles[i].x, 1e-3f) << "particle " << i;
+	ASSERT_NEAR(expected[i].y, particles[i].y, 1e-3f) << "particle " << i;
+      }
+
+    // The fluid fell, and every slab count ends up where FluidSolver does.
+    float expectedMeanY = 0.0f, meanY = 0.0f;
+    for (unsigned i = 0; i < expected.size(); ++i) {
+      expectedMeanY += expected[i].y / expected.size();
+      meanY += particles[i].y / particles.size();
+    }
+    EXPECT_LT(expectedMeanY, initialMeanY - 1.0f);
+    EXPECT_NEAR(expectedMeanY, meanY, 1e-3f);
+  }
+}
+
+#endif // __SLAB_SOLVER_TEST__
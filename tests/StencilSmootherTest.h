@@ -0,0 +1,92 @@
+#ifndef __STENCIL_SMOOTHER_TEST__
+#define __STENCIL_SMOOTHER_TEST__
+
+#include <gtest/gtest.h>
+#include <vector>
+#include "CellMask.h"
+#include "StencilSmoother.h"
+
+// A 37 x 29 field (plus the extra row and column) holding a pool of fluid
+// under air, with a solid column and a few solid and air cells inside it.
+class StencilSmootherTest : public ::testing::Test {
+protected:
+  virtual void SetUp()
+  {
+    mask = CellMask(COLS, ROWS);
+    for (unsigned y = 0; y + 1 < ROWS; ++y)
+      for (unsigned x = 0; x + 1 < COLS; ++x)
+	if (x == 5)
+	  mask.set(x, y, Cell::SOLID);
+	else if (y < 20 && (x * 7 + y * 3) % 23 != 0)
+	  mask.set(x, y, Cell::FLUID);
+    mask.set(12, 8, Cell::SOLID);
+    mask.set(30, 3, Cell::AIR);
+
+    rhs.assign(COLS * ROWS, 0.0);
+    start.assign(COLS * ROWS, 0.0);
+    unsigned seed = 11;
+    for (unsigned i = 0; i < COLS * ROWS; ++i) {
+      seed = seed * 1664525u + 1013904223u;
+      rhs[i] = (seed >> 8) * (1.0 / 16777216.0) - 0.5;
+      seed = seed * 1664525u + 1013904223u;
+      if (mask.isFluid(i % COLS, i / COLS))
+	start[i] = (seed >> 8) * (1.0 / 16777216.0);
+    }
+  }
+
+  static const unsigned COLS = 38;
+  static const unsigned ROWS = 30;
+  CellMask mask;
+  std::vector<double> rhs;
+  std::vector<double> start;
+};
+
+TEST_F(StencilSmootherTest, SchedulesAgree)
+{
+  // Blocked sweeps match naive sweeps bit for bit, for any block depth,
+  // including sweep counts that leave a partial block.
+  const StencilSmoother::Method methods[2] =
+    { StencilSmoother::JACOBI, StencilSmoother::RED_BLACK_SOR };
+  for (unsigned m = 0; m < 2; ++m) {
+    StencilSmoother naive(methods[m], 0.9);
+    naive.setSchedule(StencilSmoother::NAIVE);
+    std::vector<double> expected(start);
+    naive.smooth(mask, 0.5, &rhs[0], &expected[0], 7);
+
+    for (unsigned depth = 1; depth <= 9; ++depth) {
+      StencilSmoother blocked(methods[m], 0.9);
+      blocked.setBlockDepth(depth);
+      std::vector<double> p(start);
+      blocked.smooth(mask, 0.5, &rhs[0], &p[0], 7);
+      for (unsigned i = 0; i < COLS * ROWS; ++i)
+	ASSERT_EQ(expected[i], p[i]) << "method " << m << " depth " << depth
+				     << " cell " << i;
+    }
+  }
+}
+
+TEST_F(StencilSmootherTest, Converges)
+{
+  // Gauss-Seidel solves the system; weighted Jacobi reduces the residual.
+  // Cells that are not FLUID keep their values.
+  std::vector<double> p(start);
+  const double initial =
+    StencilSmoother::getResidual(mask, 0.5, &rhs[0], &p[0]);
+
+  StencilSmoother jacobi;
+  jacobi.smooth(mask, 0.5, &rhs[0], &p[0], 20);
+  EXPECT_LT(StencilSmoother::getResidual(mask, 0.5, &rhs[0], &p[0]),
+	    initial);
+
+  StencilSmoother gaussSeidel(StencilSmoother::RED_BLACK_SOR, 1.0);
+  gaussSeidel.smooth(mask, 0.5, &rhs[0], &p[0], 2000);
+  EXPECT_LT(StencilSmoother::getResidual(mask, 0.5, &rhs[0], &p[0]), 1e-9);
+
+  for (unsigned i = 0; i < COLS * ROWS; ++i) {
+    if (!mask.isFluid(i % COLS, i / COLS)) {
+      EXPECT_EQ(start[i], p[i]);
+    }
+  }
+}
+
+#endif // __STENCIL_SMOOTHER_TEST__
@@ -0,0 +1,91 @@
+#ifndef __SURFACE_EXTRACTOR_TEST__
+#define __SURFACE_EXTRACTOR_TEST__
+
+#include <gtest/gtest.h>
+#include <cmath>
+#include <map>
+#include <utility>
+#include "FluidSolver.h"
+#include "SurfaceExtractor.h"
+
+// Checks that the segments form closed outlines: every vertex that ends one
+// segment starts exactly one other.
+static void expectClosed(const std::vector<Vector2> &vertices)
+{
+  std::map<std::pair<float, float>, int> balance;
+  for (unsigned i = 0; i < vertices.size(); i += 2) {
+    ++balance[std::make_pair(vertices[i].x, vertices[i].y)];
+    --balance[std::make_pair(vertices[i + 1].x, vertices[i + 1].y)];
+  }
+  std::map<std::pair<float, float>, int>::const_iterator itr;
+  for (itr = balance.begin(); itr != balance.end(); ++itr)
+    EXPECT_EQ(0, itr->second) << itr->first.first << ", "
+			      << itr->first.second;
+}
+
+TEST(SurfaceExtractorTest, ParticleBlock)
+{
+  // reset() fills the top right quarter, [8, 16] on both axes.
+  FluidSolver solver(16.0f, 16.0f);
+  SurfaceExtractor surface;
+  surface.sampleParticles(solver.getGrid(), solver.getParticles());
+  surface.extract();
+  const std::vector<Vector2> &vertices = surface.getVertices();
+  ASSERT_EQ(2 * surface.getSegmentCount(), vertices.size());
+  ASSERT_GT(surface.getSegmentCount(), 0u);
+  expectClosed(vertices);
+
+  // The outline hugs the block, corners cut off, and closes at the walls.
+  Vector2 lower(1e9f, 1e9f), upper(-1e9f, -1e9f);
+  for (unsigned i = 0; i < vertices.size(); ++i) {
+    lower.x = std::min(lower.x, vertices[i].x);
+    lower.y = std::min(lower.y, vertices[i].y);
+    upper.x = std::max(upper.x, vertices[i].x);
+    upper.y = std::max(upper.y, vertices[i].y);
+  }
+  EXPECT_NEAR(8.0f, lower.x, 1e-4f);
+  EXPECT_NEAR(8.0f, lower.y, 1e-4f);
+  EXPECT_NEAR(16.0f, upper.x, 1e-4f);
+  EXPECT_NEAR(16.0f, upper.y, 1e-4f);
+
+  // The liquid lies on the right of every segment.
+  for (unsigned i = 0; i < vertices.size(); i += 2) {
+    const Vector2 direction = vertices[i + 1] - vertices[i];
+    const Vector2 toCenter = Vector2(12.0f, 12.0f) - vertices[i];
+    EXPECT_LT(direction.x * toCenter.y - direction.y * toCenter.x, 0.0f);
+  }
+}
+
+TEST(SurfaceExtractorTest, ScalarDisc)
+{
+  // A disc spanning several tiles, from one of the grid's scalar fields.
+  const float radius = 14.0f;
+  FluidSolver solver(48.0f, 40.0f);
+  unsigned field = solver.addScalarField(0.0f);
+  for (unsigned y = 0; y < 40; ++y)
+    for (unsigned x = 0; x < 48; ++x) {
+      const float dx = x + 0.5f - 24.0f, dy = y + 0.5f - 20.0f;
+      solver.setScalar(x, y, field, radius - sqrtf(dx * dx + dy * dy));
+    }
+
+  SurfaceExtractor surface;
+  surface.sampleScalar(solver.getGrid(), field, -radius);
+  surface.extract(0.0f);
+  const std::vector<Vector2> vertices = surface.getVertices();
+  ASSERT_GT(surface.getSegmentCount(), 40u);
+  expectClosed(vertices);
+  for (unsigned i = 0; i < vertices.size(); ++i) {
+    const float dx = vertices[i].x - 24.0f, dy = vertices[i].y - 20.0f;
+    EXPECT_NEAR(radius, sqrtf(dx * dx + dy * dy), 0.05f);
+  }
+
+  // Extracting again reuses the buffer and gives the same segments.
+  surface.extract(0.0f);
+  ASSERT_EQ(vertices.size(), surface.getVertices().size());
+  for (unsigned i = 0; i < vertices.size(); ++i) {
+    EXPECT_EQ(vertices[i].x, surface.getVertices()[i].x);
+    EXPECT_EQ(vertices[i].y, surface.getVertices()[i].y);
+  }
+}
+
+#endif // __SURFACE_EXTRACTOR_TEST__
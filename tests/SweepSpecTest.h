@@ -0,0 +1,89 @@
+#ifndef __SWEEP_SPEC_TEST__
+#define __SWEEP_SPEC_TEST__
+
+#include <gtest/gtest.h>
+#include <sstream>
+#include <vector>
+#include "SweepSpec.h"
+
+TEST(SweepSpecTest, Defaults)
+{
+  SweepSpec spec;
+  ASSERT_EQ(1u, spec.getVariantCount());
+  std::vector<SweepSpec::Variant> variants = spec.getVariants();
+  ASSERT_EQ(1u, variants.size());
+  EXPECT_EQ(-9.8f, variants[0].gravity);
+  EXPECT_EQ(8.0f, variants[0].width);
+  EXPECT_EQ(8.0f, variants[0].height);
+  EXPECT_EQ(0.5f, variants[0].fill);
+  EXPECT_EQ(0u, variants[0].vtkInterval);
+}
+
+TEST(SweepSpecTest, VtkExport)
+{
+  std::istringstream in("output results\n"
+			"vtk 10\n");
+  SweepSpec spec;
+  ASSERT_TRUE(spec.parse(in)) << spec.getError();
+  std::vector<SweepSpec::Variant> variants = spec.getVariants();
+  EXPECT_EQ(10u, variants[0].vtkInterval);
+  EXPECT_EQ(variants[0].output.substr(0, variants[0].output.size() - 4) +
+	    "_vtk", variants[0].vtkOutput);
+}
+
+TEST(SweepSpecTest, CartesianProduct)
+{
+  std::istringstream in("# A small sweep.\n"
+			"gravity -9.8 -1.0\n"
+			"resolution 16 32x8   # square and rectangular\n"
+			"fill 0.25 0.5 0.75\n"
+			"frames 10\n"
+			"output results\n");
+  SweepSpec spec;
+  ASSERT_TRUE(spec.parse(in)) << spec.getError();
+  ASSERT_EQ(12u, spec.getVariantCount());
+  EXPECT_EQ("results", spec.getOutputDirectory());
+
+  std::vector<SweepSpec::Variant> variants = spec.getVariants();
+  ASSERT_EQ(12u, variants.size());
+  for (unsigned i = 0; i < variants.size(); ++i) {
+    EXPECT_EQ(i, variants[i].index);
+    EXPECT_EQ(10u, variants[i].frames);
+    EXPECT_EQ(0u, variants[i].output.find("results/"));
+    for (unsigned j = 0; j < i; ++j)
+      EXPECT_NE(variants[j].output, variants[i].output);
+  }
+  EXPECT_EQ(-9.8f, variants[0].gravity);
+  EXPECT_EQ(16.0f, variants[0].width);
+  EXPECT_EQ(16.0f, variants[0].height);
+  EXPECT_EQ(0.25f, variants[0].fill);
+  EXPECT_EQ(32.0f, variants[5].width);
+  EXPECT_EQ(8.0f, variants[5].height);
+  EXPECT_EQ(0.75f, variants[5].fill);
+  EXPECT_EQ(-1.0f, variants[11].gravity);
+}
+
+TEST(SweepSpecTest, InvalidInput)
+{
+  SweepSpec spec;
+  std::istringstream unknown("viscosity 1.0\n");
+  EXPECT_FALSE(spec.parse(unknown));
+  EXPECT_FALSE(spec.getError().empty());
+
+  std::istringstream badNumber("gravity -9.8 abc\n");
+  EXPECT_FALSE(spec.parse(badNumber));
+
+  std::istringstream badResolution("resolution 16y16\n");
+  EXPECT_FALSE(spec.parse(badResolution));
+
+  std::istringstream badInterval("vtk -1\n");
+  EXPECT_FALSE(spec.parse(badInterval));
+
+  std::istringstream empty("fill\n");
+  EXPECT_FALSE(spec.parse(empty));
+
+  // A failed parse leaves the previous sweep in place.
+  EXPECT_EQ(1u, spec.getVariantCount());
+}
+
+#endif // __SWEEP_SPEC_TEST__
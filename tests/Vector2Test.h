@@ -219,4 +219,33 @@ TEST(Vector2Test, Division)
   EXPECT_EQ(-5.0f, result.y);  
 }
 
+TEST(Vector2Test, Batch)
+{
+  Vector2 vecs[4] = { Vector2(1.0f, 2.0f), Vector2(-3.0f, 4.0f),
+		      Vector2(0.0f, 0.0f), Vector2(6.0f, -8.0f) };
+  Vector2xN<4> batch, offset;
+  batch.load(vecs);
+  EXPECT_EQ(Vector2(-3.0f, 4.0f), batch.get(1));
+
+  // Lane-wise arithmetic matches the scalar operators.
+  for (unsigned i = 0; i < 4; ++i)
+    offset.set(i, Vector2(1.0f, 1.0f));
+  batch = (batch + offset) * 2.0f;
+  batch -= offset;
+  for (unsigned i = 0; i < 4; ++i)
+    EXPECT_EQ((vecs[i] + Vector2(1.0f, 1.0f)) * 2.0f - Vector2(1.0f, 1.0f),
+	      batch.get(i));
+
+  float mags[4];
+  Vector2xN<4> original;
+  original.load(vecs);
+  original.magnitude(mags);
+  EXPECT_EQ(5.0f, mags[1]);
+  EXPECT_EQ(10.0f, mags[3]);
+
+  Vector2 out[4];
+  batch.store(out);
+  EXPECT_EQ(batch.get(3), out[3]);
+}
+
 #endif // __VECTOR_2_TEST__
@@ -0,0 +1,47 @@
+#ifndef __VELOCITY_EXTRAPOLATOR_TEST__
+#define __VELOCITY_EXTRAPOLATOR_TEST__
+
+#include <gtest/gtest.h>
+#include "Grid.h"
+#include "VelocityExtrapolator.h"
+
+TEST(VelocityExtrapolatorTest, FillsBand)
+{
+  // A 4x4 block of fluid moving at (1, 2) in a 40x40 grid, with leftover
+  // velocities everywhere else.
+  Grid grid(40.0f, 40.0f);
+  for (unsigned i = 0; i < grid.getCellCount(); ++i) {
+    grid[i].vel[Cell::X] = 99.0f;
+    grid[i].vel[Cell::Y] = 99.0f;
+  }
+  for (unsigned y = 16; y < 20; ++y)
+    for (unsigned x = 16; x < 20; ++x) {
+      grid.setCellType(x, y, Cell::FLUID);
+      grid(x, y).vel[Cell::X] = grid(x + 1, y).vel[Cell::X] = 1.0f;
+      grid(x, y).vel[Cell::Y] = grid(x, y + 1).vel[Cell::Y] = 2.0f;
+    }
+
+  VelocityExtrapolator extrapolator(0);
+  extrapolator.extrapolate(grid);
+  EXPECT_EQ(99.0f, grid(14, 18).vel[Cell::X]);
+
+  extrapolator.setBandWidth(3);
+  extrapolator.extrapolate(grid);
+  // Faces up to three cells from the known faces take the fluid velocity.
+  EXPECT_EQ(1.0f, grid(15, 18).vel[Cell::X]);
+  EXPECT_EQ(1.0f, grid(13, 18).vel[Cell::X]);
+  EXPECT_EQ(1.0f, grid(23, 17).vel[Cell::X]);
+  EXPECT_EQ(1.0f, grid(18, 22).vel[Cell::X]);
+  EXPECT_EQ(2.0f, grid(18, 23).vel[Cell::Y]);
+  EXPECT_EQ(2.0f, grid(17, 13).vel[Cell::Y]);
+  EXPECT_EQ(2.0f, grid(21, 16).vel[Cell::Y]);
+  // Faces beyond the band are left alone.
+  EXPECT_EQ(99.0f, grid(12, 18).vel[Cell::X]);
+  EXPECT_EQ(99.0f, grid(18, 24).vel[Cell::Y]);
+  EXPECT_EQ(99.0f, grid(2, 2).vel[Cell::X]);
+  // Known faces are unchanged.
+  EXPECT_EQ(1.0f, grid(16, 16).vel[Cell::X]);
+  EXPECT_EQ(2.0f, grid(19, 20).vel[Cell::Y]);
+}
+
+#endif // __VELOCITY_EXTRAPOLATOR_TEST__
@@ -0,0 +1,105 @@
+#ifndef __VTK_EXPORTER_TEST__
+#define __VTK_EXPORTER_TEST__
+
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include "FluidSolver.h"
+#include "VtkExporter.h"
+
+// Reads a whole file, returning an empty string if it doesn't exist.
+static std::string readFile(const std::string &path)
+{
+  std::ifstream in(path.c_str(), std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(in),
+		     std::istreambuf_iterator<char>());
+}
+
+// Locates the n'th array of a VTK file's appended data, returning its size.
+static uint32_t appendedArray(const std::string &file, unsigned n,
+			      const char **data)
+{
+  std::string::size_type offset = file.find('_', file.find("<AppendedData"));
+  const char *array = file.data() + offset + 1;
+  uint32_t size;
+  for (unsigned i = 0; ; ++i) {
+    memcpy(&size, array, sizeof(size));
+    if (i == n)
+      break;
+    array += sizeof(size) + size;
+  }
+  *data = array + sizeof(size);
+  return size;
+}
+
+TEST(VtkExporterTest, ExportsEveryNthFrame)
+{
+  char base[] = "/tmp/vtk-export-test-XXXXXX";
+  ASSERT_TRUE(mkdtemp(base) != NULL);
+  const std::string directory = std::string(base) + "/frames";
+
+  FluidSolver solver(16.0f, 8.0f);
+  VtkExporter exporter;
+  EXPECT_FALSE(exporter.publish(solver));
+  ASSERT_TRUE(exporter.open(directory, 2));
+  exporter.setDropFrames(false);
+  for (unsigned frame = 0; frame < 5; ++frame) {
+    solver.advanceFrame();
+    solver.consumeFrame();
+    ASSERT_TRUE(exporter.publish(solver));
+  }
+  exporter.close();
+  EXPECT_EQ(3u, exporter.getWrittenCount());
+  EXPECT_EQ(0u, exporter.getDroppedCount());
+  EXPECT_EQ(0u, exporter.getFailedCount());
+  EXPECT_TRUE(readFile(exporter.getFieldsPath(1)).empty());
+  EXPECT_FALSE(readFile(exporter.getFieldsPath(2)).empty());
+
+  // The last frame written is the solver's current state.
+  const Grid &grid = solver.getGrid();
+  const std::string fields = readFile(exporter.getFieldsPath(4));
+  ASSERT_NE(std::string::npos, fields.find("WholeExtent=\"0 16 0 8 0 0\""));
+  const char *data;
+  const unsigned cells = 16 * 8;
+  ASSERT_EQ(3 * cells * sizeof(float), appendedArray(fields, 0, &data));
+  const float *velocity = reinterpret_cast<const float *>(data);
+  ASSERT_EQ(cells * sizeof(float), appendedArray(fields, 1, &data));
+  const float *pressure = reinterpret_cast<const float *>(data);
+  ASSERT_EQ(cells * sizeof(float), appendedArray(fields, 2, &data));
+  const float *divergence = reinterpret_cast<const float *>(data);
+  ASSERT_EQ(cells * sizeof(uint8_t), appendedArray(fields, 3, &data));
+  const uint8_t *cellType = reinterpret_cast<const uint8_t *>(data);
+  for (unsigned y = 0, c = 0; y < 8; ++y)
+    for (unsigned x = 0; x < 16; ++x, ++c) {
+      const Vector2 center = grid.getVelocity(Vector2(x + 0.5f, y + 0.5f));
+      EXPECT_NEAR(center.x, velocity[3 * c], 1e-5f);
+      EXPECT_NEAR(center.y, velocity[3 * c + 1], 1e-5f);
+      EXPECT_EQ(float(grid.getPressure(x, y)), pressure[c]);
+      EXPECT_NEAR(grid.getVelocityDivergence(x, y), divergence[c], 1e-5f);
+      EXPECT_EQ(grid(x, y).cellType, cellType[c]);
+    }
+
+  const ParticleArray &particles = solver.getParticles();
+  const std::string points = readFile(exporter.getParticlesPath(4));
+  ASSERT_EQ(3 * particles.size() * sizeof(float),
+	    appendedArray(points, 0, &data));
+  const float *position = reinterpret_cast<const float *>(data);
+  for (unsigned i = 0; i < particles.size(); ++i) {
+    EXPECT_EQ(particles[i].x, position[3 * i]);
+    EXPECT_EQ(particles[i].y, position[3 * i + 1]);
+  }
+
+  for (unsigned frame = 0; frame <= 4; frame += 2) {
+    unlink(exporter.getFieldsPath(frame).c_str());
+    unlink(exporter.getParticlesPath(frame).c_str());
+  }
+  rmdir(directory.c_str());
+  rmdir(base);
+}
+
+#endif // __VTK_EXPORTER_TEST__
@@ -8,10 +8,25 @@
 // Include test headers here:
 #include "Vector2Test.h"
 #include "CellTest.h"
+#include "CellMaskTest.h"
 #include "GridTest.h"
-
-// TODO - YUCK - This global variable is a temporary hack!!!
-FluidSolver *solver = NULL;
+#include "FluidSolverTest.h"
+#include "SweepSpecTest.h"
+#include "SlabSolverTest.h"
+#include "KernelsTest.h"
+#include "FieldMemoryTest.h"
+#include "StencilSmootherTest.h"
+#include "VelocityExtrapolatorTest.h"
+#include "CommandQueueTest.h"
+#include "FrameServerTest.h"
+#include "SharedFrameRingTest.h"
+#include "SceneSpecTest.h"
+#include "FluidSolverCTest.h"
+#include "SurfaceExtractorTest.h"
+#include "VtkExporterTest.h"
+#include "AutoTunerTest.h"
+#include "JobDaemonTest.h"
+#include "KernelEquivalenceTest.h"
 
 GTEST_API_ int main(int argc, char *argv[])
 {
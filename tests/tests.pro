@@ -8,7 +8,26 @@ CONFIG(release, debug|release) {
 
 HEADERS += Vector2Test.h \
 	   CellTest.h \
-	   GridTest.h
+	   CellMaskTest.h \
+	   GridTest.h \
+	   FluidSolverTest.h \
+	   SweepSpecTest.h \
+	   SlabSolverTest.h \
+	   KernelsTest.h \
+	   FieldMemoryTest.h \
+	   StencilSmootherTest.h \
+	   VelocityExtrapolatorTest.h \
+	   CommandQueueTest.h \
+	   FrameServerTest.h \
+	   SharedFrameRingTest.h \
+	   SceneSpecTest.h \
+	   FluidSolverCTest.h \
+	   SurfaceExtractorTest.h \
+	   VtkExporterTest.h \
+	   AutoTunerTest.h \
+	   JobDaemonTest.h \
+	   ReferenceKernels.h \
+	   KernelEquivalenceTest.h
 
 SOURCES += tests.cpp
 
@@ -2,17 +2,20 @@
 #include "MainWindow.h"
 #include "QRendererWidget.h"
 #include "SignalRelay.h"
+#include "FluidSolver.h"
 
-MainWindow::MainWindow()
+MainWindow::MainWindow(FluidSolver *solver)
   : _mainLayout(NULL),
     _controlLayout(NULL),
     _rendWidget(NULL),
-    _resetButton(NULL)
-    
+    _resetButton(NULL),
+    _pauseButton(NULL),
+    _stepButton(NULL),
+    _solver(solver)
 {
   // Establish a default renderer to use.
   _rendWidget = QRendererWidget::rendererWidget
-    (this, QRendererWidget::COMPATIBILITY_RENDERER);
+    (this, QRendererWidget::COMPATIBILITY_RENDERER, solver);
 
   // Create the overall window layout - an HBoxLayout.
   _mainLayout = new QHBoxLayout;
@@ -28,6 +31,17 @@ MainWindow::MainWindow()
   QObject::connect(_resetButton, SIGNAL(clicked()),
 		   SignalRelay::getInstance(), SIGNAL(resetSimulation()));
 
+  // Pause and step go straight to the solver's command queue, so they
+  // take effect between timesteps without the solver taking a lock.
+  _pauseButton = new QPushButton("Pause");
+  _pauseButton->setCheckable(true);
+  _controlLayout->addWidget(_pauseButton);
+  QObject::connect(_pauseButton, SIGNAL(clicked()),
+		   this, SLOT(togglePause()));
+  _stepButton = new QPushButton("Step");
+  _controlLayout->addWidget(_stepButton);
+  QObject::connect(_stepButton, SIGNAL(clicked()), this, SLOT(step()));
+
   // Realize all widgets.
   setLayout(_mainLayout);
 
@@ -40,6 +54,23 @@ MainWindow::~MainWindow()
   // Clean up memory.
   delete _rendWidget;
   delete _resetButton;
+  delete _pauseButton;
+  delete _stepButton;
   delete _controlLayout;
   delete _mainLayout;
 }
+
+
+void MainWindow::togglePause()
+{
+  const bool paused = _pauseButton->isChecked();
+  _solver->getCommandQueue().push(SolverCommand(paused ? SolverCommand::PAUSE
+						       : SolverCommand::RESUME));
+  _pauseButton->setText(paused ? "Resume" : "Pause");
+}
+
+
+void MainWindow::step()
+{
+  _solver->getCommandQueue().push(SolverCommand(SolverCommand::STEP));
+}
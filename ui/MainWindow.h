@@ -5,6 +5,8 @@
 #include <QWidget>
 #include "QRendererWidget.h"
 
+class FluidSolver;
+
 namespace Ui {
   class MainWindow;
 }
@@ -16,10 +18,24 @@ class MainWindow : public QWidget
   QVBoxLayout     *_controlLayout;
   QRendererWidget *_rendWidget;
   QPushButton     *_resetButton;
+  QPushButton     *_pauseButton;
+  QPushButton     *_stepButton;
+  FluidSolver     *_solver;     // The simulation displayed. Not owned.
     
 public:
-  MainWindow();
+  // Constructs the main window, displaying the provided simulation.
+  //
+  // Arguments:
+  //   FluidSolver *solver - The simulation to display. Not owned.
+  MainWindow(FluidSolver *solver);
   virtual ~MainWindow();
+
+private slots:
+  // Sends the solver a PAUSE or RESUME command, toggling the button.
+  void togglePause();
+
+  // Sends the solver a STEP command, advancing one frame while paused.
+  void step();
 };
 
 #endif // __MAINWINDOW_H__
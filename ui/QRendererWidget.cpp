@@ -1,15 +1,19 @@
 #include "QRendererWidget.h"
+#include <QMouseEvent>
+#include <algorithm>
 #include "CompatibilityRenderer.h"
-
-// TODO - YUCK - This global variable is a temporary hack!!!
 #include "FluidSolver.h"
-extern FluidSolver *solver;
+
+// The radius of the force a mouse drag applies, in cells.
+static const float DRAG_RADIUS = 2.0f;
 
 QRendererWidget * QRendererWidget::rendererWidget(QWidget *parent,
-						  Renderers renderer)
+						  Renderers renderer,
+						  FluidSolver *solver)
 {
   // Assert that sane arguments are provided.
   // TODO Assert(parent != NULL);
+  // TODO Assert(solver != NULL);
   // TODO Assert(renderer < RENDERER_COUNT);
 
   // Instantiate the appropriate renderer.
@@ -24,15 +28,19 @@ QRendererWidget * QRendererWidget::rendererWidget(QWidget *parent,
   }
 
   // Instantiate and return a QRendererWidget.
-  return new QRendererWidget(rendPtr->getFormat(), parent, rendPtr);
+  return new QRendererWidget(rendPtr->getFormat(), parent, rendPtr, solver);
 }
 
 
 QRendererWidget::QRendererWidget(const QGLFormat &format,
 				 QWidget *parent,
-				 IFluidRenderer *renderer)
+				 IFluidRenderer *renderer,
+				 FluidSolver *solver)
   : QGLWidget(format, parent),
-    _renderer(renderer)
+    _renderer(renderer),
+    _solver(solver),
+    _dragPosition(),
+    _dragTimer()
 {}
 
 
@@ -63,12 +71,51 @@ void QRendererWidget::initializeGL()
 
 void QRendererWidget::resizeGL(int width, int height)
 {
-  _renderer->resize(width, height);
+  _renderer->resize(width, height,
+		    _solver->getSimulationWidth(),
+		    _solver->getSimulationHeight());
 }
 
 
 void QRendererWidget::paintGL()
 {
-  solver->draw(_renderer);
+  _solver->draw(_renderer);
   update();
 }
+
+
+void QRendererWidget::mousePressEvent(QMouseEvent *event)
+{
+  _dragPosition = toWorld(event->pos());
+  _dragTimer.start();
+}
+
+
+void QRendererWidget::mouseMoveEvent(QMouseEvent *event)
+{
+  if (!(event->buttons() & Qt::LeftButton) || !_dragTimer.isValid())
+    return;
+
+  // The force carries the cursor's velocity.  The push never blocks; if the
+  // solver has fallen behind and its queue is full, the drag is dropped.
+  const Vector2 position = toWorld(event->pos());
+  const float elapsedSec = std::max<qint64>(_dragTimer.restart(), 1) / 1000.0f;
+  const Vector2 velocity = (position - _dragPosition) / elapsedSec;
+  _solver->getCommandQueue().push(SolverCommand::force(position, velocity,
+						       DRAG_RADIUS));
+  _dragPosition = position;
+}
+
+
+Vector2 QRendererWidget::toWorld(QPoint pixel)
+{
+  // An orthographic projection maps world x to 2 / (r - l) * x + offset;
+  // invert that from normalized device coordinates.
+  makeCurrent();
+  GLdouble projection[16];
+  glGetDoublev(GL_PROJECTION_MATRIX, projection);
+  const double ndcX = 2.0 * (pixel.x() + 0.5) / width() - 1.0;
+  const double ndcY = 1.0 - 2.0 * (pixel.y() + 0.5) / height();
+  return Vector2((ndcX - projection[12]) / projection[0],
+		 (ndcY - projection[13]) / projection[5]);
+}
@@ -2,7 +2,11 @@
 #define __Q_RENDERER_WIDGET_H__
 
 #include <QGLWidget>
+#include <QElapsedTimer>
 #include "IFluidRenderer.h"
+#include "Vector2.h"
+
+class FluidSolver;
 
 class QRendererWidget : public QGLWidget
 {
@@ -10,6 +14,7 @@ class QRendererWidget : public QGLWidget
 
 public:
   IFluidRenderer *_renderer;
+  FluidSolver    *_solver;    // The solver drawn by this widget. Not owned.
 
   // Enumerated type listing all implemented renderers to choose from.
   enum Renderers {
@@ -18,17 +23,20 @@ public:
   };
   
   // Static factory method that, when provided with the desired parent
-  // widget and a type of renderer, creates an OpenGL context and
-  // attaches an instantiated FluidRenderer to it.  Returns a pointer
-  // to the newly created QRendererWidget.
+  // widget, a type of renderer and the solver to draw, creates an OpenGL
+  // context and attaches an instantiated FluidRenderer to it.  Returns a
+  // pointer to the newly created QRendererWidget.
   //
-  // The caller accepts ownership of the returned pointer.
+  // The caller accepts ownership of the returned pointer.  The solver is not
+  // owned by the widget, and must outlive it.
   // 
   // Arguments:
   //   QWidget *parent - The parent widget.
   //   Renderers renderer - The renderer that should be used.
+  //   FluidSolver *solver - The simulation this widget draws.
   static QRendererWidget * rendererWidget(QWidget *parent,
-					  Renderers renderer);
+					  Renderers renderer,
+					  FluidSolver *solver);
 
   // Destructor
   //
@@ -98,16 +106,44 @@ protected:
   //   None
   virtual void paintGL();
 
+  // Mouse drags push the fluid under the cursor: each move sends the solver
+  // a force at the cursor, with the velocity the cursor moved at.
+  //
+  // Inherited from QWidget.
+  //
+  // Arguments:
+  //   QMouseEvent *event - The mouse event.
+  //
+  // Returns:
+  //   None
+  virtual void mousePressEvent(QMouseEvent *event);
+  virtual void mouseMoveEvent(QMouseEvent *event);
+
 private:
+  // Maps a widget pixel to world coordinates, using the orthographic
+  // projection the renderer set up in resizeGL().
+  //
+  // Arguments:
+  //   QPoint pixel - The position within the widget, in pixels.
+  //
+  // Returns:
+  //   Vector2 - The position in world coordinates.
+  Vector2 toWorld(QPoint pixel);
+
+  Vector2       _dragPosition; // World position of the last mouse event.
+  QElapsedTimer _dragTimer;    // Time since the last mouse event.
+
   // This serves as a Qt widget wrapper around a FluidRenderer instance.
   // 
   // Arguments:
   //   QGLFormat &format - The requested format for the OpenGL context.
   //   QWidget *parent - The parent widget of this widget.
   //   IFluidRenderer *renderer - The instantiated FluidRenderer to use.
+  //   FluidSolver *solver - The simulation this widget draws.
   QRendererWidget(const QGLFormat &format,
 		  QWidget *parent,
-		  IFluidRenderer *renderer);
+		  IFluidRenderer *renderer,
+		  FluidSolver *solver);
 
 };
 